@@ -0,0 +1,91 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "CookieCodec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Outcome of one download, as reported by the engine.
+struct DownloadResult
+{
+    std::wstring uri;
+    std::wstring path;
+    bool completed = false;     // false when the download was interrupted
+    int64_t bytesReceived = 0;
+    int64_t totalBytes = 0;     // 0 when the server did not announce a size
+};
+
+// An image response the engine can hand over instead of downloading the
+// image again, see BrowserEngine::SetResponseCapture.
+struct ImageResponse
+{
+    std::wstring uri;
+    std::wstring contentType;
+    int64_t contentLength = -1;  // -1 when the server did not announce a size
+    bool isDocument = false;     // The navigation itself, e.g. a bare image URL
+    bool fromScript = false;     // Loaded by XHR or fetch rather than an element
+};
+
+// Receives engine events. Events are raised on the thread that drives the
+// engine: the UI thread for WebView2, the simulation loop for MockEngine.
+class BrowserEngineEvents
+{
+public:
+    virtual ~BrowserEngineEvents() = default;
+
+    virtual void OnNavigationCompleted(const std::wstring& uri, bool succeeded) = 0;
+    // Returns the file the download is saved to; empty keeps the engine's choice.
+    virtual std::wstring OnDownloadStarting(const std::wstring& uri) = 0;
+    virtual void OnDownloadFinished(const DownloadResult& result) = 0;
+    // Returns the file the response body is written to; empty leaves it
+    // alone. A taken response reports through OnDownloadFinished, without
+    // OnDownloadStarting.
+    virtual std::wstring OnImageResponse(const ImageResponse& /*response*/) { return std::wstring(); }
+};
+
+// The part of a browser tab the capture and download pipeline drives, so the
+// orchestration code builds and runs without WebView2. WebView2Engine wraps
+// a tab in the app, MockEngine simulates one for load tests.
+class BrowserEngine
+{
+public:
+    using ScriptCallback = std::function<void(bool succeeded, const std::wstring& resultJson)>;
+    using CookiesCallback = std::function<void(bool succeeded, const std::vector<CookieView>& cookies)>;
+
+    virtual ~BrowserEngine() = default;
+
+    void SetEvents(BrowserEngineEvents* events) { m_events = events; }
+    // When disabled, downloads the page starts are cancelled before anything
+    // is written and reported to OnDownloadFinished as not completed, without
+    // OnDownloadStarting. For engines that only warm pages up.
+    void SetDownloadsEnabled(bool enabled) { m_downloadsEnabled = enabled; }
+    size_t GetTabId() const { return m_tabId; }
+
+    // All return false when the request could not be issued; callbacks then
+    // never run.
+    virtual bool Navigate(const std::wstring& uri) = 0;
+    // Stops loading the page and cancels the download in flight. Events of
+    // either are not raised afterwards.
+    virtual bool Stop() = 0;
+    virtual bool ExecuteScript(const std::wstring& script, ScriptCallback callback) = 0;
+    virtual bool GetCookies(const std::wstring& uri, CookiesCallback callback) = 0;
+    // Returns how many cookies were accepted.
+    virtual size_t ImportCookies(const std::vector<Cookie>& cookies) = 0;
+    // Offers image responses to OnImageResponse as they arrive. Returns
+    // false when the engine cannot, and pages keep being downloaded.
+    virtual bool SetResponseCapture(bool /*enabled*/) { return false; }
+
+protected:
+    explicit BrowserEngine(size_t tabId) : m_tabId(tabId) {}
+
+    BrowserEngineEvents* m_events = nullptr;
+    size_t m_tabId = 0;
+    bool m_downloadsEnabled = true;
+};
@@ -6,6 +6,10 @@
 #include "shlobj.h"
 #include <Urlmon.h>
 #pragma comment (lib, "Urlmon.lib")
+#include "CookieCodec.h"
+#include "DownloadScheduler.h"
+#include "JsonString.h"
+#include "MappedFile.h"
 #include "Util.h"
 #include "env.h"
 
@@ -17,6 +21,7 @@
 
 #include <filesystem>
 #include <iostream>
+#include <psapi.h>
 
 
 
@@ -95,10 +100,30 @@ LRESULT CALLBACK BrowserWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam,
 
   switch (message)
     {
+        case WM_APP_TASK_COMPLETE:
+        {
+            // Completion of a background post-processing task
+            std::unique_ptr<ThreadPool::Task> completion(reinterpret_cast<ThreadPool::Task*>(lParam));
+            if (completion && *completion)
+            {
+                (*completion)();
+            }
+        }
+        break;
+
         case WM_APP_DOWNLOAD_NEXT:
         {
-            m_currentDownloadIndex++;
-            DownloadNextImageWithNavigate();  // ȷȷĺ
+            if (m_downloadScheduler)
+            {
+                // Nothing is in flight between two pages, the cheapest time
+                // to start over with fresh browser processes
+                m_pagesSinceRecycle++;
+                if (m_downloadScheduler->IsRunning() && ShouldRecycleContentEnvironment())
+                {
+                    RecycleContentEnvironment(false);
+                }
+                m_downloadScheduler->Advance();
+            }
         }
         break;
     
@@ -119,9 +144,9 @@ LRESULT CALLBACK BrowserWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam,
         case WM_SIZE:
         {
             ResizeUIWebViews();
-            if (m_tabs.find(m_activeTabId) != m_tabs.end())
+            if (Tab* tab = GetReadyActiveTab())
             {
-                m_tabs.at(m_activeTabId)->ResizeWebView();
+                tab->ResizeWebView();
             }
         }
         break;
@@ -130,6 +155,24 @@ LRESULT CALLBACK BrowserWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam,
             if (wParam == 1) // ڴ鶨ʱ
             {
                 ReadFromSharedMemory();
+                CheckTraceDumpRequest();
+            }
+            else if (wParam == METRICS_TIMER_ID)
+            {
+                PublishMetrics();
+            }
+            else if (wParam == TAB_LIFECYCLE_TIMER_ID)
+            {
+                UpdateTabLifecycle();
+            }
+            else if (wParam == DOWNLOAD_TIMER_ID)
+            {
+                // One-shot: the scheduler arms it again for the next deadline
+                KillTimer(m_hWnd, DOWNLOAD_TIMER_ID);
+                if (m_downloadScheduler)
+                {
+                    m_downloadScheduler->OnWatchdog();
+                }
             }
         }
         break;
@@ -137,12 +180,23 @@ LRESULT CALLBACK BrowserWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam,
         case WM_CLOSE:
         {
             KillTimer(m_hWnd, 1);
+            KillTimer(m_hWnd, METRICS_TIMER_ID);
+            KillTimer(m_hWnd, TAB_LIFECYCLE_TIMER_ID);
+            KillTimer(m_hWnd, DOWNLOAD_TIMER_ID);
             CleanupSharedMemory();
+            DumpTrace();
+            PublishMetrics();
 
             web::json::value jsonObj = web::json::value::parse(L"{}");
             jsonObj[L"message"] = web::json::value(MG_CLOSE_WINDOW);
             jsonObj[L"args"] = web::json::value::parse(L"{}");
 
+            if (!m_controlsWebView)
+            {
+                // No controls UI to confirm with when headless
+                DestroyWindow(m_hWnd);
+                break;
+            }
             CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.get()), L"Try again.");
         }
         break;
@@ -150,6 +204,8 @@ LRESULT CALLBACK BrowserWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam,
         case WM_NCDESTROY:
         {
             SetWindowLongPtr(hWnd, GWLP_USERDATA, NULL);
+            // Hidden tabs still being created outlive the window
+            ReleasePrefetcher();
             delete this;
             PostQuitMessage(0);
             return 0;  // ֱӷأҪbreak
@@ -188,7 +244,31 @@ BOOL BrowserWindow::LaunchWindow(_In_ HINSTANCE hInstance, _In_ int nCmdShow)
 // BrowserWindow.cpp
 BrowserWindow::~BrowserWindow()
 {
+    // Let queued post-processing finish before the state it uses goes away.
+    // Pool tasks never call into this thread's COM objects (response bodies
+    // are drained before they are handed over), so waiting here without
+    // pumping messages cannot deadlock
+    if (m_postProcessPool)
+    {
+        m_postProcessPool->Shutdown();
+    }
+    if (m_fileWriter)
+    {
+        if (!m_fileWriter->Flush())
+        {
+            OutputDebugString(L"Could not write output file\n");
+        }
+        m_fileWriter->Shutdown();
+    }
+    m_bundleWriter.Finalize();
     CleanupSharedMemory();
+    CleanupMetrics();
+
+    if (m_hTraceDumpEvent)
+    {
+        CloseHandle(m_hTraceDumpEvent);
+        m_hTraceDumpEvent = nullptr;
+    }
 }
 
 //
@@ -204,6 +284,7 @@ BrowserWindow::~BrowserWindow()
 BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
 {
     m_hInst = hInstance; // Store app instance handle
+    m_headless = g_headless;
     LoadStringW(m_hInst, IDS_APP_TITLE, s_title, MAX_LOADSTRING);
 
     // ʼڴ
@@ -225,12 +306,23 @@ BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
      // öʱڼ鹲ڴ
      SetTimer(m_hWnd, 1, 100, NULL);
 
+    InitPostProcessPool();
+    InitTrace();
+    InitMetrics();
+    InitTabLifecycle();
+    InitRequestFilter();
+    InitWebResourceCache();
+    m_startupStart = Metrics::NowMicroseconds();
+
     // Make the BrowserWindow instance ptr available through the hWnd
     SetWindowLongPtr(m_hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
 
     UpdateMinWindowSize();
-    ShowWindow(m_hWnd, nCmdShow);
-    UpdateWindow(m_hWnd);
+    if (!m_headless)
+    {
+        ShowWindow(m_hWnd, nCmdShow);
+        UpdateWindow(m_hWnd);
+    }
 
     // Get directory for user data. This will be kept separated from the
     // directory for the browser UI data.
@@ -238,36 +330,39 @@ BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
 
     // Create WebView environment for web content requested by the user. All
     // tabs will be created from this environment and kept isolated from the
-    // browser UI. This enviroment is created first so the UI can request new
-    // tabs when it's ready.
+    // browser UI. The UI environment is created at the same time; tabs the
+    // UI asks for before this one is ready are created once it is.
+    m_contentEnvSpan = Trace::Instance().Begin("Startup:ContentEnvironment", 0);
     HRESULT hr = CreateCoreWebView2EnvironmentWithOptions(nullptr, userDataDirectory.c_str(),
         nullptr, Callback<ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler>(
             [this](HRESULT result, ICoreWebView2Environment* env) -> HRESULT
     {
+        Trace::Instance().End(m_contentEnvSpan);
         RETURN_IF_FAILED(result);
+        LogStartupPhase(L"content environment");
 
         m_contentEnv = env;
-        HRESULT hr = InitUIWebViews();
-
-        if (!SUCCEEDED(hr))
+        InitTabPool();
+        if (m_headless)
+        {
+            // Without the controls UI nobody asks for the first tab
+            CreateInitialTab();
+        }
+        std::vector<PendingTab> pendingTabs = std::move(m_pendingTabs);
+        for (const PendingTab& pending : pendingTabs)
         {
-            OutputDebugString(L"UI WebViews environment creation failed\n");
+            CreateTab(pending.id, pending.shouldBeActive, pending.uri);
         }
 
         if (Util::CheckIfUrlsFileExists()) 
         {
             IsInImageDownloadMode = true;
-         // öʱȴWebViewȫʼ
-            SetTimer(m_hWnd, 2, 1000*10, [](HWND hWnd, UINT, UINT_PTR, DWORD) {
-                KillTimer(hWnd, 2);
-                BrowserWindow* window = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
-                if (window) {
-                    window->StartDownloadProcess();
-                }
-            });
+            // Starts as soon as the first tab navigates instead of after a
+            // fixed wait
+            m_downloadsWaitForFirstTab = true;
         }
 
-        return hr;
+        return S_OK;
     }).Get());
 
     if (!SUCCEEDED(hr))
@@ -276,9 +371,20 @@ BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
         return FALSE;
     }
 
+    if (!m_headless && !SUCCEEDED(InitUIWebViews()))
+    {
+        OutputDebugString(L"UI WebViews environment creation failed\n");
+    }
+
     return TRUE;
 }
 
+void BrowserWindow::LogStartupPhase(const wchar_t* phase)
+{
+    int64_t elapsedMs = (Metrics::NowMicroseconds() - m_startupStart) / 1000;
+    OutputDebugString((L"Startup: " + std::wstring(phase) + L" ready after " + std::to_wstring(elapsedMs) + L" ms\n").c_str());
+}
+
 HRESULT BrowserWindow::InitUIWebViews()
 {
     // Get data directory for browser UI data
@@ -287,15 +393,20 @@ HRESULT BrowserWindow::InitUIWebViews()
 
     // Create WebView environment for browser UI. A separate data directory is
     // used to isolate the browser UI from web content requested by the user.
+    m_uiEnvSpan = Trace::Instance().Begin("Startup:UIEnvironment", 0);
     return CreateCoreWebView2EnvironmentWithOptions(nullptr, browserDataDirectory.c_str(),
         nullptr, Callback<ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler>(
             [this](HRESULT result, ICoreWebView2Environment* env) -> HRESULT
     {
-        // Environment is ready, create the WebView
-        m_uiEnv = env;
+        Trace::Instance().End(m_uiEnvSpan);
+        RETURN_IF_FAILED(result);
+        LogStartupPhase(L"UI environment");
 
+        // Environment is ready, create the WebView. The options dropdown
+        // waits until it is first opened.
+        m_uiEnv = env;
+        m_controlsSpan = Trace::Instance().Begin("Startup:ControlsWebView", 0);
         RETURN_IF_FAILED(CreateBrowserControlsWebView());
-        RETURN_IF_FAILED(CreateBrowserOptionsWebView());
 
         return S_OK;
     }).Get());
@@ -306,11 +417,13 @@ HRESULT BrowserWindow::CreateBrowserControlsWebView()
     return m_uiEnv->CreateCoreWebView2Controller(m_hWnd, Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
         [this](HRESULT result, ICoreWebView2Controller* host) -> HRESULT
     {
+        Trace::Instance().End(m_controlsSpan);
         if (!SUCCEEDED(result))
         {
             OutputDebugString(L"Controls WebView creation failed\n");
             return result;
         }
+        LogStartupPhase(L"controls WebView");
         // WebView created
         m_controlsController = host;
         CheckFailure(m_controlsController->get_CoreWebView2(&m_controlsWebView), L"");
@@ -376,8 +489,478 @@ HRESULT BrowserWindow::CreateBrowserControlsWebView()
     }).Get());
 }
 
+void BrowserWindow::InitTabPool()
+{
+    // Batch jobs open tab after tab; browsing does not pay for hidden
+    // controllers unless asked to
+    size_t poolSize = 0;
+    if (!g_tabPoolSize.empty())
+    {
+        poolSize = static_cast<size_t>(_wtoi(g_tabPoolSize.c_str()));
+    }
+    else if (!g_outHtmlFile.empty() || Util::CheckIfUrlsFileExists())
+    {
+        poolSize = 2;
+    }
+    if (poolSize == 0 || !m_contentEnv)
+    {
+        return;
+    }
+    m_tabPool = std::make_unique<TabPool>(m_hWnd, m_contentEnv.get(), poolSize);
+    m_tabPool->Refill();
+}
+
+void BrowserWindow::InitRequestFilter()
+{
+    RequestFilter::Mode mode = RequestFilter::ParseMode(g_blockMode);
+    // Batch jobs only need the DOM or the image. Browsing stays untouched,
+    // and so does -i, where the user logs in or solves a captcha to get
+    // cookie.txt written
+    if (g_blockMode.empty() && g_cmd != L"-i")
+    {
+        if (!g_outHtmlFile.empty())
+        {
+            mode = RequestFilter::Mode::Capture;
+        }
+        else if (Util::CheckIfUrlsFileExists())
+        {
+            mode = RequestFilter::Mode::Download;
+        }
+    }
+    m_requestFilter.Configure(mode);
+    if (!m_requestFilter.IsEnabled())
+    {
+        return;
+    }
+
+    // Checking hosts routes every request through the UI thread, not just
+    // the blocked types, so domains are only checked when asked for
+    if (g_blockDefaults)
+    {
+        m_requestFilter.AddDefaultDomains();
+    }
+    if (!g_blockListFile.empty())
+    {
+        size_t added = m_requestFilter.AddDomainList(Util::fileRead(g_blockListFile));
+        OutputDebugString((L"Blocking " + std::to_wstring(added) + L" domains from " + g_blockListFile + L"\n").c_str());
+    }
+}
+
+void BrowserWindow::InitWebResourceCache()
+{
+    std::wstring directory = g_cacheDirectory;
+    if (directory == L"off")
+    {
+        return;
+    }
+    if (directory.empty())
+    {
+        // Batch crawls revisit the same viewer assets; browsing and -i,
+        // where the user logs in, leave it off
+        if (g_cmd == L"-i" || (g_outHtmlFile.empty() && !Util::CheckIfUrlsFileExists()))
+        {
+            return;
+        }
+        directory = GetFullPathFor(L"cache");
+    }
+
+    HttpCache::Config config;
+    config.directory = directory;
+    if (!g_cacheSize.empty())
+    {
+        config.capacity = static_cast<uint64_t>(_wtoi(g_cacheSize.c_str())) * 1024 * 1024;
+    }
+    m_webResourceCache = std::make_unique<WebResourceCache>(
+        [this](ThreadPool::Task work) { RunInBackground(std::move(work)); },
+        [this](ThreadPool::Task task) { RunOnUIThread(std::move(task)); });
+    if (config.capacity == 0 || !m_webResourceCache->Open(config))
+    {
+        OutputDebugString((L"Disk cache disabled, cannot open " + directory + L"\n").c_str());
+        m_webResourceCache.reset();
+    }
+}
+
+void BrowserWindow::InitTabLifecycle()
+{
+    TabLifecycle::Config config;
+    if (!g_suspendAfter.empty())
+    {
+        config.suspendAfter = static_cast<int64_t>(_wtoi(g_suspendAfter.c_str())) * 1000000;
+    }
+    // Both are opt-in: a discarded tab loses its back/forward history
+    if (!g_memoryBudget.empty())
+    {
+        config.memoryBudget = static_cast<uint64_t>(_wtoi(g_memoryBudget.c_str())) * 1024 * 1024;
+    }
+    m_tabLifecycle.Configure(config);
+
+    // -recycle-memory is checked between pages against the last sample
+    // taken here
+    if (!g_recycleMemory.empty())
+    {
+        m_recycleMemoryBytes = static_cast<uint64_t>(_wtoi(g_recycleMemory.c_str())) * 1024 * 1024;
+    }
+
+    if (config.suspendAfter > 0 || config.memoryBudget > 0 || m_recycleMemoryBytes > 0)
+    {
+        SetTimer(m_hWnd, TAB_LIFECYCLE_TIMER_ID, TAB_LIFECYCLE_CHECK_MS, NULL);
+    }
+}
+
+uint64_t BrowserWindow::GetContentMemoryBytes()
+{
+    // Renderers are shared between tabs of the same site, so only the total
+    // over all processes of the content environment is meaningful
+    if (!m_contentEnv)
+    {
+        return 0;
+    }
+    auto env8 = m_contentEnv.try_query<ICoreWebView2Environment8>();
+    wil::com_ptr<ICoreWebView2ProcessInfoCollection> processes;
+    if (!env8 || FAILED(env8->GetProcessInfos(&processes)))
+    {
+        return 0;
+    }
+
+    UINT count = 0;
+    processes->get_Count(&count);
+    uint64_t total = 0;
+    for (UINT i = 0; i < count; ++i)
+    {
+        wil::com_ptr<ICoreWebView2ProcessInfo> info;
+        INT32 processId = 0;
+        if (FAILED(processes->GetValueAtIndex(i, &info)) || FAILED(info->get_ProcessId(&processId)))
+        {
+            continue;
+        }
+        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(processId));
+        if (hProcess)
+        {
+            PROCESS_MEMORY_COUNTERS_EX counters = {};
+            if (GetProcessMemoryInfo(hProcess, reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+            {
+                total += counters.PrivateUsage;
+            }
+            CloseHandle(hProcess);
+        }
+    }
+    return total;
+}
+
+void BrowserWindow::UpdateTabLifecycle()
+{
+    int64_t now = Metrics::NowMicroseconds();
+    uint64_t memory = m_tabLifecycle.GetConfig().memoryBudget > 0 || m_recycleMemoryBytes > 0 ? GetContentMemoryBytes() : 0;
+    m_contentMemoryBytes = memory;
+    TabLifecycle::Plan plan = m_tabLifecycle.Evaluate(now, memory);
+
+    for (size_t tabId : plan.suspend)
+    {
+        auto it = m_tabs.find(tabId);
+        if (it == m_tabs.end() || !it->second->IsReady())
+        {
+            continue;
+        }
+        HWND hWnd = m_hWnd;
+        m_tabLifecycle.OnSuspendRequested(tabId);
+        bool issued = it->second->TrySuspend([hWnd, tabId](bool suspended) {
+            BrowserWindow* window = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+            if (!window)
+            {
+                return;
+            }
+            if (suspended)
+            {
+                window->m_tabLifecycle.OnSuspended(tabId);
+                Metrics::Instance().Add(Metrics::Counter::TabSuspends);
+            }
+            else
+            {
+                window->m_tabLifecycle.OnSuspendFailed(tabId);
+            }
+        });
+        if (!issued)
+        {
+            m_tabLifecycle.OnSuspendFailed(tabId);
+        }
+    }
+
+    for (size_t tabId : plan.discard)
+    {
+        auto it = m_tabs.find(tabId);
+        if (it != m_tabs.end() && SUCCEEDED(it->second->Discard()))
+        {
+            m_tabLifecycle.OnDiscarded(tabId);
+            Metrics::Instance().Add(Metrics::Counter::TabDiscards);
+            OutputDebugString((L"Discarded tab " + std::to_wstring(tabId) + L", content processes use " +
+                std::to_wstring(memory / (1024 * 1024)) + L" MB\n").c_str());
+        }
+    }
+}
+
+void BrowserWindow::HandleTabProcessFailed(size_t tabId, COREWEBVIEW2_PROCESS_FAILED_KIND kind)
+{
+    // Recovery closes controllers, which must not happen inside their own
+    // event handler
+    RunOnUIThread([this, tabId, kind]() { RecoverFromProcessFailure(tabId, kind); });
+}
+
+void BrowserWindow::RecoverFromProcessFailure(size_t tabId, COREWEBVIEW2_PROCESS_FAILED_KIND kind)
+{
+    switch (kind)
+    {
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_BROWSER_PROCESS_EXITED:
+        // Every tab reports it, the first one starts over
+        if (!m_recyclingEnvironment && m_contentEnv)
+        {
+            Metrics::Instance().Add(Metrics::Counter::ProcessFailures);
+            OutputDebugString(L"Content browser process exited\n");
+            RecycleContentEnvironment(true);
+        }
+        break;
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_RENDER_PROCESS_EXITED:
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_RENDER_PROCESS_UNRESPONSIVE:
+        Metrics::Instance().Add(Metrics::Counter::ProcessFailures);
+        OutputDebugString((L"Renderer of tab " + std::to_wstring(tabId) + L" exited or hung\n").c_str());
+        RecoverTab(tabId);
+        break;
+    default:
+        // Frame renderers, GPU and utility processes are restarted by the
+        // runtime itself
+        break;
+    }
+}
+
+void BrowserWindow::RecoverTab(size_t tabId)
+{
+    // Prefetch tabs get a new renderer with their next navigation, and the
+    // prefetcher stops those that hang
+    auto it = m_tabs.find(tabId);
+    if (it == m_tabs.end() || !it->second->IsReady() || !m_contentEnv)
+    {
+        return;
+    }
+    Tab* tab = it->second.get();
+    bool isDownloadTab = m_downloadEngine && tabId == m_downloadTabId;
+    if (isDownloadTab)
+    {
+        if (m_downloadScheduler)
+        {
+            m_downloadScheduler->OnEngineLost();
+        }
+        m_downloadEngine->Detach();
+    }
+    if (FAILED(tab->Discard()))
+    {
+        if (isDownloadTab)
+        {
+            // Carries on in the old WebView; a hung page is stopped by the watchdog
+            ResumeDownloadsOnRestoredTab();
+        }
+        return;
+    }
+    m_tabLifecycle.OnDiscarded(tabId);
+
+    if (isDownloadTab)
+    {
+        // Comes back behind the user's tab unless it is the one in front
+        m_restoringDownloadTab = true;
+        RestoreDownloadTab(*tab);
+    }
+    else if (tabId == m_activeTabId)
+    {
+        CheckFailure(tab->Restore(m_contentEnv.get(), true), L"Can't restore tab.");
+    }
+    // Background tabs come back when they are shown, like discarded ones
+}
+
+bool BrowserWindow::ShouldRecycleContentEnvironment()
+{
+    if (m_recyclingEnvironment || !m_contentEnv)
+    {
+        return false;
+    }
+    size_t pageLimit = g_recyclePages.empty() ? 0 : static_cast<size_t>(_wtoi(g_recyclePages.c_str()));
+    if (pageLimit > 0 && m_pagesSinceRecycle >= pageLimit)
+    {
+        return true;
+    }
+    return m_recycleMemoryBytes > 0 && m_contentMemoryBytes >= m_recycleMemoryBytes;
+}
+
+void BrowserWindow::RecycleContentEnvironment(bool browserExited)
+{
+    if (m_recyclingEnvironment || !m_contentEnv)
+    {
+        return;
+    }
+    m_recyclingEnvironment = true;
+    Metrics::Instance().Add(Metrics::Counter::EnvironmentRecycles);
+    OutputDebugString((L"Recycling the content environment after " + std::to_wstring(m_pagesSinceRecycle) + L" pages\n").c_str());
+
+    // Everything created from the old environment goes
+    if (m_downloadScheduler)
+    {
+        m_downloadScheduler->OnEngineLost();
+    }
+    ReleasePrefetcher();
+    m_tabPool.reset();
+    if (m_downloadEngine)
+    {
+        m_downloadEngine->Detach();
+        m_restoringDownloadTab = true;
+    }
+    for (auto& entry : m_tabs)
+    {
+        if (entry.second->IsReady() && SUCCEEDED(entry.second->Discard()))
+        {
+            m_tabLifecycle.OnDiscarded(entry.first);
+        }
+    }
+    // MG_CREATE_TAB queues tabs again until the new one is ready
+    m_retiredEnv = std::move(m_contentEnv);
+
+    // A new environment on the same user data folder would join the old
+    // browser process while it is still shutting down
+    auto env5 = m_retiredEnv.try_query<ICoreWebView2Environment5>();
+    if (!browserExited && env5 && SUCCEEDED(env5->add_BrowserProcessExited(
+        Callback<ICoreWebView2BrowserProcessExitedEventHandler>(
+            [this](ICoreWebView2Environment* sender, ICoreWebView2BrowserProcessExitedEventArgs* args) -> HRESULT
+    {
+        CheckFailure(RecreateContentEnvironment(), L"Can't recreate content environment.");
+        return S_OK;
+    }).Get(), &m_browserExitedToken)))
+    {
+        return;
+    }
+    CheckFailure(RecreateContentEnvironment(), L"Can't recreate content environment.");
+}
+
+HRESULT BrowserWindow::RecreateContentEnvironment()
+{
+    return CreateCoreWebView2EnvironmentWithOptions(nullptr, GetUserDataDirectory().c_str(),
+        nullptr, Callback<ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler>(
+            [this](HRESULT result, ICoreWebView2Environment* env) -> HRESULT
+    {
+        auto retiredEnv5 = m_retiredEnv.try_query<ICoreWebView2Environment5>();
+        if (retiredEnv5 && m_browserExitedToken.value != 0)
+        {
+            retiredEnv5->remove_BrowserProcessExited(m_browserExitedToken);
+        }
+        m_browserExitedToken = {};
+        m_retiredEnv.reset();
+        m_recyclingEnvironment = false;
+        if (FAILED(result))
+        {
+            // Without tabs the queue cannot go on
+            OutputDebugString(L"Content environment could not be recreated\n");
+            return result;
+        }
+
+        m_contentEnv = env;
+        m_pagesSinceRecycle = 0;
+        m_contentMemoryBytes = 0;
+        InitTabPool();
+        std::vector<PendingTab> pendingTabs = std::move(m_pendingTabs);
+        for (const PendingTab& pending : pendingTabs)
+        {
+            CreateTab(pending.id, pending.shouldBeActive, pending.uri);
+        }
+
+        auto downloadTab = m_restoringDownloadTab ? m_tabs.find(m_downloadTabId) : m_tabs.end();
+        if (downloadTab != m_tabs.end())
+        {
+            RestoreDownloadTab(*downloadTab->second);
+        }
+        auto activeTab = m_tabs.find(m_activeTabId);
+        if (activeTab != m_tabs.end() && activeTab->second->IsDiscarded())
+        {
+            CheckFailure(activeTab->second->Restore(m_contentEnv.get(), true), L"Can't restore tab.");
+        }
+        return S_OK;
+    }).Get());
+}
+
+void BrowserWindow::RestoreDownloadTab(Tab& tab)
+{
+    bool isActive = m_downloadTabId == m_activeTabId;
+    if (!isActive)
+    {
+        m_tabLifecycle.OnHidden(m_downloadTabId, Metrics::NowMicroseconds());
+    }
+    CheckFailure(tab.Restore(m_contentEnv.get(), isActive, L"about:blank"), L"Can't restore download tab.");
+}
+
+void BrowserWindow::ResumeDownloadsOnRestoredTab()
+{
+    auto it = m_tabs.find(m_downloadTabId);
+    if (!m_downloadEngine || it == m_tabs.end() || !m_downloadEngine->Attach(it->second.get()))
+    {
+        OutputDebugString(L"Could not attach to the restored download tab\n");
+        return;
+    }
+    if (m_downloadScheduler)
+    {
+        InitPrefetcher();
+        m_downloadScheduler->SetPrefetcher(m_prefetcher.get());
+        m_downloadScheduler->OnEngineRestored();
+    }
+}
+
+void BrowserWindow::CreateTab(size_t id, bool shouldBeActive, const std::wstring& uri)
+{
+    if (id == INVALID_TAB_ID)
+    {
+        // Such a tab would stay hidden as a warm tab and never navigate
+        OutputDebugString(L"CreateTab called without a tab id\n");
+        return;
+    }
+    std::unique_ptr<Tab> newTab = m_tabPool ? m_tabPool->Take() : nullptr;
+    if (!newTab)
+    {
+        newTab = Tab::CreateNewTab(m_hWnd, m_contentEnv.get());
+        Metrics::Instance().Add(Metrics::Counter::TabPoolMisses);
+    }
+    Tab* tab = newTab.get();
+
+    std::map<size_t, std::unique_ptr<Tab>>::iterator it = m_tabs.find(id);
+    if (it == m_tabs.end())
+    {
+        m_tabs.insert(std::pair<size_t,std::unique_ptr<Tab>>(id, std::move(newTab)));
+    }
+    else
+    {
+        if (it->second->m_contentController)
+        {
+            it->second->m_contentController->Close();
+        }
+        it->second = std::move(newTab);
+        m_tabLifecycle.OnRemoved(id);
+    }
+    if (!shouldBeActive)
+    {
+        m_tabLifecycle.OnHidden(id, Metrics::NowMicroseconds());
+    }
+
+    // The tab goes into m_tabs first: a warm tab navigates and is switched
+    // to right away, one still being created does so once its controller
+    // exists
+    tab->Assign(id, shouldBeActive, uri);
+
+    if (m_tabPool)
+    {
+        m_tabPool->Refill();
+    }
+}
+
 void BrowserWindow::CreateInitialTab()
 {
+    if (m_headless)
+    {
+        CreateTab(c_headlessTabId, true, std::wstring());
+        return;
+    }
+
     if (!m_controlsWebView) {
         OutputDebugString(L"Controls WebView not ready\n");
         return;
@@ -397,6 +980,7 @@ HRESULT BrowserWindow::CreateBrowserOptionsWebView()
     return m_uiEnv->CreateCoreWebView2Controller(m_hWnd, Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
         [this](HRESULT result, ICoreWebView2Controller* host) -> HRESULT
     {
+        m_optionsCreating = false;
         if (!SUCCEEDED(result))
         {
             OutputDebugString(L"Options WebView creation failed\n");
@@ -447,8 +1031,8 @@ HRESULT BrowserWindow::CreateBrowserOptionsWebView()
         }
         ).Get(), &m_optionsZoomToken));
 
-        // Hide by default
-        RETURN_IF_FAILED(m_optionsController->put_IsVisible(FALSE));
+        // Hide by default, unless it was asked for while being created
+        RETURN_IF_FAILED(m_optionsController->put_IsVisible(m_showOptionsWhenReady ? TRUE : FALSE));
         RETURN_IF_FAILED(m_optionsWebView->add_WebMessageReceived(m_uiMessageBroker.get(), &m_optionsUIMessageBrokerToken));
 
         // Hide menu when focus is lost
@@ -469,6 +1053,11 @@ HRESULT BrowserWindow::CreateBrowserOptionsWebView()
         std::wstring optionsPath = GetFullPathFor(L"gui\\controls_ui\\options.html");
         RETURN_IF_FAILED(m_optionsWebView->Navigate(optionsPath.c_str()));
 
+        if (m_showOptionsWhenReady)
+        {
+            m_showOptionsWhenReady = false;
+            m_optionsController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+        }
         return S_OK;
     }).Get());
 }
@@ -505,29 +1094,26 @@ void BrowserWindow::SetUIMessageBroker()
         {
             size_t id = args.at(L"tabId").as_number().to_uint32();
             bool shouldBeActive = args.at(L"active").as_bool();
-            std::unique_ptr<Tab> newTab = Tab::CreateNewTab(m_hWnd, m_contentEnv.get(), id, shouldBeActive);
-
             // ṩURI±ǩҳе
-            if (args.has_field(L"uri"))
+            std::wstring uri = args.has_field(L"uri") ? args.at(L"uri").as_string() : std::wstring();
+            if (!m_contentEnv)
             {
-                std::wstring uri = args.at(L"uri").as_string();
-                newTab->m_contentWebView->Navigate(uri.c_str());
-            }
-
-            std::map<size_t, std::unique_ptr<Tab>>::iterator it = m_tabs.find(id);
-            if (it == m_tabs.end())
-            {
-                m_tabs.insert(std::pair<size_t,std::unique_ptr<Tab>>(id, std::move(newTab)));
-            }
-            else
-            {
-                m_tabs.at(id)->m_contentController->Close();
-                it->second = std::move(newTab);
+                // The UI came up first; created once the content environment is
+                m_pendingTabs.push_back({ id, shouldBeActive, uri });
+                break;
             }
+            CreateTab(id, shouldBeActive, uri);
         }
         break;
         case MG_NAVIGATE:
         {
+            // Commands for a tab that is being recreated are dropped; the
+            // UI shows its restored state once it is back
+            Tab* tab = GetReadyActiveTab();
+            if (!tab)
+            {
+                break;
+            }
             std::wstring uri(args.at(L"uri").as_string());
             std::wstring browserScheme(L"browser://");
 
@@ -543,43 +1129,58 @@ void BrowserWindow::SetUIMessageBroker()
                     filePath.append(path);
                     filePath.append(L".html");
                     std::wstring fullPath = GetFullPathFor(filePath.c_str());
-                    CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(fullPath.c_str()), L"Can't navigate to browser page.");
+                    CheckFailure(tab->m_contentWebView->Navigate(fullPath.c_str()), L"Can't navigate to browser page.");
                 }
                 else
                 {
                     OutputDebugString(L"Requested unknown browser page\n");
                 }
             }
-            else if (!SUCCEEDED(m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(uri.c_str())))
+            else if (!SUCCEEDED(tab->m_contentWebView->Navigate(uri.c_str())))
             {
-                CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(args.at(L"encodedSearchURI").as_string().c_str()), L"Can't navigate to requested page.");
+                CheckFailure(tab->m_contentWebView->Navigate(args.at(L"encodedSearchURI").as_string().c_str()), L"Can't navigate to requested page.");
             }
         }
         break;
         case MG_GO_FORWARD:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->GoForward(), L"");
+            if (Tab* tab = GetReadyActiveTab())
+            {
+                CheckFailure(tab->m_contentWebView->GoForward(), L"");
+            }
         }
         break;
         case MG_GO_BACK:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->GoBack(), L"");
+            if (Tab* tab = GetReadyActiveTab())
+            {
+                CheckFailure(tab->m_contentWebView->GoBack(), L"");
+            }
         }
         break;
         case MG_RELOAD:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->Reload(), L"");
+            Tab* tab = GetReadyActiveTab();
+            if (!tab)
+            {
+                break;
+            }
+            CheckFailure(tab->m_contentWebView->Reload(), L"");
              
             //! [CookieManager]
             wil::unique_cotaskmem_string source;
-            RETURN_IF_FAILED(m_tabs.at(m_activeTabId)->m_contentWebView->get_Source(&source));
+            RETURN_IF_FAILED(tab->m_contentWebView->get_Source(&source));
             std::wstring uri(source.get());
-            CheckFailure(m_tabs.at(m_activeTabId)->GetCookies(uri), L"");
+            // An explicit reload always rewrites cookie.txt
+            CheckFailure(tab->GetCookies(uri, true), L"");
         }
         break;
         case MG_CANCEL:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->CallDevToolsProtocolMethod(L"Page.stopLoading", L"{}", nullptr), L"");
+            if (Tab* tab = GetReadyActiveTab())
+            {
+                CheckFailure(tab->m_contentWebView->CallDevToolsProtocolMethod(L"Page.stopLoading", L"{}", nullptr), L"");
+            }
         }
         break;
         case MG_SWITCH_TAB:
@@ -592,8 +1193,12 @@ void BrowserWindow::SetUIMessageBroker()
         case MG_CLOSE_TAB:
         {
             size_t id = args.at(L"tabId").as_number().to_uint32();
-            m_tabs.at(id)->m_contentController->Close();
+            if (m_tabs.at(id)->m_contentController)
+            {
+                m_tabs.at(id)->m_contentController->Close();
+            }
             m_tabs.erase(id);
+            m_tabLifecycle.OnRemoved(id);
         }
         break;
         case MG_CLOSE_WINDOW:
@@ -603,18 +1208,37 @@ void BrowserWindow::SetUIMessageBroker()
         break;
         case MG_SHOW_OPTIONS:
         {
+            if (!m_optionsController)
+            {
+                // Shown as soon as it exists
+                m_showOptionsWhenReady = true;
+                if (!m_optionsCreating)
+                {
+                    HRESULT hr = CreateBrowserOptionsWebView();
+                    m_optionsCreating = SUCCEEDED(hr);
+                    CheckFailure(hr, L"Can't create the options dropdown.");
+                }
+                break;
+            }
             CheckFailure(m_optionsController->put_IsVisible(TRUE), L"");
             m_optionsController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
         }
         break;
         case MG_HIDE_OPTIONS:
         {
-            CheckFailure(m_optionsController->put_IsVisible(FALSE), L"Something went wrong when trying to close the options dropdown.");
+            m_showOptionsWhenReady = false;
+            if (m_optionsController)
+            {
+                CheckFailure(m_optionsController->put_IsVisible(FALSE), L"Something went wrong when trying to close the options dropdown.");
+            }
         }
         break;
         case MG_OPTION_SELECTED:
         {
-            m_tabs.at(m_activeTabId)->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+            if (Tab* tab = GetReadyActiveTab())
+            {
+                tab->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+            }
         }
         break;
         case MG_GET_FAVORITES:
@@ -639,6 +1263,12 @@ void BrowserWindow::SetUIMessageBroker()
     });
 }
 
+Tab* BrowserWindow::GetReadyActiveTab()
+{
+    auto it = m_tabs.find(m_activeTabId);
+    return it != m_tabs.end() && it->second->IsReady() ? it->second.get() : nullptr;
+}
+
 HRESULT BrowserWindow::SwitchToTab(size_t tabId)
 {
     // ǩҳǷ
@@ -647,12 +1277,33 @@ HRESULT BrowserWindow::SwitchToTab(size_t tabId)
         return E_INVALIDARG;
     }
 
+    // A discarded tab is recreated first and switched to once it is ready;
+    // until then the current tab stays in front
+    Tab* tab = m_tabs.at(tabId).get();
+    if (tab->IsDiscarded())
+    {
+        if (!m_contentEnv)
+        {
+            // Being recycled; the active tab comes back with the new one
+            return S_OK;
+        }
+        Metrics::Instance().Add(Metrics::Counter::TabRestores);
+        m_tabLifecycle.OnShown(tabId, Metrics::NowMicroseconds());
+        return tab->Restore(m_contentEnv.get(), true);
+    }
+    if (!tab->IsReady())
+    {
+        return S_OK;
+    }
+
     size_t previousActiveTab = m_activeTabId;
+    int64_t now = Metrics::NowMicroseconds();
 
     // ±ǩҳ
-    RETURN_IF_FAILED(m_tabs.at(tabId)->ResizeWebView());
-    RETURN_IF_FAILED(m_tabs.at(tabId)->m_contentController->put_IsVisible(TRUE));
+    RETURN_IF_FAILED(tab->ResizeWebView());
+    RETURN_IF_FAILED(tab->m_contentController->put_IsVisible(TRUE));
     m_activeTabId = tabId;
+    m_tabLifecycle.OnShown(tabId, now);
 
     // ֮ǰĻǩҳ
     if (previousActiveTab != INVALID_TAB_ID && previousActiveTab != m_activeTabId) 
@@ -662,6 +1313,7 @@ HRESULT BrowserWindow::SwitchToTab(size_t tabId)
             previousTabIterator->second->m_contentController)
         {
             previousTabIterator->second->m_contentController->put_IsVisible(FALSE);
+            m_tabLifecycle.OnHidden(previousActiveTab, now);
         }
     }
 
@@ -715,13 +1367,19 @@ HRESULT BrowserWindow::HandleTabURIUpdate(size_t tabId, ICoreWebView2* webview)
              L"    return document.documentElement ? document.documentElement.outerHTML : document.body;"
              L"})();"
          );
+         Trace::Span htmlSpan = Trace::Instance().Begin("ExecuteScript:html", tabId);
          CheckFailure(webview->ExecuteScript(getSourceHtml.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-         [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+         [this, tabId, htmlSpan](HRESULT error, PCWSTR result) -> HRESULT
          {
+             Trace::Instance().End(htmlSpan);
              RETURN_IF_FAILED(error);
-             web::json::value jsonObj = web::json::value::parse(L"{}");
-             jsonObj[L"html"]  = web::json::value::parse(result);
-             Util::fileWrite(Util::GetUserHomeDirectory() + L"\\bookget\\" + g_outHtmlFile, jsonObj[L"html"].as_string());
+             std::wstring html;
+             if (!JsonString::Unquote(result, html))
+             {
+                 OutputDebugString(L"HTML script did not return a string\n");
+                 return S_OK;
+             }
+             WriteFileInBackground(Util::GetUserHomeDirectory() + L"\\bookget\\" + g_outHtmlFile, std::move(html));
              return S_OK;
          }).Get()), L"Can't update favicon");
      }
@@ -754,6 +1412,9 @@ HRESULT BrowserWindow::HandleTabHistoryUpdate(size_t tabId, ICoreWebView2* webvi
 
 HRESULT BrowserWindow::HandleTabNavStarting(size_t tabId, ICoreWebView2* webview)
 {
+    m_navigationSpans[tabId] = Trace::Instance().Begin("Navigation", tabId);
+    m_navigationStarts[tabId] = Metrics::NowMicroseconds();
+
     web::json::value jsonObj = web::json::value::parse(L"{}");
     jsonObj[L"message"] = web::json::value(MG_NAV_STARTING);
     jsonObj[L"args"] = web::json::value::parse(L"{}");
@@ -821,30 +1482,61 @@ HRESULT BrowserWindow::HandleTabNavCompleted(size_t tabId, ICoreWebView2* webvie
         L"})();"
     );
 
+    auto navigationSpan = m_navigationSpans.find(tabId);
+    if (navigationSpan != m_navigationSpans.end())
+    {
+        Trace::Instance().End(navigationSpan->second);
+        m_navigationSpans.erase(navigationSpan);
+    }
+    auto navigationStart = m_navigationStarts.find(tabId);
+    if (navigationStart != m_navigationStarts.end())
+    {
+        Metrics::Instance().RecordSince(Metrics::Histogram::Navigation, navigationStart->second);
+        m_navigationStarts.erase(navigationStart);
+    }
+    Metrics::Instance().Add(Metrics::Counter::Navigations);
+    TraceScope navCompletedScope("HandleTabNavCompleted", tabId);
+
+    if (m_restoringDownloadTab && tabId == m_downloadTabId)
+    {
+        // The blank page of a recreated download tab; attaching from outside
+        // this handler keeps the engine from seeing its completion
+        m_restoringDownloadTab = false;
+        RunOnUIThread([this]() { ResumeDownloadsOnRestoredTab(); });
+    }
+
+    Trace::Span titleSpan = Trace::Instance().Begin("ExecuteScript:title", tabId);
     CheckFailure(webview->ExecuteScript(getTitleScript.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+        [this, tabId, titleSpan](HRESULT error, PCWSTR result) -> HRESULT
     {
+        Trace::Instance().End(titleSpan);
         RETURN_IF_FAILED(error);
 
         web::json::value jsonObj = web::json::value::parse(L"{}");
         jsonObj[L"message"] = web::json::value(MG_UPDATE_TAB);
         jsonObj[L"args"] = web::json::value::parse(L"{}");
-        jsonObj[L"args"][L"title"] = web::json::value::parse(result);
+        std::wstring title;
+        jsonObj[L"args"][L"title"] = JsonString::Unquote(result, title) ?
+            web::json::value::string(title) : web::json::value::parse(result);
         jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
 
         CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.get()), L"Can't update title.");
         return S_OK;
     }).Get()), L"Can't update title.");
 
+    Trace::Span faviconSpan = Trace::Instance().Begin("ExecuteScript:favicon", tabId);
     CheckFailure(webview->ExecuteScript(getFaviconURI.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+        [this, tabId, faviconSpan](HRESULT error, PCWSTR result) -> HRESULT
     {
+        Trace::Instance().End(faviconSpan);
         RETURN_IF_FAILED(error);
 
         web::json::value jsonObj = web::json::value::parse(L"{}");
         jsonObj[L"message"] = web::json::value(MG_UPDATE_FAVICON);
         jsonObj[L"args"] = web::json::value::parse(L"{}");
-        jsonObj[L"args"][L"uri"] = web::json::value::parse(result);
+        std::wstring uri;
+        jsonObj[L"args"][L"uri"] = JsonString::Unquote(result, uri) ?
+            web::json::value::string(uri) : web::json::value::parse(result);
         jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
 
         CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.get()), L"Can't update favicon.");
@@ -860,15 +1552,20 @@ HRESULT BrowserWindow::HandleTabNavCompleted(size_t tabId, ICoreWebView2* webvie
     if (SUCCEEDED(args->get_IsSuccess(&navigationSucceeded)))
     {
         jsonObj[L"args"][L"isError"] = web::json::value::boolean(!navigationSucceeded);
+        if (!navigationSucceeded)
+        {
+            Metrics::Instance().Add(Metrics::Counter::Failures);
+        }
     }
      // ǷͼƬģʽ
     if (IsInImageDownloadMode)
     {
         // ȡǰURL
-         wil::unique_cotaskmem_string source;
-         RETURN_IF_FAILED(webview->get_Source(&source));
-        
-         TriggerDownload(webview);
+         // Batch downloads are driven by m_downloadScheduler through its engine
+         if (!m_downloadScheduler || !m_downloadScheduler->IsRunning())
+         {
+             TriggerDownload(webview);
+         }
        
     }
     else {
@@ -885,14 +1582,31 @@ HRESULT BrowserWindow::HandleTabNavCompleted(size_t tabId, ICoreWebView2* webvie
             L"})();"
         );
 
+        Trace::Span htmlSpan = Trace::Instance().Begin("ExecuteScript:html", tabId);
+        int64_t captureStart = Metrics::NowMicroseconds();
         CheckFailure(webview->ExecuteScript(getSourceHtml.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+        [this, tabId, htmlSpan, captureStart](HRESULT error, PCWSTR result) -> HRESULT
         {
+            Trace::Instance().End(htmlSpan);
+            if (FAILED(error))
+            {
+                Metrics::Instance().Add(Metrics::Counter::Failures);
+            }
             RETURN_IF_FAILED(error);
-            web::json::value jsonObj = web::json::value::parse(L"{}");
-            jsonObj[L"html"]  = web::json::value::parse(result);
+            std::wstring html;
+            {
+                TraceScope parseScope("ParseHtmlResult", tabId);
+                if (!JsonString::Unquote(result, html))
+                {
+                    OutputDebugString(L"HTML script did not return a string\n");
+                    Metrics::Instance().Add(Metrics::Counter::Failures);
+                    return S_OK;
+                }
+            }
 
-            WriteHtmlToSharedMemory(jsonObj[L"html"].as_string());
+            WriteHtmlToSharedMemory(html);
+            Metrics::Instance().RecordSince(Metrics::Histogram::Capture, captureStart);
+            Metrics::Instance().Add(Metrics::Counter::Captures);
             //Util::fileWrite(Util::GetUserHomeDirectory() + L"\\bookget\\"+ g_outHtmlFile, jsonObj[L"html"].as_string());
             return S_OK;
         }).Get()), L"Can't update favicon");
@@ -918,10 +1632,21 @@ HRESULT BrowserWindow::HandleTabSecurityUpdate(size_t tabId, ICoreWebView2* webv
 
 void BrowserWindow::HandleTabCreated(size_t tabId, bool shouldBeActive)
 {
+    if (!m_firstTabStarted)
+    {
+        m_firstTabStarted = true;
+        Metrics::Instance().RecordSince(Metrics::Histogram::Startup, m_startupStart);
+        LogStartupPhase(L"first tab");
+    }
     if (shouldBeActive)
     {
         CheckFailure(SwitchToTab(tabId), L"");
     }
+    if (m_downloadsWaitForFirstTab && m_tabs.find(m_activeTabId) != m_tabs.end() && m_tabs.at(m_activeTabId)->IsReady())
+    {
+        m_downloadsWaitForFirstTab = false;
+        StartDownloadProcess();
+    }
 }
 
 HRESULT BrowserWindow::HandleTabMessageReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs)
@@ -998,6 +1723,7 @@ HRESULT BrowserWindow::HandleTabMessageReceived(size_t tabId, ICoreWebView2* web
 
             if (SUCCEEDED(ClearContentCookies()))
             {
+                m_cookieTracker.Reset();
                 jsonObj[L"args"][L"content"] = web::json::value::boolean(true);
             }
 
@@ -1036,21 +1762,39 @@ HRESULT BrowserWindow::HandleTabMessageReceived(size_t tabId, ICoreWebView2* web
 
 HRESULT BrowserWindow::ClearContentCache()
 {
-    return m_tabs.at(m_activeTabId)->m_contentWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCache", L"{}", nullptr);
+    Tab* tab = GetReadyActiveTab();
+    if (!tab)
+    {
+        return E_NOT_VALID_STATE;
+    }
+    return tab->m_contentWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCache", L"{}", nullptr);
 }
 
 HRESULT BrowserWindow::ClearControlsCache()
 {
+    if (!m_controlsWebView)
+    {
+        return S_OK;
+    }
     return m_controlsWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCache", L"{}", nullptr);
 }
 
 HRESULT BrowserWindow::ClearContentCookies()
 {
-    return m_tabs.at(m_activeTabId)->m_contentWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCookies", L"{}", nullptr);
+    Tab* tab = GetReadyActiveTab();
+    if (!tab)
+    {
+        return E_NOT_VALID_STATE;
+    }
+    return tab->m_contentWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCookies", L"{}", nullptr);
 }
 
 HRESULT BrowserWindow::ClearControlsCookies()
 {
+    if (!m_controlsWebView)
+    {
+        return S_OK;
+    }
     return m_controlsWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCookies", L"{}", nullptr);
 }
 
@@ -1129,6 +1873,11 @@ int BrowserWindow::GetDPIAwareBound(int bound)
     return (bound * GetDpiForWindow(m_hWnd) / DEFAULT_DPI);
 }
 
+int BrowserWindow::GetContentTop()
+{
+    return m_headless ? 0 : GetDPIAwareBound(c_uiBarHeight);
+}
+
 std::wstring BrowserWindow::GetAppDataDirectory()
 {
     TCHAR path[MAX_PATH];
@@ -1179,6 +1928,12 @@ std::wstring BrowserWindow::GetFilePathAsURI(std::wstring fullPath)
 
 HRESULT BrowserWindow::PostJsonToWebView(web::json::value jsonObj, ICoreWebView2* webview)
 {
+    // The controls UI does not exist when headless, nor before it is created
+    if (!webview)
+    {
+        return S_OK;
+    }
+
     utility::stringstream_t stream;
     jsonObj.serialize(stream);
 
@@ -1202,163 +1957,142 @@ void BrowserWindow::StartDownloadProcess()
         return;
     }
 
-    // ü
-    m_downloadCounter = 1;
-    m_currentDownloadIndex = 0;
-
     // URLб
-    LoadImageUrlsFromFile();
+    std::vector<std::wstring> imageUrls = LoadImageUrlsFromFile();
+    if (imageUrls.empty() || m_tabs.find(m_activeTabId) == m_tabs.end())
+    {
+        return;
+    }
 
-    if (!m_imageUrls.empty())
+    // The engine brings its own download handler
+    auto webview10 = m_tabs.at(m_activeTabId)->m_contentWebView.try_query<ICoreWebView2_10>();
+    if (webview10 && m_downloadStartingToken.value != 0)
     {
-        // ش
-        SetupDownloadHandler();
-        
-        // ʼһ
-        DownloadNextImage();
+        webview10->remove_DownloadStarting(m_downloadStartingToken);
+        m_downloadStartingToken = {};
     }
-}
 
-void BrowserWindow::DownloadNextImage()
-{
-    if (m_currentDownloadIndex >= m_imageUrls.size())
+    m_downloadScheduler.reset();
+    m_downloadEngine = std::make_unique<WebView2Engine>(m_tabs.at(m_activeTabId).get(), m_activeTabId);
+    if (!m_downloadEngine->IsAttached())
     {
-        OutputDebugString(L"All downloads completed\n");
+        m_downloadEngine.reset();
         return;
     }
-
-    if (m_tabs.find(m_activeTabId) != m_tabs.end() && m_tabs.at(m_activeTabId)->m_contentWebView)
+    m_downloadTabId = m_activeTabId;
+    // Captured images are written on the post-processing pool
+    m_downloadEngine->SetDispatchers(
+        [this](ThreadPool::Task work) { RunInBackground(std::move(work)); },
+        [this](ThreadPool::Task task) { RunOnUIThread(std::move(task)); });
+    // The queue keeps running when the user looks at another tab
+    m_tabLifecycle.SetPinned(m_activeTabId, true);
+
+    DownloadScheduler::Host host;
+    HWND hWnd = m_hWnd;
+    host.postNext = [hWnd]() { PostMessage(hWnd, WM_APP_DOWNLOAD_NEXT, 0, 0); };
+    host.onPageCompleted = [this](size_t pageIndex, const DownloadResult& result) {
+        AddDownloadToBundle(pageIndex, result.path, result.totalBytes);
+    };
+    host.onPageFailed = [this](size_t pageIndex) {
+        m_bundleStrand->Submit([this, pageIndex]() { m_bundleWriter.SkipPage(pageIndex); });
+    };
+    host.onFinished = [this]() { FinishDownloadProcess(); };
+    host.log = [](const std::wstring& message) { OutputDebugString(message.c_str()); };
+    host.setWatchdog = [hWnd](uint32_t delayMs) {
+        if (delayMs > 0)
+        {
+            SetTimer(hWnd, DOWNLOAD_TIMER_ID, delayMs, NULL);
+        }
+        else
+        {
+            KillTimer(hWnd, DOWNLOAD_TIMER_ID);
+        }
+    };
+    m_downloadScheduler = std::make_unique<DownloadScheduler>(*m_downloadEngine, std::move(host));
+    // A page that hangs is stopped and retried later instead of holding up the batch
+    DownloadScheduler::Watchdog watchdog;
+    watchdog.navigationTimeoutMs = g_navTimeout.empty() ? DOWNLOAD_DELAY_MS : static_cast<uint32_t>(_wtoi(g_navTimeout.c_str())) * 1000;
+    if (!g_downloadTimeout.empty())
+    {
+        watchdog.downloadTimeoutMs = static_cast<uint32_t>(_wtoi(g_downloadTimeout.c_str())) * 1000;
+    }
+    if (!g_retries.empty())
     {
-        OutputDebugString(L"Downloading: ");
-        OutputDebugString(m_imageUrls[m_currentDownloadIndex].c_str());
-        OutputDebugString(L"\n");
-        
-        // ͼƬURL⽫
-        m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(m_imageUrls[m_currentDownloadIndex].c_str());
+        watchdog.maxAttempts = static_cast<size_t>(_wtoi(g_retries.c_str())) + 1;
     }
+    m_downloadScheduler->SetWatchdog(watchdog);
+    if (g_captureImages != L"off" && !m_downloadScheduler->SetResponseCapture(true))
+    {
+        OutputDebugString(L"WebView2 version cannot capture responses, images are downloaded again\n");
+    }
+    InitPrefetcher();
+    m_downloadScheduler->SetPrefetcher(m_prefetcher.get());
+
+    // гȺ -layout 滮Ŀ¼
+    std::wstring jobName = g_urlsFile.empty() ? L"urls" : std::filesystem::path(g_urlsFile).stem().wstring();
+    size_t filesPerShard = g_shardSize.empty() ? 1000 : static_cast<size_t>(_wtoi(g_shardSize.c_str()));
+    m_downloadScheduler->GetLayout().Configure(downloadsDir, DownloadLayout::ParseMode(g_downloadLayout), jobName,
+        imageUrls.size(), filesPerShard);
+
+    OpenBundle();
+
+    // ʼһ
+    m_downloadScheduler->Start(std::move(imageUrls));
 }
 
-std::wstring BrowserWindow::GetNextDownloadFilename()
+void BrowserWindow::InitPrefetcher()
 {
-    std::wstringstream filename;
-    filename << std::setw(4) << std::setfill(L'0') << m_downloadCounter++;
-    
-    // ԴURLȡļչ
-    size_t dotPos = m_imageUrls[m_currentDownloadIndex].find_last_of(L'.');
-    if (dotPos != std::wstring::npos)
+    // Opt-in: the hidden tabs cost a renderer each and load every page twice
+    size_t lookahead = g_prefetch.empty() ? 0 : static_cast<size_t>(_wtoi(g_prefetch.c_str()));
+    if (m_prefetcher || lookahead == 0 || !m_contentEnv)
     {
-        std::wstring ext = m_imageUrls[m_currentDownloadIndex].substr(dotPos);
-        if (ext.length() <= 5) // չ5ַ
+        return;
+    }
+    Prefetcher::Config config;
+    config.lookahead = lookahead;
+    m_prefetcher = std::make_unique<Prefetcher>(config);
+    m_prefetcher->SetLog([](const std::wstring& message) { OutputDebugString(message.c_str()); });
+
+    // Tabs of the content environment share its connections and caches with
+    // the download tab. Each one joins once its controller is ready, so the
+    // queue never waits for them.
+    for (size_t i = 0; i < lookahead; ++i)
+    {
+        std::unique_ptr<Tab> tab = Tab::CreateWarmTab(m_hWnd, m_contentEnv.get(), [this](Tab* warmed, HRESULT result) {
+            if (FAILED(result))
+            {
+                OutputDebugString(L"Prefetch tab creation failed\n");
+                return;
+            }
+            auto engine = std::make_unique<WebView2Engine>(warmed, INVALID_TAB_ID);
+            if (engine->IsAttached())
+            {
+                m_prefetcher->AddEngine(*engine);
+                m_prefetchEngines.push_back(std::move(engine));
+            }
+        });
+        if (tab)
         {
-            filename << ext;
-            return filename.str();
+            m_prefetchTabs.push_back(std::move(tab));
         }
     }
-    
-    // Ĭʹ.jpg
-    filename << L".jpg";
-    return filename.str();
 }
 
-
-void BrowserWindow::SetupDownloadHandler()
+void BrowserWindow::ReleasePrefetcher()
 {
-    if (m_tabs.find(m_activeTabId) != m_tabs.end() && m_tabs.at(m_activeTabId)->m_contentWebView)
+    if (m_downloadScheduler)
     {
-        auto webview10 = m_tabs.at(m_activeTabId)->m_contentWebView.try_query<ICoreWebView2_10>();
-        if (!webview10)
-        {
-            OutputDebugString(L"WebView2 version does not support download API\n");
-            return;
-        }
-
-        // Ƴɵؼڣ
-        if (m_downloadStartingToken.value != 0)
-        {
-            webview10->remove_DownloadStarting(m_downloadStartingToken);
-        }
-
-
-        // µؼ
-        webview10->add_DownloadStarting(
-            Callback<ICoreWebView2DownloadStartingEventHandler>(
-                [this](ICoreWebView2* sender, ICoreWebView2DownloadStartingEventArgs* args) -> HRESULT {
-                    wil::com_ptr<ICoreWebView2DownloadOperation> download;
-                    RETURN_IF_FAILED(args->get_DownloadOperation(&download));
-                    
-                    wil::unique_cotaskmem_string uri;
-                    RETURN_IF_FAILED(download->get_Uri(&uri));
-
-                    // ȷĿ¼
-                    std::wstring downloadsDir = Util::GetCurrentExeDirectory() + L"\\downloads";
-                    if (!CreateDirectory(downloadsDir.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
-                    {
-                        OutputDebugString(L"Could not create downloads directory\n");
-                        return S_OK;
-                    }
-
-                    // ·
-                    std::wstring filename = GetNextDownloadFilename();
-                    std::wstring fullPath = downloadsDir + L"\\" + filename;
-                    
-                    // 
-                    args->put_ResultFilePath(fullPath.c_str());
-                    args->put_Handled(TRUE);
-                    
-                    // ز
-                    m_downloadOperation = download;
-                    
-                  
-
-                   // עؽȼ
-                    EventRegistrationToken token;
-                    HRESULT hr = download->add_BytesReceivedChanged(
-                        Callback<ICoreWebView2BytesReceivedChangedEventHandler>(
-                            [](ICoreWebView2DownloadOperation* download, IUnknown* args) -> HRESULT {
-                                INT64 bytesReceived = 0;
-                                download->get_BytesReceived(&bytesReceived);
-                                UINT64 unsignedBytesReceived = static_cast<UINT64>(bytesReceived);
-            
-                                // ӡϢã
-                                wil::unique_cotaskmem_string uri;
-                                download->get_Uri(&uri);
-                                std::wstring debugMsg = L"Download progress: " + std::to_wstring(bytesReceived) + 
-                                                      L" bytes received for " + std::wstring(uri.get()) + L"\n";
-                                OutputDebugString(debugMsg.c_str());
-            
-                                return S_OK;
-                            }).Get(), &token);
-
-                    if (FAILED(hr)) {
-                        OutputDebugString(L"Failed to register BytesReceivedChanged event\n");
-                    }
-
-                    // ״̬
-                    download->add_StateChanged(
-                        Callback<ICoreWebView2StateChangedEventHandler>(
-                            [this](ICoreWebView2DownloadOperation* download, IUnknown* args) -> HRESULT {
-                                COREWEBVIEW2_DOWNLOAD_STATE state;
-                                download->get_State(&state);
-                                switch (state) {
-                                    case COREWEBVIEW2_DOWNLOAD_STATE_IN_PROGRESS:
-                                        break;
-                                    case COREWEBVIEW2_DOWNLOAD_STATE_INTERRUPTED:
-                                        OutputDebugString(L"Download interrupted\n");
-                                        // ʧҲһ
-                                        PostMessage(m_hWnd, WM_APP_DOWNLOAD_NEXT, 0, 0);
-                                        break;
-                                    case COREWEBVIEW2_DOWNLOAD_STATE_COMPLETED:
-                                          OutputDebugString(L"Download completed\n");
-                                        // ɺһ
-                                         PostMessage(m_hWnd, WM_APP_DOWNLOAD_NEXT, 0, 0);
-                                        break;
-                                }
-                                return S_OK;
-                            }).Get(), &token);
+        m_downloadScheduler->SetPrefetcher(nullptr);
+    }
+    m_prefetcher.reset();
+    m_prefetchEngines.clear();
 
-                    return S_OK;
-                }).Get(), &m_downloadStartingToken);
+    // Tabs still being created free themselves once their handler has run
+    for (std::unique_ptr<Tab>& tab : m_prefetchTabs)
+    {
+        Tab::Abandon(std::move(tab));
     }
+    m_prefetchTabs.clear();
 }
 
 void BrowserWindow::SetupDownloaderHandler(const wchar_t* imagePath)
@@ -1391,6 +2125,8 @@ void BrowserWindow::SetupDownloaderHandler(const wchar_t* imagePath)
                 wil::unique_cotaskmem_string uri;
                 RETURN_IF_FAILED(download->get_Uri(&uri));
 
+                int64_t downloadStart = Metrics::NowMicroseconds();
+
                 // 
                 args->put_ResultFilePath(imagePath);
                 args->put_Handled(TRUE);
@@ -1426,7 +2162,7 @@ void BrowserWindow::SetupDownloaderHandler(const wchar_t* imagePath)
                 // ״̬
                 download->add_StateChanged(
                     Callback<ICoreWebView2StateChangedEventHandler>(
-                        [this, imagePath](ICoreWebView2DownloadOperation* download, IUnknown* args) -> HRESULT {
+                        [this, imagePath, downloadStart](ICoreWebView2DownloadOperation* download, IUnknown* args) -> HRESULT {
                             COREWEBVIEW2_DOWNLOAD_STATE state;
                             download->get_State(&state);
                             switch (state) {
@@ -1434,11 +2170,13 @@ void BrowserWindow::SetupDownloaderHandler(const wchar_t* imagePath)
                                     break;
                                 case COREWEBVIEW2_DOWNLOAD_STATE_INTERRUPTED:
                                     OutputDebugString(L"Download interrupted\n");
+                                    Metrics::Instance().Add(Metrics::Counter::Failures);
                                     WriteImagePathToSharedMemory(imagePath, true);
                                     break;
                                 case COREWEBVIEW2_DOWNLOAD_STATE_COMPLETED:
                                     OutputDebugString(L"Download completed\n");
                                     // 
+                                    RecordDownloadMetrics(download, downloadStart);
                                     WriteImagePathToSharedMemory(imagePath, false);
                                     break;
                             }
@@ -1452,16 +2190,16 @@ void BrowserWindow::SetupDownloaderHandler(const wchar_t* imagePath)
 
 
 
-void BrowserWindow::LoadImageUrlsFromFile()
+std::vector<std::wstring> BrowserWindow::LoadImageUrlsFromFile()
 {
+    std::vector<std::wstring> imageUrls;
     std::wstring urlsFile;
-    std::wifstream file;
+    TextFileReader file;
 
     // 1. ȳԴȫ g_urlsFile
     if (!g_urlsFile.empty()) 
     {
-        file.open(g_urlsFile);
-        if (file.is_open()) 
+        if (file.Open(g_urlsFile)) 
         {
             urlsFile = g_urlsFile;
             OutputDebugString(L"Successfully opened global urls file\n");
@@ -1473,116 +2211,45 @@ void BrowserWindow::LoadImageUrlsFromFile()
     }
 
     // 2. ȫļδʧܣԱļ
-    if (!file.is_open())
+    if (!file.IsOpen())
     {
         urlsFile = Util::GetCurrentExeDirectory() + L"\\urls.txt";
-        file.open(urlsFile);
     
-        if (file.is_open())
+        if (file.Open(urlsFile))
         {
             OutputDebugString(L"Successfully opened local urls file\n");
         }
     }
 
     // 3. ռǷɹһļ
-    if (!file.is_open())
+    if (!file.IsOpen())
     {
         OutputDebugString(L"Error: Could not open any urls file (global or local)\n");
-        return;
+        return imageUrls;
     }
 
-
-    m_imageUrls.clear();
-    std::wstring line;
-    while (std::getline(file, line))
+    // жȡӳļ UTF-8 룬β \r ȥ
+    std::string_view line;
+    while (file.NextLine(line))
     {
         if (!line.empty())
         {
-            m_imageUrls.push_back(line);
+            imageUrls.push_back(Util::Utf8ToUtf16(std::string(line)));
         }
     }
+    return imageUrls;
 }
 
-void BrowserWindow::DownloadNextImageWithNavigate()
-{
-    if (m_currentDownloadIndex >= m_imageUrls.size())
-    {
-        OutputDebugString(L"All downloads completed\n");
-        return;
-    }
-
-    OutputDebugString(L"Processing download: ");
-    OutputDebugString(m_imageUrls[m_currentDownloadIndex].c_str());
-    OutputDebugString(L"\n");
-
-    if (m_tabs.find(m_activeTabId) != m_tabs.end() && m_tabs.at(m_activeTabId)->m_contentWebView)
-    {
-        // ȷش
-        SetupDownloadHandler();
-        
-        // URL
-        m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(m_imageUrls[m_currentDownloadIndex].c_str());
-    }
-    else
-    {
-        OutputDebugString(L"No active tab or webview available, moving to next download\n");
-        PostMessage(m_hWnd, WM_APP_DOWNLOAD_NEXT, 0, 0);
-    }
-}
-
-
 void BrowserWindow::TriggerDownload(ICoreWebView2* webview) {
   
 
     // ִмű
+    Trace::Span triggerSpan = Trace::Instance().Begin("ExecuteScript:download", m_activeTabId);
     webview->ExecuteScript(
-        LR"JS(
-            (function() {
-                try {
-                    return checkAndDownloadImage();
-                } catch(e) {
-                    console.error('Image detection failed:', e);
-                    return false;
-                }
-                
-                function checkAndDownloadImage() {
-                    // 1ǷǴͼƬĵֱӴjpg/png
-                    if (document.contentType && document.contentType.startsWith('image/')) {
-                        downloadImage(window.location.href);
-                        return true;
-                    }
-
-                    // 2<body>Ƿֻ<img>ǩ
-                    const bodyChildren = document.body.children;
-                    if (bodyChildren.length === 1 && bodyChildren[0] instanceof HTMLImageElement) {
-                        downloadImage(bodyChildren[0].src);
-                        return true;
-                    }
-
-                    // 3鱳ͼǷΨһ
-                    const bgImage = window.getComputedStyle(document.body).backgroundImage;
-                    if (bgImage && bgImage !== 'none' && document.body.innerText.trim() === '') {
-                        const imgUrl = bgImage.replace(/^url$["']?/, '').replace(/["']?$$/, '');
-                        downloadImage(imgUrl);
-                        return true;
-                    }
-
-                    return false;
-
-                    function downloadImage(url) {
-                        const link = document.createElement('a');
-                        link.href = url;
-                        link.download = url.split('/').pop() || 'download';
-                        document.body.appendChild(link);
-                        link.click();
-                        setTimeout(() => document.body.removeChild(link), 100);
-                    }
-                 }
-
-            })()
-        )JS",
+        DownloadScheduler::GetTriggerScript(),
         Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-            [](HRESULT errorCode, const wchar_t* resultJson) -> HRESULT {
+            [triggerSpan](HRESULT errorCode, const wchar_t* resultJson) -> HRESULT {
+                Trace::Instance().End(triggerSpan);
                 if (SUCCEEDED(errorCode)) {
                     // falseʾͼƬҳ
                     std::wstring result = Util::ParseJsonBool(resultJson);
@@ -1606,6 +2273,268 @@ void BrowserWindow::TriggerDownload(ICoreWebView2* webview) {
     //webview->ExecuteScript(js.c_str(), nullptr);
 }
 
+void BrowserWindow::InitPostProcessPool()
+{
+    m_postProcessPool = std::make_unique<ThreadPool>();
+    m_bundleStrand = m_postProcessPool->CreateStrand();
+    m_fileOutputStrand = m_postProcessPool->CreateStrand();
+    m_fileWriter = std::make_unique<FileWriter>(FileWriter::SyncPolicy::OnFlush);
+
+    // Completions are marshalled back to the UI thread
+    m_postProcessPool->SetCompletionDispatcher([this](ThreadPool::Task completion) {
+        RunOnUIThread(std::move(completion));
+    });
+}
+
+void BrowserWindow::RunOnUIThread(ThreadPool::Task task)
+{
+    // Dropped once the window is gone, see WM_APP_TASK_COMPLETE
+    auto* message = new ThreadPool::Task(std::move(task));
+    if (!PostMessage(m_hWnd, WM_APP_TASK_COMPLETE, 0, reinterpret_cast<LPARAM>(message)))
+    {
+        delete message;
+    }
+}
+
+void BrowserWindow::RunInBackground(ThreadPool::Task work)
+{
+    if (!m_postProcessPool || !m_postProcessPool->Submit(work))
+    {
+        // Pool is full or gone, fall back to running on the caller
+        work();
+    }
+}
+
+void BrowserWindow::WriteFileInBackground(const std::wstring& filename, std::wstring data)
+{
+    if (!m_fileWriter)
+    {
+        Util::fileWrite(filename, data);
+        return;
+    }
+
+    // A newer write to the same file replaces one that is still queued
+    m_fileWriter->Write(filename, std::move(data));
+}
+
+void BrowserWindow::ImportStartupCookies(Tab* tab)
+{
+    if (g_cookieFile.empty() || m_startupCookiesImported)
+    {
+        return;
+    }
+    m_startupCookiesImported = true;
+
+    std::vector<Cookie> cookies;
+    CookieCodec::ParseText(Util::fileRead(g_cookieFile), cookies);
+    size_t imported = tab->ImportCookies(cookies);
+    std::wstring message = L"Imported " + std::to_wstring(imported) + L" of " + std::to_wstring(cookies.size()) +
+        L" cookies from " + g_cookieFile + L"\n";
+    OutputDebugString(message.c_str());
+}
+
+void BrowserWindow::PublishCookies(const std::wstring& uri, const std::vector<CookieView>& cookies, bool force)
+{
+    CookieTracker::Delta delta = m_cookieTracker.Update(uri, cookies);
+    if (!force && !delta.NeedsPublish())
+    {
+        return;
+    }
+
+    std::wstring message = L"Cookies for " + uri + L": +" + std::to_wstring(delta.added) + L" ~" +
+        std::to_wstring(delta.changed) + L" -" + std::to_wstring(delta.removed) + L"\n";
+    OutputDebugString(message.c_str());
+
+    std::wstring text = CookieCodec::ToText(cookies, uri);
+    WriteCookiesToSharedMemory(text, cookies);
+    WriteFileInBackground(Util::GetCurrentExeDirectory() + L"\\cookie.txt", std::move(text));
+    m_cookieTracker.MarkPublished(uri);
+}
+
+void BrowserWindow::InitTrace()
+{
+    if (g_traceFile.empty())
+    {
+        return;
+    }
+    Trace::Instance().Enable();
+
+    // Any process can ask for a dump with SetEvent on this auto-reset event
+    m_hTraceDumpEvent = CreateEventW(nullptr, FALSE, FALSE, m_traceDumpEventName);
+}
+
+void BrowserWindow::CheckTraceDumpRequest()
+{
+    if (m_hTraceDumpEvent && WaitForSingleObject(m_hTraceDumpEvent, 0) == WAIT_OBJECT_0)
+    {
+        DumpTrace();
+    }
+}
+
+void BrowserWindow::DumpTrace()
+{
+    if (!Trace::Instance().IsEnabled())
+    {
+        return;
+    }
+
+    std::wstring path = g_traceFile;
+    uint32_t processId = GetCurrentProcessId();
+    m_fileOutputStrand->Submit(
+        [path, processId]() { return Trace::Instance().DumpChromeJson(path, processId); },
+        [](bool written) {
+            OutputDebugString(written ? L"Trace written\n" : L"Could not write trace file\n");
+        });
+}
+
+void BrowserWindow::InitMetrics()
+{
+    m_hMetricsMemory = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+        sizeof(MetricsBlock), m_metricsMemoryName);
+    if (m_hMetricsMemory == nullptr)
+    {
+        OutputDebugString(L"Failed to create metrics shared memory\n");
+    }
+    else
+    {
+        m_pMetricsBlock = static_cast<MetricsBlock*>(
+            MapViewOfFile(m_hMetricsMemory, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(MetricsBlock)));
+        if (m_pMetricsBlock == nullptr)
+        {
+            OutputDebugString(L"Failed to map metrics shared memory\n");
+            CloseHandle(m_hMetricsMemory);
+            m_hMetricsMemory = nullptr;
+        }
+    }
+
+    SetTimer(m_hWnd, METRICS_TIMER_ID, METRICS_PUBLISH_MS, NULL);
+}
+
+void BrowserWindow::PublishMetrics()
+{
+    if (m_pMetricsBlock)
+    {
+        Metrics::Instance().Publish(m_pMetricsBlock, GetCurrentProcessId());
+    }
+
+    if (!g_metricsFile.empty())
+    {
+        std::wstring path = g_metricsFile;
+        m_fileOutputStrand->Submit([path]() {
+            std::string text = Metrics::Instance().ToPrometheusText();
+            // Write next to the target and rename, so scrapers never see a partial file
+            std::wstring tempPath = path + L".tmp";
+            std::ofstream out(tempPath, std::ios::binary | std::ios::out | std::ios::trunc);
+            if (!out.is_open())
+            {
+                return;
+            }
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            out.close();
+            MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+        });
+    }
+}
+
+void BrowserWindow::CleanupMetrics()
+{
+    if (m_pMetricsBlock)
+    {
+        UnmapViewOfFile(m_pMetricsBlock);
+        m_pMetricsBlock = nullptr;
+    }
+    if (m_hMetricsMemory)
+    {
+        CloseHandle(m_hMetricsMemory);
+        m_hMetricsMemory = nullptr;
+    }
+}
+
+void BrowserWindow::RecordDownloadMetrics(ICoreWebView2DownloadOperation* download, int64_t startMicroseconds)
+{
+    INT64 bytesReceived = 0;
+    download->get_BytesReceived(&bytesReceived);
+    Metrics::Instance().RecordSince(Metrics::Histogram::Download, startMicroseconds);
+    Metrics::Instance().Add(Metrics::Counter::Bytes, static_cast<uint64_t>((std::max<INT64>)(bytesReceived, 0)));
+    Metrics::Instance().Add(Metrics::Counter::Downloads);
+}
+
+void BrowserWindow::FinishDownloadProcess()
+{
+    if (m_downloadEngine)
+    {
+        m_tabLifecycle.SetPinned(m_downloadEngine->GetTabId(), false);
+    }
+    m_bundleStrand->Submit(
+        [this]() { return !m_bundleWriter.IsOpen() || m_bundleWriter.Finalize(); },
+        [](bool finalized) {
+            if (!finalized)
+            {
+                OutputDebugString(L"Could not finalize download bundle\n");
+            }
+        });
+}
+
+void BrowserWindow::OpenBundle()
+{
+    BundleWriter::Format format = BundleWriter::ParseFormat(g_bundleFormat);
+    if (format == BundleWriter::Format::None)
+    {
+        return;
+    }
+
+    // Name the container after the urls file, e.g. urls.txt -> urls.pdf in the job directory
+    std::wstring name = L"book";
+    if (!g_urlsFile.empty())
+    {
+        name = std::filesystem::path(g_urlsFile).stem().wstring();
+    }
+    std::wstring bundlePath = m_downloadScheduler->GetLayout().GetJobDirectory() + L"\\" + name + BundleWriter::GetExtension(format);
+    m_bundleStrand->Submit(
+        [this, bundlePath, format]() { return m_bundleWriter.Open(bundlePath, format); },
+        [](bool opened) {
+            if (!opened)
+            {
+                OutputDebugString(L"Could not create download bundle\n");
+            }
+        });
+}
+
+void BrowserWindow::AddDownloadToBundle(size_t pageIndex, const std::wstring& filePath, int64_t totalBytes)
+{
+    if (BundleWriter::ParseFormat(g_bundleFormat) == BundleWriter::Format::None)
+    {
+        return;
+    }
+
+    // Verification and container output run on the bundle strand, in order
+    m_bundleStrand->Submit(
+        [this, pageIndex, filePath, totalBytes]() {
+            if (!m_bundleWriter.IsOpen())
+            {
+                return true;
+            }
+
+            // Verify the file on disk matches what the server announced
+            // before it becomes part of the container.
+            std::error_code ec;
+            uintmax_t fileSize = std::filesystem::file_size(filePath, ec);
+            if (ec || fileSize == 0 || (totalBytes > 0 && fileSize != static_cast<uintmax_t>(totalBytes)))
+            {
+                OutputDebugString(L"Downloaded file failed verification, not bundled\n");
+                m_bundleWriter.SkipPage(pageIndex);
+                return true;
+            }
+            return m_bundleWriter.AddPage(pageIndex, filePath);
+        },
+        [](bool added) {
+            if (!added)
+            {
+                OutputDebugString(L"Could not add page to download bundle\n");
+            }
+        });
+}
+
 
 //ڴ
 // ʼڴͻ
@@ -1678,7 +2607,9 @@ void BrowserWindow::ReadFromSharedMemory()
         return;
 
     // ȡ
+    int64_t waitStart = Metrics::NowMicroseconds();
     DWORD waitResult = WaitForSingleObject(m_hSharedMemoryMutex, 5000);
+    Metrics::Instance().RecordSince(Metrics::Histogram::IpcWait, waitStart);
     if (waitResult != WAIT_OBJECT_0)
     {
         OutputDebugString(L"Failed to acquire mutex for reading shared memory\n");
@@ -1718,12 +2649,30 @@ void BrowserWindow::ReadFromSharedMemory()
         }
     }
 
- 
-
-
+    // Cookies pushed by a client, e.g. a session from another worker
+    std::vector<Cookie> pushedCookies;
+    if (sharedData->cookiePushReady)
+    {
+        size_t size = (std::min)(static_cast<size_t>(sharedData->cookiePushBytes), sizeof(sharedData->cookiePush));
+        const uint8_t* cursor = sharedData->cookiePush;
+        CookieView view;
+        while (CookieCodec::ReadRecord(cursor, sharedData->cookiePush + size, view))
+        {
+            pushedCookies.emplace_back(view);
+        }
+        sharedData->cookiePushReady = false;
+    }
 
     // ͷŻ
     ReleaseMutex(m_hSharedMemoryMutex);
+
+    if (!pushedCookies.empty() && m_tabs.find(m_activeTabId) != m_tabs.end())
+    {
+        size_t imported = m_tabs.at(m_activeTabId)->ImportCookies(pushedCookies);
+        std::wstring message = L"Imported " + std::to_wstring(imported) + L" of " +
+            std::to_wstring(pushedCookies.size()) + L" pushed cookies\n";
+        OutputDebugString(message.c_str());
+    }
 }
 
 // дHTMLڴ
@@ -1732,8 +2681,12 @@ void BrowserWindow::WriteHtmlToSharedMemory(const std::wstring& html)
     if (m_pSharedMemory == nullptr)
         return;
 
+    TraceScope traceScope("SharedMemory:html", 0);
+
     // ȡ
+    int64_t waitStart = Metrics::NowMicroseconds();
     DWORD waitResult = WaitForSingleObject(m_hSharedMemoryMutex, 5000);
+    Metrics::Instance().RecordSince(Metrics::Histogram::IpcWait, waitStart);
     if (waitResult != WAIT_OBJECT_0)
     {
         OutputDebugString(L"Failed to acquire mutex for writing HTML\n");
@@ -1754,13 +2707,17 @@ void BrowserWindow::WriteHtmlToSharedMemory(const std::wstring& html)
 }
 
 // дCookiesڴ
-void BrowserWindow::WriteCookiesToSharedMemory(const std::wstring& cookies)
+void BrowserWindow::WriteCookiesToSharedMemory(const std::wstring& cookies, const std::vector<CookieView>& records)
 {
     if (m_pSharedMemory == nullptr)
         return;
 
+    TraceScope traceScope("SharedMemory:cookies", 0);
+
     // ȡ
+    int64_t waitStart = Metrics::NowMicroseconds();
     DWORD waitResult = WaitForSingleObject(m_hSharedMemoryMutex, 5000);
+    Metrics::Instance().RecordSince(Metrics::Histogram::IpcWait, waitStart);
     if (waitResult != WAIT_OBJECT_0)
     {
         OutputDebugString(L"Failed to acquire mutex for writing cookies\n");
@@ -1772,6 +2729,28 @@ void BrowserWindow::WriteCookiesToSharedMemory(const std::wstring& cookies)
     // дCookies
     size_t copySize = min(cookies.size(), sizeof(sharedData->cookies) / sizeof(wchar_t) - 1);
     wcsncpy_s(sharedData->cookies, cookies.c_str(), copySize);
+
+    // Records are encoded straight into the mapping; a record that does not
+    // fit is skipped so smaller ones after it still get through
+    size_t offset = 0;
+    uint32_t recordCount = 0;
+    uint32_t truncated = 0;
+    for (const CookieView& record : records)
+    {
+        size_t written = CookieCodec::WriteRecord(sharedData->cookieRecords + offset,
+            sizeof(sharedData->cookieRecords) - offset, record);
+        if (written == 0)
+        {
+            truncated++;
+            continue;
+        }
+        offset += written;
+        recordCount++;
+    }
+    sharedData->cookieRecordCount = recordCount;
+    sharedData->cookieRecordBytes = static_cast<uint32_t>(offset);
+    sharedData->cookieRecordsTruncated = truncated;
+    sharedData->cookieGeneration++;
     sharedData->CookiesReady = true;
     sharedData->PID = GetCurrentProcessId(); // ½ID
 
@@ -1785,8 +2764,12 @@ void BrowserWindow::WriteImagePathToSharedMemory(const std::wstring& imagePath,
     if (m_pSharedMemory == nullptr)
         return;
 
+    TraceScope traceScope("SharedMemory:imagePath", 0);
+
     // ȡ
+    int64_t waitStart = Metrics::NowMicroseconds();
     DWORD waitResult = WaitForSingleObject(m_hSharedMemoryMutex, 5000);
+    Metrics::Instance().RecordSince(Metrics::Histogram::IpcWait, waitStart);
     if (waitResult != WAIT_OBJECT_0)
     {
         OutputDebugString(L"Failed to acquire mutex for writing HTML\n");
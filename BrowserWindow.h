@@ -5,13 +5,31 @@
 #pragma once
 
 #include "framework.h"
+#include "BundleWriter.h"
+#include "CookieTracker.h"
+#include "DownloadScheduler.h"
+#include "FileWriter.h"
+#include "Metrics.h"
+#include "Prefetcher.h"
+#include "RequestFilter.h"
 #include "Tab.h"
+#include "TabLifecycle.h"
+#include "TabPool.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "WebResourceCache.h"
+#include "WebView2Engine.h"
 
 #define DOWNLOAD_TIMER_ID 1001
-#define DOWNLOAD_DELAY_MS 1000*60  // 10ӳ
+#define METRICS_TIMER_ID 1002
+#define METRICS_PUBLISH_MS 1000
+#define TAB_LIFECYCLE_TIMER_ID 1003
+#define TAB_LIFECYCLE_CHECK_MS 5000
+#define DOWNLOAD_DELAY_MS (1000*60)  // Default -nav-timeout of a page in the urls file
 // ԶϢ
 #define WM_APP_DOWNLOAD_COMPLETE (WM_APP + 1)  // ԶϢ
 #define WM_APP_DOWNLOAD_NEXT (WM_APP + 2)
+#define WM_APP_TASK_COMPLETE (WM_APP + 3)  // lParam: ThreadPool::Task* to run on the UI thread
 
 class BrowserWindow
 {
@@ -20,6 +38,9 @@ public:
     static const int c_uiBarHeight = 70;
     static const int c_optionsDropdownHeight = 108;
     static const int c_optionsDropdownWidth = 200;
+    // Id of the only tab in -headless mode. The controls UI numbers its tabs
+    // from 1 as well; INVALID_TAB_ID (0) marks warm pool and prefetch tabs.
+    static const size_t c_headlessTabId = 1;
 
     static ATOM RegisterClass(_In_ HINSTANCE hInstance);
     static LRESULT CALLBACK WndProcStatic(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
@@ -34,12 +55,34 @@ public:
     HRESULT HandleTabNavCompleted(size_t tabId, ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args);
     HRESULT HandleTabSecurityUpdate(size_t tabId, ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args);
     void HandleTabCreated(size_t tabId, bool shouldBeActive);
+    // From any tab's ProcessFailed, including the hidden prefetch tabs
+    void HandleTabProcessFailed(size_t tabId, COREWEBVIEW2_PROCESS_FAILED_KIND kind);
     HRESULT HandleTabMessageReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs);
     int GetDPIAwareBound(int bound);
+    // Height of the controls bar above the tabs, 0 when headless
+    int GetContentTop();
     static void CheckFailure(HRESULT hr, LPCWSTR errorMessage);
 
     static std::wstring GetUserDataDirectory();
 
+    // Background post-processing, completions come back on the UI thread
+    void RunInBackground(ThreadPool::Task work);
+    // Callable from any thread
+    void RunOnUIThread(ThreadPool::Task task);
+    void WriteFileInBackground(const std::wstring& filename, std::wstring data);
+
+    // Writes cookie.txt and the shared memory copy when the jar differs from
+    // what was last published, or always when force is set.
+    void PublishCookies(const std::wstring& uri, const std::vector<CookieView>& cookies, bool force);
+    // Imports the -cookies file through the first tab that asks; cookies are
+    // shared by all tabs of the profile
+    void ImportStartupCookies(Tab* tab);
+
+    // Shared by all tabs, only used on the UI thread
+    RequestFilter& GetRequestFilter() { return m_requestFilter; }
+    // Null unless the disk cache is enabled
+    WebResourceCache* GetWebResourceCache() { return m_webResourceCache.get(); }
+
 protected:
     HINSTANCE m_hInst = nullptr;  // Current app instance
     HWND m_hWnd = nullptr;
@@ -58,6 +101,74 @@ protected:
     wil::com_ptr<ICoreWebView2> m_optionsWebView;
     std::map<size_t,std::unique_ptr<Tab>> m_tabs;
     size_t m_activeTabId = 0;
+    // Pre-created hidden tabs handed out by MG_CREATE_TAB (-tab-pool <n>)
+    std::unique_ptr<TabPool> m_tabPool;
+    void InitTabPool();
+    void CreateTab(size_t id, bool shouldBeActive, const std::wstring& uri);
+
+    // -headless: only the content environment and its tabs are created, the
+    // window stays hidden and messages for the controls UI are dropped
+    bool m_headless = false;
+
+    // Startup runs as a small dependency graph: both environments are created
+    // at once, the controls WebView waits for the UI environment, tabs wait
+    // for the content environment (MG_CREATE_TAB arriving earlier is queued)
+    // and the options WebView is only created on first MG_SHOW_OPTIONS
+    struct PendingTab
+    {
+        size_t id;
+        bool shouldBeActive;
+        std::wstring uri;
+    };
+    std::vector<PendingTab> m_pendingTabs;
+    bool m_optionsCreating = false;
+    bool m_showOptionsWhenReady = false;
+
+    // Phases are traced with -trace and logged; the whole cold start goes
+    // into the startup histogram once the first tab navigates
+    int64_t m_startupStart = 0;
+    Trace::Span m_contentEnvSpan;
+    Trace::Span m_uiEnvSpan;
+    Trace::Span m_controlsSpan;
+    bool m_firstTabStarted = false;
+    bool m_downloadsWaitForFirstTab = false;  // -urls queue starts with the first tab
+    void LogStartupPhase(const wchar_t* phase);
+
+    // Subresources the job does not need, by type (-block) and by domain
+    // (-block-defaults, -block-list)
+    RequestFilter m_requestFilter;
+    void InitRequestFilter();
+
+    // Subresources shared between crawls through the disk cache (-cache)
+    std::unique_ptr<WebResourceCache> m_webResourceCache;
+    void InitWebResourceCache();
+
+    // Suspends long-hidden tabs and discards the least recently shown ones
+    // over the -memory-budget; discarded tabs come back on SwitchToTab
+    TabLifecycle m_tabLifecycle;
+    void InitTabLifecycle();
+    void UpdateTabLifecycle();
+    uint64_t GetContentMemoryBytes();
+
+    // A tab whose renderer died or hung is recreated; when the browser
+    // process dies the whole content environment is, and the same happens
+    // on purpose every -recycle-pages pages or past -recycle-memory MB,
+    // between two pages of the queue. The download tab comes back on a
+    // blank page and the queue resumes once that has loaded.
+    bool m_recyclingEnvironment = false;
+    bool m_restoringDownloadTab = false;
+    size_t m_pagesSinceRecycle = 0;
+    uint64_t m_recycleMemoryBytes = 0;
+    uint64_t m_contentMemoryBytes = 0;  // Sampled by the tab lifecycle timer
+    wil::com_ptr<ICoreWebView2Environment> m_retiredEnv;  // Until its browser process has exited
+    EventRegistrationToken m_browserExitedToken = {};
+    void RecoverFromProcessFailure(size_t tabId, COREWEBVIEW2_PROCESS_FAILED_KIND kind);
+    void RecoverTab(size_t tabId);
+    bool ShouldRecycleContentEnvironment();
+    void RecycleContentEnvironment(bool browserExited);
+    HRESULT RecreateContentEnvironment();
+    void RestoreDownloadTab(Tab& tab);
+    void ResumeDownloadsOnRestoredTab();
 
     EventRegistrationToken m_controlsUIMessageBrokerToken = {};  // Token for the UI message handler in controls WebView
     EventRegistrationToken m_controlsZoomToken = {};
@@ -81,29 +192,75 @@ protected:
     void UpdateMinWindowSize();
     HRESULT PostJsonToWebView(web::json::value jsonObj, ICoreWebView2* webview);
     HRESULT SwitchToTab(size_t tabId);
+    // Null while the active tab is discarded or being recreated
+    Tab* GetReadyActiveTab();
     std::wstring GetFilePathAsURI(std::wstring fullPath);
 
+    // Pipeline tracing (-trace <file>); a dump is requested by signalling
+    // the named event, or happens when the window closes
+    std::map<size_t, Trace::Span> m_navigationSpans;
+    HANDLE m_hTraceDumpEvent = nullptr;
+    const wchar_t* m_traceDumpEventName = L"Local\\BookgetTraceDump";
+    void InitTrace();
+    void CheckTraceDumpRequest();
+    void DumpTrace();
+
+    // Latency histograms and counters, published every second to the
+    // Local\WebView2SharedMemoryMetrics mapping and, with -metrics <file>,
+    // as a Prometheus text file
+    std::map<size_t, int64_t> m_navigationStarts;
+    HANDLE m_hMetricsMemory = nullptr;
+    MetricsBlock* m_pMetricsBlock = nullptr;
+    const wchar_t* m_metricsMemoryName = L"Local\\WebView2SharedMemoryMetrics";
+    void InitMetrics();
+    void PublishMetrics();
+    void CleanupMetrics();
+    void RecordDownloadMetrics(ICoreWebView2DownloadOperation* download, int64_t startMicroseconds);
+
 private:
     EventRegistrationToken m_newWindowRequestedToken; // ´¼token
 
 // ͼƬ
 private:
     bool IsInImageDownloadMode = false; //ǷͼƬ
-    std::vector<std::wstring> m_imageUrls; // 洢ͼƬURLб
-    int m_downloadCounter = 1; // ؼ
-    int m_currentDownloadIndex = 0; // ǰ
+    // Hidden tabs that load the entries after the current one (-prefetch <n>);
+    // declared first so the scheduler goes before them
+    std::vector<std::unique_ptr<Tab>> m_prefetchTabs;
+    std::vector<std::unique_ptr<WebView2Engine>> m_prefetchEngines;
+    std::unique_ptr<Prefetcher> m_prefetcher;
+    void InitPrefetcher();
+    void ReleasePrefetcher();
+    // Batch downloads: the scheduler walks the urls file through the active
+    // tab's engine and owns the download directory layout
+    std::unique_ptr<WebView2Engine> m_downloadEngine;
+    size_t m_downloadTabId = INVALID_TAB_ID;
+    std::unique_ptr<DownloadScheduler> m_downloadScheduler;
     wil::com_ptr<ICoreWebView2DownloadOperation> m_downloadOperation; // ز
     EventRegistrationToken m_downloadStartingToken; // ؿʼ¼token
     EventRegistrationToken m_downloadStateChangedToken;  // 
 
 
-    void LoadImageUrlsFromFile();
-    void SetupDownloadHandler();
-    std::wstring GetNextDownloadFilename();
-    void DownloadNextImage();
+    std::vector<std::wstring> LoadImageUrlsFromFile();
     void StartDownloadProcess();
-    void DownloadNextImageWithNavigate();
     void TriggerDownload(ICoreWebView2* webview);
+    void FinishDownloadProcess();
+
+    // Post-download pipeline stages run here instead of on the UI thread
+    std::unique_ptr<ThreadPool> m_postProcessPool;
+    std::shared_ptr<ThreadPool::Strand> m_bundleStrand;
+    std::shared_ptr<ThreadPool::Strand> m_fileOutputStrand;
+    void InitPostProcessPool();
+
+    // Batches and coalesces the text files written after each navigation
+    std::unique_ptr<FileWriter> m_fileWriter;
+
+    CookieTracker m_cookieTracker;
+    bool m_startupCookiesImported = false;
+
+    // Optional PDF/CBZ container fed with each completed page
+    BundleWriter m_bundleWriter;
+    void OpenBundle();
+    void AddDownloadToBundle(size_t pageIndex, const std::wstring& filePath, int64_t totalBytes);
 
     void SetupDownloaderHandler(const wchar_t* imagePath);
 
@@ -135,6 +292,22 @@ private:
         wchar_t HTML[1024 * 1024 * 10];  // 10MB HTML
         wchar_t cookies[1024 * 10];  // 10KB Cookie
         wchar_t imagePath[1024];  // ͼƬ·1024ַ
+        // Full cookie jar as CookieRecordHeader records, written together
+        // with cookies and CookiesReady. cookies is cut at 10KB, these are
+        // only cut when the whole jar exceeds cookieRecords.
+        uint32_t cookieRecordCount;
+        uint32_t cookieRecordBytes;
+        uint32_t cookieRecordsTruncated;  // Records that did not fit
+        uint8_t cookieRecords[1024 * 1024];
+        // Bumped each time the cookies above are republished; clients can
+        // poll it without the mutex and skip unchanged jars
+        uint32_t cookieGeneration;
+        // Cookie push from a client: cookiePushBytes of records in the
+        // cookieRecords format, imported on the next poll after which
+        // cookiePushReady is cleared
+        uint32_t cookiePushReady;
+        uint32_t cookiePushBytes;
+        uint8_t cookiePush[256 * 1024];
     };
     #pragma pack(pop)  // ָĬ϶
 
@@ -145,7 +318,7 @@ private:
     void CleanupSharedMemory();
 
 public:
-    void WriteCookiesToSharedMemory(const std::wstring& cookies);
+    void WriteCookiesToSharedMemory(const std::wstring& cookies, const std::vector<CookieView>& records);
 
 };
 
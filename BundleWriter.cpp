@@ -0,0 +1,571 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BundleWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+
+namespace
+{
+    constexpr size_t c_copyBufferSize = 64 * 1024;
+
+    constexpr uint32_t c_zipLocalHeader = 0x04034b50;
+    constexpr uint64_t c_zipLocalCrcOffset = 14;  // CRC and sizes within the local header
+    constexpr uint32_t c_zipCentralHeader = 0x02014b50;
+    constexpr uint32_t c_zipEndOfCentralDir = 0x06054b50;
+    constexpr uint32_t c_zip64EndOfCentralDir = 0x06064b50;
+    constexpr uint32_t c_zip64EndLocator = 0x07064b50;
+    // Bit 11: names are UTF-8. The CRC and sizes are patched into the local
+    // header rather than following the data, which streaming readers reject
+    // for stored entries.
+    constexpr uint16_t c_zipFlags = 1 << 11;
+
+    const std::array<uint32_t, 256>& Crc32Table()
+    {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    uint32_t Crc32Update(uint32_t crc, const char* data, size_t size)
+    {
+        const auto& table = Crc32Table();
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    struct JpegInfo
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int components = 0;
+        bool adobeInverted = false;
+    };
+
+    // Walk the JPEG marker segments up to the first start-of-frame. Only the
+    // segment headers are read, the entropy coded data is never touched.
+    bool ReadJpegInfo(std::ifstream& in, JpegInfo& info)
+    {
+        unsigned char soi[2] = {};
+        if (!in.read(reinterpret_cast<char*>(soi), 2) || soi[0] != 0xFF || soi[1] != 0xD8)
+        {
+            return false;
+        }
+
+        while (in)
+        {
+            int byte = in.get();
+            if (byte != 0xFF)
+            {
+                return false;
+            }
+            int marker = in.get();
+            while (marker == 0xFF)
+            {
+                marker = in.get();
+            }
+            if (marker == EOF || marker == 0xD9 || marker == 0xDA)
+            {
+                return false;
+            }
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                continue;  // Standalone markers have no length
+            }
+
+            unsigned char len[2] = {};
+            if (!in.read(reinterpret_cast<char*>(len), 2))
+            {
+                return false;
+            }
+            int segmentLength = (len[0] << 8) | len[1];
+            if (segmentLength < 2)
+            {
+                return false;
+            }
+
+            bool isStartOfFrame = marker >= 0xC0 && marker <= 0xCF &&
+                marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+            if (isStartOfFrame)
+            {
+                unsigned char sof[6] = {};
+                if (!in.read(reinterpret_cast<char*>(sof), 6))
+                {
+                    return false;
+                }
+                info.height = (sof[1] << 8) | sof[2];
+                info.width = (sof[3] << 8) | sof[4];
+                info.components = sof[5];
+                return info.width > 0 && info.height > 0;
+            }
+
+            if (marker == 0xEE && segmentLength >= 14)
+            {
+                // APP14 "Adobe" segment: CMYK data is stored inverted
+                char tag[5] = {};
+                in.read(tag, 5);
+                info.adobeInverted = std::string(tag, 5) == std::string("Adobe", 5);
+                in.seekg(segmentLength - 2 - 5, std::ios::cur);
+                continue;
+            }
+
+            in.seekg(segmentLength - 2, std::ios::cur);
+        }
+        return false;
+    }
+
+    bool GetDosDateTime(uint16_t& dosTime, uint16_t& dosDate)
+    {
+        std::time_t now = std::time(nullptr);
+        struct tm local = {};
+#ifdef _WIN32
+        if (localtime_s(&local, &now) != 0)
+#else
+        if (localtime_r(&now, &local) == nullptr)
+#endif
+        {
+            return false;
+        }
+        dosTime = static_cast<uint16_t>((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+        dosDate = static_cast<uint16_t>(((std::max)(local.tm_year - 80, 0) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+        return true;
+    }
+
+    std::string ToUtf8Name(const std::filesystem::path& path)
+    {
+        std::u8string name = path.filename().u8string();
+        return std::string(reinterpret_cast<const char*>(name.c_str()), name.size());
+    }
+}
+
+BundleWriter::~BundleWriter()
+{
+    if (IsOpen())
+    {
+        Finalize();
+    }
+}
+
+BundleWriter::Format BundleWriter::ParseFormat(const std::wstring& name)
+{
+    if (name == L"pdf" || name == L"PDF")
+    {
+        return Format::Pdf;
+    }
+    if (name == L"cbz" || name == L"CBZ" || name == L"zip" || name == L"ZIP")
+    {
+        return Format::Cbz;
+    }
+    return Format::None;
+}
+
+const wchar_t* BundleWriter::GetExtension(Format format)
+{
+    switch (format)
+    {
+    case Format::Pdf:
+        return L".pdf";
+    case Format::Cbz:
+        return L".cbz";
+    default:
+        return L"";
+    }
+}
+
+bool BundleWriter::Open(const std::wstring& path, Format format)
+{
+    if (IsOpen())
+    {
+        Finalize();
+    }
+    if (format == Format::None)
+    {
+        return false;
+    }
+
+    m_out.open(std::filesystem::path(path), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!m_out.is_open())
+    {
+        return false;
+    }
+
+    m_path = path;
+    m_format = format;
+    m_offset = 0;
+    m_end = 0;
+    m_nextIndex = 0;
+    m_pageCount = 0;
+    m_pending.clear();
+    m_skipped.clear();
+    m_objectOffsets.clear();
+    m_pageObjects.clear();
+    m_entries.clear();
+
+    if (m_format == Format::Pdf)
+    {
+        Write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+        // Objects 1 (catalog) and 2 (page tree) are written by Finalize
+        m_objectOffsets.assign(2, 0);
+    }
+    else
+    {
+        GetDosDateTime(m_dosTime, m_dosDate);
+    }
+    return m_out.good();
+}
+
+bool BundleWriter::AddPage(size_t index, const std::wstring& imagePath)
+{
+    if (!IsOpen() || index < m_nextIndex)
+    {
+        return false;
+    }
+    m_pending[index] = imagePath;
+    return DrainReady();
+}
+
+void BundleWriter::SkipPage(size_t index)
+{
+    if (!IsOpen() || index < m_nextIndex)
+    {
+        return;
+    }
+    m_skipped.insert(index);
+    DrainReady();
+}
+
+bool BundleWriter::DrainReady()
+{
+    bool ok = true;
+    for (;;)
+    {
+        if (m_skipped.erase(m_nextIndex) > 0)
+        {
+            m_nextIndex++;
+            continue;
+        }
+        auto it = m_pending.find(m_nextIndex);
+        if (it == m_pending.end())
+        {
+            break;
+        }
+        ok = WritePage(it->second) && ok;
+        m_pending.erase(it);
+        m_nextIndex++;
+    }
+    return ok;
+}
+
+bool BundleWriter::WritePage(const std::wstring& imagePath)
+{
+    bool written = m_format == Format::Pdf ? WritePdfPage(imagePath) : WriteZipEntry(imagePath);
+    if (written)
+    {
+        m_pageCount++;
+    }
+    return written;
+}
+
+bool BundleWriter::Finalize()
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    // Pages that never got a predecessor are still kept, in index order
+    for (auto& page : m_pending)
+    {
+        WritePage(page.second);
+    }
+    m_pending.clear();
+    m_skipped.clear();
+
+    bool ok = m_format == Format::Pdf ? FinalizePdf() : FinalizeZip();
+    m_out.close();
+    m_format = Format::None;
+    if (m_end > m_offset)
+    {
+        // A page was rolled back and the trailer did not cover it
+        std::error_code ec;
+        std::filesystem::resize_file(m_path, m_offset, ec);
+        ok = ok && !ec;
+    }
+    return ok;
+}
+
+void BundleWriter::Write(const void* data, size_t size)
+{
+    m_out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_offset += size;
+    m_end = (std::max)(m_end, m_offset);
+}
+
+void BundleWriter::Seek(uint64_t offset)
+{
+    m_out.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+    m_offset = offset;
+}
+
+void BundleWriter::Write(const std::string& text)
+{
+    Write(text.data(), text.size());
+}
+
+void BundleWriter::WriteLE(uint64_t value, int bytes)
+{
+    char buffer[8];
+    for (int i = 0; i < bytes; ++i)
+    {
+        buffer[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+    Write(buffer, bytes);
+}
+
+uint32_t BundleWriter::BeginPdfObject()
+{
+    m_objectOffsets.push_back(m_offset);
+    uint32_t number = static_cast<uint32_t>(m_objectOffsets.size());
+    Write(std::to_string(number) + " 0 obj\n");
+    return number;
+}
+
+bool BundleWriter::WritePdfPage(const std::wstring& imagePath)
+{
+    std::error_code ec;
+    std::filesystem::path path(imagePath);
+    uint64_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec || fileSize == 0)
+    {
+        return false;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    JpegInfo info;
+    if (!in.is_open() || !ReadJpegInfo(in, info))
+    {
+        // Only baseline/progressive JPEGs can be embedded without re-encoding
+        return false;
+    }
+
+    const char* colorSpace = info.components == 1 ? "/DeviceGray" :
+                             info.components == 4 ? "/DeviceCMYK" : "/DeviceRGB";
+    std::string width = std::to_string(info.width);
+    std::string height = std::to_string(info.height);
+
+    const uint64_t pageStart = m_offset;
+    uint32_t imageObject = BeginPdfObject();
+    std::string dict = "<< /Type /XObject /Subtype /Image /Width " + width + " /Height " + height +
+        " /ColorSpace " + colorSpace + " /BitsPerComponent 8 /Filter /DCTDecode";
+    if (info.components == 4 && info.adobeInverted)
+    {
+        dict += " /Decode [1 0 1 0 1 0 1 0]";
+    }
+    dict += " /Length " + std::to_string(fileSize) + " >>\nstream\n";
+    Write(dict);
+
+    in.clear();
+    in.seekg(0, std::ios::beg);
+    std::vector<char> buffer(c_copyBufferSize);
+    uint64_t copied = 0;
+    while (copied < fileSize)
+    {
+        in.read(buffer.data(), buffer.size());
+        if (in.gcount() <= 0)
+        {
+            break;
+        }
+        size_t got = static_cast<size_t>((std::min<uint64_t>)(static_cast<uint64_t>(in.gcount()), fileSize - copied));
+        Write(buffer.data(), got);
+        copied += got;
+    }
+    if (copied != fileSize)
+    {
+        // The /Length is already out; drop the partial object so it does not
+        // corrupt the file, the next page or the trailer overwrites it
+        m_objectOffsets.pop_back();
+        Seek(pageStart);
+        return false;
+    }
+    Write("\nendstream\nendobj\n");
+
+    // One image per page, scaled to the page at 72 dpi
+    std::string content = "q " + width + " 0 0 " + height + " 0 0 cm /Im0 Do Q\n";
+    uint32_t contentObject = BeginPdfObject();
+    Write("<< /Length " + std::to_string(content.size()) + " >>\nstream\n" + content + "endstream\nendobj\n");
+
+    uint32_t pageObject = BeginPdfObject();
+    Write("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " + width + " " + height + "]"
+        " /Resources << /XObject << /Im0 " + std::to_string(imageObject) + " 0 R >> >>"
+        " /Contents " + std::to_string(contentObject) + " 0 R >>\nendobj\n");
+    m_pageObjects.push_back(pageObject);
+
+    return m_out.good();
+}
+
+bool BundleWriter::FinalizePdf()
+{
+    m_objectOffsets[1] = m_offset;
+    std::string kids;
+    for (uint32_t page : m_pageObjects)
+    {
+        kids += std::to_string(page) + " 0 R ";
+    }
+    Write("2 0 obj\n<< /Type /Pages /Kids [" + kids + "] /Count " + std::to_string(m_pageObjects.size()) + " >>\nendobj\n");
+
+    m_objectOffsets[0] = m_offset;
+    Write("1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+
+    uint64_t xrefOffset = m_offset;
+    std::string xref = "xref\n0 " + std::to_string(m_objectOffsets.size() + 1) + "\n0000000000 65535 f \n";
+    for (uint64_t offset : m_objectOffsets)
+    {
+        char entry[32];
+        snprintf(entry, sizeof(entry), "%010llu 00000 n \n", static_cast<unsigned long long>(offset));
+        xref += entry;
+    }
+    Write(xref);
+    Write("trailer\n<< /Size " + std::to_string(m_objectOffsets.size() + 1) + " /Root 1 0 R >>\nstartxref\n" +
+        std::to_string(xrefOffset) + "\n%%EOF\n");
+
+    return m_out.good();
+}
+
+bool BundleWriter::WriteZipEntry(const std::wstring& imagePath)
+{
+    std::filesystem::path path(imagePath);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+    {
+        return false;
+    }
+
+    ZipEntry entry;
+    entry.name = ToUtf8Name(path);
+    entry.offset = m_offset;
+
+    WriteLE(c_zipLocalHeader, 4);
+    WriteLE(20, 2);             // Version needed to extract
+    WriteLE(c_zipFlags, 2);
+    WriteLE(0, 2);              // Stored, no compression
+    WriteLE(m_dosTime, 2);
+    WriteLE(m_dosDate, 2);
+    WriteLE(0, 4);              // CRC and sizes, patched below
+    WriteLE(0, 4);
+    WriteLE(0, 4);
+    WriteLE(entry.name.size(), 2);
+    WriteLE(0, 2);
+    Write(entry.name);
+
+    std::vector<char> buffer(c_copyBufferSize);
+    while (in.read(buffer.data(), buffer.size()), in.gcount() > 0)
+    {
+        size_t got = static_cast<size_t>(in.gcount());
+        entry.crc = Crc32Update(entry.crc, buffer.data(), got);
+        entry.size += got;
+        Write(buffer.data(), got);
+    }
+    if (in.bad())
+    {
+        Seek(entry.offset);
+        return false;
+    }
+
+    const uint64_t end = m_offset;
+    Seek(entry.offset + c_zipLocalCrcOffset);
+    WriteLE(entry.crc, 4);
+    WriteLE(entry.size, 4);
+    WriteLE(entry.size, 4);
+    Seek(end);
+
+    m_entries.push_back(std::move(entry));
+    return m_out.good();
+}
+
+bool BundleWriter::FinalizeZip()
+{
+    uint64_t centralDirOffset = m_offset;
+    for (const ZipEntry& entry : m_entries)
+    {
+        bool needsZip64 = entry.offset >= 0xFFFFFFFFull;
+
+        WriteLE(c_zipCentralHeader, 4);
+        WriteLE(needsZip64 ? 45 : 20, 2);  // Version made by
+        WriteLE(needsZip64 ? 45 : 20, 2);  // Version needed to extract
+        WriteLE(c_zipFlags, 2);
+        WriteLE(0, 2);
+        WriteLE(m_dosTime, 2);
+        WriteLE(m_dosDate, 2);
+        WriteLE(entry.crc, 4);
+        WriteLE(entry.size, 4);
+        WriteLE(entry.size, 4);
+        WriteLE(entry.name.size(), 2);
+        WriteLE(needsZip64 ? 12 : 0, 2);  // Extra field length
+        WriteLE(0, 2);                     // Comment length
+        WriteLE(0, 2);                     // Disk number
+        WriteLE(0, 2);                     // Internal attributes
+        WriteLE(0, 4);                     // External attributes
+        WriteLE(needsZip64 ? 0xFFFFFFFFull : entry.offset, 4);
+        Write(entry.name);
+        if (needsZip64)
+        {
+            WriteLE(0x0001, 2);
+            WriteLE(8, 2);
+            WriteLE(entry.offset, 8);
+        }
+    }
+    uint64_t centralDirSize = m_offset - centralDirOffset;
+    uint64_t entryCount = m_entries.size();
+
+    bool needsZip64End = entryCount >= 0xFFFF || centralDirOffset >= 0xFFFFFFFFull;
+    if (needsZip64End)
+    {
+        uint64_t zip64EndOffset = m_offset;
+        WriteLE(c_zip64EndOfCentralDir, 4);
+        WriteLE(44, 8);  // Size of the remaining record
+        WriteLE(45, 2);
+        WriteLE(45, 2);
+        WriteLE(0, 4);
+        WriteLE(0, 4);
+        WriteLE(entryCount, 8);
+        WriteLE(entryCount, 8);
+        WriteLE(centralDirSize, 8);
+        WriteLE(centralDirOffset, 8);
+
+        WriteLE(c_zip64EndLocator, 4);
+        WriteLE(0, 4);
+        WriteLE(zip64EndOffset, 8);
+        WriteLE(1, 4);
+    }
+
+    WriteLE(c_zipEndOfCentralDir, 4);
+    WriteLE(0, 2);
+    WriteLE(0, 2);
+    WriteLE(needsZip64End ? 0xFFFF : entryCount, 2);
+    WriteLE(needsZip64End ? 0xFFFF : entryCount, 2);
+    WriteLE(needsZip64End ? 0xFFFFFFFFull : centralDirSize, 4);
+    WriteLE(needsZip64End ? 0xFFFFFFFFull : centralDirOffset, 4);
+    WriteLE(0, 2);
+
+    return m_out.good();
+}
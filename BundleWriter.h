@@ -0,0 +1,88 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Streams finished pages of an image batch into a single PDF or CBZ
+// container. Pages are appended as soon as they are reported and are
+// written strictly in download-index order; only the file paths of pages
+// that arrive early are buffered, page bytes are copied through a fixed
+// size buffer so memory stays bounded regardless of page size.
+class BundleWriter
+{
+public:
+    enum class Format
+    {
+        None,
+        Pdf,
+        Cbz
+    };
+
+    ~BundleWriter();
+
+    static Format ParseFormat(const std::wstring& name);
+    static const wchar_t* GetExtension(Format format);
+
+    bool Open(const std::wstring& path, Format format);
+    bool IsOpen() const { return m_format != Format::None; }
+
+    // Report a verified page. Returns false if the page could not be written.
+    bool AddPage(size_t index, const std::wstring& imagePath);
+    // Report a page that will never arrive so later pages are not held back.
+    void SkipPage(size_t index);
+    // Write any remaining pages and the container trailer.
+    bool Finalize();
+
+private:
+    struct ZipEntry
+    {
+        std::string name;
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        uint64_t offset = 0;
+    };
+
+    bool DrainReady();
+    bool WritePage(const std::wstring& imagePath);
+    bool WritePdfPage(const std::wstring& imagePath);
+    bool WriteZipEntry(const std::wstring& imagePath);
+    bool FinalizePdf();
+    bool FinalizeZip();
+
+    void Write(const void* data, size_t size);
+    void Write(const std::string& text);
+    void WriteLE(uint64_t value, int bytes);
+    // Moves the write position, e.g. back over a page that failed; Finalize
+    // cuts the file to the last position written.
+    void Seek(uint64_t offset);
+    uint32_t BeginPdfObject();
+
+    Format m_format = Format::None;
+    std::filesystem::path m_path;
+    std::ofstream m_out;
+    uint64_t m_offset = 0;
+    uint64_t m_end = 0;  // Furthest offset ever written
+
+    size_t m_nextIndex = 0;
+    std::map<size_t, std::wstring> m_pending;  // Early pages, keyed by download index
+    std::set<size_t> m_skipped;
+    uint32_t m_pageCount = 0;
+
+    // PDF state: object offsets by object number (1-based) and page objects
+    std::vector<uint64_t> m_objectOffsets;
+    std::vector<uint32_t> m_pageObjects;
+
+    // CBZ state
+    std::vector<ZipEntry> m_entries;
+    uint16_t m_dosTime = 0;
+    uint16_t m_dosDate = 0;
+};
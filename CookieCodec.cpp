@@ -0,0 +1,346 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CookieCodec.h"
+#include "JsonString.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+
+namespace
+{
+    // Quotes, booleans, the expiry, tabs and the same-site name
+    constexpr size_t c_fixedLineLength = 96;
+    constexpr size_t c_recordAlignment = 8;
+
+    const wchar_t* SameSiteName(CookieSameSite sameSite)
+    {
+        switch (sameSite)
+        {
+        case CookieSameSite::Lax:
+            return L"Lax";
+        case CookieSameSite::Strict:
+            return L"Strict";
+        default:
+            return L"None";
+        }
+    }
+
+    void AppendBool(std::wstring& out, bool value)
+    {
+        out += value ? L"true" : L"false";
+    }
+
+    CookieSameSite ParseSameSite(std::wstring_view name)
+    {
+        if (name == L"Lax")
+        {
+            return CookieSameSite::Lax;
+        }
+        if (name == L"Strict")
+        {
+            return CookieSameSite::Strict;
+        }
+        return CookieSameSite::None;
+    }
+
+    bool ParseBool(std::wstring_view text)
+    {
+        // "true" in cookie.txt, "TRUE" in Netscape files
+        return text == L"true" || text == L"TRUE";
+    }
+
+    double ParseNumber(std::wstring_view text)
+    {
+        std::wstring number(text);
+        return std::wcstod(number.c_str(), nullptr);
+    }
+
+    // Splits line at tabs into at most count fields; returns the number found
+    size_t SplitFields(std::wstring_view line, std::wstring_view* fields, size_t count)
+    {
+        size_t found = 0;
+        while (found < count)
+        {
+            size_t tab = line.find(L'\t');
+            fields[found++] = line.substr(0, tab);
+            if (tab == std::wstring_view::npos)
+            {
+                break;
+            }
+            line.remove_prefix(tab + 1);
+        }
+        return found;
+    }
+
+    void CopyUnits(uint8_t*& out, std::wstring_view text)
+    {
+        std::memcpy(out, text.data(), text.size() * sizeof(wchar_t));
+        out += text.size() * sizeof(wchar_t);
+    }
+}
+
+Cookie::Cookie(const CookieView& view)
+    : name(view.name), value(view.value), domain(view.domain), path(view.path), expires(view.expires),
+    httpOnly(view.httpOnly), secure(view.secure), session(view.session), sameSite(view.sameSite)
+{
+}
+
+CookieView Cookie::GetView() const
+{
+    CookieView view;
+    view.name = name;
+    view.value = value;
+    view.domain = domain;
+    view.path = path;
+    view.expires = expires;
+    view.httpOnly = httpOnly;
+    view.secure = secure;
+    view.session = session;
+    view.sameSite = sameSite;
+    return view;
+}
+
+size_t CookieCodec::GetTextLineCapacity(const CookieView& cookie)
+{
+    // Exact unless a string needs JSON escapes, which only costs a regrow
+    return c_fixedLineLength + cookie.name.size() + cookie.value.size() + cookie.domain.size() + cookie.path.size();
+}
+
+// See https://curl.se/docs/http-cookies.html
+//Field number, what type and example data and the meaning of it:
+//0. string example.com - the domain name
+//1. boolean FALSE - include subdomains
+//2. string /foobar/ - path
+//3. boolean TRUE - send/receive over HTTPS only
+//4. number 1462299217 - expires at - seconds since Jan 1st 1970, or 0
+//5. string person - name of the cookie
+//6. string daniel - value of the cookie
+//7. boolean FALSE - isSecure
+//8. string None - Same site
+void CookieCodec::AppendTextLine(std::wstring& out, const CookieView& cookie)
+{
+    JsonString::AppendQuoted(out, cookie.domain);
+    out += L'\t';
+    AppendBool(out, cookie.domain.starts_with(L'.'));
+    out += L'\t';
+    JsonString::AppendQuoted(out, cookie.path);
+    out += L'\t';
+    AppendBool(out, cookie.httpOnly);
+    out += L'\t';
+    if (cookie.session)
+    {
+        out += L"#HttpOnly_";
+    }
+    else
+    {
+        wchar_t expires[64];
+        int length = std::swprintf(expires, sizeof(expires) / sizeof(expires[0]), L"%f", cookie.expires);
+        out.append(expires, length > 0 ? static_cast<size_t>(length) : 0);
+    }
+    out += L'\t';
+    JsonString::AppendQuoted(out, cookie.name);
+    out += L'\t';
+    JsonString::AppendQuoted(out, cookie.value);
+    out += L'\t';
+    AppendBool(out, cookie.secure);
+    out += L'\t';
+    JsonString::AppendQuoted(out, SameSiteName(cookie.sameSite));
+    out += L'\t';
+}
+
+std::wstring CookieCodec::ToText(const std::vector<CookieView>& cookies, std::wstring_view uri)
+{
+    std::wstring result;
+    if (cookies.empty())
+    {
+        result = L"#No cookies found.";
+        return result;
+    }
+
+    size_t capacity = 160 + uri.size();
+    for (const CookieView& cookie : cookies)
+    {
+        capacity += GetTextLineCapacity(cookie) + 1;
+    }
+    result.reserve(capacity);
+
+    result += L"#";
+    result += std::to_wstring(cookies.size());
+    result += L" cookie(s) found";
+    if (!uri.empty())
+    {
+        result += L" on ";
+        result += uri;
+    }
+    result += L"\n#domain\t  subdomains\t  path\t  HTTPS only\t  expires\t  name\t  value\t secure\t  Same site\n\n";
+    for (size_t i = 0; i < cookies.size(); ++i)
+    {
+        AppendTextLine(result, cookies[i]);
+        if (i != cookies.size() - 1)
+        {
+            result += L'\n';
+        }
+    }
+    result += L'\n';
+    return result;
+}
+
+size_t CookieCodec::ParseText(std::wstring_view text, std::vector<Cookie>& cookies)
+{
+    size_t parsed = 0;
+    while (!text.empty())
+    {
+        size_t newline = text.find(L'\n');
+        std::wstring_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::wstring_view::npos ? text.size() : newline + 1);
+        if (!line.empty() && line.back() == L'\r')
+        {
+            line.remove_suffix(1);
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+
+        Cookie cookie;
+        bool valid = line.front() == L'"' ? ParseAppLine(line, cookie) : ParseNetscapeLine(line, cookie);
+        if (valid && !cookie.name.empty() && !cookie.domain.empty())
+        {
+            cookies.push_back(std::move(cookie));
+            parsed++;
+        }
+    }
+    return parsed;
+}
+
+// "domain"  subdomains  "path"  httpOnly  expires|#HttpOnly_  "name"  "value"  secure  "sameSite"
+bool CookieCodec::ParseAppLine(std::wstring_view line, Cookie& cookie)
+{
+    std::wstring_view fields[9];
+    if (SplitFields(line, fields, 9) < 9)
+    {
+        return false;
+    }
+    if (!JsonString::Unquote(fields[0], cookie.domain) || !JsonString::Unquote(fields[2], cookie.path) ||
+        !JsonString::Unquote(fields[5], cookie.name) || !JsonString::Unquote(fields[6], cookie.value))
+    {
+        return false;
+    }
+    std::wstring sameSite;
+    if (JsonString::Unquote(fields[8], sameSite))
+    {
+        cookie.sameSite = ParseSameSite(sameSite);
+    }
+    cookie.httpOnly = ParseBool(fields[3]);
+    cookie.session = fields[4] == L"#HttpOnly_";
+    cookie.expires = cookie.session ? 0 : ParseNumber(fields[4]);
+    cookie.secure = ParseBool(fields[7]);
+    return true;
+}
+
+// [#HttpOnly_]domain  subdomains  path  secure  expires  name  value
+bool CookieCodec::ParseNetscapeLine(std::wstring_view line, Cookie& cookie)
+{
+    constexpr std::wstring_view httpOnlyPrefix = L"#HttpOnly_";
+    if (line.starts_with(httpOnlyPrefix))
+    {
+        cookie.httpOnly = true;
+        line.remove_prefix(httpOnlyPrefix.size());
+    }
+    else if (line.front() == L'#')
+    {
+        return false;
+    }
+
+    std::wstring_view fields[7];
+    if (SplitFields(line, fields, 7) < 7)
+    {
+        return false;
+    }
+    cookie.domain = fields[0];
+    cookie.path = fields[2];
+    cookie.secure = ParseBool(fields[3]);
+    cookie.expires = ParseNumber(fields[4]);
+    cookie.session = cookie.expires <= 0;
+    cookie.name = fields[5];
+    cookie.value = fields[6];
+    // The format predates SameSite; Lax is what browsers assume when unset
+    cookie.sameSite = CookieSameSite::Lax;
+    return true;
+}
+
+size_t CookieCodec::GetRecordSize(const CookieView& cookie)
+{
+    size_t size = sizeof(CookieRecordHeader) +
+        (cookie.name.size() + cookie.value.size() + cookie.domain.size() + cookie.path.size()) * sizeof(wchar_t);
+    return (size + c_recordAlignment - 1) & ~(c_recordAlignment - 1);
+}
+
+size_t CookieCodec::WriteRecord(uint8_t* out, size_t capacity, const CookieView& cookie)
+{
+    size_t size = GetRecordSize(cookie);
+    if (size > capacity || size > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    CookieRecordHeader header = {};
+    header.size = static_cast<uint32_t>(size);
+    header.flags = (cookie.httpOnly ? CookieRecordHeader::c_httpOnly : 0) |
+        (cookie.secure ? CookieRecordHeader::c_secure : 0) |
+        (cookie.session ? CookieRecordHeader::c_session : 0);
+    header.expires = cookie.expires;
+    header.nameLength = static_cast<uint32_t>(cookie.name.size());
+    header.valueLength = static_cast<uint32_t>(cookie.value.size());
+    header.domainLength = static_cast<uint32_t>(cookie.domain.size());
+    header.pathLength = static_cast<uint32_t>(cookie.path.size());
+    header.sameSite = static_cast<uint8_t>(cookie.sameSite);
+
+    uint8_t* cursor = out;
+    std::memcpy(cursor, &header, sizeof(header));
+    cursor += sizeof(header);
+    CopyUnits(cursor, cookie.name);
+    CopyUnits(cursor, cookie.value);
+    CopyUnits(cursor, cookie.domain);
+    CopyUnits(cursor, cookie.path);
+    std::memset(cursor, 0, out + size - cursor);
+    return size;
+}
+
+bool CookieCodec::ReadRecord(const uint8_t*& cursor, const uint8_t* end, CookieView& cookie)
+{
+    if (static_cast<size_t>(end - cursor) < sizeof(CookieRecordHeader))
+    {
+        return false;
+    }
+
+    CookieRecordHeader header;
+    std::memcpy(&header, cursor, sizeof(header));
+    uint64_t units = static_cast<uint64_t>(header.nameLength) + header.valueLength + header.domainLength + header.pathLength;
+    if (header.size < sizeof(header) || header.size > static_cast<size_t>(end - cursor) ||
+        units > (header.size - sizeof(header)) / sizeof(wchar_t))
+    {
+        return false;
+    }
+
+    const wchar_t* text = reinterpret_cast<const wchar_t*>(cursor + sizeof(header));
+    cookie.name = std::wstring_view(text, header.nameLength);
+    text += header.nameLength;
+    cookie.value = std::wstring_view(text, header.valueLength);
+    text += header.valueLength;
+    cookie.domain = std::wstring_view(text, header.domainLength);
+    text += header.domainLength;
+    cookie.path = std::wstring_view(text, header.pathLength);
+    cookie.expires = header.expires;
+    cookie.httpOnly = (header.flags & CookieRecordHeader::c_httpOnly) != 0;
+    cookie.secure = (header.flags & CookieRecordHeader::c_secure) != 0;
+    cookie.session = (header.flags & CookieRecordHeader::c_session) != 0;
+    cookie.sameSite = header.sameSite <= static_cast<uint8_t>(CookieSameSite::Strict) ?
+        static_cast<CookieSameSite>(header.sameSite) : CookieSameSite::None;
+
+    cursor += header.size;
+    return true;
+}
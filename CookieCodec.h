@@ -0,0 +1,104 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class CookieSameSite : uint8_t
+{
+    None,
+    Lax,
+    Strict
+};
+
+// One cookie with its strings borrowed from whoever owns them (COM task
+// memory, a cookie file or a shared memory record).
+struct CookieView
+{
+    std::wstring_view name;
+    std::wstring_view value;
+    std::wstring_view domain;
+    std::wstring_view path;
+    double expires = 0;  // Seconds since 1970, ignored for session cookies
+    bool httpOnly = false;
+    bool secure = false;
+    bool session = false;
+    CookieSameSite sameSite = CookieSameSite::None;
+};
+
+// A cookie that owns its strings, e.g. one read from a cookie file.
+struct Cookie
+{
+    std::wstring name;
+    std::wstring value;
+    std::wstring domain;
+    std::wstring path;
+    double expires = 0;
+    bool httpOnly = false;
+    bool secure = false;
+    bool session = false;
+    CookieSameSite sameSite = CookieSameSite::None;
+
+    Cookie() = default;
+    explicit Cookie(const CookieView& view);
+    CookieView GetView() const;
+};
+
+// Header of a binary cookie record. The record is the header followed by
+// the name, value, domain and path as wchar_t units (UTF-16 on Windows),
+// not NUL terminated, padded to a multiple of 8 bytes.
+#pragma pack(push, 1)
+struct CookieRecordHeader
+{
+    static constexpr uint32_t c_httpOnly = 1;
+    static constexpr uint32_t c_secure = 2;
+    static constexpr uint32_t c_session = 4;
+
+    uint32_t size;      // Whole record including header and padding
+    uint32_t flags;
+    double expires;
+    uint32_t nameLength;
+    uint32_t valueLength;
+    uint32_t domainLength;
+    uint32_t pathLength;
+    uint8_t sameSite;   // CookieSameSite
+    uint8_t reserved[7];
+};
+#pragma pack(pop)
+
+// Serializes cookies to the curl-style cookie.txt text and to length-
+// prefixed binary records. Both are written into buffers sized up front,
+// one cookie at a time, without temporaries.
+class CookieCodec
+{
+public:
+    // The whole cookie.txt document: comment header plus one line per cookie.
+    static std::wstring ToText(const std::vector<CookieView>& cookies, std::wstring_view uri);
+    static void AppendTextLine(std::wstring& out, const CookieView& cookie);
+
+    // Parses cookie.txt as written by ToText or a Netscape/curl cookie file,
+    // one format per line. Comments and malformed lines are skipped. Returns
+    // the number of cookies appended.
+    static size_t ParseText(std::wstring_view text, std::vector<Cookie>& cookies);
+
+    static size_t GetRecordSize(const CookieView& cookie);
+
+    // Writes one record at out. Returns the bytes written, 0 when it does
+    // not fit in capacity.
+    static size_t WriteRecord(uint8_t* out, size_t capacity, const CookieView& cookie);
+
+    // Reads the record at cursor and advances past it. The views point into
+    // the buffer. Returns false at the end or on a malformed record.
+    static bool ReadRecord(const uint8_t*& cursor, const uint8_t* end, CookieView& cookie);
+
+private:
+    static bool ParseAppLine(std::wstring_view line, Cookie& cookie);
+    static bool ParseNetscapeLine(std::wstring_view line, Cookie& cookie);
+    static size_t GetTextLineCapacity(const CookieView& cookie);
+};
@@ -0,0 +1,133 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CookieTracker.h"
+#include "UrlParser.h"
+
+namespace
+{
+    // FNV-1a, 64-bit
+    constexpr uint64_t c_fnvOffset = 14695981039346656037ull;
+    constexpr uint64_t c_fnvPrime = 1099511628211ull;
+
+    uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * c_fnvPrime;
+        }
+        return hash;
+    }
+
+    uint64_t HashText(uint64_t hash, std::wstring_view text)
+    {
+        // The length keeps ("ab", "c") and ("a", "bc") apart
+        uint64_t length = text.size();
+        hash = HashBytes(hash, &length, sizeof(length));
+        return HashBytes(hash, text.data(), text.size() * sizeof(wchar_t));
+    }
+
+    // Finalizer from MurmurHash3, so the jar hash can simply add them up
+    uint64_t Mix(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+}
+
+std::wstring CookieTracker::GetOrigin(std::wstring_view uri)
+{
+    UrlParts parts = UrlParser::Parse(uri);
+    std::wstring origin;
+    origin.reserve(parts.scheme.size() + parts.host.size() + parts.port.size() + 4);
+    origin.append(parts.scheme).append(L"://").append(parts.host);
+    if (!parts.port.empty())
+    {
+        origin.append(L":").append(parts.port);
+    }
+    return origin;
+}
+
+CookieTracker::Delta CookieTracker::Update(std::wstring_view uri, const std::vector<CookieView>& cookies)
+{
+    std::wstring origin = GetOrigin(uri);
+    Delta delta;
+    delta.originChanged = !m_published || origin != m_publishedOrigin;
+
+    Snapshot current;
+    current.cookies.reserve(cookies.size());
+    for (const CookieView& cookie : cookies)
+    {
+        // A cookie is identified by name, domain and path, like in the jar
+        uint64_t identity = HashText(HashText(HashText(c_fnvOffset, cookie.domain), cookie.path), cookie.name);
+        uint64_t content = HashText(identity, cookie.value);
+        uint8_t flags[4] = { cookie.httpOnly, cookie.secure, cookie.session, static_cast<uint8_t>(cookie.sameSite) };
+        content = HashBytes(content, flags, sizeof(flags));
+        content = HashBytes(content, &cookie.expires, sizeof(cookie.expires));
+        content = Mix(content);
+        if (current.cookies.emplace(identity, content).second)
+        {
+            current.hash += content;
+        }
+    }
+
+    auto found = m_snapshots.find(origin);
+    if (found == m_snapshots.end())
+    {
+        delta.added = current.cookies.size();
+        if (m_snapshots.size() >= c_maxOrigins)
+        {
+            // Long crawls touch many origins; starting over only costs one
+            // extra publish per origin
+            m_snapshots.clear();
+        }
+        m_snapshots.emplace(std::move(origin), std::move(current));
+        return delta;
+    }
+
+    Snapshot& previous = found->second;
+    if (previous.hash == current.hash && previous.cookies.size() == current.cookies.size())
+    {
+        return delta;
+    }
+
+    size_t kept = 0;
+    for (const auto& [identity, content] : current.cookies)
+    {
+        auto old = previous.cookies.find(identity);
+        if (old == previous.cookies.end())
+        {
+            delta.added++;
+        }
+        else
+        {
+            kept++;
+            if (old->second != content)
+            {
+                delta.changed++;
+            }
+        }
+    }
+    delta.removed = previous.cookies.size() - kept;
+    previous = std::move(current);
+    return delta;
+}
+
+void CookieTracker::MarkPublished(std::wstring_view uri)
+{
+    m_publishedOrigin = GetOrigin(uri);
+    m_published = true;
+}
+
+void CookieTracker::Reset()
+{
+    m_snapshots.clear();
+    m_publishedOrigin.clear();
+    m_published = false;
+}
@@ -0,0 +1,56 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "CookieCodec.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Remembers the last cookie jar seen for each origin as one hash per cookie,
+// so a fetch can be diffed against it and published only when something
+// changed. The snapshot is a few bytes per cookie; the strings themselves
+// are not kept.
+class CookieTracker
+{
+public:
+    struct Delta
+    {
+        size_t added = 0;
+        size_t changed = 0;
+        size_t removed = 0;
+        bool originChanged = false;  // The last publish was for another origin
+
+        bool IsEmpty() const { return added == 0 && changed == 0 && removed == 0; }
+        // Whether the published copy (cookie.txt, shared memory) is stale
+        bool NeedsPublish() const { return originChanged || !IsEmpty(); }
+    };
+
+    // Diffs cookies against the snapshot of uri's origin and replaces it.
+    Delta Update(std::wstring_view uri, const std::vector<CookieView>& cookies);
+
+    // Call after the jar of uri was published.
+    void MarkPublished(std::wstring_view uri);
+    // Forget everything, e.g. after the cookies were cleared.
+    void Reset();
+
+private:
+    static constexpr size_t c_maxOrigins = 256;
+
+    struct Snapshot
+    {
+        std::unordered_map<uint64_t, uint64_t> cookies;  // Identity hash -> content hash
+        uint64_t hash = 0;                               // Order independent jar hash
+    };
+
+    static std::wstring GetOrigin(std::wstring_view uri);
+
+    std::unordered_map<std::wstring, Snapshot> m_snapshots;
+    std::wstring m_publishedOrigin;
+    bool m_published = false;
+};
@@ -0,0 +1,68 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+
+// Compile-time and run-time selection of the SIMD kernels. SSE2 is part of
+// the x64 baseline and NEON of AArch64, AVX2 is only used when the CPU and
+// the OS both support it.
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BOOKGET_SSE2 1
+#define BOOKGET_AVX2 1
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define BOOKGET_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Marks a function that may use AVX2 intrinsics; only call it when
+// CpuHasAvx2() returned true.
+#if defined(BOOKGET_AVX2) && !defined(_MSC_VER)
+#define BOOKGET_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BOOKGET_TARGET_AVX2
+#endif
+
+// Index of the lowest set bit; mask must not be zero.
+inline int CountTrailingZeros(uint64_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+inline bool CpuHasAvx2()
+{
+#if defined(BOOKGET_AVX2)
+    static const bool hasAvx2 = []() {
+#if defined(_MSC_VER)
+        int info[4] = {};
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }();
+    return hasAvx2;
+#else
+    return false;
+#endif
+}
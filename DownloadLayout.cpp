@@ -0,0 +1,142 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "DownloadLayout.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define LAYOUT_SEPARATOR L"\\"
+#else
+#define LAYOUT_SEPARATOR L"/"
+#endif
+
+DownloadLayout::Mode DownloadLayout::ParseMode(const std::wstring& name)
+{
+    if (name == L"job")
+    {
+        return Mode::Job;
+    }
+    if (name == L"hash")
+    {
+        return Mode::Hash;
+    }
+    if (name == L"range")
+    {
+        return Mode::Range;
+    }
+    return Mode::Flat;
+}
+
+void DownloadLayout::Configure(const std::wstring& rootDirectory, Mode mode, const std::wstring& jobName,
+    size_t queueLength, size_t filesPerShard)
+{
+    m_mode = mode;
+    m_filesPerShard = (std::max<size_t>)(filesPerShard, 1);
+    m_jobDirectory = rootDirectory;
+    if (m_mode != Mode::Flat && !jobName.empty())
+    {
+        m_jobDirectory += LAYOUT_SEPARATOR + jobName;
+    }
+
+    // At least four digits, as before, and enough for the whole queue
+    m_width = 4;
+    for (size_t n = queueLength; n >= 10000; n /= 10)
+    {
+        m_width++;
+    }
+
+    m_createdDirectories.clear();
+}
+
+std::wstring DownloadLayout::GetPath(size_t index, const std::wstring& extension)
+{
+    std::wstring fileName = FormatNumber(index + 1) + extension;
+    std::wstring directory = GetShardDirectory(index, fileName);
+    if (!EnsureDirectory(directory))
+    {
+        // Fall back to the job directory rather than losing the page
+        directory = m_jobDirectory;
+        EnsureDirectory(directory);
+    }
+    return directory + LAYOUT_SEPARATOR + fileName;
+}
+
+std::wstring DownloadLayout::FormatNumber(size_t number) const
+{
+    std::wstring digits = std::to_wstring(number);
+    if (digits.size() < static_cast<size_t>(m_width))
+    {
+        digits.insert(0, m_width - digits.size(), L'0');
+    }
+    return digits;
+}
+
+std::wstring DownloadLayout::GetShardDirectory(size_t index, const std::wstring& fileName) const
+{
+    switch (m_mode)
+    {
+    case Mode::Hash:
+    {
+        // FNV-1a over the file name, 256 buckets named by the low byte
+        uint32_t hash = 2166136261u;
+        for (wchar_t c : fileName)
+        {
+            hash = (hash ^ static_cast<uint32_t>(c)) * 16777619u;
+        }
+        static const wchar_t hex[] = L"0123456789abcdef";
+        wchar_t bucket[3] = { hex[(hash >> 4) & 0xF], hex[hash & 0xF], 0 };
+        return m_jobDirectory + LAYOUT_SEPARATOR + bucket;
+    }
+    case Mode::Range:
+    {
+        size_t first = (index / m_filesPerShard) * m_filesPerShard + 1;
+        return m_jobDirectory + LAYOUT_SEPARATOR + FormatNumber(first) + L"-" + FormatNumber(first + m_filesPerShard - 1);
+    }
+    default:
+        return m_jobDirectory;
+    }
+}
+
+bool DownloadLayout::EnsureDirectory(const std::wstring& directory)
+{
+    // Each directory is created once per job instead of once per file
+    if (m_createdDirectories.count(directory) > 0)
+    {
+        return true;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(directory), ec);
+    if (ec && !std::filesystem::is_directory(std::filesystem::path(directory), ec))
+    {
+        return false;
+    }
+    m_createdDirectories.insert(directory);
+    return true;
+}
+
+bool DownloadLayout::Preallocate(NativeFile file, uint64_t size)
+{
+    if (size == 0)
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO allocation = {};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    return SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation)) == TRUE;
+#else
+    return posix_fallocate(file, 0, static_cast<off_t>(size)) == 0;
+#endif
+}
@@ -0,0 +1,61 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+// Decides where each page of a batch is written. Besides the original flat
+// <root>\NNNN.ext layout it can put every job in its own directory and shard
+// large jobs into hash-prefix or fixed-size range subdirectories, so no
+// directory grows past a few thousand entries. The number width follows the
+// queue length, so names keep sorting correctly past 9999 pages.
+class DownloadLayout
+{
+public:
+    enum class Mode
+    {
+        Flat,   // <root>\0001.jpg
+        Job,    // <root>\<job>\0001.jpg
+        Hash,   // <root>\<job>\3f\0001.jpg
+        Range   // <root>\<job>\0001-1000\0001.jpg
+    };
+
+    static Mode ParseMode(const std::wstring& name);
+
+    void Configure(const std::wstring& rootDirectory, Mode mode, const std::wstring& jobName,
+        size_t queueLength, size_t filesPerShard = 1000);
+
+    // Full path for the page at a zero-based queue index. The containing
+    // directory is created the first time it is used.
+    std::wstring GetPath(size_t index, const std::wstring& extension);
+
+    const std::wstring& GetJobDirectory() const { return m_jobDirectory; }
+    int GetWidth() const { return m_width; }
+
+#ifdef _WIN32
+    using NativeFile = void*;  // HANDLE
+#else
+    using NativeFile = int;    // File descriptor
+#endif
+
+    // Reserve disk space for a file whose final size is known up front, so
+    // the file system can lay it out contiguously. Takes the handle the
+    // writer goes on to write through: NTFS gives back an allocation made
+    // through a handle once that handle is closed.
+    static bool Preallocate(NativeFile file, uint64_t size);
+
+private:
+    std::wstring FormatNumber(size_t number) const;
+    std::wstring GetShardDirectory(size_t index, const std::wstring& fileName) const;
+    bool EnsureDirectory(const std::wstring& directory);
+
+    Mode m_mode = Mode::Flat;
+    std::wstring m_jobDirectory;
+    size_t m_filesPerShard = 1000;
+    int m_width = 4;
+    std::unordered_set<std::wstring> m_createdDirectories;
+};
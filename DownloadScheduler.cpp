@@ -0,0 +1,425 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "DownloadScheduler.h"
+#include "Metrics.h"
+#include "UrlClassifier.h"
+
+#include <algorithm>
+#include <utility>
+
+DownloadScheduler::DownloadScheduler(BrowserEngine& engine, Host host)
+    : m_engine(engine), m_host(std::move(host))
+{
+    m_engine.SetEvents(this);
+}
+
+DownloadScheduler::~DownloadScheduler()
+{
+    if (m_prefetcher && m_running)
+    {
+        // It points into m_urls
+        m_prefetcher->Stop();
+    }
+    m_engine.SetEvents(nullptr);
+}
+
+const wchar_t* DownloadScheduler::GetTriggerScript()
+{
+    return LR"JS(
+            (function() {
+                try {
+                    return checkAndDownloadImage();
+                } catch(e) {
+                    console.error('Image detection failed:', e);
+                    return false;
+                }
+
+                function checkAndDownloadImage() {
+                    // Case 1: a bare image document, e.g. a jpg/png opened directly
+                    if (document.contentType && document.contentType.startsWith('image/')) {
+                        downloadImage(window.location.href);
+                        return true;
+                    }
+
+                    // Case 2: <body> holds a single <img>
+                    const bodyChildren = document.body.children;
+                    if (bodyChildren.length === 1 && bodyChildren[0] instanceof HTMLImageElement) {
+                        downloadImage(bodyChildren[0].src);
+                        return true;
+                    }
+
+                    // Case 3: the background image is the only content
+                    const bgImage = window.getComputedStyle(document.body).backgroundImage;
+                    if (bgImage && bgImage !== 'none' && document.body.innerText.trim() === '') {
+                        const imgUrl = bgImage.replace(/^url$["']?/, '').replace(/["']?$$/, '');
+                        downloadImage(imgUrl);
+                        return true;
+                    }
+
+                    return false;
+
+                    function downloadImage(url) {
+                        const link = document.createElement('a');
+                        link.href = url;
+                        link.download = url.split('/').pop() || 'download';
+                        document.body.appendChild(link);
+                        link.click();
+                        setTimeout(() => document.body.removeChild(link), 100);
+                    }
+                 }
+
+            })()
+        )JS";
+}
+
+int64_t DownloadScheduler::Now() const
+{
+    return m_host.clock ? m_host.clock() : Metrics::NowMicroseconds();
+}
+
+void DownloadScheduler::Log(const std::wstring& message) const
+{
+    if (m_host.log)
+    {
+        m_host.log(message);
+    }
+}
+
+bool DownloadScheduler::SetResponseCapture(bool enabled)
+{
+    m_captureResponses = m_engine.SetResponseCapture(enabled) && enabled;
+    return m_captureResponses == enabled;
+}
+
+void DownloadScheduler::Start(std::vector<std::wstring> urls)
+{
+    m_urls = std::move(urls);
+    m_next = 0;
+    m_retries.clear();
+    m_attempts.clear();
+    m_waitingForRetry = false;
+    m_engineLost = false;
+    m_completed = 0;
+    m_failed = 0;
+    m_stalls = 0;
+    m_running = !m_urls.empty();
+    if (m_running)
+    {
+        StartNextPage();
+    }
+}
+
+void DownloadScheduler::Advance()
+{
+    m_nextPosted = false;
+    if (!m_running || m_engineLost)
+    {
+        return;
+    }
+    StartNextPage();
+}
+
+void DownloadScheduler::PostNext()
+{
+    m_nextPosted = true;
+    m_host.postNext();
+}
+
+void DownloadScheduler::ArmWatchdog(uint32_t delayMs)
+{
+    if (m_host.setWatchdog)
+    {
+        m_host.setWatchdog(delayMs);
+    }
+}
+
+void DownloadScheduler::StartNextPage()
+{
+    if (!m_retries.empty() && m_retries.begin()->first <= Now())
+    {
+        m_index = m_retries.begin()->second;
+        m_retries.erase(m_retries.begin());
+        NavigateCurrent(true);
+        return;
+    }
+    if (m_next < m_urls.size())
+    {
+        m_index = m_next++;
+        NavigateCurrent(false);
+        return;
+    }
+    if (!m_retries.empty() && m_host.setWatchdog)
+    {
+        // Only retries are left; come back when the first one is due
+        int64_t waitMs = (m_retries.begin()->first - Now() + 999) / 1000;
+        m_waitingForRetry = true;
+        ArmWatchdog(static_cast<uint32_t>((std::max<int64_t>)(waitMs, 1)));
+        return;
+    }
+
+    m_running = false;
+    if (m_prefetcher)
+    {
+        m_prefetcher->Stop();
+    }
+    Log(L"All downloads completed\n");
+    if (m_host.onFinished)
+    {
+        m_host.onFinished();
+    }
+}
+
+void DownloadScheduler::NavigateCurrent(bool isRetry)
+{
+    m_downloadStarted = false;
+    m_pageSettled = false;
+    Log((isRetry ? L"Retrying: " : L"Downloading: ") + m_urls[m_index] + L"\n");
+    ArmWatchdog(m_watchdog.navigationTimeoutMs);
+
+    // Image URLs usually turn into a download right away; other pages are
+    // handled by the trigger script once they have loaded
+    if (!m_engine.Navigate(m_urls[m_index]))
+    {
+        Log(L"Could not navigate, moving to next download\n");
+        FailCurrent();
+    }
+    // After the page's own request, which should never queue behind these.
+    // Retries are behind the lookahead already.
+    if (m_prefetcher && !isRetry)
+    {
+        m_prefetcher->OnPageStarted(m_urls, m_index);
+    }
+}
+
+void DownloadScheduler::FailCurrent()
+{
+    if (m_pageSettled)
+    {
+        return;
+    }
+    m_pageSettled = true;
+    ArmWatchdog(0);
+    m_failed++;
+    Metrics::Instance().Add(Metrics::Counter::Failures);
+    if (m_host.onPageFailed)
+    {
+        m_host.onPageFailed(m_index);
+    }
+    PostNext();
+}
+
+void DownloadScheduler::OnWatchdog()
+{
+    if (!m_running || m_engineLost)
+    {
+        return;
+    }
+    if (m_waitingForRetry)
+    {
+        m_waitingForRetry = false;
+        StartNextPage();
+        return;
+    }
+    if (!m_pageSettled)
+    {
+        StallCurrent();
+    }
+}
+
+void DownloadScheduler::StallCurrent()
+{
+    m_stalls++;
+    Metrics& metrics = Metrics::Instance();
+    metrics.Add(Metrics::Counter::Stalls);
+    Log((m_downloadStarted ? L"Download stalled: " : L"Page stalled: ") + m_urls[m_index] + L"\n");
+    if (m_downloadStarted)
+    {
+        Trace::Instance().End(m_downloadSpan);
+    }
+    // Late events of the stopped page are not raised
+    m_engine.Stop();
+
+    if (Requeue(true))
+    {
+        PostNext();
+    }
+}
+
+bool DownloadScheduler::Requeue(bool backoff)
+{
+    size_t attempts = ++m_attempts[m_index];
+    if (attempts >= m_watchdog.maxAttempts)
+    {
+        FailCurrent();
+        return false;
+    }
+    int64_t delayMs = backoff ? static_cast<int64_t>(m_watchdog.retryDelayMs) << (std::min<size_t>)(attempts - 1, 16) : 0;
+    m_pageSettled = true;
+    ArmWatchdog(0);
+    m_retries.emplace(Now() + delayMs * 1000, m_index);
+    Metrics::Instance().Add(Metrics::Counter::Retries);
+    Log(L"Retrying in " + std::to_wstring(delayMs / 1000) + L" s\n");
+    return true;
+}
+
+void DownloadScheduler::OnEngineLost()
+{
+    if (!m_running || m_engineLost)
+    {
+        return;
+    }
+    m_engineLost = true;
+    m_waitingForRetry = false;
+    ArmWatchdog(0);
+    if (m_pageSettled)
+    {
+        return;
+    }
+    Log(L"Engine lost during: " + m_urls[m_index] + L"\n");
+    if (m_downloadStarted)
+    {
+        Trace::Instance().End(m_downloadSpan);
+    }
+    m_engine.Stop();
+    Requeue(false);
+}
+
+void DownloadScheduler::OnEngineRestored()
+{
+    if (!m_running || !m_engineLost)
+    {
+        return;
+    }
+    m_engineLost = false;
+    if (!m_nextPosted)
+    {
+        StartNextPage();
+    }
+}
+
+void DownloadScheduler::OnNavigationCompleted(const std::wstring& uri, bool succeeded)
+{
+    if (!m_running || m_pageSettled || m_downloadStarted)
+    {
+        // A navigation that became a download completes as aborted, and one
+        // whose image is being captured needs no trigger; the download
+        // events carry on from here
+        return;
+    }
+    if (!succeeded)
+    {
+        Log(L"Navigation failed: " + uri + L"\n");
+        FailCurrent();
+        return;
+    }
+
+    size_t pageIndex = m_index;
+    Trace::Span triggerSpan = Trace::Instance().Begin("ExecuteScript:download", m_engine.GetTabId());
+    bool issued = m_engine.ExecuteScript(GetTriggerScript(),
+        [this, pageIndex, triggerSpan](bool scriptSucceeded, const std::wstring& resultJson) {
+            Trace::Instance().End(triggerSpan);
+            if (!m_running || pageIndex != m_index || m_pageSettled)
+            {
+                return;
+            }
+            if (scriptSucceeded && resultJson == L"true")
+            {
+                Log(L"Image download triggered\n");
+            }
+            else if (!m_downloadStarted)
+            {
+                Log(L"No image found on page\n");
+                FailCurrent();
+            }
+        });
+    if (!issued)
+    {
+        FailCurrent();
+    }
+}
+
+std::wstring DownloadScheduler::OnDownloadStarting(const std::wstring& /*uri*/)
+{
+    if (!m_running || m_pageSettled)
+    {
+        return std::wstring();
+    }
+    return BeginDownload();
+}
+
+std::wstring DownloadScheduler::OnImageResponse(const ImageResponse& response)
+{
+    if (!m_captureResponses || !m_running || m_pageSettled || m_downloadStarted)
+    {
+        return std::wstring();
+    }
+
+    // The page itself, or an image the viewer loaded that is too big to be
+    // part of its chrome: a script fetch, or a whole-image IIIF request
+    // however it was made, since viewers load those as elements too. IIIF
+    // tiles are never the page. Once taken, the trigger script is skipped.
+    UrlMatch match = UrlClassifier::Default().ClassifyUrl(response.uri);
+    bool bigEnough = response.contentLength < 0 || response.contentLength >= c_minScriptImageBytes;
+    bool isPageImage = response.isDocument || (match.route != UrlRoute::IiifTile && bigEnough &&
+        (response.fromScript || match.route == UrlRoute::IiifImage));
+    if (!isPageImage)
+    {
+        return std::wstring();
+    }
+    Log(L"Capturing image response (" + std::wstring(match ? match.rule : L"unclassified") + L"): " + response.uri + L"\n");
+    Metrics::Instance().Add(Metrics::Counter::ImageCaptures);
+    return BeginDownload();
+}
+
+std::wstring DownloadScheduler::BeginDownload()
+{
+    m_downloadStarted = true;
+    m_downloadIndex = m_index;
+    m_downloadStart = Now();
+    m_downloadSpan = Trace::Instance().Begin("Download", m_engine.GetTabId());
+    ArmWatchdog(m_watchdog.downloadTimeoutMs);
+    return GetDownloadPath(m_index);
+}
+
+void DownloadScheduler::OnDownloadFinished(const DownloadResult& result)
+{
+    if (!m_running || m_pageSettled || !m_downloadStarted || m_downloadIndex != m_index)
+    {
+        return;
+    }
+    Trace::Instance().End(m_downloadSpan);
+
+    if (!result.completed)
+    {
+        Log(L"Download interrupted\n");
+        FailCurrent();
+        return;
+    }
+
+    m_pageSettled = true;
+    ArmWatchdog(0);
+    m_completed++;
+    Metrics& metrics = Metrics::Instance();
+    metrics.Record(Metrics::Histogram::Download, static_cast<uint64_t>((std::max<int64_t>)(Now() - m_downloadStart, 0)));
+    metrics.Add(Metrics::Counter::Bytes, static_cast<uint64_t>((std::max<int64_t>)(result.bytesReceived, 0)));
+    metrics.Add(Metrics::Counter::Downloads);
+    if (m_host.onPageCompleted)
+    {
+        m_host.onPageCompleted(m_index, result);
+    }
+    PostNext();
+}
+
+std::wstring DownloadScheduler::GetDownloadPath(size_t index)
+{
+    // Keep the extension of the URL when it looks like one, .jpg otherwise
+    const std::wstring& url = m_urls[index];
+    size_t dotPos = url.find_last_of(L'.');
+    if (dotPos != std::wstring::npos && url.size() - dotPos <= 5)
+    {
+        return m_layout.GetPath(index, url.substr(dotPos));
+    }
+    return m_layout.GetPath(index, L".jpg");
+}
@@ -0,0 +1,143 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "BrowserEngine.h"
+#include "DownloadLayout.h"
+#include "Prefetcher.h"
+#include "Trace.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Walks a batch of image URLs through one engine: navigate, make the page
+// download its image, save it under the DownloadLayout path, move on. It
+// knows nothing about windows or COM; the host supplies the event loop hop
+// between pages and takes the finished pages.
+//
+// A page that neither loads nor downloads within its deadline is stopped
+// and goes back into the queue, after the pages already due, with a delay
+// that doubles per attempt; it fails once it runs out of attempts. A page
+// whose engine died goes back the same way without a delay, and the queue
+// waits until the host has brought the engine back.
+class DownloadScheduler : public BrowserEngineEvents
+{
+public:
+    struct Host
+    {
+        // Must arrange for Advance() to run later on the engine's thread,
+        // never inline, so engine callbacks unwind first.
+        std::function<void()> postNext;
+        std::function<void(size_t pageIndex, const DownloadResult& result)> onPageCompleted;
+        std::function<void(size_t pageIndex)> onPageFailed;
+        std::function<void()> onFinished;
+        std::function<void(const std::wstring& message)> log;
+        // Microsecond clock for the latency metrics, Metrics::NowMicroseconds
+        // when not set.
+        std::function<int64_t()> clock;
+        // Arms the one watchdog timer, replacing the armed one; 0 disarms
+        // it. The host calls OnWatchdog when it fires. Pages have no
+        // deadline when not set.
+        std::function<void(uint32_t delayMs)> setWatchdog;
+    };
+
+    struct Watchdog
+    {
+        uint32_t navigationTimeoutMs = 60 * 1000;  // Until the image starts downloading; 0 waits forever
+        uint32_t downloadTimeoutMs = 5 * 60 * 1000;
+        uint32_t retryDelayMs = 5 * 1000;          // Before the second attempt, doubled for each one after
+        size_t maxAttempts = 3;
+    };
+
+    DownloadScheduler(BrowserEngine& engine, Host host);
+    ~DownloadScheduler();
+
+    DownloadLayout& GetLayout() { return m_layout; }
+    // Saves the image from the response the engine already received instead
+    // of downloading it a second time. False when the engine cannot.
+    bool SetResponseCapture(bool enabled);
+    // Warms the entries after the current one in the prefetcher's engines.
+    // It must outlive the scheduler or be unset first.
+    void SetPrefetcher(Prefetcher* prefetcher) { m_prefetcher = prefetcher; }
+    void SetWatchdog(const Watchdog& watchdog) { m_watchdog = watchdog; }
+
+    void Start(std::vector<std::wstring> urls);
+    // Moves to the next page, see Host::postNext.
+    void Advance();
+    // The timer armed through Host::setWatchdog fired.
+    void OnWatchdog();
+    // The engine's processes died or are being replaced: the page in flight
+    // is requeued and nothing is started until OnEngineRestored.
+    void OnEngineLost();
+    void OnEngineRestored();
+
+    bool IsRunning() const { return m_running; }
+    bool IsEngineLost() const { return m_engineLost; }
+    size_t GetPageCount() const { return m_urls.size(); }
+    size_t GetCurrentIndex() const { return m_index; }
+    size_t GetCompletedCount() const { return m_completed; }
+    size_t GetFailedCount() const { return m_failed; }
+    size_t GetStallCount() const { return m_stalls; }
+
+    // Clicks a download link for the image the page shows; returns true when
+    // it found one.
+    static const wchar_t* GetTriggerScript();
+
+    void OnNavigationCompleted(const std::wstring& uri, bool succeeded) override;
+    std::wstring OnDownloadStarting(const std::wstring& uri) override;
+    void OnDownloadFinished(const DownloadResult& result) override;
+    std::wstring OnImageResponse(const ImageResponse& response) override;
+
+private:
+    // Script-loaded images smaller than this are taken for icons and sprites
+    static constexpr int64_t c_minScriptImageBytes = 32 * 1024;
+
+    int64_t Now() const;
+    void Log(const std::wstring& message) const;
+    void ArmWatchdog(uint32_t delayMs);
+    void PostNext();
+    // Due retries first, then the next page of the list
+    void StartNextPage();
+    void NavigateCurrent(bool isRetry);
+    void FailCurrent();
+    // Stops the page past its deadline and requeues or fails it
+    void StallCurrent();
+    // Counts an attempt of the current page and queues it again, with the
+    // retry delay for this attempt or due at once; false when it failed
+    // instead, having been the last attempt
+    bool Requeue(bool backoff);
+    // Marks the current page's image as on its way; returns its path
+    std::wstring BeginDownload();
+    std::wstring GetDownloadPath(size_t index);
+
+    BrowserEngine& m_engine;
+    Prefetcher* m_prefetcher = nullptr;
+    Host m_host;
+    Watchdog m_watchdog;
+    DownloadLayout m_layout;
+    std::vector<std::wstring> m_urls;
+    size_t m_index = 0;
+    size_t m_next = 0;                       // First page of the list not started yet
+    std::multimap<int64_t, size_t> m_retries;  // Due time to page index
+    std::map<size_t, size_t> m_attempts;       // Failed attempts of stalled pages
+    bool m_waitingForRetry = false;
+    bool m_nextPosted = false;  // An Advance is on its way through Host::postNext
+    bool m_engineLost = false;
+    size_t m_completed = 0;
+    size_t m_failed = 0;
+    size_t m_stalls = 0;
+    bool m_running = false;
+    bool m_captureResponses = false;
+
+    // State of the page at m_index
+    bool m_downloadStarted = false;
+    bool m_pageSettled = false;
+    size_t m_downloadIndex = 0;
+    int64_t m_downloadStart = 0;
+    Trace::Span m_downloadSpan;
+};
@@ -0,0 +1,286 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "FileWriter.h"
+#include "Transcoder.h"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t c_bufferBytes = 256 * 1024;
+
+    class OutputFile
+    {
+    public:
+        ~OutputFile() { Close(); }
+
+        bool Open(const std::wstring& path, bool truncate)
+        {
+#ifdef _WIN32
+            m_file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            }
+            LARGE_INTEGER zero = {};
+            return truncate || SetFilePointerEx(m_file, zero, nullptr, FILE_END);
+#else
+            m_fd = open(std::filesystem::path(path).c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND), 0644);
+            return m_fd >= 0;
+#endif
+        }
+
+        bool Write(const char* data, size_t size)
+        {
+#ifdef _WIN32
+            while (size > 0)
+            {
+                DWORD chunk = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+                DWORD written = 0;
+                if (!WriteFile(m_file, data, chunk, &written, nullptr) || written == 0)
+                {
+                    return false;
+                }
+                data += written;
+                size -= written;
+            }
+            return true;
+#else
+            while (size > 0)
+            {
+                ssize_t written = write(m_fd, data, size);
+                if (written <= 0)
+                {
+                    return false;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+#endif
+        }
+
+        bool Sync()
+        {
+#ifdef _WIN32
+            return FlushFileBuffers(m_file) != FALSE;
+#else
+            return fsync(m_fd) == 0;
+#endif
+        }
+
+        void Close()
+        {
+#ifdef _WIN32
+            if (m_file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_file);
+                m_file = INVALID_HANDLE_VALUE;
+            }
+#else
+            if (m_fd >= 0)
+            {
+                close(m_fd);
+                m_fd = -1;
+            }
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+        int m_fd = -1;
+#endif
+    };
+}
+
+FileWriter::FileWriter(SyncPolicy policy, std::chrono::milliseconds batchDelay)
+    : m_policy(policy), m_batchDelay(batchDelay)
+{
+    m_thread = std::thread(&FileWriter::WriterLoop, this);
+}
+
+FileWriter::~FileWriter()
+{
+    Shutdown();
+}
+
+void FileWriter::Write(const std::wstring& path, std::wstring data)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stopping)
+    {
+        lock.unlock();
+        WritePending(path, Pending{ true, { std::move(data) } }, m_policy != SyncPolicy::None);
+        return;
+    }
+
+    Pending& pending = m_pending[path];
+    if (!pending.chunks.empty())
+    {
+        m_superseded++;
+    }
+    pending.truncate = true;
+    pending.chunks.clear();
+    pending.chunks.push_back(std::move(data));
+    m_queued++;
+    m_wake.notify_one();
+}
+
+void FileWriter::Append(const std::wstring& path, std::wstring data)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stopping)
+    {
+        lock.unlock();
+        WritePending(path, Pending{ false, { std::move(data) } }, m_policy != SyncPolicy::None);
+        return;
+    }
+
+    m_pending[path].chunks.push_back(std::move(data));
+    m_queued++;
+    m_wake.notify_one();
+}
+
+bool FileWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_stopping)
+    {
+        uint64_t target = ++m_queued;
+        m_flushRequested = true;
+        m_wake.notify_one();
+        m_flushed.wait(lock, [this, target]() { return m_written >= target; });
+    }
+    bool succeeded = !m_failed;
+    m_failed = false;
+    return succeeded;
+}
+
+void FileWriter::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+        {
+            return;
+        }
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void FileWriter::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [this]() { return m_stopping || m_flushRequested || !m_pending.empty(); });
+        if (!m_stopping && !m_flushRequested)
+        {
+            // Give further writes a moment to arrive and be merged into this batch
+            m_wake.wait_for(lock, m_batchDelay, [this]() { return m_stopping || m_flushRequested; });
+        }
+
+        std::map<std::wstring, Pending> batch;
+        batch.swap(m_pending);
+        bool flushing = m_flushRequested || m_stopping;
+        bool sync = m_policy == SyncPolicy::Always || (flushing && m_policy == SyncPolicy::OnFlush);
+        std::set<std::wstring> unsynced;
+        if (sync)
+        {
+            unsynced.swap(m_unsynced);
+        }
+        uint64_t generation = m_queued;
+        bool stopping = m_stopping;
+        m_flushRequested = false;
+        lock.unlock();
+
+        bool succeeded = true;
+        for (const auto& [path, pending] : batch)
+        {
+            succeeded = WritePending(path, pending, sync) && succeeded;
+            unsynced.erase(path);
+        }
+        // Files written by earlier batches that have not been synced yet
+        for (const std::wstring& path : unsynced)
+        {
+            succeeded = SyncFile(path) && succeeded;
+        }
+
+        lock.lock();
+        if (!sync && m_policy == SyncPolicy::OnFlush)
+        {
+            for (const auto& [path, pending] : batch)
+            {
+                m_unsynced.insert(path);
+            }
+        }
+        m_failed = m_failed || !succeeded;
+        m_written = generation;
+        m_flushed.notify_all();
+        if (stopping && m_pending.empty())
+        {
+            break;
+        }
+    }
+}
+
+bool FileWriter::WritePending(const std::wstring& path, const Pending& pending, bool sync)
+{
+    OutputFile file;
+    if (!file.Open(path, pending.truncate))
+    {
+        return false;
+    }
+
+    // Encode into one large buffer so the file sees few, big sequential writes
+    std::vector<char> buffer(c_bufferBytes);
+    size_t used = 0;
+    for (const std::wstring& chunk : pending.chunks)
+    {
+        size_t offset = 0;
+        while (offset < chunk.size())
+        {
+            size_t room = (buffer.size() - used) / Transcoder::MaxUtf8LengthWide(1);
+            if (room < 2)
+            {
+                if (!file.Write(buffer.data(), used))
+                {
+                    return false;
+                }
+                used = 0;
+                continue;
+            }
+            size_t units = Transcoder::SplitUtf16(chunk.data() + offset, chunk.size() - offset, room);
+            used += Transcoder::Utf16ToUtf8(chunk.data() + offset, units, buffer.data() + used);
+            offset += units;
+        }
+    }
+    if (used > 0 && !file.Write(buffer.data(), used))
+    {
+        return false;
+    }
+    return !sync || file.Sync();
+}
+
+bool FileWriter::SyncFile(const std::wstring& path)
+{
+    OutputFile file;
+    return file.Open(path, false) && file.Sync();
+}
@@ -0,0 +1,80 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background writer for output files that are rewritten or appended to
+// often, such as cookie.txt after every navigation. Callers only queue the
+// text; a dedicated thread collects everything queued within a short batch
+// window, converts it to UTF-8 and writes each file with one sequential
+// pass. A Write to a path supersedes whatever is still queued for it, and
+// queued Appends to a path are merged.
+class FileWriter
+{
+public:
+    enum class SyncPolicy
+    {
+        None,     // Leave write-back to the OS cache
+        OnFlush,  // Sync every file written so far on Flush() and Shutdown()
+        Always    // Sync each file after every batch
+    };
+
+    explicit FileWriter(SyncPolicy policy = SyncPolicy::OnFlush,
+        std::chrono::milliseconds batchDelay = std::chrono::milliseconds(200));
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    // Replace the contents of path.
+    void Write(const std::wstring& path, std::wstring data);
+    // Append to path, after anything already queued for it.
+    void Append(const std::wstring& path, std::wstring data);
+
+    // Block until everything queued so far is on disk, synced according to
+    // the policy. Returns false if any write failed since the last Flush.
+    bool Flush();
+    // Flush, then stop the writer thread. Later writes run synchronously.
+    void Shutdown();
+
+    uint64_t GetSupersededCount() const { return m_superseded; }
+
+private:
+    struct Pending
+    {
+        bool truncate = false;
+        std::vector<std::wstring> chunks;
+    };
+
+    void WriterLoop();
+    static bool WritePending(const std::wstring& path, const Pending& pending, bool sync);
+    static bool SyncFile(const std::wstring& path);
+
+    const SyncPolicy m_policy;
+    const std::chrono::milliseconds m_batchDelay;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_flushed;
+    std::map<std::wstring, Pending> m_pending;
+    std::set<std::wstring> m_unsynced;
+    uint64_t m_queued = 0;   // Generation of the last queued request
+    uint64_t m_written = 0;  // Generation covered by the last finished batch
+    std::atomic<uint64_t> m_superseded = 0;
+    bool m_flushRequested = false;
+    bool m_stopping = false;
+    bool m_failed = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,863 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "HttpCache.h"
+#include "Transcoder.h"
+#include "UrlParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+struct HttpCache::IndexHeader
+{
+    static constexpr uint32_t c_magic = 0x43484742;  // "BGHC"
+    static constexpr uint32_t c_version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint64_t totalBytes;   // Sum of the entry file sizes
+    uint64_t entryCount;
+    uint64_t evictCursor;
+    uint64_t reserved[3];
+};
+
+struct HttpCache::Slot
+{
+    static constexpr uint32_t c_hasValidators = 1;
+
+    uint64_t key;          // 0 for a free slot
+    int64_t storedAt;
+    int64_t freshUntil;
+    int64_t lastUsed;
+    uint64_t fileSize;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+namespace
+{
+    constexpr uint32_t c_probeLength = 16;
+    constexpr int c_evictionSamples = 8;
+    constexpr int64_t c_maxHeuristicLifetime = 24 * 60 * 60;
+
+    struct EntryFileHeader
+    {
+        static constexpr uint32_t c_magic = 0x45484742;  // "BGHE"
+        static constexpr uint32_t c_version = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t status;
+        uint32_t urlSize;
+        uint32_t headersSize;
+        uint32_t etagSize;
+        uint32_t lastModifiedSize;
+        uint32_t reserved;
+        uint64_t bodySize;
+    };
+
+    std::string ToUtf8(std::wstring_view text)
+    {
+        std::string out(Transcoder::MaxUtf8LengthWide(text.size()), '\0');
+        out.resize(Transcoder::Utf16ToUtf8(text.data(), text.size(), out.data()));
+        return out;
+    }
+
+    std::wstring FromUtf8(std::string_view text)
+    {
+        std::wstring out(Transcoder::MaxUtf16Length(text.size()), L'\0');
+        out.resize(Transcoder::Utf8ToUtf16(text.data(), text.size(), out.data()));
+        return out;
+    }
+
+    wchar_t ToLowerAscii(wchar_t c)
+    {
+        return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c - L'A' + L'a') : c;
+    }
+
+    std::wstring ToLower(std::wstring_view text)
+    {
+        std::wstring out(text);
+        std::transform(out.begin(), out.end(), out.begin(), ToLowerAscii);
+        return out;
+    }
+
+    bool EqualsIgnoreCase(std::wstring_view text, std::wstring_view lower)
+    {
+        if (text.size() != lower.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (ToLowerAscii(text[i]) != lower[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::wstring_view Trim(std::wstring_view text)
+    {
+        while (!text.empty() && (text.front() == L' ' || text.front() == L'\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == L' ' || text.back() == L'\t'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    // Calls onItem for every trimmed, non-empty item of a comma separated list
+    template <typename OnItem>
+    void ForEachListItem(std::wstring_view list, OnItem onItem)
+    {
+        while (!list.empty())
+        {
+            size_t comma = list.find(L',');
+            std::wstring_view item = Trim(list.substr(0, comma));
+            if (!item.empty())
+            {
+                onItem(item);
+            }
+            list = comma == std::wstring_view::npos ? std::wstring_view() : list.substr(comma + 1);
+        }
+    }
+
+    // Non-negative delta-seconds, -1 if malformed
+    int64_t ParseSeconds(std::wstring_view text)
+    {
+        text = Trim(text);
+        if (text.size() >= 2 && text.front() == L'"' && text.back() == L'"')
+        {
+            text = text.substr(1, text.size() - 2);
+        }
+        if (text.empty())
+        {
+            return -1;
+        }
+        int64_t value = 0;
+        for (wchar_t c : text)
+        {
+            if (c < L'0' || c > L'9')
+            {
+                return -1;
+            }
+            value = (std::min<int64_t>)(value * 10 + (c - L'0'), INT32_MAX);
+        }
+        return value;
+    }
+
+    // Headers that describe the body rather than the transfer, replayed when
+    // an entry is served
+    bool IsReplayedHeader(std::wstring_view name)
+    {
+        static const wchar_t* const c_names[] = {
+            L"content-type",
+            L"content-language",
+            L"access-control-allow-origin",
+            L"access-control-allow-credentials",
+            L"access-control-expose-headers",
+            L"timing-allow-origin",
+            L"cross-origin-resource-policy",
+            L"etag",
+            L"last-modified",
+        };
+        for (const wchar_t* replayed : c_names)
+        {
+            if (EqualsIgnoreCase(name, replayed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int64_t DaysFromCivil(int64_t year, int64_t month, int64_t day)
+    {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t yearOfEra = year - era * 400;
+        int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    std::string ReadBytes(const char*& cursor, uint32_t size)
+    {
+        std::string bytes(cursor, size);
+        cursor += size;
+        return bytes;
+    }
+}
+
+HttpCache::~HttpCache()
+{
+    Close();
+}
+
+bool HttpCache::Open(const Config& config)
+{
+    static_assert(sizeof(IndexHeader) == 64 && sizeof(Slot) == 48, "index layout changed");
+    Close();
+    if (config.directory.empty() || config.slotCount == 0)
+    {
+        return false;
+    }
+    m_config = config;
+
+    std::error_code error;
+    std::filesystem::path directory(config.directory);
+    std::filesystem::create_directories(directory / L"data", error);
+    size_t indexSize = sizeof(IndexHeader) + static_cast<size_t>(config.slotCount) * sizeof(Slot);
+    if (!m_index.OpenWritable((directory / L"index.bin").wstring(), indexSize))
+    {
+        return false;
+    }
+
+    IndexHeader* header = GetHeader();
+    if (header->magic != IndexHeader::c_magic || header->version != IndexHeader::c_version ||
+        header->slotCount != config.slotCount || header->slotSize != sizeof(Slot))
+    {
+        // Entries of another layout cannot be found any more, start over
+        std::memset(m_index.GetWritableData(), 0, indexSize);
+        std::filesystem::remove_all(directory / L"data", error);
+        std::filesystem::create_directories(directory / L"data", error);
+        header->version = IndexHeader::c_version;
+        header->slotCount = config.slotCount;
+        header->slotSize = sizeof(Slot);
+        header->magic = IndexHeader::c_magic;
+        m_index.Flush();
+    }
+
+    // Totals drift when a process dies between writing an entry and its
+    // slot, so they are recounted on every open
+    uint64_t totalBytes = 0;
+    uint64_t entryCount = 0;
+    const Slot* slots = GetSlots();
+    for (uint32_t i = 0; i < config.slotCount; ++i)
+    {
+        if (slots[i].key != 0)
+        {
+            totalBytes += slots[i].fileSize;
+            entryCount++;
+        }
+    }
+    header->totalBytes = totalBytes;
+    header->entryCount = entryCount;
+
+    std::random_device random;
+    m_instanceId = (static_cast<uint64_t>(random()) << 32) ^ random();
+    return true;
+}
+
+void HttpCache::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_index.IsOpen())
+    {
+        m_index.Flush();
+        m_index.Close();
+    }
+}
+
+int64_t HttpCache::NowSeconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::wstring HttpCache::NormalizeUrl(std::wstring_view url)
+{
+    UrlParts parts = UrlParser::Parse(url);
+    std::wstring scheme = ToLower(parts.scheme);
+    if ((scheme != L"http" && scheme != L"https") || parts.host.empty())
+    {
+        return std::wstring();
+    }
+
+    std::wstring normalized = scheme + L"://" + ToLower(parts.host);
+    if (!parts.port.empty() && !(scheme == L"http" && parts.port == L"80") &&
+        !(scheme == L"https" && parts.port == L"443"))
+    {
+        normalized += L':';
+        normalized += parts.port;
+    }
+    if (parts.path.empty())
+    {
+        normalized += L'/';
+    }
+    else
+    {
+        normalized += parts.path;
+    }
+    if (!parts.query.empty())
+    {
+        normalized += L'?';
+        normalized += parts.query;
+    }
+    return normalized;
+}
+
+int64_t HttpCache::ParseHttpDate(std::wstring_view text)
+{
+    // "Sun, 06 Nov 1994 08:49:37 GMT", or the obsolete "Sunday, 06-Nov-94 08:49:37 GMT"
+    size_t comma = text.find(L',');
+    if (comma == std::wstring_view::npos)
+    {
+        return -1;
+    }
+    text = Trim(text.substr(comma + 1));
+
+    auto readNumber = [&text](size_t minDigits, size_t maxDigits, int64_t& value) {
+        size_t digits = 0;
+        value = 0;
+        while (digits < text.size() && digits < maxDigits && text[digits] >= L'0' && text[digits] <= L'9')
+        {
+            value = value * 10 + (text[digits] - L'0');
+            digits++;
+        }
+        text.remove_prefix(digits);
+        return digits >= minDigits;
+    };
+    auto skip = [&text](wchar_t separator) {
+        if (text.empty() || (text.front() != separator && !(separator == L' ' && text.front() == L'-')))
+        {
+            return false;
+        }
+        text.remove_prefix(1);
+        return true;
+    };
+
+    static const wchar_t* const c_months[] = {
+        L"jan", L"feb", L"mar", L"apr", L"may", L"jun", L"jul", L"aug", L"sep", L"oct", L"nov", L"dec" };
+    int64_t day = 0;
+    int64_t month = 0;
+    int64_t year = 0;
+    int64_t hour = 0;
+    int64_t minute = 0;
+    int64_t second = 0;
+    if (!readNumber(1, 2, day) || !skip(L' ') || text.size() < 3)
+    {
+        return -1;
+    }
+    for (int i = 0; i < 12 && month == 0; ++i)
+    {
+        if (EqualsIgnoreCase(text.substr(0, 3), c_months[i]))
+        {
+            month = i + 1;
+        }
+    }
+    text.remove_prefix(3);
+    size_t yearDigits = text.size();
+    if (month == 0 || !skip(L' ') || !readNumber(2, 4, year))
+    {
+        return -1;
+    }
+    yearDigits -= text.size() + 1;
+    if (yearDigits == 2)
+    {
+        year += year < 70 ? 2000 : 1900;
+    }
+    if (!skip(L' ') || !readNumber(2, 2, hour) || !skip(L':') || !readNumber(2, 2, minute) ||
+        !skip(L':') || !readNumber(2, 2, second))
+    {
+        return -1;
+    }
+    if (day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+    {
+        return -1;
+    }
+    return DaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+HttpCache::Policy HttpCache::GetPolicy(int status, const Headers& headers, int64_t now)
+{
+    Policy policy;
+    if (status != 200 && status != 203)
+    {
+        return policy;
+    }
+
+    bool noCache = false;
+    bool pragmaNoCache = false;
+    bool hasCacheControl = false;
+    int64_t maxAge = -1;
+    int64_t sharedMaxAge = -1;
+    int64_t expires = -1;
+    bool hasExpires = false;
+    int64_t date = -1;
+    int64_t lastModified = -1;
+    for (const auto& [name, value] : headers)
+    {
+        if (EqualsIgnoreCase(name, L"cache-control"))
+        {
+            hasCacheControl = true;
+            bool forbidden = false;
+            ForEachListItem(value, [&](std::wstring_view directive) {
+                size_t equals = directive.find(L'=');
+                std::wstring_view directiveName = Trim(directive.substr(0, equals));
+                std::wstring_view argument = equals == std::wstring_view::npos ? std::wstring_view() : directive.substr(equals + 1);
+                if (EqualsIgnoreCase(directiveName, L"no-store") || EqualsIgnoreCase(directiveName, L"private"))
+                {
+                    forbidden = true;
+                }
+                else if (EqualsIgnoreCase(directiveName, L"no-cache"))
+                {
+                    noCache = true;
+                }
+                else if (EqualsIgnoreCase(directiveName, L"max-age"))
+                {
+                    maxAge = ParseSeconds(argument);
+                }
+                else if (EqualsIgnoreCase(directiveName, L"s-maxage"))
+                {
+                    sharedMaxAge = ParseSeconds(argument);
+                }
+            });
+            if (forbidden)
+            {
+                return policy;
+            }
+        }
+        else if (EqualsIgnoreCase(name, L"pragma"))
+        {
+            pragmaNoCache = ToLower(value).find(L"no-cache") != std::wstring::npos;
+        }
+        else if (EqualsIgnoreCase(name, L"expires"))
+        {
+            // Invalid dates such as "0" mean already expired
+            hasExpires = true;
+            expires = ParseHttpDate(value);
+        }
+        else if (EqualsIgnoreCase(name, L"date"))
+        {
+            date = ParseHttpDate(value);
+        }
+        else if (EqualsIgnoreCase(name, L"last-modified"))
+        {
+            lastModified = ParseHttpDate(value);
+            policy.lastModified = value;
+        }
+        else if (EqualsIgnoreCase(name, L"etag"))
+        {
+            policy.etag = value;
+        }
+        else if (EqualsIgnoreCase(name, L"set-cookie") || EqualsIgnoreCase(name, L"content-range"))
+        {
+            // Per-user or partial responses
+            return policy;
+        }
+        else if (EqualsIgnoreCase(name, L"vary"))
+        {
+            // Bodies are stored decoded, so only Accept-Encoding can vary
+            bool varies = false;
+            ForEachListItem(value, [&varies](std::wstring_view field) {
+                varies = varies || !EqualsIgnoreCase(field, L"accept-encoding");
+            });
+            if (varies)
+            {
+                return policy;
+            }
+        }
+    }
+
+    int64_t lifetime = 0;
+    if (noCache || (pragmaNoCache && !hasCacheControl))
+    {
+        policy.explicitFreshness = true;
+    }
+    else if (sharedMaxAge >= 0 || maxAge >= 0)
+    {
+        policy.explicitFreshness = true;
+        lifetime = sharedMaxAge >= 0 ? sharedMaxAge : maxAge;
+    }
+    else if (hasExpires)
+    {
+        policy.explicitFreshness = true;
+        if (expires >= 0)
+        {
+            lifetime = expires - (date >= 0 ? date : now);
+        }
+    }
+    else if (lastModified >= 0)
+    {
+        // Heuristic freshness: a tenth of the time since the last change
+        lifetime = (std::min)(((date >= 0 ? date : now) - lastModified) / 10, c_maxHeuristicLifetime);
+    }
+    lifetime = (std::max<int64_t>)(lifetime, 0);
+
+    policy.freshUntil = now + lifetime;
+    policy.storable = lifetime > 0 || !policy.etag.empty() || !policy.lastModified.empty();
+    return policy;
+}
+
+std::wstring HttpCache::GetReplayedHeaders(const Headers& headers)
+{
+    std::wstring replayed;
+    for (const auto& [name, value] : headers)
+    {
+        if (IsReplayedHeader(name))
+        {
+            replayed += (replayed.empty() ? L"" : L"\r\n") + name + L": " + value;
+        }
+    }
+    return replayed;
+}
+
+uint64_t HttpCache::HashKey(std::wstring_view normalizedUrl)
+{
+    // FNV-1a over the code units; 0 marks a free slot
+    uint64_t hash = 14695981039346656037ull;
+    for (wchar_t c : normalizedUrl)
+    {
+        hash ^= static_cast<uint32_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash ? hash : 1;
+}
+
+std::wstring HttpCache::GetEntryPath(uint64_t key) const
+{
+    static const wchar_t c_hex[] = L"0123456789abcdef";
+    std::wstring name(16, L'0');
+    for (int i = 0; i < 16; ++i)
+    {
+        name[15 - i] = c_hex[(key >> (i * 4)) & 0xF];
+    }
+    // 256 subdirectories keep each directory small
+    return (std::filesystem::path(m_config.directory) / L"data" / name.substr(0, 2) / name).wstring();
+}
+
+HttpCache::IndexHeader* HttpCache::GetHeader() const
+{
+    return reinterpret_cast<IndexHeader*>(m_index.GetWritableData());
+}
+
+HttpCache::Slot* HttpCache::GetSlots() const
+{
+    return reinterpret_cast<Slot*>(m_index.GetWritableData() + sizeof(IndexHeader));
+}
+
+HttpCache::Slot* HttpCache::FindSlot(uint64_t key, bool forInsert) const
+{
+    Slot* slots = GetSlots();
+    uint32_t slotCount = m_config.slotCount;
+    Slot* candidate = nullptr;
+    for (uint32_t probe = 0; probe < c_probeLength && probe < slotCount; ++probe)
+    {
+        Slot& slot = slots[(key + probe) % slotCount];
+        if (slot.key == key)
+        {
+            return &slot;
+        }
+        if (!forInsert)
+        {
+            continue;
+        }
+        if (slot.key == 0)
+        {
+            if (!candidate || candidate->key != 0)
+            {
+                candidate = &slot;
+            }
+        }
+        else if (!candidate || (candidate->key != 0 && slot.lastUsed < candidate->lastUsed))
+        {
+            candidate = &slot;
+        }
+    }
+    return candidate;
+}
+
+void HttpCache::RemoveSlot(Slot& slot)
+{
+    if (slot.key == 0)
+    {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::remove(GetEntryPath(slot.key), error);
+
+    IndexHeader* header = GetHeader();
+    header->totalBytes -= (std::min)(header->totalBytes, slot.fileSize);
+    header->entryCount -= header->entryCount ? 1 : 0;
+    slot.key = 0;
+}
+
+void HttpCache::EvictOverCapacity()
+{
+    IndexHeader* header = GetHeader();
+    if (header->totalBytes <= m_config.capacity)
+    {
+        return;
+    }
+
+    // Approximate LRU: drop the least recently used of a few occupied slots
+    // at a time, down to 90% so eviction does not run on every store
+    uint64_t target = m_config.capacity - m_config.capacity / 10;
+    Slot* slots = GetSlots();
+    uint32_t slotCount = m_config.slotCount;
+    uint32_t scanned = 0;
+    while (header->totalBytes > target && scanned < slotCount)
+    {
+        Slot* victim = nullptr;
+        for (int sampled = 0; sampled < c_evictionSamples && scanned < slotCount; ++scanned)
+        {
+            Slot& slot = slots[header->evictCursor % slotCount];
+            header->evictCursor = (header->evictCursor + 1) % slotCount;
+            if (slot.key != 0)
+            {
+                sampled++;
+                if (!victim || slot.lastUsed < victim->lastUsed)
+                {
+                    victim = &slot;
+                }
+            }
+        }
+        if (!victim)
+        {
+            break;
+        }
+        RemoveSlot(*victim);
+    }
+}
+
+bool HttpCache::ReadEntry(uint64_t key, const std::wstring& url, Entry& entry) const
+{
+    MappedFile file;
+    if (!file.Open(GetEntryPath(key)) || file.GetSize() < sizeof(EntryFileHeader))
+    {
+        return false;
+    }
+
+    EntryFileHeader header;
+    std::memcpy(&header, file.GetData(), sizeof(header));
+    uint64_t expectedSize = sizeof(header) + static_cast<uint64_t>(header.urlSize) + header.headersSize +
+        header.etagSize + header.lastModifiedSize + header.bodySize;
+    if (header.magic != EntryFileHeader::c_magic || header.version != EntryFileHeader::c_version ||
+        header.key != key || expectedSize != file.GetSize())
+    {
+        return false;
+    }
+
+    // Different URLs can share a key; the entry names its own
+    const char* cursor = file.GetData() + sizeof(header);
+    if (ReadBytes(cursor, header.urlSize) != ToUtf8(url))
+    {
+        return false;
+    }
+    entry.status = static_cast<int>(header.status);
+    entry.headers = FromUtf8(ReadBytes(cursor, header.headersSize));
+    entry.etag = FromUtf8(ReadBytes(cursor, header.etagSize));
+    entry.lastModified = FromUtf8(ReadBytes(cursor, header.lastModifiedSize));
+    entry.body.assign(cursor, static_cast<size_t>(header.bodySize));
+    return true;
+}
+
+HttpCache::Lookup HttpCache::Probe(std::wstring_view url, int64_t now) const
+{
+    std::wstring normalized = NormalizeUrl(url);
+    if (normalized.empty() || !IsOpen())
+    {
+        return Lookup::Miss;
+    }
+    uint64_t key = HashKey(normalized);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Slot* slot = FindSlot(key, false);
+    if (!slot)
+    {
+        return Lookup::Miss;
+    }
+    if (slot->freshUntil > now)
+    {
+        return Lookup::Fresh;
+    }
+    return (slot->flags & Slot::c_hasValidators) ? Lookup::Stale : Lookup::Miss;
+}
+
+HttpCache::Lookup HttpCache::Find(std::wstring_view url, int64_t now, Entry& entry)
+{
+    std::wstring normalized = NormalizeUrl(url);
+    if (normalized.empty() || !IsOpen())
+    {
+        return Lookup::Miss;
+    }
+    uint64_t key = HashKey(normalized);
+
+    Lookup result = Lookup::Miss;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Slot* slot = FindSlot(key, false);
+        if (!slot)
+        {
+            return Lookup::Miss;
+        }
+        if (slot->freshUntil > now)
+        {
+            result = Lookup::Fresh;
+        }
+        else if (slot->flags & Slot::c_hasValidators)
+        {
+            result = Lookup::Stale;
+        }
+        else
+        {
+            return Lookup::Miss;
+        }
+        slot->lastUsed = now;
+    }
+
+    if (!ReadEntry(key, normalized, entry))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (Slot* slot = FindSlot(key, false))
+        {
+            RemoveSlot(*slot);
+        }
+        return Lookup::Miss;
+    }
+    return result;
+}
+
+bool HttpCache::Store(std::wstring_view url, int status, const Headers& headers, std::string_view body, int64_t now)
+{
+    std::wstring normalized = NormalizeUrl(url);
+    if (normalized.empty() || !IsOpen() || body.size() > m_config.maxEntrySize)
+    {
+        return false;
+    }
+    Policy policy = GetPolicy(status, headers, now);
+    if (!policy.storable)
+    {
+        return false;
+    }
+    uint64_t key = HashKey(normalized);
+
+    std::string urlBytes = ToUtf8(normalized);
+    std::string headerBytes = ToUtf8(GetReplayedHeaders(headers));
+    std::string etagBytes = ToUtf8(policy.etag);
+    std::string lastModifiedBytes = ToUtf8(policy.lastModified);
+
+    EntryFileHeader fileHeader = {};
+    fileHeader.magic = EntryFileHeader::c_magic;
+    fileHeader.version = EntryFileHeader::c_version;
+    fileHeader.key = key;
+    fileHeader.status = static_cast<uint32_t>(status);
+    fileHeader.urlSize = static_cast<uint32_t>(urlBytes.size());
+    fileHeader.headersSize = static_cast<uint32_t>(headerBytes.size());
+    fileHeader.etagSize = static_cast<uint32_t>(etagBytes.size());
+    fileHeader.lastModifiedSize = static_cast<uint32_t>(lastModifiedBytes.size());
+    fileHeader.bodySize = body.size();
+
+    // Write under a name of our own and rename, so readers in any process
+    // only ever see complete entries
+    std::filesystem::path path(GetEntryPath(key));
+    std::filesystem::path tempPath = path;
+    tempPath += L"." + std::to_wstring(m_instanceId) + L"-" + std::to_wstring(m_tempCounter++) + L".tmp";
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!out.is_open())
+        {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+        out.write(urlBytes.data(), static_cast<std::streamsize>(urlBytes.size()));
+        out.write(headerBytes.data(), static_cast<std::streamsize>(headerBytes.size()));
+        out.write(etagBytes.data(), static_cast<std::streamsize>(etagBytes.size()));
+        out.write(lastModifiedBytes.data(), static_cast<std::streamsize>(lastModifiedBytes.size()));
+        out.write(body.data(), static_cast<std::streamsize>(body.size()));
+        out.close();
+        if (out.fail())
+        {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+    uint64_t fileSize = sizeof(fileHeader) + urlBytes.size() + headerBytes.size() + etagBytes.size() +
+        lastModifiedBytes.size() + body.size();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Slot* slot = FindSlot(key, true);
+    if (slot && slot->key != key)
+    {
+        RemoveSlot(*slot);
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error || !slot)
+    {
+        // Typically another process reading the entry right now
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    IndexHeader* header = GetHeader();
+    if (slot->key == key)
+    {
+        header->totalBytes -= (std::min)(header->totalBytes, slot->fileSize);
+        header->entryCount -= header->entryCount ? 1 : 0;
+    }
+    // Cleared first so a reader in another process never pairs the new key
+    // with the old entry's freshness
+    slot->key = 0;
+    slot->storedAt = now;
+    slot->freshUntil = policy.freshUntil;
+    slot->lastUsed = now;
+    slot->fileSize = fileSize;
+    slot->flags = (!policy.etag.empty() || !policy.lastModified.empty()) ? Slot::c_hasValidators : 0;
+    slot->key = key;
+    header->totalBytes += fileSize;
+    header->entryCount++;
+
+    EvictOverCapacity();
+    return true;
+}
+
+bool HttpCache::Refresh(std::wstring_view url, const Headers& headers, int64_t now)
+{
+    std::wstring normalized = NormalizeUrl(url);
+    if (normalized.empty() || !IsOpen())
+    {
+        return false;
+    }
+    Policy policy = GetPolicy(200, headers, now);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Slot* slot = FindSlot(HashKey(normalized), false);
+    if (!slot)
+    {
+        return false;
+    }
+    // Without new freshness information the entry keeps its old lifetime
+    int64_t lifetime = (std::max<int64_t>)(slot->freshUntil - slot->storedAt, 0);
+    slot->freshUntil = policy.explicitFreshness ? policy.freshUntil : now + lifetime;
+    slot->storedAt = now;
+    slot->lastUsed = now;
+    return true;
+}
+
+uint64_t HttpCache::GetTotalBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return IsOpen() ? GetHeader()->totalBytes : 0;
+}
+
+uint64_t HttpCache::GetEntryCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return IsOpen() ? GetHeader()->entryCount : 0;
+}
@@ -0,0 +1,128 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// On-disk cache for the subresources of crawled pages (viewer bundles,
+// info.json, tiles), kept outside the WebView profile so MG_CLEAR_CACHE
+// does not wipe it and every process and user-data folder can share it.
+//
+// index.bin is a memory-mapped open-addressing table: one fixed-size slot
+// per entry, keyed by the hash of the normalized URL, with its freshness,
+// validators and size. Each response lives in its own file under data/,
+// written to a temporary name and renamed into place before its slot is
+// published. Entry files repeat the URL and key, so a slot torn by a
+// concurrent writer in another process reads as a miss, never as the wrong
+// response. Freshness follows Cache-Control, Expires and the usual
+// Last-Modified heuristic; stale entries with an ETag or Last-Modified are
+// revalidated instead of fetched again. When the store grows past its
+// capacity the least recently used of a few sampled entries is dropped.
+class HttpCache
+{
+public:
+    using Headers = std::vector<std::pair<std::wstring, std::wstring>>;
+
+    struct Config
+    {
+        std::wstring directory;
+        uint64_t capacity = 1024ull * 1024 * 1024;
+        uint64_t maxEntrySize = 64ull * 1024 * 1024;
+        uint32_t slotCount = 1u << 16;
+    };
+
+    enum class Lookup
+    {
+        Miss,
+        Fresh,   // Serve as is
+        Stale    // Revalidate with the entry's ETag or Last-Modified first
+    };
+
+    // What the response headers allow; times are Unix seconds
+    struct Policy
+    {
+        bool storable = false;
+        bool explicitFreshness = false;  // Cache-Control or Expires said how long
+        int64_t freshUntil = 0;
+        std::wstring etag;
+        std::wstring lastModified;
+    };
+
+    struct Entry
+    {
+        int status = 0;
+        // Kept response headers as "Name: value" lines joined by CRLF, the
+        // form CreateWebResourceResponse takes
+        std::wstring headers;
+        std::wstring etag;
+        std::wstring lastModified;
+        std::string body;
+    };
+
+    HttpCache() = default;
+    ~HttpCache();
+    HttpCache(const HttpCache&) = delete;
+    HttpCache& operator=(const HttpCache&) = delete;
+
+    // Creates the directory and maps the index, starting a new one when the
+    // existing index has another layout.
+    bool Open(const Config& config);
+    void Close();
+    bool IsOpen() const { return m_index.IsOpen(); }
+
+    static int64_t NowSeconds();
+    // Lowercases scheme and host and drops the fragment and a default port.
+    // Empty for anything but http and https.
+    static std::wstring NormalizeUrl(std::wstring_view url);
+    static Policy GetPolicy(int status, const Headers& headers, int64_t now);
+    // IMF-fixdate as sent in Date, Expires and Last-Modified; -1 if invalid
+    static int64_t ParseHttpDate(std::wstring_view text);
+    // The headers kept with an entry, in the form Entry::headers uses
+    static std::wstring GetReplayedHeaders(const Headers& headers);
+
+    // What Find would answer, from the index alone; nothing is read from
+    // disk
+    Lookup Probe(std::wstring_view url, int64_t now) const;
+    // Fills entry for Fresh and Stale results.
+    Lookup Find(std::wstring_view url, int64_t now, Entry& entry);
+    // Stores a response the policy allows; false when it was not stored.
+    bool Store(std::wstring_view url, int status, const Headers& headers, std::string_view body, int64_t now);
+    // Extends a stale entry after a 304 Not Modified with these headers.
+    bool Refresh(std::wstring_view url, const Headers& headers, int64_t now);
+
+    uint64_t GetMaxEntrySize() const { return m_config.maxEntrySize; }
+    uint64_t GetTotalBytes() const;
+    uint64_t GetEntryCount() const;
+
+private:
+    struct IndexHeader;
+    struct Slot;
+
+    static uint64_t HashKey(std::wstring_view normalizedUrl);
+    std::wstring GetEntryPath(uint64_t key) const;
+    IndexHeader* GetHeader() const;
+    Slot* GetSlots() const;
+    // Slot holding key, else a free slot or the oldest one in its probe
+    // window, which the caller overwrites. Called with m_mutex held.
+    Slot* FindSlot(uint64_t key, bool forInsert) const;
+    void RemoveSlot(Slot& slot);
+    void EvictOverCapacity();
+    bool ReadEntry(uint64_t key, const std::wstring& url, Entry& entry) const;
+
+    Config m_config;
+    MappedFile m_index;
+    mutable std::mutex m_mutex;
+    uint64_t m_instanceId = 0;               // Keeps temporary file names unique between processes
+    std::atomic<uint64_t> m_tempCounter = 0;
+};
@@ -0,0 +1,372 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "JsonString.h"
+#include "CpuFeatures.h"
+
+#include <cstdint>
+
+namespace
+{
+    template <typename Unit>
+    inline bool NeedsEscape(Unit c)
+    {
+        return c == '"' || c == '\\' || static_cast<uint32_t>(c) < 0x20;
+    }
+
+    // Index of the first unit at or after start that needs escaping, or
+    // length if there is none.
+#if defined(BOOKGET_AVX2)
+    BOOKGET_TARGET_AVX2 size_t FindEscapeAvx2(const char16_t* text, size_t start, size_t length)
+    {
+        const __m256i quote = _mm256_set1_epi16('"');
+        const __m256i backslash = _mm256_set1_epi16('\\');
+        const __m256i control = _mm256_set1_epi16(0x1F);
+        const __m256i zero = _mm256_setzero_si256();
+        size_t i = start;
+        for (; i + 16 <= length; i += 16)
+        {
+            __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+            // Saturating subtract is zero exactly for units <= 0x1F
+            __m256i hits = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi16(units, quote), _mm256_cmpeq_epi16(units, backslash)),
+                _mm256_cmpeq_epi16(_mm256_subs_epu16(units, control), zero));
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+            if (mask != 0)
+            {
+                return i + CountTrailingZeros(mask) / 2;
+            }
+        }
+        return i;
+    }
+#endif
+
+
+    // Vector part of FindEscape, for UTF-16 units only (UTF-32 wchar_t
+    // takes the scalar loop). Stops at the first hit or when less than a
+    // block is left.
+    size_t FindEscapeVector(const char16_t* text, size_t start, size_t length, bool avx2)
+    {
+        size_t i = start;
+#if defined(BOOKGET_SSE2)
+        if (avx2)
+        {
+            i = FindEscapeAvx2(text, i, length);
+            if (i + 16 <= length)
+            {
+                return i;
+            }
+        }
+        const __m128i quote = _mm_set1_epi16('"');
+        const __m128i backslash = _mm_set1_epi16('\\');
+        const __m128i control = _mm_set1_epi16(0x1F);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+            __m128i hits = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi16(units, quote), _mm_cmpeq_epi16(units, backslash)),
+                _mm_cmpeq_epi16(_mm_subs_epu16(units, control), zero));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+            if (mask != 0)
+            {
+                return i + CountTrailingZeros(mask) / 2;
+            }
+        }
+#elif defined(BOOKGET_NEON)
+        (void)avx2;
+        const uint16x8_t quote = vdupq_n_u16('"');
+        const uint16x8_t backslash = vdupq_n_u16('\\');
+        const uint16x8_t control = vdupq_n_u16(0x20);
+        for (; i + 8 <= length; i += 8)
+        {
+            uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(text + i));
+            uint16x8_t hits = vorrq_u16(vorrq_u16(vceqq_u16(units, quote), vceqq_u16(units, backslash)),
+                vcltq_u16(units, control));
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hits)), 0);
+            if (mask != 0)
+            {
+                return i + CountTrailingZeros(mask) / 8;
+            }
+        }
+#else
+        (void)text;
+        (void)length;
+        (void)avx2;
+#endif
+        return i;
+    }
+
+    template <typename Unit>
+    size_t FindEscape(const Unit* text, size_t start, size_t length, bool avx2)
+    {
+        size_t i = start;
+        if constexpr (sizeof(Unit) == 2)
+        {
+            i = FindEscapeVector(reinterpret_cast<const char16_t*>(text), i, length, avx2);
+        }
+        for (; i < length; ++i)
+        {
+            if (NeedsEscape(text[i]))
+            {
+                return i;
+            }
+        }
+        return length;
+    }
+
+    // Vector part of FindQuoteOrBackslash, same contract as FindEscapeVector.
+    size_t FindQuoteOrBackslashVector(const char16_t* text, size_t start, size_t length)
+    {
+        size_t i = start;
+#if defined(BOOKGET_SSE2)
+        const __m128i quote = _mm_set1_epi16('"');
+        const __m128i backslash = _mm_set1_epi16('\\');
+        for (; i + 16 <= length; i += 16)
+        {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 8));
+            low = _mm_or_si128(_mm_cmpeq_epi16(low, quote), _mm_cmpeq_epi16(low, backslash));
+            high = _mm_or_si128(_mm_cmpeq_epi16(high, quote), _mm_cmpeq_epi16(high, backslash));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(low, high)));
+            if (mask != 0)
+            {
+                return i + CountTrailingZeros(mask);
+            }
+        }
+#elif defined(BOOKGET_NEON)
+        const uint16x8_t quote = vdupq_n_u16('"');
+        const uint16x8_t backslash = vdupq_n_u16('\\');
+        for (; i + 8 <= length; i += 8)
+        {
+            uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(text + i));
+            uint16x8_t hits = vorrq_u16(vceqq_u16(units, quote), vceqq_u16(units, backslash));
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hits)), 0);
+            if (mask != 0)
+            {
+                return i + CountTrailingZeros(mask) / 8;
+            }
+        }
+#else
+        (void)text;
+        (void)length;
+#endif
+        return i;
+    }
+
+    // Index of the first quote or backslash at or after start, or length.
+    template <typename Unit>
+    size_t FindQuoteOrBackslash(const Unit* text, size_t start, size_t length)
+    {
+        size_t i = start;
+        if constexpr (sizeof(Unit) == 2)
+        {
+            i = FindQuoteOrBackslashVector(reinterpret_cast<const char16_t*>(text), i, length);
+        }
+        for (; i < length; ++i)
+        {
+            if (text[i] == '"' || text[i] == '\\')
+            {
+                return i;
+            }
+        }
+        return length;
+    }
+
+    template <typename Unit>
+    int HexValue(Unit c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F')
+        {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    template <typename Unit>
+    void AppendEscape(std::basic_string<Unit>& out, char c)
+    {
+        const Unit escape[] = { '\\', static_cast<Unit>(c) };
+        out.append(escape, 2);
+    }
+
+    template <typename Unit>
+    void AppendQuotedImpl(std::basic_string<Unit>& out, std::basic_string_view<Unit> raw)
+    {
+        static const char hex[] = "0123456789abcdef";
+        const bool avx2 = CpuHasAvx2();
+
+        out.reserve(out.size() + raw.size() + 2);
+        out += static_cast<Unit>('"');
+        size_t i = 0;
+        while (i < raw.size())
+        {
+            size_t next = FindEscape(raw.data(), i, raw.size(), avx2);
+            out.append(raw.data() + i, next - i);
+            if (next == raw.size())
+            {
+                break;
+            }
+
+            Unit c = raw[next];
+            switch (c)
+            {
+            case '"':
+                AppendEscape(out, '"');
+                break;
+            case '\\':
+                AppendEscape(out, '\\');
+                break;
+            case '\b':
+                AppendEscape(out, 'b');
+                break;
+            case '\f':
+                AppendEscape(out, 'f');
+                break;
+            case '\n':
+                AppendEscape(out, 'n');
+                break;
+            case '\r':
+                AppendEscape(out, 'r');
+                break;
+            case '\t':
+                AppendEscape(out, 't');
+                break;
+            default:
+            {
+                const Unit escape[] = { '\\', 'u', '0', '0', static_cast<Unit>(hex[(c >> 4) & 0xF]),
+                    static_cast<Unit>(hex[c & 0xF]) };
+                out.append(escape, 6);
+                break;
+            }
+            }
+            i = next + 1;
+        }
+        out += static_cast<Unit>('"');
+    }
+
+    template <typename Unit>
+    bool UnquoteImpl(std::basic_string_view<Unit> json, std::basic_string<Unit>& out)
+    {
+        // ExecuteScript results carry no surrounding whitespace, but be lenient
+        const Unit whitespace[] = { ' ', '\t', '\r', '\n' };
+        const std::basic_string_view<Unit> blanks(whitespace, 4);
+        size_t first = json.find_first_not_of(blanks);
+        size_t last = json.find_last_not_of(blanks);
+        if (first == std::basic_string_view<Unit>::npos || last - first < 1 || json[first] != '"' || json[last] != '"')
+        {
+            return false;
+        }
+        const Unit* text = json.data() + first + 1;
+        const size_t length = last - first - 1;
+
+        out.clear();
+        out.reserve(length);
+        size_t i = 0;
+        while (i < length)
+        {
+            size_t next = FindQuoteOrBackslash(text, i, length);
+            out.append(text + i, next - i);
+            if (next == length)
+            {
+                break;
+            }
+            if (text[next] == '"')
+            {
+                // A bare quote ends the literal early, e.g. "a"b"
+                return false;
+            }
+            if (next + 1 >= length)
+            {
+                // The closing quote was escaped
+                return false;
+            }
+
+            Unit c = text[next + 1];
+            i = next + 2;
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                out += c;
+                break;
+            case 'b':
+                out += static_cast<Unit>('\b');
+                break;
+            case 'f':
+                out += static_cast<Unit>('\f');
+                break;
+            case 'n':
+                out += static_cast<Unit>('\n');
+                break;
+            case 'r':
+                out += static_cast<Unit>('\r');
+                break;
+            case 't':
+                out += static_cast<Unit>('\t');
+                break;
+            case 'u':
+            {
+                if (i + 4 > length)
+                {
+                    return false;
+                }
+                int value = 0;
+                for (size_t j = 0; j < 4; ++j)
+                {
+                    int digit = HexValue(text[i + j]);
+                    if (digit < 0)
+                    {
+                        return false;
+                    }
+                    value = (value << 4) | digit;
+                }
+                // Surrogate pairs arrive as two escapes and simply stay two units
+                out += static_cast<Unit>(value);
+                i += 4;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+void JsonString::AppendQuoted(std::wstring& out, std::wstring_view raw)
+{
+    AppendQuotedImpl(out, raw);
+}
+
+void JsonString::AppendQuoted(std::u16string& out, std::u16string_view raw)
+{
+    AppendQuotedImpl(out, raw);
+}
+
+std::wstring JsonString::Quote(std::wstring_view raw)
+{
+    std::wstring out;
+    AppendQuoted(out, raw);
+    return out;
+}
+
+bool JsonString::Unquote(std::wstring_view json, std::wstring& out)
+{
+    return UnquoteImpl(json, out);
+}
+
+bool JsonString::Unquote(std::u16string_view json, std::u16string& out)
+{
+    return UnquoteImpl(json, out);
+}
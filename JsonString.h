@@ -0,0 +1,29 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// JSON string literal escaping and unescaping without a regex or a full
+// JSON parser. Both directions scan 8-16 UTF-16 units at a time for the
+// few characters that need work (quote, backslash and control characters
+// when escaping, quote and backslash when unescaping) and copy the clean
+// runs in between in bulk. The char16_t overloads take the same vector
+// path on platforms where wchar_t is UTF-32.
+class JsonString
+{
+public:
+    // Appends raw as a quoted JSON string literal.
+    static void AppendQuoted(std::wstring& out, std::wstring_view raw);
+    static void AppendQuoted(std::u16string& out, std::u16string_view raw);
+    static std::wstring Quote(std::wstring_view raw);
+
+    // Decodes a JSON string literal such as an ExecuteScript result. Returns
+    // false, leaving out unspecified, when json is not a well-formed string
+    // literal (e.g. null, an object or "a"b").
+    static bool Unquote(std::wstring_view json, std::wstring& out);
+    static bool Unquote(std::u16string_view json, std::u16string& out);
+};
@@ -0,0 +1,274 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "MappedFile.h"
+#include "Transcoder.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::wstring& path)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(file, &size) ||
+        static_cast<uint64_t>(size.QuadPart) > (std::numeric_limits<size_t>::max)())
+    {
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_open = true;
+    if (m_size == 0)
+    {
+        // Empty files cannot be mapped
+        return true;
+    }
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+    {
+        m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int fd = open(std::filesystem::path(path).c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status = {};
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    m_size = static_cast<size_t>(status.st_size);
+    m_open = true;
+    if (m_size > 0)
+    {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(data);
+        }
+    }
+    close(fd);
+#endif
+
+    if (m_size > 0 && m_data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::OpenWritable(const std::wstring& path, size_t size)
+{
+    Close();
+    if (size == 0)
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_file = file;
+    m_size = size;
+    m_open = true;
+    m_writable = true;
+
+    // Mapping a size past the end grows the file, zero-filled
+    ULARGE_INTEGER mappingSize = {};
+    mappingSize.QuadPart = size;
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, nullptr);
+    if (m_mapping)
+    {
+        m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size));
+    }
+#else
+    int fd = open(std::filesystem::path(path).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status = {};
+    if (fstat(fd, &status) != 0 ||
+        (static_cast<uint64_t>(status.st_size) < size && ftruncate(fd, static_cast<off_t>(size)) != 0))
+    {
+        close(fd);
+        return false;
+    }
+    m_size = size;
+    m_open = true;
+    m_writable = true;
+    void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED)
+    {
+        m_data = static_cast<const char*>(data);
+    }
+    close(fd);
+#endif
+
+    if (m_data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::Flush()
+{
+    if (!m_writable || m_data == nullptr)
+    {
+        return false;
+    }
+#ifdef _WIN32
+    return FlushViewOfFile(m_data, 0) != FALSE;
+#else
+    return msync(const_cast<char*>(m_data), m_size, MS_ASYNC) == 0;
+#endif
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file)
+    {
+        CloseHandle(m_file);
+        m_file = nullptr;
+    }
+#else
+    if (m_data)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+    m_writable = false;
+}
+
+bool TextFileReader::Open(const std::wstring& path)
+{
+    m_text = std::string_view();
+    m_offset = 0;
+    if (!m_file.Open(path))
+    {
+        return false;
+    }
+
+    m_text = std::string_view(m_file.GetData(), m_file.GetSize());
+    if (m_text.size() >= 3 && m_text.compare(0, 3, "\xEF\xBB\xBF") == 0)
+    {
+        m_text.remove_prefix(3);
+    }
+    return true;
+}
+
+bool TextFileReader::NextChunk(std::string_view& chunk)
+{
+    if (m_offset >= m_text.size())
+    {
+        return false;
+    }
+
+    size_t end = m_text.size();
+    if (end - m_offset > m_chunkSize)
+    {
+        end = m_offset + m_chunkSize;
+        size_t newline = m_text.rfind('\n', end - 1);
+        if (newline != std::string_view::npos && newline >= m_offset)
+        {
+            end = newline + 1;
+        }
+        else
+        {
+            // No line break in range: at least do not split a UTF-8 sequence
+            while (end > m_offset && (static_cast<unsigned char>(m_text[end]) & 0xC0) == 0x80)
+            {
+                end--;
+            }
+            if (end == m_offset)
+            {
+                end = m_offset + m_chunkSize;
+            }
+        }
+    }
+
+    chunk = m_text.substr(m_offset, end - m_offset);
+    m_offset = end;
+    return true;
+}
+
+bool TextFileReader::NextLine(std::string_view& line)
+{
+    if (m_offset >= m_text.size())
+    {
+        return false;
+    }
+
+    size_t newline = m_text.find('\n', m_offset);
+    size_t end = newline == std::string_view::npos ? m_text.size() : newline;
+    line = m_text.substr(m_offset, end - m_offset);
+    if (!line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+    m_offset = newline == std::string_view::npos ? m_text.size() : newline + 1;
+    return true;
+}
+
+bool TextFileReader::NextChunk(std::wstring& chunk)
+{
+    std::string_view utf8;
+    if (!NextChunk(utf8))
+    {
+        return false;
+    }
+    chunk.resize(Transcoder::MaxUtf16Length(utf8.size()));
+    chunk.resize(Transcoder::Utf8ToUtf16(utf8.data(), utf8.size(), chunk.data()));
+    return true;
+}
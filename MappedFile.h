@@ -0,0 +1,69 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+
+#include <string>
+#include <string_view>
+
+// Memory mapping of a whole file, read-only unless opened writable.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::wstring& path);
+    // Maps the file for reading and writing, creating it or growing it to
+    // size bytes first. Writes are shared with every other mapping of it.
+    bool OpenWritable(const std::wstring& path, size_t size);
+    void Close();
+
+    bool IsOpen() const { return m_open; }
+    const char* GetData() const { return m_data; }
+    char* GetWritableData() const { return m_writable ? const_cast<char*>(m_data) : nullptr; }
+    size_t GetSize() const { return m_size; }
+    // Starts writing dirty pages back to the file
+    bool Flush();
+
+private:
+    bool m_open = false;
+    bool m_writable = false;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+// Walks a memory-mapped UTF-8 text file without copying it: whole, line by
+// line or in chunks of roughly chunkSize bytes. Chunks end after a newline
+// when one is in range and never inside a UTF-8 sequence, so each can be
+// decoded on its own and huge files never have to be held decoded in full.
+// A leading UTF-8 BOM is skipped.
+class TextFileReader
+{
+public:
+    explicit TextFileReader(size_t chunkSize = 1 << 20) : m_chunkSize(chunkSize ? chunkSize : 1) {}
+
+    bool Open(const std::wstring& path);
+    bool IsOpen() const { return m_file.IsOpen(); }
+    std::string_view GetText() const { return m_text; }
+
+    bool NextChunk(std::string_view& chunk);
+    // Line without its "\n" or "\r\n" terminator
+    bool NextLine(std::string_view& line);
+    bool NextChunk(std::wstring& chunk);
+
+private:
+    MappedFile m_file;
+    std::string_view m_text;
+    size_t m_offset = 0;
+    size_t m_chunkSize;
+};
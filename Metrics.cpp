@@ -0,0 +1,292 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    int FloorLog2(uint64_t value)
+    {
+        int log = 0;
+        while (value >>= 1)
+        {
+            log++;
+        }
+        return log;
+    }
+
+    void AppendSeconds(std::string& text, uint64_t microseconds)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.6f", microseconds / 1e6);
+        text += buffer;
+    }
+}
+
+uint32_t HdrHistogram::IndexOf(uint64_t value)
+{
+    if (value < c_subBucketCount)
+    {
+        return static_cast<uint32_t>(value);
+    }
+
+    int shift = FloorLog2(value) - (c_subBucketBits - 1);
+    if (shift > c_maxShift)
+    {
+        return c_bucketCount - 1;
+    }
+    uint32_t subBucket = static_cast<uint32_t>(value >> shift) - c_subBucketHalfCount;
+    return c_subBucketCount + (shift - 1) * c_subBucketHalfCount + subBucket;
+}
+
+uint64_t HdrHistogram::HighestValueAt(uint32_t index)
+{
+    if (index < c_subBucketCount)
+    {
+        return index;
+    }
+
+    uint32_t offset = index - c_subBucketCount;
+    int shift = static_cast<int>(offset / c_subBucketHalfCount) + 1;
+    uint64_t lowest = static_cast<uint64_t>(offset % c_subBucketHalfCount + c_subBucketHalfCount) << shift;
+    return lowest + (1ull << shift) - 1;
+}
+
+void HdrHistogram::Record(uint64_t value)
+{
+    m_counts[IndexOf(value)]++;
+    m_count++;
+    m_sum += value;
+    m_min = (std::min)(m_min, value);
+    m_max = (std::max)(m_max, value);
+}
+
+void HdrHistogram::Reset()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_count = 0;
+    m_min = UINT64_MAX;
+    m_max = 0;
+    m_sum = 0;
+}
+
+uint64_t HdrHistogram::GetValueAtPercentile(double percentile) const
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * m_count));
+    target = std::clamp<uint64_t>(target, 1, m_count);
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < c_bucketCount; ++i)
+    {
+        seen += m_counts[i];
+        if (seen >= target)
+        {
+            return (std::min)(HighestValueAt(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+Metrics& Metrics::Instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+int64_t Metrics::NowMicroseconds()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Metrics::Record(Histogram histogram, uint64_t microseconds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_histograms[static_cast<int>(histogram)].Record(microseconds);
+}
+
+void Metrics::RecordSince(Histogram histogram, int64_t startMicroseconds)
+{
+    int64_t elapsed = NowMicroseconds() - startMicroseconds;
+    Record(histogram, static_cast<uint64_t>((std::max<int64_t>)(elapsed, 0)));
+}
+
+void Metrics::Add(Counter counter, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters[static_cast<int>(counter)] += value;
+}
+
+uint64_t Metrics::Get(Counter counter) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counters[static_cast<int>(counter)];
+}
+
+void Metrics::Publish(MetricsBlock* block, uint32_t processId) const
+{
+    static_assert(static_cast<int>(Histogram::Count) <= MetricsBlock::c_maxHistograms, "MetricsBlock too small");
+    static_assert(static_cast<int>(Counter::Count) <= MetricsBlock::c_maxCounters, "MetricsBlock too small");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Seqlock: odd sequence tells readers the block is being rewritten
+    uint32_t sequence = block->sequence;
+    block->sequence = sequence | 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    block->magic = MetricsBlock::c_magic;
+    block->version = MetricsBlock::c_version;
+    block->PID = processId;
+    block->updatedAtUnixMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    block->counterCount = static_cast<uint32_t>(Counter::Count);
+    block->histogramCount = static_cast<uint32_t>(Histogram::Count);
+    block->bucketCount = HdrHistogram::c_bucketCount;
+    block->subBucketBits = HdrHistogram::c_subBucketBits;
+
+    for (int i = 0; i < static_cast<int>(Counter::Count); ++i)
+    {
+        block->counters[i] = m_counters[i];
+    }
+    for (int i = 0; i < static_cast<int>(Histogram::Count); ++i)
+    {
+        const HdrHistogram& histogram = m_histograms[i];
+        MetricsBlock::HistogramSummary& summary = block->histograms[i];
+        summary.count = histogram.GetCount();
+        summary.min = histogram.GetMin();
+        summary.max = histogram.GetMax();
+        summary.sum = histogram.GetSum();
+        summary.p50 = histogram.GetValueAtPercentile(50.0);
+        summary.p90 = histogram.GetValueAtPercentile(90.0);
+        summary.p99 = histogram.GetValueAtPercentile(99.0);
+        summary.p999 = histogram.GetValueAtPercentile(99.9);
+        memcpy(block->buckets[i], histogram.GetCounts().data(), sizeof(block->buckets[i]));
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    block->sequence = (sequence | 1) + 1;
+}
+
+std::string Metrics::ToPrometheusText() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string text;
+
+    for (int i = 0; i < static_cast<int>(Histogram::Count); ++i)
+    {
+        const HdrHistogram& histogram = m_histograms[i];
+        std::string name = std::string("bookget_") + GetName(static_cast<Histogram>(i)) + "_seconds";
+        text += "# TYPE " + name + " summary\n";
+        for (double quantile : { 0.5, 0.9, 0.99, 0.999 })
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "{quantile=\"%g\"} ", quantile);
+            text += name + label;
+            AppendSeconds(text, histogram.GetValueAtPercentile(quantile * 100.0));
+            text += "\n";
+        }
+        text += name + "_sum ";
+        AppendSeconds(text, histogram.GetSum());
+        text += "\n" + name + "_count " + std::to_string(histogram.GetCount()) + "\n";
+    }
+
+    for (int i = 0; i < static_cast<int>(Counter::Count); ++i)
+    {
+        std::string name = std::string("bookget_") + GetName(static_cast<Counter>(i)) + "_total";
+        text += "# TYPE " + name + " counter\n";
+        text += name + " " + std::to_string(m_counters[i]) + "\n";
+    }
+    return text;
+}
+
+const char* Metrics::GetName(Histogram histogram)
+{
+    switch (histogram)
+    {
+    case Histogram::Navigation:
+        return "navigation";
+    case Histogram::Capture:
+        return "capture";
+    case Histogram::Download:
+        return "download";
+    case Histogram::IpcWait:
+        return "ipc_wait";
+    case Histogram::TabCreate:
+        return "tab_create";
+    case Histogram::Startup:
+        return "startup";
+    default:
+        return "unknown";
+    }
+}
+
+const char* Metrics::GetName(Counter counter)
+{
+    switch (counter)
+    {
+    case Counter::Bytes:
+        return "downloaded_bytes";
+    case Counter::Retries:
+        return "retries";
+    case Counter::Failures:
+        return "failures";
+    case Counter::Navigations:
+        return "navigations";
+    case Counter::Captures:
+        return "captures";
+    case Counter::Downloads:
+        return "downloads";
+    case Counter::TabPoolHits:
+        return "tab_pool_hits";
+    case Counter::TabPoolMisses:
+        return "tab_pool_misses";
+    case Counter::TabSuspends:
+        return "tab_suspends";
+    case Counter::TabDiscards:
+        return "tab_discards";
+    case Counter::TabRestores:
+        return "tab_restores";
+    case Counter::BlockedRequests:
+        return "blocked_requests";
+    case Counter::BlockedBytesEstimate:
+        return "blocked_bytes_estimate";
+    case Counter::CacheHits:
+        return "cache_hits";
+    case Counter::CacheMisses:
+        return "cache_misses";
+    case Counter::CacheRevalidations:
+        return "cache_revalidations";
+    case Counter::CacheBytes:
+        return "cache_bytes";
+    case Counter::ImageCaptures:
+        return "image_captures";
+    case Counter::Prefetches:
+        return "prefetches";
+    case Counter::PrefetchHits:
+        return "prefetch_hits";
+    case Counter::PrefetchWasted:
+        return "prefetch_wasted";
+    case Counter::Stalls:
+        return "stalls";
+    case Counter::ProcessFailures:
+        return "process_failures";
+    case Counter::EnvironmentRecycles:
+        return "environment_recycles";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,150 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// High dynamic range histogram of microsecond latencies. Values below 256us
+// are exact, larger values land in log-linear buckets of 128 sub-buckets
+// each, i.e. better than 1% relative precision up to ~38 hours.
+class HdrHistogram
+{
+public:
+    static constexpr int c_subBucketBits = 8;
+    static constexpr uint32_t c_subBucketCount = 1u << c_subBucketBits;
+    static constexpr uint32_t c_subBucketHalfCount = c_subBucketCount / 2;
+    static constexpr int c_maxShift = 29;
+    static constexpr uint32_t c_bucketCount = c_subBucketCount + c_maxShift * c_subBucketHalfCount;
+
+    HdrHistogram() : m_counts(c_bucketCount, 0) {}
+
+    void Record(uint64_t value);
+    void Reset();
+
+    uint64_t GetCount() const { return m_count; }
+    uint64_t GetMin() const { return m_count ? m_min : 0; }
+    uint64_t GetMax() const { return m_max; }
+    uint64_t GetSum() const { return m_sum; }
+    uint64_t GetValueAtPercentile(double percentile) const;
+    const std::vector<uint64_t>& GetCounts() const { return m_counts; }
+
+    static uint32_t IndexOf(uint64_t value);
+    // Highest value that maps to the bucket; reported percentiles never
+    // understate the latency.
+    static uint64_t HighestValueAt(uint32_t index);
+
+private:
+    std::vector<uint64_t> m_counts;
+    uint64_t m_count = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+    uint64_t m_sum = 0;
+};
+
+// Fixed binary layout published in the Local\WebView2SharedMemoryMetrics
+// mapping. Readers take a consistent snapshot without any lock: copy the
+// block while sequence is even and unchanged before and after the copy.
+#pragma pack(push, 1)
+struct MetricsBlock
+{
+    static constexpr uint32_t c_magic = 0x544D4742;  // "BGMT"
+    static constexpr uint32_t c_version = 2;
+    static constexpr int c_maxCounters = 32;
+    static constexpr int c_maxHistograms = 8;
+
+    struct HistogramSummary
+    {
+        uint64_t count;
+        uint64_t min;
+        uint64_t max;
+        uint64_t sum;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t p999;
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t PID;
+    uint32_t sequence;           // Odd while the writer is updating the block
+    uint64_t updatedAtUnixMs;
+    uint32_t counterCount;
+    uint32_t histogramCount;
+    uint32_t bucketCount;        // HdrHistogram::c_bucketCount
+    uint32_t subBucketBits;      // HdrHistogram::c_subBucketBits
+    uint64_t counters[c_maxCounters];
+    HistogramSummary histograms[c_maxHistograms];  // Values in microseconds
+    uint64_t buckets[c_maxHistograms][HdrHistogram::c_bucketCount];
+};
+#pragma pack(pop)
+
+// Process-wide latency histograms and counters. The slot numbers of both
+// enums are part of the MetricsBlock layout: append, never reorder.
+class Metrics
+{
+public:
+    enum class Histogram
+    {
+        Navigation,  // NavigationStarting -> NavigationCompleted
+        Capture,     // outerHTML script round-trip through shared memory write
+        Download,    // DownloadStarting -> completed
+        IpcWait,     // Waiting for the shared memory mutex
+        TabCreate,   // Tab assigned -> first navigation issued
+        Startup,     // InitInstance -> first tab navigating
+        Count
+    };
+
+    enum class Counter
+    {
+        Bytes,       // Bytes downloaded
+        Retries,
+        Failures,
+        Navigations,
+        Captures,
+        Downloads,
+        TabPoolHits,    // Tabs handed out with a ready controller
+        TabPoolMisses,  // Tabs that still had to wait for their controller
+        TabSuspends,
+        TabDiscards,    // Background renderers closed to stay under budget
+        TabRestores,
+        BlockedRequests,  // Subresources dropped by the request filter
+        BlockedBytesEstimate,  // Summed from average response sizes per type, not measured
+        CacheHits,        // Subresources answered from the disk cache
+        CacheMisses,
+        CacheRevalidations,  // Stale entries confirmed by 304 Not Modified
+        CacheBytes,       // Body bytes served from the disk cache
+        ImageCaptures,    // Images saved from a response already received, not downloaded again
+        Prefetches,       // Queue entries warmed up in a background engine
+        PrefetchHits,     // Warmed entries that were ready when the download reached them
+        PrefetchWasted,   // Warmed entries that failed or were never reached
+        Stalls,           // Pages stopped by the watchdog past their deadline
+        ProcessFailures,  // Content renderers or browser processes that died or hung
+        EnvironmentRecycles,  // Content environments replaced by a new browser process
+        Count
+    };
+
+    static Metrics& Instance();
+    static int64_t NowMicroseconds();
+
+    void Record(Histogram histogram, uint64_t microseconds);
+    void RecordSince(Histogram histogram, int64_t startMicroseconds);
+    void Add(Counter counter, uint64_t value = 1);
+    uint64_t Get(Counter counter) const;
+
+    void Publish(MetricsBlock* block, uint32_t processId) const;
+    std::string ToPrometheusText() const;
+
+private:
+    static const char* GetName(Histogram histogram);
+    static const char* GetName(Counter counter);
+
+    mutable std::mutex m_mutex;
+    HdrHistogram m_histograms[static_cast<int>(Histogram::Count)];
+    uint64_t m_counters[static_cast<int>(Counter::Count)] = {};
+};
@@ -0,0 +1,250 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "MockEngine.h"
+
+#include <utility>
+
+void SimulatedLoop::Post(uint64_t delayMs, Task task)
+{
+    m_queue.push({ m_now + delayMs, m_sequence++, std::move(task) });
+}
+
+size_t SimulatedLoop::RunUntilIdle()
+{
+    size_t ran = 0;
+    while (!m_queue.empty())
+    {
+        Entry entry = std::move(const_cast<Entry&>(m_queue.top()));
+        m_queue.pop();
+        m_now = entry.time;
+        entry.task();
+        ran++;
+    }
+    return ran;
+}
+
+MockEngine::MockEngine(SimulatedLoop& loop, const Config& config, size_t tabId)
+    : BrowserEngine(tabId), m_loop(loop), m_config(config), m_random(config.seed ? config.seed : 1)
+{
+}
+
+uint64_t MockEngine::NextRandom()
+{
+    // xorshift64*
+    m_random ^= m_random >> 12;
+    m_random ^= m_random << 25;
+    m_random ^= m_random >> 27;
+    return m_random * 2685821657736338717ull;
+}
+
+bool MockEngine::Roll(double rate)
+{
+    if (rate <= 0)
+    {
+        return false;
+    }
+    return static_cast<double>(NextRandom() >> 11) * (1.0 / 9007199254740992.0) < rate;
+}
+
+uint64_t MockEngine::Latency(uint32_t baseMs)
+{
+    return baseMs + (m_config.jitterMs ? NextRandom() % (m_config.jitterMs + 1ull) : 0);
+}
+
+uint64_t MockEngine::ColdLatency(const std::wstring& uri)
+{
+    if (!m_profile)
+    {
+        return m_config.coldMs;
+    }
+    auto inserted = m_profile->warmAt.emplace(uri, m_loop.Now() + m_config.coldMs);
+    uint64_t warmAt = inserted.first->second;
+    return warmAt > m_loop.Now() ? warmAt - m_loop.Now() : 0;
+}
+
+bool MockEngine::Navigate(const std::wstring& uri)
+{
+    m_uri = uri;
+    uint64_t navigationId = ++m_navigationId;
+    m_navigations++;
+    bool fails = Roll(m_config.navigationFailureRate);
+    bool crashes = Roll(m_config.crashRate);
+    if (Roll(m_config.hangRate))
+    {
+        // The server keeps the connection open and never answers
+        m_hangs++;
+        return true;
+    }
+
+    m_loop.Post(ColdLatency(uri) + Latency(m_config.navigationMs), [this, uri, navigationId, fails, crashes]() {
+        if (navigationId != m_navigationId || !m_events)
+        {
+            return;
+        }
+        if (crashes && m_crashHandler)
+        {
+            m_crashes++;
+            m_crashHandler();
+            return;
+        }
+        if (fails)
+        {
+            m_events->OnNavigationCompleted(uri, false);
+            return;
+        }
+        if (m_responseCapture && CaptureResponse(uri))
+        {
+            // The body came with the navigation, nothing is fetched again
+            m_events->OnNavigationCompleted(uri, true);
+            return;
+        }
+        if (m_config.navigationDownloads)
+        {
+            // Like WebView2: the download starts, then the navigation
+            // completes as aborted
+            StartDownload(uri);
+            m_events->OnNavigationCompleted(uri, false);
+            return;
+        }
+        m_events->OnNavigationCompleted(uri, true);
+    });
+    return true;
+}
+
+bool MockEngine::Stop()
+{
+    ++m_navigationId;
+    ++m_downloadId;
+    return true;
+}
+
+void MockEngine::StartDownload(const std::wstring& uri)
+{
+    if (!m_events)
+    {
+        return;
+    }
+    if (!m_downloadsEnabled)
+    {
+        DownloadResult cancelled;
+        cancelled.uri = uri;
+        m_events->OnDownloadFinished(cancelled);
+        return;
+    }
+    std::wstring path = m_events->OnDownloadStarting(uri);
+    m_downloads++;
+    bool completes = !Roll(m_config.downloadFailureRate);
+    uint64_t downloadId = m_downloadId;
+
+    m_loop.Post(Latency(m_config.downloadMs), [this, uri, path, completes, downloadId]() {
+        if (downloadId != m_downloadId || !m_events)
+        {
+            return;
+        }
+        DownloadResult result;
+        result.uri = uri;
+        result.path = path;
+        result.completed = completes;
+        result.totalBytes = m_config.downloadBytes;
+        result.bytesReceived = completes ? m_config.downloadBytes : m_config.downloadBytes / 2;
+        m_events->OnDownloadFinished(result);
+    });
+}
+
+bool MockEngine::SetResponseCapture(bool enabled)
+{
+    m_responseCapture = enabled;
+    return true;
+}
+
+bool MockEngine::CaptureResponse(const std::wstring& uri)
+{
+    ImageResponse response;
+    response.uri = uri;
+    response.contentType = L"image/jpeg";
+    response.contentLength = m_config.downloadBytes;
+    response.isDocument = true;
+    std::wstring path = m_events->OnImageResponse(response);
+    if (path.empty())
+    {
+        return false;
+    }
+    m_captures++;
+    bool completes = !Roll(m_config.downloadFailureRate);
+    uint64_t downloadId = m_downloadId;
+
+    // Only the write to disk is left
+    m_loop.Post(0, [this, uri, path, completes, downloadId]() {
+        if (downloadId != m_downloadId || !m_events)
+        {
+            return;
+        }
+        DownloadResult result;
+        result.uri = uri;
+        result.path = path;
+        result.completed = completes;
+        result.totalBytes = m_config.downloadBytes;
+        result.bytesReceived = completes ? m_config.downloadBytes : 0;
+        m_events->OnDownloadFinished(result);
+    });
+    return true;
+}
+
+bool MockEngine::ExecuteScript(const std::wstring& script, ScriptCallback callback)
+{
+    bool fails = Roll(m_config.scriptFailureRate);
+    uint64_t navigationId = m_navigationId;
+    m_loop.Post(Latency(m_config.scriptMs), [this, script, callback = std::move(callback), navigationId, fails]() {
+        if (navigationId != m_navigationId)
+        {
+            // The page the script was meant for is gone
+            callback(false, std::wstring());
+            return;
+        }
+        if (fails)
+        {
+            callback(false, std::wstring());
+            return;
+        }
+        callback(true, m_scriptHandler ? m_scriptHandler(script) : std::wstring(L"null"));
+    });
+    return true;
+}
+
+bool MockEngine::GetCookies(const std::wstring& /*uri*/, CookiesCallback callback)
+{
+    m_loop.Post(Latency(m_config.cookiesMs), [this, callback = std::move(callback)]() {
+        std::vector<CookieView> views;
+        views.reserve(m_cookies.size());
+        for (const Cookie& cookie : m_cookies)
+        {
+            views.push_back(cookie.GetView());
+        }
+        callback(true, views);
+    });
+    return true;
+}
+
+size_t MockEngine::ImportCookies(const std::vector<Cookie>& cookies)
+{
+    for (const Cookie& cookie : cookies)
+    {
+        bool replaced = false;
+        for (Cookie& existing : m_cookies)
+        {
+            if (existing.name == cookie.name && existing.domain == cookie.domain && existing.path == cookie.path)
+            {
+                existing = cookie;
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced)
+        {
+            m_cookies.push_back(cookie);
+        }
+    }
+    return cookies.size();
+}
@@ -0,0 +1,138 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "BrowserEngine.h"
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Single-threaded event loop on a simulated millisecond clock. Tasks run in
+// time order, ties in posting order, so a run is fully reproducible.
+class SimulatedLoop
+{
+public:
+    using Task = std::function<void()>;
+
+    void Post(uint64_t delayMs, Task task);
+    // Runs tasks until none are left; returns how many ran.
+    size_t RunUntilIdle();
+    uint64_t Now() const { return m_now; }
+
+private:
+    struct Entry
+    {
+        uint64_t time;
+        uint64_t sequence;
+        Task task;
+
+        bool operator>(const Entry& other) const
+        {
+            return time != other.time ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_queue;
+    uint64_t m_now = 0;
+    uint64_t m_sequence = 0;
+};
+
+// What the engines of one simulated profile share: when each URL's
+// connection setup and subresources were paid for, in loop time.
+struct SimulatedProfile
+{
+    std::unordered_map<std::wstring, uint64_t> warmAt;
+};
+
+// In-process stand-in for a browser tab with configurable latencies and
+// failure rates, driven by a SimulatedLoop. Randomness comes from a seeded
+// generator, so the same configuration always produces the same run.
+class MockEngine : public BrowserEngine
+{
+public:
+    struct Config
+    {
+        uint32_t navigationMs = 80;
+        uint32_t scriptMs = 5;
+        uint32_t cookiesMs = 2;
+        uint32_t downloadMs = 150;
+        uint32_t jitterMs = 0;            // Added uniformly in [0, jitterMs]
+        // Added to the first navigation to a URL in the profile: DNS, TLS,
+        // redirects and the viewer's bundle. Later ones, in any engine of
+        // the profile, only wait for what is left of it.
+        uint32_t coldMs = 0;
+        double navigationFailureRate = 0;
+        double scriptFailureRate = 0;
+        double downloadFailureRate = 0;
+        double hangRate = 0;              // Navigations that never complete
+        double crashRate = 0;             // Navigations whose renderer dies, see SetCrashHandler
+        int64_t downloadBytes = 256 * 1024;
+        // Whether navigating starts the download, as for image URLs in
+        // WebView2; otherwise a page loads and a script has to trigger it.
+        bool navigationDownloads = true;
+        uint64_t seed = 1;
+    };
+
+    // Decides what a script returns; the default returns null. Call
+    // StartDownload from here to simulate a page that clicks a link.
+    using ScriptHandler = std::function<std::wstring(const std::wstring& script)>;
+
+    MockEngine(SimulatedLoop& loop, const Config& config, size_t tabId = 1);
+
+    void SetScriptHandler(ScriptHandler handler) { m_scriptHandler = std::move(handler); }
+    // Told when a navigation crashes the simulated renderer, in place of
+    // its completion. Nothing else about the engine changes.
+    void SetCrashHandler(std::function<void()> handler) { m_crashHandler = std::move(handler); }
+    // Without a profile every navigation is cold
+    void SetProfile(SimulatedProfile* profile) { m_profile = profile; }
+    void StartDownload(const std::wstring& uri);
+
+    bool Navigate(const std::wstring& uri) override;
+    bool Stop() override;
+    bool ExecuteScript(const std::wstring& script, ScriptCallback callback) override;
+    bool GetCookies(const std::wstring& uri, CookiesCallback callback) override;
+    size_t ImportCookies(const std::vector<Cookie>& cookies) override;
+    // Navigations then load as image documents whose body is offered to
+    // OnImageResponse, and only fall back to a download when it is refused.
+    bool SetResponseCapture(bool enabled) override;
+
+    const std::wstring& GetUri() const { return m_uri; }
+    size_t GetNavigationCount() const { return m_navigations; }
+    size_t GetDownloadCount() const { return m_downloads; }
+    size_t GetCaptureCount() const { return m_captures; }
+    size_t GetHangCount() const { return m_hangs; }
+    size_t GetCrashCount() const { return m_crashes; }
+
+private:
+    // True when the response was taken
+    bool CaptureResponse(const std::wstring& uri);
+
+    uint64_t NextRandom();
+    bool Roll(double rate);
+    uint64_t Latency(uint32_t baseMs);
+    // What is left of the URL's cold start, which begins now if nobody paid it
+    uint64_t ColdLatency(const std::wstring& uri);
+
+    SimulatedLoop& m_loop;
+    Config m_config;
+    ScriptHandler m_scriptHandler;
+    std::function<void()> m_crashHandler;
+    SimulatedProfile* m_profile = nullptr;
+    uint64_t m_random;
+    std::wstring m_uri;
+    uint64_t m_navigationId = 0;  // Bumped per Navigate and Stop, stale events are dropped
+    uint64_t m_downloadId = 0;    // Bumped per Stop, for downloads
+    std::vector<Cookie> m_cookies;
+    size_t m_navigations = 0;
+    size_t m_downloads = 0;
+    size_t m_captures = 0;
+    size_t m_hangs = 0;
+    size_t m_crashes = 0;
+    bool m_responseCapture = false;
+};
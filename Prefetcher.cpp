@@ -0,0 +1,196 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Prefetcher.h"
+#include "Metrics.h"
+#include "UrlClassifier.h"
+
+#include <algorithm>
+#include <utility>
+
+Prefetcher::Prefetcher(const Config& config)
+    : m_config(config)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+    for (std::unique_ptr<Slot>& slot : m_slots)
+    {
+        slot->m_engine.SetEvents(nullptr);
+    }
+}
+
+void Prefetcher::Log(const std::wstring& message) const
+{
+    if (m_log)
+    {
+        m_log(message);
+    }
+}
+
+void Prefetcher::AddEngine(BrowserEngine& engine)
+{
+    m_slots.push_back(std::make_unique<Slot>(*this, engine));
+    engine.SetDownloadsEnabled(false);
+    engine.SetEvents(m_slots.back().get());
+    Fill();
+}
+
+void Prefetcher::OnPageStarted(const std::vector<std::wstring>& urls, size_t index)
+{
+    m_urls = &urls;
+    m_current = index;
+
+    auto it = m_entries.find(index);
+    if (it != m_entries.end() && it->second != Status::Failed)
+    {
+        // Still loading is late but not wasted, the connection is shared
+        m_wastedInRow = 0;
+        if (it->second == Status::Ready)
+        {
+            m_hits++;
+            Metrics::Instance().Add(Metrics::Counter::PrefetchHits);
+        }
+    }
+    m_entries.erase(m_entries.begin(), m_entries.upper_bound(index));
+
+    // The download loads those itself now, and a page that hangs would hold
+    // its engine forever
+    for (std::unique_ptr<Slot>& slot : m_slots)
+    {
+        if (slot->m_busy && slot->m_index != c_noEntry && slot->m_index <= index)
+        {
+            slot->m_engine.Stop();
+            slot->m_busy = false;
+            slot->m_index = c_noEntry;
+        }
+    }
+    Fill();
+}
+
+void Prefetcher::Stop()
+{
+    size_t unreached = 0;
+    for (const auto& entry : m_entries)
+    {
+        unreached += entry.second != Status::Failed ? 1 : 0;
+    }
+    m_wasted += unreached;
+    Metrics::Instance().Add(Metrics::Counter::PrefetchWasted, unreached);
+    m_entries.clear();
+    m_urls = nullptr;
+    m_enabled = true;
+    m_wastedInRow = 0;
+
+    for (std::unique_ptr<Slot>& slot : m_slots)
+    {
+        if (slot->m_busy)
+        {
+            slot->m_engine.Stop();
+        }
+        slot->m_index = c_noEntry;
+        slot->m_busy = slot->m_engine.Navigate(L"about:blank");
+    }
+}
+
+void Prefetcher::Fill()
+{
+    if (!m_enabled || !m_urls || m_urls->empty())
+    {
+        return;
+    }
+
+    size_t last = (std::min)(m_current + m_config.lookahead, m_urls->size() - 1);
+    for (size_t index = m_current + 1; index <= last; ++index)
+    {
+        if (m_entries.count(index) != 0 || UrlClassifier::Default().ClassifyUrl((*m_urls)[index]).IsImage())
+        {
+            continue;
+        }
+        auto idle = std::find_if(m_slots.begin(), m_slots.end(),
+            [](const std::unique_ptr<Slot>& slot) { return !slot->m_busy; });
+        if (idle == m_slots.end())
+        {
+            return;
+        }
+
+        Slot& slot = **idle;
+        slot.m_index = index;
+        slot.m_busy = true;
+        slot.m_answered = false;
+        m_entries[index] = Status::Loading;
+        m_issued++;
+        Metrics::Instance().Add(Metrics::Counter::Prefetches);
+        if (!slot.m_engine.Navigate((*m_urls)[index]))
+        {
+            slot.m_busy = false;
+            slot.m_index = c_noEntry;
+            m_entries[index] = Status::Failed;
+            Waste(1);
+            if (!m_enabled)
+            {
+                return;
+            }
+        }
+    }
+}
+
+void Prefetcher::OnSlotFinished(Slot& slot, bool succeeded)
+{
+    size_t index = slot.m_index;
+    slot.m_busy = false;
+    slot.m_index = c_noEntry;
+
+    // Entries the download already reached are accounted for
+    auto it = index != c_noEntry ? m_entries.find(index) : m_entries.end();
+    if (it != m_entries.end() && it->second == Status::Loading)
+    {
+        if (succeeded)
+        {
+            it->second = Status::Ready;
+        }
+        else
+        {
+            it->second = Status::Failed;
+            Log(L"Prefetch failed: " + (m_urls ? (*m_urls)[index] : std::wstring()) + L"\n");
+            Waste(1);
+        }
+    }
+    Fill();
+}
+
+void Prefetcher::Waste(size_t count)
+{
+    m_wasted += count;
+    m_wastedInRow += count;
+    Metrics::Instance().Add(Metrics::Counter::PrefetchWasted, count);
+    if (m_enabled && m_wastedInRow >= m_config.maxWasted)
+    {
+        m_enabled = false;
+        Log(L"Prefetching stopped after " + std::to_wstring(m_wastedInRow) + L" wasted entries in a row\n");
+    }
+}
+
+void Prefetcher::Slot::OnNavigationCompleted(const std::wstring& /*uri*/, bool succeeded)
+{
+    if (m_busy)
+    {
+        // A navigation that became a download completes as aborted
+        m_owner.OnSlotFinished(*this, succeeded || m_answered);
+    }
+}
+
+std::wstring Prefetcher::Slot::OnDownloadStarting(const std::wstring& /*uri*/)
+{
+    // Not raised while downloads are off
+    return std::wstring();
+}
+
+void Prefetcher::Slot::OnDownloadFinished(const DownloadResult& /*result*/)
+{
+    // The cancelled download of an entry that turned out to be a file: the
+    // server has answered
+    m_answered = m_busy;
+}
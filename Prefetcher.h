@@ -0,0 +1,106 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "BrowserEngine.h"
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Navigates the next few queue entries in background engines while the
+// DownloadScheduler works on the current one. The engines share the
+// foreground's profile, so by the time the download reaches an entry its
+// DNS lookup, TLS handshake, redirects and viewer bundle are already in the
+// connection pool and the caches. Nothing is saved from the background
+// engines: their downloads are cancelled as soon as they start. Entries
+// that UrlClassifier already knows to be images are skipped; a background
+// engine would fetch the whole image only for the download to fetch it
+// again, and there is no viewer to warm.
+//
+// At most one entry per engine is in flight and never more than lookahead
+// entries ahead; an engine still loading when the download reaches its entry
+// is stopped. Entries that fail or are never reached count as wasted;
+// after maxWasted of them in a row prefetching stops for the rest of the
+// batch, e.g. when a server refuses parallel requests.
+class Prefetcher
+{
+public:
+    struct Config
+    {
+        size_t lookahead = 2;
+        size_t maxWasted = 8;
+    };
+
+    explicit Prefetcher(const Config& config);
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    void SetLog(std::function<void(const std::wstring& message)> log) { m_log = std::move(log); }
+    // Takes over the engine's events and turns its downloads off. Engines
+    // may be added while a batch runs, e.g. as their tabs become ready.
+    void AddEngine(BrowserEngine& engine);
+
+    // The scheduler moved on to urls[index]; urls must stay alive until
+    // Stop.
+    void OnPageStarted(const std::vector<std::wstring>& urls, size_t index);
+    // Ends the batch and sends the engines to a blank page.
+    void Stop();
+
+    bool IsEnabled() const { return m_enabled; }
+    size_t GetEngineCount() const { return m_slots.size(); }
+    size_t GetIssuedCount() const { return m_issued; }
+    size_t GetHitCount() const { return m_hits; }
+    size_t GetWastedCount() const { return m_wasted; }
+
+private:
+    enum class Status
+    {
+        Loading,
+        Ready,
+        Failed
+    };
+
+    // One background engine and the entry it is loading
+    class Slot : public BrowserEngineEvents
+    {
+    public:
+        Slot(Prefetcher& owner, BrowserEngine& engine) : m_owner(owner), m_engine(engine) {}
+
+        void OnNavigationCompleted(const std::wstring& uri, bool succeeded) override;
+        std::wstring OnDownloadStarting(const std::wstring& uri) override;
+        void OnDownloadFinished(const DownloadResult& result) override;
+
+        Prefetcher& m_owner;
+        BrowserEngine& m_engine;
+        size_t m_index = 0;
+        bool m_busy = false;
+        bool m_answered = false;  // The server answered with a download
+    };
+
+    static constexpr size_t c_noEntry = static_cast<size_t>(-1);
+
+    void Log(const std::wstring& message) const;
+    void Fill();
+    void OnSlotFinished(Slot& slot, bool succeeded);
+    void Waste(size_t count);
+
+    Config m_config;
+    std::function<void(const std::wstring& message)> m_log;
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    const std::vector<std::wstring>* m_urls = nullptr;
+    size_t m_current = 0;
+    std::map<size_t, Status> m_entries;  // Entries past m_current that were prefetched
+    bool m_enabled = true;
+    size_t m_wastedInRow = 0;
+    size_t m_issued = 0;
+    size_t m_hits = 0;
+    size_t m_wasted = 0;
+};
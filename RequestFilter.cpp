@@ -0,0 +1,267 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "RequestFilter.h"
+#include "Metrics.h"
+#include "UrlParser.h"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr uint32_t c_noNode = UINT32_MAX;
+
+    bool IsSpace(wchar_t c)
+    {
+        return c == L' ' || c == L'\t' || c == L'\r';
+    }
+}
+
+RequestFilter::Mode RequestFilter::ParseMode(const std::wstring& name)
+{
+    if (name == L"capture")
+    {
+        return Mode::Capture;
+    }
+    if (name == L"download")
+    {
+        return Mode::Download;
+    }
+    return Mode::Off;
+}
+
+void RequestFilter::Configure(Mode mode)
+{
+    m_mode = mode;
+    switch (mode)
+    {
+    case Mode::Capture:
+        m_blockedTypes = GetBit(ResourceType::Image) | GetBit(ResourceType::Media) |
+            GetBit(ResourceType::Font) | GetBit(ResourceType::Stylesheet) | GetBit(ResourceType::TextTrack);
+        break;
+    case Mode::Download:
+        // Stylesheets stay: the trigger script may find the image as a CSS
+        // background
+        m_blockedTypes = GetBit(ResourceType::Media) | GetBit(ResourceType::Font) | GetBit(ResourceType::TextTrack);
+        break;
+    default:
+        m_blockedTypes = 0;
+        break;
+    }
+}
+
+uint64_t RequestFilter::HashLabel(std::wstring_view label)
+{
+    // FNV-1a over the lower-cased label
+    uint64_t hash = 14695981039346656037ULL;
+    for (wchar_t c : label)
+    {
+        if (c >= L'A' && c <= L'Z')
+        {
+            c = static_cast<wchar_t>(c - L'A' + L'a');
+        }
+        hash ^= static_cast<uint64_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint32_t RequestFilter::FindChild(uint32_t node, uint64_t hash) const
+{
+    const auto& children = m_nodes[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), hash,
+        [](const std::pair<uint64_t, uint32_t>& child, uint64_t value) { return child.first < value; });
+    return it != children.end() && it->first == hash ? it->second : c_noNode;
+}
+
+void RequestFilter::AddDomain(std::wstring_view domain)
+{
+    while (!domain.empty() && (domain.back() == L'.' || IsSpace(domain.back())))
+    {
+        domain.remove_suffix(1);
+    }
+    while (!domain.empty() && (domain.front() == L'.' || domain.front() == L'*' || IsSpace(domain.front())))
+    {
+        domain.remove_prefix(1);
+    }
+    if (domain.empty())
+    {
+        return;
+    }
+
+    uint32_t node = 0;
+    size_t end = domain.size();
+    while (true)
+    {
+        size_t dot = domain.rfind(L'.', end - 1);
+        size_t begin = dot == std::wstring_view::npos ? 0 : dot + 1;
+        uint64_t hash = HashLabel(domain.substr(begin, end - begin));
+
+        uint32_t child = FindChild(node, hash);
+        if (child == c_noNode)
+        {
+            child = static_cast<uint32_t>(m_nodes.size());
+            m_nodes.emplace_back();
+            auto& children = m_nodes[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), hash,
+                [](const std::pair<uint64_t, uint32_t>& entry, uint64_t value) { return entry.first < value; });
+            children.insert(it, { hash, child });
+        }
+        node = child;
+
+        if (dot == std::wstring_view::npos || dot == 0)
+        {
+            break;
+        }
+        end = dot;
+    }
+
+    if (!m_nodes[node].terminal)
+    {
+        m_nodes[node].terminal = true;
+        m_domainCount++;
+    }
+}
+
+void RequestFilter::AddDefaultDomains()
+{
+    static const wchar_t* const c_defaultDomains[] = {
+        L"google-analytics.com",
+        L"googletagmanager.com",
+        L"googlesyndication.com",
+        L"doubleclick.net",
+        L"googleadservices.com",
+        L"connect.facebook.net",
+        L"hotjar.com",
+        L"clarity.ms",
+        L"scorecardresearch.com",
+        L"quantserve.com",
+        L"hm.baidu.com",
+        L"cnzz.com",
+        L"51.la",
+        L"mc.yandex.ru",
+    };
+    for (const wchar_t* domain : c_defaultDomains)
+    {
+        AddDomain(domain);
+    }
+}
+
+size_t RequestFilter::AddDomainList(std::wstring_view text)
+{
+    size_t before = m_domainCount;
+    size_t position = 0;
+    while (position < text.size())
+    {
+        size_t lineEnd = text.find(L'\n', position);
+        if (lineEnd == std::wstring_view::npos)
+        {
+            lineEnd = text.size();
+        }
+        std::wstring_view line = text.substr(position, lineEnd - position);
+        position = lineEnd + 1;
+
+        size_t comment = line.find(L'#');
+        if (comment != std::wstring_view::npos)
+        {
+            line = line.substr(0, comment);
+        }
+        // Hosts files put the address first; the domain is the last field
+        while (!line.empty() && IsSpace(line.back()))
+        {
+            line.remove_suffix(1);
+        }
+        size_t space = line.find_last_of(L" \t");
+        if (space != std::wstring_view::npos)
+        {
+            line = line.substr(space + 1);
+        }
+        if (line != L"localhost")
+        {
+            AddDomain(line);
+        }
+    }
+    return m_domainCount - before;
+}
+
+bool RequestFilter::IsDomainBlocked(std::wstring_view host) const
+{
+    while (!host.empty() && host.back() == L'.')
+    {
+        host.remove_suffix(1);
+    }
+    if (host.empty() || m_domainCount == 0)
+    {
+        return false;
+    }
+
+    uint32_t node = 0;
+    size_t end = host.size();
+    while (true)
+    {
+        size_t dot = host.rfind(L'.', end - 1);
+        size_t begin = dot == std::wstring_view::npos ? 0 : dot + 1;
+        node = FindChild(node, HashLabel(host.substr(begin, end - begin)));
+        if (node == c_noNode)
+        {
+            return false;
+        }
+        if (m_nodes[node].terminal)
+        {
+            return true;
+        }
+        if (dot == std::wstring_view::npos || dot == 0)
+        {
+            return false;
+        }
+        end = dot;
+    }
+}
+
+RequestFilter::Decision RequestFilter::Check(std::wstring_view url, ResourceType type)
+{
+    // The page itself is never blocked, whatever its host
+    if (m_mode == Mode::Off || type == ResourceType::Document)
+    {
+        return Decision::Allow;
+    }
+
+    Decision decision = Decision::Allow;
+    if (m_blockedTypes & GetBit(type))
+    {
+        decision = Decision::BlockedType;
+    }
+    else if (m_domainCount > 0 && IsDomainBlocked(UrlParser::Parse(url).host))
+    {
+        decision = Decision::BlockedDomain;
+    }
+
+    if (decision != Decision::Allow)
+    {
+        Metrics& metrics = Metrics::Instance();
+        metrics.Add(Metrics::Counter::BlockedRequests);
+        metrics.Add(Metrics::Counter::BlockedBytesEstimate, GetEstimatedBytes(type));
+    }
+    return decision;
+}
+
+uint64_t RequestFilter::GetEstimatedBytes(ResourceType type)
+{
+    // Rough median transfer sizes of web pages' subresources
+    switch (type)
+    {
+    case ResourceType::Stylesheet:
+        return 16 * 1024;
+    case ResourceType::Image:
+        return 48 * 1024;
+    case ResourceType::Media:
+        return 512 * 1024;
+    case ResourceType::Font:
+        return 32 * 1024;
+    case ResourceType::Script:
+        return 24 * 1024;
+    default:
+        return 2 * 1024;
+    }
+}
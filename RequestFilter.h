@@ -0,0 +1,99 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Decides which subresource requests a job does not need. Requests are
+// blocked by resource type, e.g. fonts and media when only outerHTML is
+// captured, or by host against a domain list that also covers subdomains.
+// Hosts are matched label by label, right to left, through a trie keyed by
+// label hashes, so a check costs a few hash probes and never allocates.
+class RequestFilter
+{
+public:
+    // Values match COREWEBVIEW2_WEB_RESOURCE_CONTEXT
+    enum class ResourceType : uint8_t
+    {
+        Document = 1,
+        Stylesheet,
+        Image,
+        Media,
+        Font,
+        Script,
+        XmlHttpRequest,
+        Fetch,
+        TextTrack,
+        EventSource,
+        WebSocket,
+        Manifest,
+        SignedExchange,
+        Ping,
+        CspViolationReport,
+        Other,
+        Count
+    };
+
+    enum class Mode
+    {
+        Off,
+        Capture,   // -i/-o: only the DOM matters, no images, media, fonts or CSS
+        Download   // -urls: the image must load, fonts and media need not
+    };
+
+    enum class Decision
+    {
+        Allow,
+        BlockedType,
+        BlockedDomain
+    };
+
+    static Mode ParseMode(const std::wstring& name);
+    static constexpr uint32_t GetBit(ResourceType type) { return 1u << static_cast<uint32_t>(type); }
+
+    // Sets the blocked types for the mode; Off also ignores the domain list.
+    void Configure(Mode mode);
+    Mode GetMode() const { return m_mode; }
+    bool IsEnabled() const { return m_mode != Mode::Off; }
+    uint32_t GetBlockedTypes() const { return m_blockedTypes; }
+    // Whether every request has to be seen, not just the blocked types
+    bool HasDomains() const { return m_domainCount > 0; }
+
+    // Blocks the domain and all of its subdomains.
+    void AddDomain(std::wstring_view domain);
+    // Analytics and ad hosts common on library portals
+    void AddDefaultDomains();
+    // One domain per line; hosts-file lines ("0.0.0.0 example.com") and
+    // # comments are accepted. Returns how many domains were added.
+    size_t AddDomainList(std::wstring_view text);
+
+    // Counts what it blocks in the blocked_requests and
+    // blocked_bytes_estimate metrics.
+    Decision Check(std::wstring_view url, ResourceType type);
+    bool IsDomainBlocked(std::wstring_view host) const;
+
+    // Typical transfer size of a response of this type, what a blocked
+    // request is assumed to have saved
+    static uint64_t GetEstimatedBytes(ResourceType type);
+
+private:
+    struct Node
+    {
+        std::vector<std::pair<uint64_t, uint32_t>> children;  // Label hash -> node, sorted
+        bool terminal = false;
+    };
+
+    static uint64_t HashLabel(std::wstring_view label);
+    uint32_t FindChild(uint32_t node, uint64_t hash) const;
+
+    Mode m_mode = Mode::Off;
+    uint32_t m_blockedTypes = 0;
+    std::vector<Node> m_nodes = std::vector<Node>(1);  // Node 0 is the root
+    size_t m_domainCount = 0;
+};
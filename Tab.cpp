@@ -4,116 +4,393 @@
 
 #include "BrowserWindow.h"
 #include "CheckFailure.h"
+#include "CookieCodec.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include "Util.h"
 #include "env.h"
 
 using namespace Microsoft::WRL;
 
 
-std::unique_ptr<Tab> Tab::CreateNewTab(HWND hWnd, ICoreWebView2Environment* env, size_t id, bool shouldBeActive)
+std::unique_ptr<Tab> Tab::CreateNewTab(HWND hWnd, ICoreWebView2Environment* env)
 {
     std::unique_ptr<Tab> tab = std::make_unique<Tab>();
     tab->m_parentHWnd = hWnd;
-    tab->m_tabId = id;
     tab->SetMessageBroker();
-    tab->Init(env, shouldBeActive);
+    tab->Init(env);
 
     return tab;
 }
 
-HRESULT Tab::Init(ICoreWebView2Environment* env, bool shouldBeActive)
+std::unique_ptr<Tab> Tab::CreateWarmTab(HWND hWnd, ICoreWebView2Environment* env, WarmedCallback onWarmed)
 {
-    return env->CreateCoreWebView2Controller(m_parentHWnd, Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
-        [this, shouldBeActive](HRESULT result, ICoreWebView2Controller* host) -> HRESULT {
-        if (!SUCCEEDED(result))
+    std::unique_ptr<Tab> tab = std::make_unique<Tab>();
+    tab->m_parentHWnd = hWnd;
+    tab->m_onWarmed = std::move(onWarmed);
+    tab->SetMessageBroker();
+    if (FAILED(tab->Init(env)))
+    {
+        // The completion handler never runs
+        return nullptr;
+    }
+
+    return tab;
+}
+
+void Tab::Assign(size_t id, bool shouldBeActive, const std::wstring& uri)
+{
+    m_tabId = id;
+    m_shouldBeActive = shouldBeActive;
+    m_pendingUri = uri;
+    m_assignedAt = Metrics::NowMicroseconds();
+    m_onWarmed = nullptr;
+    if (IsReady())
+    {
+        BrowserWindow::CheckFailure(Start(), L"Can't start tab");
+    }
+}
+
+void Tab::Abandon(std::unique_ptr<Tab> tab)
+{
+    if (!tab)
+    {
+        return;
+    }
+    if (tab->m_creating)
+    {
+        // The completion handler still points at the tab
+        tab->m_abandoned = true;
+        tab->m_onWarmed = nullptr;
+        tab.release();
+        return;
+    }
+    if (tab->m_contentController)
+    {
+        tab->m_contentController->Close();
+    }
+}
+
+HRESULT Tab::Start()
+{
+    BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+    std::wstring uri = m_pendingUri.empty() ? g_sUrl : m_pendingUri;
+    m_pendingUri.clear();
+
+    //Ĭҳ
+    RETURN_IF_FAILED(m_contentWebView->Navigate(uri.c_str()));
+    browserWindow->HandleTabCreated(m_tabId, m_shouldBeActive);
+    Metrics::Instance().RecordSince(Metrics::Histogram::TabCreate, m_assignedAt);
+    return S_OK;
+}
+
+bool Tab::TrySuspend(std::function<void(bool suspended)> callback)
+{
+    auto webview3 = m_contentWebView.try_query<ICoreWebView2_3>();
+    if (!webview3)
+    {
+        return false;
+    }
+    return SUCCEEDED(webview3->TrySuspend(Callback<ICoreWebView2TrySuspendCompletedHandler>(
+        [callback = std::move(callback)](HRESULT errorCode, BOOL isSuccessful) -> HRESULT
+    {
+        callback(SUCCEEDED(errorCode) && isSuccessful);
+        return S_OK;
+    }).Get()));
+}
+
+HRESULT Tab::Discard()
+{
+    if (!IsReady())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    wil::unique_cotaskmem_string source;
+    RETURN_IF_FAILED(m_contentWebView->get_Source(&source));
+    m_discardedUri = source.get() ? source.get() : L"";
+    m_discarded = true;
+
+    // Closing the controller drops the renderer along with every handler
+    m_contentController->Close();
+    m_securityStateChangedReceiver.reset();
+    m_cookieManager.reset();
+    m_contentWebView.reset();
+    m_contentController.reset();
+    return S_OK;
+}
+
+HRESULT Tab::Restore(ICoreWebView2Environment* env, bool shouldBeActive, const std::wstring& uri)
+{
+    if (!m_discarded)
+    {
+        return S_OK;
+    }
+    m_discarded = false;
+    m_pendingUri = uri.empty() ? m_discardedUri : uri;
+    m_shouldBeActive = shouldBeActive;
+    m_assignedAt = Metrics::NowMicroseconds();
+    return Init(env);
+}
+
+HRESULT Tab::SetupWebResourceHandlers(ICoreWebView2Environment* env)
+{
+    BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+    RequestFilter& filter = browserWindow->GetRequestFilter();
+    WebResourceCache* cache = browserWindow->GetWebResourceCache();
+    auto webview2_2 = m_contentWebView.try_query<ICoreWebView2_2>();
+    if (!webview2_2)
+    {
+        // Without WebResourceResponseReceived nothing could be stored
+        cache = nullptr;
+    }
+    if (!filter.IsEnabled() && !cache)
+    {
+        return S_OK;
+    }
+
+    // Every request crosses over to the UI thread once it matches a filter,
+    // so only the blocked and cacheable types are routed here unless domains
+    // have to be checked as well
+    if (filter.IsEnabled() && filter.HasDomains())
+    {
+        RETURN_IF_FAILED(m_contentWebView->AddWebResourceRequestedFilter(L"*", COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL));
+    }
+    else
+    {
+        for (uint32_t type = 0; type < static_cast<uint32_t>(RequestFilter::ResourceType::Count); ++type)
         {
-            OutputDebugString(L"Tab WebView creation failed\n");
-            return result;
+            COREWEBVIEW2_WEB_RESOURCE_CONTEXT context = static_cast<COREWEBVIEW2_WEB_RESOURCE_CONTEXT>(type);
+            if ((filter.GetBlockedTypes() & (1u << type)) || (cache && WebResourceCache::IsCacheable(context)))
+            {
+                RETURN_IF_FAILED(m_contentWebView->AddWebResourceRequestedFilter(L"*", context));
+            }
         }
-        m_contentController = host;
-        BrowserWindow::CheckFailure(m_contentController->get_CoreWebView2(&m_contentWebView), L"");
-        BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
-        RETURN_IF_FAILED(m_contentWebView->add_WebMessageReceived(m_messageBroker.get(), &m_messageBrokerToken));
+    }
 
-        // Register event handler for history change
-        RETURN_IF_FAILED(m_contentWebView->add_HistoryChanged(Callback<ICoreWebView2HistoryChangedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, IUnknown* args) -> HRESULT
+    wil::com_ptr<ICoreWebView2Environment> environment = env;
+    RETURN_IF_FAILED(m_contentWebView->add_WebResourceRequested(Callback<ICoreWebView2WebResourceRequestedEventHandler>(
+        [browserWindow, environment, cache](ICoreWebView2* webview, ICoreWebView2WebResourceRequestedEventArgs* args) -> HRESULT
+    {
+        COREWEBVIEW2_WEB_RESOURCE_CONTEXT context;
+        RETURN_IF_FAILED(args->get_ResourceContext(&context));
+        wil::com_ptr<ICoreWebView2WebResourceRequest> request;
+        RETURN_IF_FAILED(args->get_Request(&request));
+        wil::unique_cotaskmem_string uri;
+        RETURN_IF_FAILED(request->get_Uri(&uri));
+
+        RequestFilter::Decision decision = browserWindow->GetRequestFilter().Check(uri.get(),
+            static_cast<RequestFilter::ResourceType>(context));
+        if (decision != RequestFilter::Decision::Allow)
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabHistoryUpdate(m_tabId, webview), L"Can't update go back/forward buttons.");
-
+            wil::com_ptr<ICoreWebView2WebResourceResponse> response;
+            RETURN_IF_FAILED(environment->CreateWebResourceResponse(nullptr, 403, L"Blocked", L"", &response));
+            RETURN_IF_FAILED(args->put_Response(response.get()));
             return S_OK;
-        }).Get(), &m_historyUpdateForwarderToken));
-
-        // Register event handler for source change
-        RETURN_IF_FAILED(m_contentWebView->add_SourceChanged(Callback<ICoreWebView2SourceChangedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2SourceChangedEventArgs* args) -> HRESULT
+        }
+        if (cache && WebResourceCache::IsCacheable(context))
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabURIUpdate(m_tabId, webview), L"Can't update address bar");
+            return cache->HandleRequest(environment.get(), args, request.get(), uri.get());
+        }
+        return S_OK;
+    }).Get(), &m_webResourceRequestedToken));
 
-            return S_OK;
-        }).Get(), &m_uriUpdateForwarderToken));
+    if (!cache)
+    {
+        return S_OK;
+    }
+    return webview2_2->add_WebResourceResponseReceived(Callback<ICoreWebView2WebResourceResponseReceivedEventHandler>(
+        [cache](ICoreWebView2* webview, ICoreWebView2WebResourceResponseReceivedEventArgs* args) -> HRESULT
+    {
+        return cache->HandleResponse(args);
+    }).Get(), &m_webResourceResponseReceivedToken);
+}
 
-        RETURN_IF_FAILED(m_contentWebView->add_NavigationStarting(Callback<ICoreWebView2NavigationStartingEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT
+HRESULT Tab::Init(ICoreWebView2Environment* env)
+{
+    wil::com_ptr<ICoreWebView2Environment> environment = env;
+    m_creating = true;
+    HRESULT hr = env->CreateCoreWebView2Controller(m_parentHWnd, Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
+        [this, environment](HRESULT result, ICoreWebView2Controller* host) -> HRESULT {
+        m_creating = false;
+        if (m_abandoned)
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabNavStarting(m_tabId, webview), L"Can't update reload button");
-
+            if (SUCCEEDED(result) && host)
+            {
+                host->Close();
+            }
+            delete this;
             return S_OK;
-        }).Get(), &m_navStartingToken));
-
-        RETURN_IF_FAILED(m_contentWebView->add_NavigationCompleted(Callback<ICoreWebView2NavigationCompletedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT
+        }
+        HRESULT hr = SUCCEEDED(result) ? InitWebView(environment.get(), host) : result;
+        if (FAILED(hr))
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabNavCompleted(m_tabId, webview, args), L"Can't udpate reload button");
+            OutputDebugString(L"Tab WebView creation failed\n");
+            if (m_onWarmed)
+            {
+                // A warm tab that cannot be used is closed and reported, so
+                // its owner stops waiting for it; the callback may free it
+                if (m_contentController)
+                {
+                    m_contentController->Close();
+                }
+                m_securityStateChangedReceiver.reset();
+                m_cookieManager.reset();
+                m_contentWebView.reset();
+                m_contentController.reset();
+                WarmedCallback onFailed = std::move(m_onWarmed);
+                onFailed(this, hr);
+            }
+        }
+        return hr;
+    }).Get());
+    if (FAILED(hr))
+    {
+        m_creating = false;
+    }
+    return hr;
+}
+
+HRESULT Tab::InitWebView(ICoreWebView2Environment* env, ICoreWebView2Controller* host)
+{
+    m_contentController = host;
+    BrowserWindow::CheckFailure(m_contentController->get_CoreWebView2(&m_contentWebView), L"");
+    BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+    RETURN_IF_FAILED(m_contentWebView->add_WebMessageReceived(m_messageBroker.get(), &m_messageBrokerToken));
 
+    // The forwarders below skip tabs without an id: hidden prefetch tabs
+    // navigate but have no place in the UI
+
+    // Register event handler for history change
+    RETURN_IF_FAILED(m_contentWebView->add_HistoryChanged(Callback<ICoreWebView2HistoryChangedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, IUnknown* args) -> HRESULT
+    {
+        if (m_tabId == INVALID_TAB_ID)
+        {
             return S_OK;
-        }).Get(), &m_navCompletedToken));
+        }
+        BrowserWindow::CheckFailure(browserWindow->HandleTabHistoryUpdate(m_tabId, webview), L"Can't update go back/forward buttons.");
 
-        // Enable listening for security events to update secure icon
-        RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Security.enable", L"{}", nullptr));
+        return S_OK;
+    }).Get(), &m_historyUpdateForwarderToken));
 
-        BrowserWindow::CheckFailure(m_contentWebView->GetDevToolsProtocolEventReceiver(L"Security.securityStateChanged", &m_securityStateChangedReceiver), L"");
+    // Register event handler for source change
+    RETURN_IF_FAILED(m_contentWebView->add_SourceChanged(Callback<ICoreWebView2SourceChangedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2SourceChangedEventArgs* args) -> HRESULT
+    {
+        if (m_tabId == INVALID_TAB_ID)
+        {
+            return S_OK;
+        }
+        BrowserWindow::CheckFailure(browserWindow->HandleTabURIUpdate(m_tabId, webview), L"Can't update address bar");
+
+        return S_OK;
+    }).Get(), &m_uriUpdateForwarderToken));
 
-        // Forward security status updates to browser
-        RETURN_IF_FAILED(m_securityStateChangedReceiver->add_DevToolsProtocolEventReceived(Callback<ICoreWebView2DevToolsProtocolEventReceivedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args) -> HRESULT
+    RETURN_IF_FAILED(m_contentWebView->add_NavigationStarting(Callback<ICoreWebView2NavigationStartingEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT
+    {
+        if (m_tabId == INVALID_TAB_ID)
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabSecurityUpdate(m_tabId, webview, args), L"Can't udpate security icon");
             return S_OK;
-        }).Get(), &m_securityUpdateToken));
+        }
+        BrowserWindow::CheckFailure(browserWindow->HandleTabNavStarting(m_tabId, webview), L"Can't update reload button");
 
-      
-        //Ĭҳ
-        RETURN_IF_FAILED(m_contentWebView->Navigate(g_sUrl.c_str()));
-        browserWindow->HandleTabCreated(m_tabId, shouldBeActive);
+        return S_OK;
+    }).Get(), &m_navStartingToken));
 
-        //! [CookieManager]
-        auto webview2_2 = m_contentWebView.try_query<ICoreWebView2_2>();
-        if (webview2_2) {
-            webview2_2->get_CookieManager(&m_cookieManager);
+    RETURN_IF_FAILED(m_contentWebView->add_NavigationCompleted(Callback<ICoreWebView2NavigationCompletedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT
+    {
+        if (m_tabId == INVALID_TAB_ID)
+        {
+            return S_OK;
         }
-        //! [CookieManager]
-        //! 
-      
-        wil::com_ptr<ICoreWebView2Settings> settings;
-        CHECK_FAILURE(m_contentWebView->get_Settings(&settings));
-        CHECK_FAILURE(settings->put_AreDefaultScriptDialogsEnabled(FALSE));
-        // ´ڵǰǩҳ
-        CHECK_FAILURE(m_contentWebView->add_NewWindowRequested(
-            Callback<ICoreWebView2NewWindowRequestedEventHandler>(
-                [this](ICoreWebView2* sender, ICoreWebView2NewWindowRequestedEventArgs* args) -> HRESULT
+        BrowserWindow::CheckFailure(browserWindow->HandleTabNavCompleted(m_tabId, webview, args), L"Can't udpate reload button");
+
+        return S_OK;
+    }).Get(), &m_navCompletedToken));
+
+    // Unlike the forwarders above this includes hidden prefetch tabs: the
+    // browser process they report dying is everyone's
+    RETURN_IF_FAILED(m_contentWebView->add_ProcessFailed(Callback<ICoreWebView2ProcessFailedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2ProcessFailedEventArgs* args) -> HRESULT
+    {
+        COREWEBVIEW2_PROCESS_FAILED_KIND kind;
+        RETURN_IF_FAILED(args->get_ProcessFailedKind(&kind));
+        browserWindow->HandleTabProcessFailed(m_tabId, kind);
+
+        return S_OK;
+    }).Get(), &m_processFailedToken));
+
+    // Drop the subresources this job does not need, serve the rest from
+    // the disk cache when possible
+    RETURN_IF_FAILED(SetupWebResourceHandlers(env));
+
+    // Enable listening for security events to update secure icon
+    RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Security.enable", L"{}", nullptr));
+
+    BrowserWindow::CheckFailure(m_contentWebView->GetDevToolsProtocolEventReceiver(L"Security.securityStateChanged", &m_securityStateChangedReceiver), L"");
+
+    // Forward security status updates to browser
+    RETURN_IF_FAILED(m_securityStateChangedReceiver->add_DevToolsProtocolEventReceived(Callback<ICoreWebView2DevToolsProtocolEventReceivedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args) -> HRESULT
+    {
+        if (m_tabId == INVALID_TAB_ID)
         {
-            // ȡURI
-            wil::unique_cotaskmem_string uri;
-            args->get_Uri(&uri);
-            m_contentWebView->Navigate(uri.get());
-       
-            // ȡĬϵ´Ϊ
-            args->put_Handled(TRUE);
             return S_OK;
-        }).Get(), &m_newWindowRequestedToken));
+        }
+        BrowserWindow::CheckFailure(browserWindow->HandleTabSecurityUpdate(m_tabId, webview, args), L"Can't udpate security icon");
         return S_OK;
-    }).Get());
+    }).Get(), &m_securityUpdateToken));
+
+  
+    //! [CookieManager]
+    auto webview2_2 = m_contentWebView.try_query<ICoreWebView2_2>();
+    if (webview2_2) {
+        webview2_2->get_CookieManager(&m_cookieManager);
+    }
+    //! [CookieManager]
+    // Saved sessions go in before the first request is made
+    browserWindow->ImportStartupCookies(this);
+  
+    wil::com_ptr<ICoreWebView2Settings> settings;
+    CHECK_FAILURE(m_contentWebView->get_Settings(&settings));
+    CHECK_FAILURE(settings->put_AreDefaultScriptDialogsEnabled(FALSE));
+    // ´ڵǰǩҳ
+    CHECK_FAILURE(m_contentWebView->add_NewWindowRequested(
+        Callback<ICoreWebView2NewWindowRequestedEventHandler>(
+            [this](ICoreWebView2* sender, ICoreWebView2NewWindowRequestedEventArgs* args) -> HRESULT
+    {
+        // ȡURI
+        wil::unique_cotaskmem_string uri;
+        args->get_Uri(&uri);
+        m_contentWebView->Navigate(uri.get());
+   
+        // ȡĬϵ´Ϊ
+        args->put_Handled(TRUE);
+        return S_OK;
+    }).Get(), &m_newWindowRequestedToken));
+
+    if (m_tabId != INVALID_TAB_ID)
+    {
+        // Assigned while the controller was being created, or restored
+        // in the background
+        if (!m_shouldBeActive)
+        {
+            RETURN_IF_FAILED(m_contentController->put_IsVisible(FALSE));
+        }
+        return Start();
+    }
+
+    // Warm or not yet assigned: stay hidden until a tab id is given
+    RETURN_IF_FAILED(m_contentController->put_IsVisible(FALSE));
+    if (m_onWarmed)
+    {
+        WarmedCallback onWarmed = std::move(m_onWarmed);
+        onWarmed(this, S_OK);
+    }
+    return S_OK;
 }
 
 void Tab::SetMessageBroker()
@@ -134,58 +411,50 @@ HRESULT Tab::ResizeWebView()
     GetClientRect(m_parentHWnd, &bounds);
 
     BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
-    bounds.top += browserWindow->GetDPIAwareBound(BrowserWindow::c_uiBarHeight);
+    bounds.top += browserWindow->GetContentTop();
 
     return m_contentController->put_Bounds(bounds);
 }
 
 
-HRESULT Tab::GetCookies(std::wstring uri) {
+HRESULT Tab::GetCookies(std::wstring uri, bool force) {
         //! [CookieManager]
         //! 
     if (m_cookieManager)
     {
         BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
 
+        Trace::Span cookiesSpan = Trace::Instance().Begin("GetCookies", m_tabId);
         CHECK_FAILURE(m_cookieManager->GetCookies(
             uri.c_str(),
             Callback<ICoreWebView2GetCookiesCompletedHandler>(
-                [this, uri, browserWindow](HRESULT error_code, ICoreWebView2CookieList* list) -> HRESULT {
+                [this, uri, force, browserWindow, cookiesSpan](HRESULT error_code, ICoreWebView2CookieList* list) -> HRESULT {
+                    Trace::Instance().End(cookiesSpan);
                     CHECK_FAILURE(error_code);
+                    TraceScope serializeScope("SerializeCookies", m_tabId);
 
-                    std::wstring result;
                     UINT cookie_list_size;
                     CHECK_FAILURE(list->get_Count(&cookie_list_size));
 
-                    if (cookie_list_size == 0)
-                    {
-                        result += L"#No cookies found.";
-                    }
-                    else
+                    // The views borrow from the COM strings, which stay put
+                    // when the vector grows
+                    std::vector<CookieStrings> strings(cookie_list_size);
+                    std::vector<CookieView> cookies;
+                    cookies.reserve(cookie_list_size);
+                    for (UINT i = 0; i < cookie_list_size; ++i)
                     {
-                        result += L"#"+ std::to_wstring(cookie_list_size) + L" cookie(s) found";
-                        if (!uri.empty()) {
-                            result += L" on " + uri;
-                        }
-                        result += L"\n#domain\t  subdomains\t  path\t  HTTPS only\t  expires\t  name\t  value\t secure\t  Same site\n\n";
-                        for (UINT i = 0; i < cookie_list_size; ++i)
+                        wil::com_ptr<ICoreWebView2Cookie> cookie;
+                        CHECK_FAILURE(list->GetValueAtIndex(i, &cookie));
+
+                        if (cookie.get())
                         {
-                            wil::com_ptr<ICoreWebView2Cookie> cookie;
-                            CHECK_FAILURE(list->GetValueAtIndex(i, &cookie));
-
-                            if (cookie.get())
-                            {
-                                result += CookieToString(cookie.get());
-                                if (i != cookie_list_size - 1)
-                                {
-                                    result += L"\n";
-                                }
-                            }
+                            CookieView view;
+                            CHECK_FAILURE(ReadCookie(cookie.get(), strings[i], view));
+                            cookies.push_back(view);
                         }
-                        result += L"\n";
                     }
-                    Util::fileWrite(Util::GetCurrentExeDirectory() + L"\\cookie.txt", result);
-                    browserWindow->WriteCookiesToSharedMemory(result);
+
+                    browserWindow->PublishCookies(uri, cookies, force);
                     return S_OK;
                 }).Get()));
 
@@ -195,78 +464,86 @@ HRESULT Tab::GetCookies(std::wstring uri) {
 }
 
 
-std::wstring Tab::CookieToString(ICoreWebView2Cookie* cookie)
+size_t Tab::ImportCookies(const std::vector<Cookie>& cookies)
+{
+    if (!m_cookieManager)
+    {
+        return 0;
+    }
+
+    size_t imported = 0;
+    for (const Cookie& cookie : cookies)
+    {
+        wil::com_ptr<ICoreWebView2Cookie> created;
+        if (FAILED(m_cookieManager->CreateCookie(cookie.name.c_str(), cookie.value.c_str(), cookie.domain.c_str(),
+            cookie.path.empty() ? L"/" : cookie.path.c_str(), &created)))
+        {
+            continue;
+        }
+        if (!cookie.session)
+        {
+            created->put_Expires(cookie.expires);
+        }
+        created->put_IsHttpOnly(cookie.httpOnly);
+        created->put_IsSecure(cookie.secure);
+        // SameSite=None is only accepted on secure cookies
+        switch (cookie.sameSite)
+        {
+        case CookieSameSite::Strict:
+            created->put_SameSite(COREWEBVIEW2_COOKIE_SAME_SITE_KIND_STRICT);
+            break;
+        case CookieSameSite::None:
+            created->put_SameSite(cookie.secure ? COREWEBVIEW2_COOKIE_SAME_SITE_KIND_NONE : COREWEBVIEW2_COOKIE_SAME_SITE_KIND_LAX);
+            break;
+        default:
+            created->put_SameSite(COREWEBVIEW2_COOKIE_SAME_SITE_KIND_LAX);
+            break;
+        }
+        if (SUCCEEDED(m_cookieManager->AddOrUpdateCookie(created.get())))
+        {
+            imported++;
+        }
+    }
+    return imported;
+}
+
+HRESULT Tab::ReadCookie(ICoreWebView2Cookie* cookie, CookieStrings& strings, CookieView& view)
 {
     //! [CookieObject]
-    wil::unique_cotaskmem_string name;
-    CHECK_FAILURE(cookie->get_Name(&name));
-    wil::unique_cotaskmem_string value;
-    CHECK_FAILURE(cookie->get_Value(&value));
-    wil::unique_cotaskmem_string domain;
-    CHECK_FAILURE(cookie->get_Domain(&domain));
-    wil::unique_cotaskmem_string path;
-    CHECK_FAILURE(cookie->get_Path(&path));
-    double expires;
-    CHECK_FAILURE(cookie->get_Expires(&expires));
+    CHECK_FAILURE(cookie->get_Name(&strings.name));
+    CHECK_FAILURE(cookie->get_Value(&strings.value));
+    CHECK_FAILURE(cookie->get_Domain(&strings.domain));
+    CHECK_FAILURE(cookie->get_Path(&strings.path));
+    CHECK_FAILURE(cookie->get_Expires(&view.expires));
     BOOL isHttpOnly = FALSE;
     CHECK_FAILURE(cookie->get_IsHttpOnly(&isHttpOnly));
     COREWEBVIEW2_COOKIE_SAME_SITE_KIND same_site;
-    std::wstring same_site_as_string;
     CHECK_FAILURE(cookie->get_SameSite(&same_site));
-    switch (same_site)
-    {
-    case COREWEBVIEW2_COOKIE_SAME_SITE_KIND_NONE:
-        same_site_as_string = L"None";
-        break;
-    case COREWEBVIEW2_COOKIE_SAME_SITE_KIND_LAX:
-        same_site_as_string = L"Lax";
-        break;
-    case COREWEBVIEW2_COOKIE_SAME_SITE_KIND_STRICT:
-        same_site_as_string = L"Strict";
-        break;
-    }
     BOOL isSecure = FALSE;
     CHECK_FAILURE(cookie->get_IsSecure(&isSecure));
     BOOL isSession = FALSE;
     CHECK_FAILURE(cookie->get_IsSession(&isSession));
 
-    //οhttps://curl.se/docs/http-cookies.html
-    //Field number, what type and example data and the meaning of it:
-    //0. string example.com - the domain name
-    //1. boolean FALSE - include subdomains
-    //2. string /foobar/ - path
-    //3. boolean TRUE - send/receive over HTTPS only
-    //4. number 1462299217 - expires at - seconds since Jan 1st 1970, or 0
-    //5. string person - name of the cookie
-    //6. string daniel - value of the cookie
-    //7. boolean FALSE - isSecure 
-    //8. string None - Same site
-
-    std::wstring result = L"";
-    std::wstring sDomain = Util::EncodeQuote(domain.get());
-    result +=  sDomain + L"\t";
-    if (sDomain.starts_with(L"\".")) {
-         result +=  L"true\t";
-    }
-    else {
-        result +=  L"false\t"; 
-    }
-    result += Util::EncodeQuote(path.get()) + L"\t";
-    result += Util::BoolToString(isHttpOnly) + L"\t";  
-    if (!!isSession)
-    {
-        result += L"#HttpOnly_\t";
-    }
-    else
+    view.name = strings.name.get() ? strings.name.get() : L"";
+    view.value = strings.value.get() ? strings.value.get() : L"";
+    view.domain = strings.domain.get() ? strings.domain.get() : L"";
+    view.path = strings.path.get() ? strings.path.get() : L"";
+    view.httpOnly = !!isHttpOnly;
+    view.secure = !!isSecure;
+    view.session = !!isSession;
+    switch (same_site)
     {
-        result += std::to_wstring(expires)+ L"\t";  
+    case COREWEBVIEW2_COOKIE_SAME_SITE_KIND_LAX:
+        view.sameSite = CookieSameSite::Lax;
+        break;
+    case COREWEBVIEW2_COOKIE_SAME_SITE_KIND_STRICT:
+        view.sameSite = CookieSameSite::Strict;
+        break;
+    default:
+        view.sameSite = CookieSameSite::None;
+        break;
     }
-    result += Util::EncodeQuote(name.get()) + L"\t";
-    result += Util::EncodeQuote(value.get()) + L"\t"; 
-    result += Util::BoolToString(isSecure) + L"\t";
-    result += Util::EncodeQuote(same_site_as_string) + L"\t";
-
-    return result;
+    return S_OK;
     //! [CookieObject]
 }
 
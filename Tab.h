@@ -5,6 +5,9 @@
 #pragma once
 
 #include "framework.h"
+#include "CookieCodec.h"
+
+#include <functional>
 
 class Tab
 {
@@ -15,11 +18,47 @@ public:
     wil::com_ptr<ICoreWebView2CookieManager> m_cookieManager;
 
 
-    static std::unique_ptr<Tab> CreateNewTab(HWND hWnd, ICoreWebView2Environment* env, size_t id, bool shouldBeActive);
+    // Called once a warm tab's controller is ready, or failed to be created
+    using WarmedCallback = std::function<void(Tab* tab, HRESULT result)>;
+
+    // Starts creating the controller; Assign must follow before it is shown
+    static std::unique_ptr<Tab> CreateNewTab(HWND hWnd, ICoreWebView2Environment* env);
+    // Creates a hidden tab with its handlers attached but nothing loaded, to
+    // be handed out later by the TabPool. Null if creation could not start.
+    static std::unique_ptr<Tab> CreateWarmTab(HWND hWnd, ICoreWebView2Environment* env, WarmedCallback onWarmed);
+    // Gives the tab its id and first URI (empty for the default page). A tab
+    // whose controller is still being created navigates once it is ready.
+    void Assign(size_t id, bool shouldBeActive, const std::wstring& uri);
+    // Lets go of a tab. One whose controller is still being created lives
+    // on until the creation completes, when it closes and frees itself.
+    static void Abandon(std::unique_ptr<Tab> tab);
+    bool IsReady() const { return m_contentWebView != nullptr; }
     HRESULT ResizeWebView();
 
-    HRESULT GetCookies(std::wstring uri);
-    static std::wstring CookieToString(ICoreWebView2Cookie* cookie);
+    // Freezes the hidden tab's renderer; the callback tells whether it took.
+    // False when the call could not be made at all.
+    bool TrySuspend(std::function<void(bool suspended)> callback);
+    // Closes the controller and keeps only the URI to come back to
+    HRESULT Discard();
+    bool IsDiscarded() const { return m_discarded; }
+    // Recreates a discarded tab and navigates it back, or to uri when given;
+    // an active one is switched to once the controller is ready, any other
+    // stays hidden
+    HRESULT Restore(ICoreWebView2Environment* env, bool shouldBeActive, const std::wstring& uri = std::wstring());
+
+    HRESULT GetCookies(std::wstring uri, bool force = false);
+
+    // Owns the COM strings a CookieView points into
+    struct CookieStrings
+    {
+        wil::unique_cotaskmem_string name;
+        wil::unique_cotaskmem_string value;
+        wil::unique_cotaskmem_string domain;
+        wil::unique_cotaskmem_string path;
+    };
+    static HRESULT ReadCookie(ICoreWebView2Cookie* cookie, CookieStrings& strings, CookieView& view);
+    // Adds the cookies to the profile's cookie jar; returns how many were accepted
+    size_t ImportCookies(const std::vector<Cookie>& cookies);
 
 protected:
 
@@ -29,13 +68,32 @@ protected:
     EventRegistrationToken m_uriUpdateForwarderToken = {};
     EventRegistrationToken m_navStartingToken = {};
     EventRegistrationToken m_navCompletedToken = {};
+    EventRegistrationToken m_processFailedToken = {};
     EventRegistrationToken m_securityUpdateToken = {};
     EventRegistrationToken m_messageBrokerToken = {};  // Message broker for browser pages loaded in a tab
     wil::com_ptr<ICoreWebView2WebMessageReceivedEventHandler> m_messageBroker;
 
-    HRESULT Init(ICoreWebView2Environment* env, bool shouldBeActive);
+    HRESULT Init(ICoreWebView2Environment* env);
+    // Attaches the handlers once the controller exists; a warm tab reports
+    // to its WarmedCallback on success and, through Init, on failure
+    HRESULT InitWebView(ICoreWebView2Environment* env, ICoreWebView2Controller* host);
     void SetMessageBroker();
 
 private:
     EventRegistrationToken m_newWindowRequestedToken; // ´¼token
+    EventRegistrationToken m_webResourceRequestedToken = {};
+    EventRegistrationToken m_webResourceResponseReceivedToken = {};
+
+    // Request filter and disk cache, both answer through WebResourceRequested
+    HRESULT SetupWebResourceHandlers(ICoreWebView2Environment* env);
+
+    HRESULT Start();
+    bool m_shouldBeActive = false;
+    std::wstring m_pendingUri;
+    int64_t m_assignedAt = 0;
+    WarmedCallback m_onWarmed;
+    bool m_creating = false;   // CreateCoreWebView2Controller has not completed
+    bool m_abandoned = false;  // Owned by its completion handler
+    bool m_discarded = false;
+    std::wstring m_discardedUri;
 };
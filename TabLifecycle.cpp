@@ -0,0 +1,112 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "TabLifecycle.h"
+
+#include <algorithm>
+
+void TabLifecycle::OnShown(size_t tabId, int64_t now)
+{
+    Entry& entry = m_tabs[tabId];
+    entry.state = State::Visible;
+    entry.hiddenSince = now;
+    entry.suspendPending = false;
+}
+
+void TabLifecycle::OnHidden(size_t tabId, int64_t now)
+{
+    auto [it, inserted] = m_tabs.try_emplace(tabId);
+    Entry& entry = it->second;
+    if (inserted || entry.state == State::Visible)
+    {
+        entry.state = State::Hidden;
+        entry.hiddenSince = now;
+    }
+}
+
+void TabLifecycle::OnSuspendRequested(size_t tabId)
+{
+    auto it = m_tabs.find(tabId);
+    if (it != m_tabs.end())
+    {
+        it->second.suspendPending = true;
+    }
+}
+
+void TabLifecycle::OnSuspended(size_t tabId)
+{
+    auto it = m_tabs.find(tabId);
+    if (it != m_tabs.end() && it->second.suspendPending)
+    {
+        // Shown again in the meantime clears the pending flag
+        it->second.suspendPending = false;
+        it->second.state = State::Suspended;
+    }
+}
+
+void TabLifecycle::OnSuspendFailed(size_t tabId)
+{
+    auto it = m_tabs.find(tabId);
+    if (it != m_tabs.end() && it->second.suspendPending)
+    {
+        // Busy pages refuse to suspend; try again after another full period
+        it->second.suspendPending = false;
+        it->second.hiddenSince += m_config.suspendAfter;
+    }
+}
+
+void TabLifecycle::OnDiscarded(size_t tabId)
+{
+    auto it = m_tabs.find(tabId);
+    if (it != m_tabs.end())
+    {
+        it->second.state = State::Discarded;
+        it->second.suspendPending = false;
+    }
+}
+
+void TabLifecycle::OnRemoved(size_t tabId)
+{
+    m_tabs.erase(tabId);
+}
+
+void TabLifecycle::SetPinned(size_t tabId, bool pinned)
+{
+    auto it = m_tabs.find(tabId);
+    if (it != m_tabs.end())
+    {
+        it->second.pinned = pinned;
+    }
+}
+
+TabLifecycle::Plan TabLifecycle::Evaluate(int64_t now, uint64_t memoryBytes) const
+{
+    Plan plan;
+    const Entry* oldest = nullptr;
+    size_t oldestId = 0;
+    for (const auto& [tabId, entry] : m_tabs)
+    {
+        if (entry.pinned || entry.state == State::Visible || entry.state == State::Discarded)
+        {
+            continue;
+        }
+        if (entry.state == State::Hidden && !entry.suspendPending &&
+            m_config.suspendAfter > 0 && now - entry.hiddenSince >= m_config.suspendAfter)
+        {
+            plan.suspend.push_back(tabId);
+        }
+        if (!oldest || entry.hiddenSince < oldest->hiddenSince)
+        {
+            oldest = &entry;
+            oldestId = tabId;
+        }
+    }
+
+    if (oldest && m_config.memoryBudget > 0 && memoryBytes > m_config.memoryBudget)
+    {
+        plan.discard.push_back(oldestId);
+        plan.suspend.erase(std::remove(plan.suspend.begin(), plan.suspend.end(), oldestId), plan.suspend.end());
+    }
+    return plan;
+}
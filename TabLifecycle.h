@@ -0,0 +1,70 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Decides which background tabs to suspend and which to discard. Tabs that
+// stay hidden past a threshold are suspended; while the content processes
+// use more than the memory budget, the least recently shown tab loses its
+// renderer, one per evaluation so the effect can be measured before the
+// next one goes. Times are in microseconds, ids are tab ids.
+class TabLifecycle
+{
+public:
+    enum class State
+    {
+        Visible,
+        Hidden,
+        Suspended,  // Renderer frozen, still in memory
+        Discarded   // Renderer closed, only the URI and title are kept
+    };
+
+    struct Config
+    {
+        int64_t suspendAfter = 0;    // 0 never suspends
+        uint64_t memoryBudget = 0;   // Bytes, 0 never discards
+    };
+
+    struct Plan
+    {
+        std::vector<size_t> suspend;
+        std::vector<size_t> discard;
+
+        bool IsEmpty() const { return suspend.empty() && discard.empty(); }
+    };
+
+    void Configure(const Config& config) { m_config = config; }
+    const Config& GetConfig() const { return m_config; }
+
+    void OnShown(size_t tabId, int64_t now);
+    void OnHidden(size_t tabId, int64_t now);
+    // TrySuspend was issued; the tab is not planned again until the result
+    // comes back through OnSuspended or OnSuspendFailed.
+    void OnSuspendRequested(size_t tabId);
+    void OnSuspended(size_t tabId);
+    void OnSuspendFailed(size_t tabId);
+    void OnDiscarded(size_t tabId);
+    void OnRemoved(size_t tabId);
+    // Pinned tabs are never suspended or discarded, e.g. while they download.
+    void SetPinned(size_t tabId, bool pinned);
+
+    Plan Evaluate(int64_t now, uint64_t memoryBytes) const;
+
+private:
+    struct Entry
+    {
+        State state = State::Hidden;
+        int64_t hiddenSince = 0;
+        bool pinned = false;
+        bool suspendPending = false;  // TrySuspend issued, result not back yet
+    };
+
+    Config m_config;
+    std::map<size_t, Entry> m_tabs;
+};
@@ -0,0 +1,77 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "TabPool.h"
+#include "Metrics.h"
+
+TabPool::TabPool(HWND hWnd, ICoreWebView2Environment* env, size_t size)
+    : m_hWnd(hWnd), m_env(env), m_size(size)
+{
+}
+
+TabPool::~TabPool()
+{
+    for (std::unique_ptr<Tab>& tab : m_ready)
+    {
+        tab->m_contentController->Close();
+    }
+    // Its completion handler runs after the pool is gone
+    Tab::Abandon(std::move(m_warming));
+}
+
+std::unique_ptr<Tab> TabPool::Take()
+{
+    std::unique_ptr<Tab> tab;
+    if (!m_ready.empty())
+    {
+        tab = std::move(m_ready.front());
+        m_ready.pop_front();
+        Metrics::Instance().Add(Metrics::Counter::TabPoolHits);
+    }
+    else if (m_warming)
+    {
+        // Still closer to done than a controller created from scratch
+        tab = std::move(m_warming);
+        Metrics::Instance().Add(Metrics::Counter::TabPoolMisses);
+    }
+    return tab;
+}
+
+void TabPool::Refill()
+{
+    if (m_warming || m_ready.size() >= m_size || m_failures >= c_maxFailures)
+    {
+        return;
+    }
+
+    m_warming = Tab::CreateWarmTab(m_hWnd, m_env.get(), [this](Tab* tab, HRESULT result) {
+        OnWarmed(tab, result);
+    });
+    if (!m_warming)
+    {
+        m_failures++;
+        OutputDebugString(L"Could not start warming a tab\n");
+    }
+}
+
+void TabPool::OnWarmed(Tab* tab, HRESULT result)
+{
+    if (!m_warming || m_warming.get() != tab)
+    {
+        return;
+    }
+
+    if (FAILED(result))
+    {
+        m_failures++;
+        m_warming.reset();
+        OutputDebugString(L"Warm tab creation failed\n");
+    }
+    else
+    {
+        m_failures = 0;
+        m_ready.push_back(std::move(m_warming));
+    }
+    Refill();
+}
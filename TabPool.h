@@ -0,0 +1,45 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "Tab.h"
+
+#include <deque>
+
+// Keeps a few hidden tabs whose controllers are already created and whose
+// event handlers are attached, so opening a tab does not wait for the
+// WebView2 runtime. The pool refills one tab at a time so the warm-up never
+// competes with the tab that is being shown.
+class TabPool
+{
+public:
+    TabPool(HWND hWnd, ICoreWebView2Environment* env, size_t size);
+    ~TabPool();
+
+    TabPool(const TabPool&) = delete;
+    TabPool& operator=(const TabPool&) = delete;
+
+    // A ready tab if there is one, else the one still warming up, else null.
+    // The caller assigns it and calls Refill afterwards.
+    std::unique_ptr<Tab> Take();
+    // Starts warming another tab unless the pool is full or one is under way.
+    void Refill();
+
+    size_t GetReadyCount() const { return m_ready.size(); }
+
+private:
+    void OnWarmed(Tab* tab, HRESULT result);
+
+    // Give up refilling after this many creations fail in a row
+    static constexpr size_t c_maxFailures = 3;
+
+    HWND m_hWnd = nullptr;
+    wil::com_ptr<ICoreWebView2Environment> m_env;
+    size_t m_size = 0;
+    std::deque<std::unique_ptr<Tab>> m_ready;
+    std::unique_ptr<Tab> m_warming;
+    size_t m_failures = 0;
+};
@@ -0,0 +1,255 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Identifies the pool and queue of the current worker thread so work
+    // submitted from inside a task lands in the worker's own deque.
+    thread_local const ThreadPool* t_currentPool = nullptr;
+    thread_local size_t t_currentQueue = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadCount, size_t maxQueuedTasks)
+    : m_maxQueuedTasks((std::max<size_t>)(maxQueuedTasks, 1))
+{
+    if (threadCount == 0)
+    {
+        // Leave one core to the UI thread and the WebView processes
+        size_t cores = std::thread::hardware_concurrency();
+        threadCount = std::clamp<size_t>(cores > 1 ? cores - 1 : 1, 1, 8);
+    }
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    Shutdown();
+}
+
+void ThreadPool::SetCompletionDispatcher(Dispatcher dispatcher)
+{
+    std::lock_guard<std::mutex> lock(m_dispatcherMutex);
+    m_dispatcher = std::move(dispatcher);
+}
+
+bool ThreadPool::Submit(Task work)
+{
+    if (!work || m_stopping || m_workers.empty())
+    {
+        return false;
+    }
+
+    // Reserve a slot; back out if the pool is already at capacity
+    if (m_queued.fetch_add(1) >= m_maxQueuedTasks)
+    {
+        m_queued.fetch_sub(1);
+        return false;
+    }
+    m_pending.fetch_add(1);
+
+    size_t index = t_currentPool == this ? t_currentQueue : m_nextQueue.fetch_add(1) % m_queues.size();
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(work));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+bool ThreadPool::TryPop(size_t index, Task& task)
+{
+    // Own queue first, newest task first: it is the most likely to be cache-hot
+    {
+        WorkerQueue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Steal the oldest task from the other workers
+    for (size_t i = 1; i < m_queues.size(); ++i)
+    {
+        WorkerQueue& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+    t_currentPool = this;
+    t_currentQueue = index;
+
+    for (;;)
+    {
+        Task task;
+        if (TryPop(index, task))
+        {
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                // A failing stage must not take the worker down with it
+            }
+
+            if (m_pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wake.wait(lock, [this]() { return m_stopping || m_queued > 0; });
+        if (m_stopping && m_queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+void ThreadPool::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        if (m_stopping && m_workers.empty())
+        {
+            return;
+        }
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    m_workers.clear();
+}
+
+void ThreadPool::Complete(Task completion)
+{
+    if (!completion)
+    {
+        return;
+    }
+
+    Dispatcher dispatcher;
+    {
+        std::lock_guard<std::mutex> lock(m_dispatcherMutex);
+        dispatcher = m_dispatcher;
+    }
+
+    if (dispatcher)
+    {
+        dispatcher(std::move(completion));
+    }
+    else
+    {
+        completion();
+    }
+}
+
+bool ThreadPool::Strand::Submit(Task work)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(work));
+        if (m_running)
+        {
+            return true;
+        }
+        m_running = true;
+    }
+
+    std::shared_ptr<Strand> self = shared_from_this();
+    if (!m_pool.Submit([self]() { self->RunNext(); }))
+    {
+        // Pool is saturated: keep ordering by running on the caller
+        RunNext();
+    }
+    return true;
+}
+
+void ThreadPool::Strand::RunNext()
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty())
+            {
+                m_running = false;
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty())
+            {
+                m_running = false;
+                return;
+            }
+        }
+
+        // Yield the worker between tasks so one busy strand cannot starve the pool
+        std::shared_ptr<Strand> self = shared_from_this();
+        if (m_pool.Submit([self]() { self->RunNext(); }))
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,143 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bounded work-stealing pool for post-download pipeline stages (hashing,
+// verification, bundling, file output). Every worker owns a deque: it pops
+// its own work LIFO and steals FIFO from the others when idle. Results are
+// handed to a completion dispatcher, which the browser window points at
+// PostMessage so completions run back on the UI thread.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+    using Dispatcher = std::function<void(Task)>;
+
+    // threadCount 0 picks one worker per spare core.
+    explicit ThreadPool(size_t threadCount = 0, size_t maxQueuedTasks = 1024);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void SetCompletionDispatcher(Dispatcher dispatcher);
+
+    // Queue work without a completion. Returns false when the pool is full or
+    // shutting down; the caller decides whether to retry or run inline.
+    bool Submit(Task work);
+
+    // Run work() on a pool thread and pass its result to onComplete(result)
+    // through the completion dispatcher.
+    template <typename Work, typename OnComplete>
+    bool Submit(Work&& work, OnComplete&& onComplete)
+    {
+        using Result = std::invoke_result_t<Work>;
+        return Submit(Task(
+            [this, work = std::forward<Work>(work), onComplete = std::forward<OnComplete>(onComplete)]() mutable
+        {
+            if constexpr (std::is_void_v<Result>)
+            {
+                work();
+                Complete(Task(std::move(onComplete)));
+            }
+            else
+            {
+                Complete(Task(
+                    [onComplete = std::move(onComplete), result = work()]() mutable
+                {
+                    onComplete(std::move(result));
+                }));
+            }
+        }));
+    }
+
+    // Block until every queued task has run. Must not be called from a worker.
+    void WaitIdle();
+    // Stop accepting work, drain the queues and join the workers.
+    void Shutdown();
+
+    size_t GetThreadCount() const { return m_workers.size(); }
+
+    // Runs its tasks one at a time and in submission order on top of the
+    // pool, for stages that share state such as a single output file.
+    class Strand : public std::enable_shared_from_this<Strand>
+    {
+    public:
+        explicit Strand(ThreadPool& pool) : m_pool(pool) {}
+
+        bool Submit(Task work);
+
+        template <typename Work, typename OnComplete>
+        bool Submit(Work&& work, OnComplete&& onComplete)
+        {
+            using Result = std::invoke_result_t<Work>;
+            ThreadPool* pool = &m_pool;
+            return Submit(Task(
+                [pool, work = std::forward<Work>(work), onComplete = std::forward<OnComplete>(onComplete)]() mutable
+            {
+                if constexpr (std::is_void_v<Result>)
+                {
+                    work();
+                    pool->Complete(Task(std::move(onComplete)));
+                }
+                else
+                {
+                    pool->Complete(Task(
+                        [onComplete = std::move(onComplete), result = work()]() mutable
+                    {
+                        onComplete(std::move(result));
+                    }));
+                }
+            }));
+        }
+
+    private:
+        void RunNext();
+
+        ThreadPool& m_pool;
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+        bool m_running = false;
+    };
+
+    std::shared_ptr<Strand> CreateStrand() { return std::make_shared<Strand>(*this); }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    bool TryPop(size_t index, Task& task);
+    void Complete(Task completion);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::atomic<size_t> m_queued = 0;   // Submitted but not yet started
+    std::atomic<size_t> m_pending = 0;  // Submitted but not yet finished
+    std::atomic<size_t> m_nextQueue = 0;
+    std::atomic<bool> m_stopping = false;
+    size_t m_maxQueuedTasks;
+
+    std::mutex m_dispatcherMutex;
+    Dispatcher m_dispatcher;
+};
@@ -0,0 +1,142 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+Trace& Trace::Instance()
+{
+    static Trace trace;
+    return trace;
+}
+
+void Trace::Enable(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.assign((std::max<size_t>)(capacity, 16), Event{});
+    m_next = 0;
+    m_wrapped = false;
+    m_origin = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    m_enabled = true;
+}
+
+int64_t Trace::Now() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - m_origin;
+}
+
+Trace::Span Trace::Begin(const char* name, size_t tabId)
+{
+    Span span;
+    if (m_enabled)
+    {
+        span.name = name;
+        span.tabId = tabId;
+        span.start = Now();
+    }
+    return span;
+}
+
+void Trace::End(const Span& span)
+{
+    if (!m_enabled || !span.IsActive())
+    {
+        return;
+    }
+    Record({ span.name, span.tabId, span.start, Now() - span.start });
+}
+
+void Trace::Instant(const char* name, size_t tabId)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+    Record({ name, tabId, Now(), -1 });
+}
+
+void Trace::Record(const Event& event)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events[m_next] = event;
+    if (++m_next == m_events.size())
+    {
+        m_next = 0;
+        m_wrapped = true;
+    }
+}
+
+std::string Trace::ToChromeJson(uint32_t processId) const
+{
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_wrapped)
+        {
+            events.insert(events.end(), m_events.begin() + m_next, m_events.end());
+        }
+        events.insert(events.end(), m_events.begin(), m_events.begin() + m_next);
+    }
+
+    std::string pid = std::to_string(processId);
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto append = [&json, &first](const std::string& event) {
+        if (!first)
+        {
+            json += ",\n";
+        }
+        json += event;
+        first = false;
+    };
+
+    // Name one trace "thread" per tab; tab 0 is the browser itself
+    std::set<size_t> tabs;
+    for (const Event& event : events)
+    {
+        tabs.insert(event.tabId);
+    }
+    for (size_t tabId : tabs)
+    {
+        std::string label = tabId == 0 ? "browser" : "tab " + std::to_string(tabId);
+        append("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + std::to_string(tabId) +
+            ",\"args\":{\"name\":\"" + label + "\"}}");
+    }
+
+    for (const Event& event : events)
+    {
+        std::string common = "\"name\":\"" + std::string(event.name) + "\",\"cat\":\"bookget\",\"pid\":" + pid +
+            ",\"tid\":" + std::to_string(event.tabId) + ",\"ts\":" + std::to_string(event.start);
+        if (event.duration >= 0)
+        {
+            append("{\"ph\":\"X\"," + common + ",\"dur\":" + std::to_string(event.duration) + "}");
+        }
+        else
+        {
+            append("{\"ph\":\"i\",\"s\":\"t\"," + common + "}");
+        }
+    }
+
+    json += "]}\n";
+    return json;
+}
+
+bool Trace::DumpChromeJson(const std::wstring& path, uint32_t processId) const
+{
+    std::string json = ToChromeJson(processId);
+    std::ofstream out(std::filesystem::path(path), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+    out.write(json.data(), static_cast<std::streamsize>(json.size()));
+    return out.good();
+}
@@ -0,0 +1,77 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Low-overhead span recorder for the navigation-to-capture pipeline. Spans
+// from all tabs go into one fixed-size ring buffer, tagged with their tab
+// id; the oldest are overwritten once it is full, so a busy tab can push
+// out the history of the others. The buffer can be dumped at any time as
+// Chrome trace-event JSON and opened in chrome://tracing or Perfetto, with
+// one track per tab.
+class Trace
+{
+public:
+    // An open span. Cheap to copy, so it can be captured by async callbacks.
+    struct Span
+    {
+        const char* name = nullptr;
+        size_t tabId = 0;
+        int64_t start = -1;  // Microseconds since the recorder started, -1 if disabled
+
+        bool IsActive() const { return start >= 0; }
+    };
+
+    static Trace& Instance();
+
+    void Enable(size_t capacity = 64 * 1024);
+    bool IsEnabled() const { return m_enabled; }
+
+    // name must be a string literal: only the pointer is stored.
+    Span Begin(const char* name, size_t tabId);
+    void End(const Span& span);
+    void Instant(const char* name, size_t tabId);
+
+    std::string ToChromeJson(uint32_t processId) const;
+    bool DumpChromeJson(const std::wstring& path, uint32_t processId) const;
+
+private:
+    struct Event
+    {
+        const char* name;
+        size_t tabId;
+        int64_t start;
+        int64_t duration;  // -1 for instant events
+    };
+
+    int64_t Now() const;
+    void Record(const Event& event);
+
+    std::atomic<bool> m_enabled = false;
+    int64_t m_origin = 0;
+    mutable std::mutex m_mutex;
+    std::vector<Event> m_events;
+    size_t m_next = 0;
+    bool m_wrapped = false;
+};
+
+// Records a span for the lifetime of a scope.
+class TraceScope
+{
+public:
+    TraceScope(const char* name, size_t tabId) : m_span(Trace::Instance().Begin(name, tabId)) {}
+    ~TraceScope() { Trace::Instance().End(m_span); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    Trace::Span m_span;
+};
@@ -0,0 +1,420 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Transcoder.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+namespace
+{
+    // ASCII block copies. Each converts whole blocks from the start of the
+    // input and stops at the first block holding a non-ASCII unit; the
+    // caller finishes the rest with the scalar code.
+
+    template <typename Unit>
+    size_t NarrowAsciiScalar(const Unit* src, size_t length, char* dst)
+    {
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4)
+        {
+            uint32_t units = static_cast<uint32_t>(src[i]) | static_cast<uint32_t>(src[i + 1]) |
+                static_cast<uint32_t>(src[i + 2]) | static_cast<uint32_t>(src[i + 3]);
+            if (units >= 0x80)
+            {
+                break;
+            }
+            dst[i] = static_cast<char>(src[i]);
+            dst[i + 1] = static_cast<char>(src[i + 1]);
+            dst[i + 2] = static_cast<char>(src[i + 2]);
+            dst[i + 3] = static_cast<char>(src[i + 3]);
+        }
+        return i;
+    }
+
+    template <typename Unit>
+    size_t WidenAsciiScalar(const char* src, size_t length, Unit* dst)
+    {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8)
+        {
+            uint64_t bytes;
+            memcpy(&bytes, src + i, sizeof(bytes));
+            if (bytes & 0x8080808080808080ull)
+            {
+                break;
+            }
+            for (size_t j = 0; j < 8; ++j)
+            {
+                dst[i + j] = static_cast<Unit>(src[i + j]);
+            }
+        }
+        return i;
+    }
+
+#if defined(BOOKGET_SSE2)
+    template <typename Unit>
+    size_t NarrowAsciiSse2(const Unit* src, size_t length, char* dst)
+    {
+        const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+            __m128i test = _mm_and_si128(_mm_or_si128(low, high), nonAscii);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(test, zero)) != 0xFFFF)
+            {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(low, high));
+        }
+        return i;
+    }
+
+    template <typename Unit>
+    size_t WidenAsciiSse2(const char* src, size_t length, Unit* dst)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+            {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+        return i;
+    }
+
+    template <typename Unit>
+    BOOKGET_TARGET_AVX2 size_t NarrowAsciiAvx2(const Unit* src, size_t length, char* dst)
+    {
+        const __m256i nonAscii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16));
+            __m256i test = _mm256_and_si256(_mm256_or_si256(low, high), nonAscii);
+            if (!_mm256_testz_si256(test, test))
+            {
+                break;
+            }
+            // packus works per 128-bit lane, put the quadwords back in order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+        }
+        return i;
+    }
+
+    template <typename Unit>
+    BOOKGET_TARGET_AVX2 size_t WidenAsciiAvx2(const char* src, size_t length, Unit* dst)
+    {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            if (_mm256_movemask_epi8(bytes) != 0)
+            {
+                break;
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16),
+                _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)));
+        }
+        return i;
+    }
+#elif defined(BOOKGET_NEON)
+    template <typename Unit>
+    size_t NarrowAsciiNeon(const Unit* src, size_t length, char* dst)
+    {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            uint16x8_t low = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i));
+            uint16x8_t high = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i + 8));
+            if (vmaxvq_u16(vorrq_u16(low, high)) >= 0x80)
+            {
+                break;
+            }
+            vst1q_u8(reinterpret_cast<uint8_t*>(dst + i), vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        }
+        return i;
+    }
+
+    template <typename Unit>
+    size_t WidenAsciiNeon(const char* src, size_t length, Unit* dst)
+    {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(src + i));
+            if (vmaxvq_u8(bytes) >= 0x80)
+            {
+                break;
+            }
+            vst1q_u16(reinterpret_cast<uint16_t*>(dst + i), vmovl_u8(vget_low_u8(bytes)));
+            vst1q_u16(reinterpret_cast<uint16_t*>(dst + i + 8), vmovl_u8(vget_high_u8(bytes)));
+        }
+        return i;
+    }
+#endif
+
+    template <typename Unit>
+    size_t NarrowAscii(const Unit* src, size_t length, char* dst, bool avx2)
+    {
+        size_t done = 0;
+        (void)avx2;
+        if constexpr (sizeof(Unit) == 2)
+        {
+#if defined(BOOKGET_SSE2)
+            if (avx2)
+            {
+                done = NarrowAsciiAvx2(src, length, dst);
+            }
+            done += NarrowAsciiSse2(src + done, length - done, dst + done);
+#elif defined(BOOKGET_NEON)
+            done = NarrowAsciiNeon(src, length, dst);
+#endif
+        }
+        return done + NarrowAsciiScalar(src + done, length - done, dst + done);
+    }
+
+    template <typename Unit>
+    size_t WidenAscii(const char* src, size_t length, Unit* dst, bool avx2)
+    {
+        size_t done = 0;
+        (void)avx2;
+        if constexpr (sizeof(Unit) == 2)
+        {
+#if defined(BOOKGET_SSE2)
+            if (avx2)
+            {
+                done = WidenAsciiAvx2(src, length, dst);
+            }
+            done += WidenAsciiSse2(src + done, length - done, dst + done);
+#elif defined(BOOKGET_NEON)
+            done = WidenAsciiNeon(src, length, dst);
+#endif
+        }
+        return done + WidenAsciiScalar(src + done, length - done, dst + done);
+    }
+
+    template <typename Unit>
+    size_t Utf16ToUtf8Impl(const Unit* src, size_t length, char* dst)
+    {
+        const bool avx2 = CpuHasAvx2();
+        char* out = dst;
+        size_t i = 0;
+        while (i < length)
+        {
+            uint32_t c = sizeof(Unit) == 2 ? static_cast<uint16_t>(src[i]) : static_cast<uint32_t>(src[i]);
+            if (c < 0x80)
+            {
+                size_t run = NarrowAscii(src + i, length - i, out, avx2);
+                if (run > 0)
+                {
+                    i += run;
+                    out += run;
+                    continue;
+                }
+                *out++ = static_cast<char>(c);
+                i++;
+            }
+            else if (c < 0x800)
+            {
+                *out++ = static_cast<char>(0xC0 | (c >> 6));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+                i++;
+            }
+            else if (c > 0xFFFF && c <= 0x10FFFF)
+            {
+                // UTF-32 input (wchar_t outside Windows)
+                *out++ = static_cast<char>(0xF0 | (c >> 18));
+                *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+                i++;
+            }
+            else if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+            {
+                uint32_t next = i + 1 < length ? static_cast<uint16_t>(src[i + 1]) : 0;
+                if (sizeof(Unit) == 2 && c <= 0xDBFF && next >= 0xDC00 && next <= 0xDFFF)
+                {
+                    uint32_t codePoint = 0x10000 + ((c - 0xD800) << 10) + (next - 0xDC00);
+                    *out++ = static_cast<char>(0xF0 | (codePoint >> 18));
+                    *out++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                    *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                    *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+                    i += 2;
+                }
+                else
+                {
+                    // Lone surrogate, or out of range UTF-32
+                    *out++ = static_cast<char>(0xEF);
+                    *out++ = static_cast<char>(0xBF);
+                    *out++ = static_cast<char>(0xBD);
+                    i++;
+                }
+            }
+            else
+            {
+                *out++ = static_cast<char>(0xE0 | (c >> 12));
+                *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+                i++;
+            }
+        }
+        return static_cast<size_t>(out - dst);
+    }
+
+    inline bool InRange(const unsigned char* src, size_t index, size_t length, unsigned char low, unsigned char high)
+    {
+        return index < length && src[index] >= low && src[index] <= high;
+    }
+
+    template <typename Unit>
+    size_t Utf8ToUtf16Impl(const char* input, size_t length, Unit* dst)
+    {
+        const bool avx2 = CpuHasAvx2();
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(input);
+        const Unit replacement = static_cast<Unit>(0xFFFD);
+        Unit* out = dst;
+        size_t i = 0;
+        while (i < length)
+        {
+            unsigned char lead = src[i];
+            if (lead < 0x80)
+            {
+                size_t run = WidenAscii(input + i, length - i, out, avx2);
+                if (run > 0)
+                {
+                    i += run;
+                    out += run;
+                    continue;
+                }
+                *out++ = static_cast<Unit>(lead);
+                i++;
+            }
+            else if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                if (InRange(src, i + 1, length, 0x80, 0xBF))
+                {
+                    *out++ = static_cast<Unit>(((lead & 0x1F) << 6) | (src[i + 1] & 0x3F));
+                    i += 2;
+                }
+                else
+                {
+                    *out++ = replacement;
+                    i++;
+                }
+            }
+            else if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                // E0 excludes overlong forms, ED excludes encoded surrogates
+                unsigned char low = lead == 0xE0 ? 0xA0 : 0x80;
+                unsigned char high = lead == 0xED ? 0x9F : 0xBF;
+                if (!InRange(src, i + 1, length, low, high))
+                {
+                    *out++ = replacement;
+                    i++;
+                }
+                else if (!InRange(src, i + 2, length, 0x80, 0xBF))
+                {
+                    *out++ = replacement;
+                    i += 2;
+                }
+                else
+                {
+                    *out++ = static_cast<Unit>(((lead & 0x0F) << 12) | ((src[i + 1] & 0x3F) << 6) | (src[i + 2] & 0x3F));
+                    i += 3;
+                }
+            }
+            else if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                // F0 excludes overlong forms, F4 caps the range at U+10FFFF
+                unsigned char low = lead == 0xF0 ? 0x90 : 0x80;
+                unsigned char high = lead == 0xF4 ? 0x8F : 0xBF;
+                if (!InRange(src, i + 1, length, low, high))
+                {
+                    *out++ = replacement;
+                    i++;
+                }
+                else if (!InRange(src, i + 2, length, 0x80, 0xBF))
+                {
+                    *out++ = replacement;
+                    i += 2;
+                }
+                else if (!InRange(src, i + 3, length, 0x80, 0xBF))
+                {
+                    *out++ = replacement;
+                    i += 3;
+                }
+                else
+                {
+                    uint32_t codePoint = ((lead & 0x07) << 18) | ((src[i + 1] & 0x3F) << 12) |
+                        ((src[i + 2] & 0x3F) << 6) | (src[i + 3] & 0x3F);
+                    if constexpr (sizeof(Unit) == 2)
+                    {
+                        codePoint -= 0x10000;
+                        *out++ = static_cast<Unit>(0xD800 + (codePoint >> 10));
+                        *out++ = static_cast<Unit>(0xDC00 + (codePoint & 0x3FF));
+                    }
+                    else
+                    {
+                        *out++ = static_cast<Unit>(codePoint);
+                    }
+                    i += 4;
+                }
+            }
+            else
+            {
+                // Stray continuation byte, C0/C1 or F5-FF
+                *out++ = replacement;
+                i++;
+            }
+        }
+        return static_cast<size_t>(out - dst);
+    }
+}
+
+size_t Transcoder::Utf16ToUtf8(const char16_t* utf16, size_t length, char* utf8)
+{
+    return Utf16ToUtf8Impl(utf16, length, utf8);
+}
+
+size_t Transcoder::Utf8ToUtf16(const char* utf8, size_t length, char16_t* utf16)
+{
+    return Utf8ToUtf16Impl(utf8, length, utf16);
+}
+
+size_t Transcoder::Utf16ToUtf8(const wchar_t* utf16, size_t length, char* utf8)
+{
+    return Utf16ToUtf8Impl(utf16, length, utf8);
+}
+
+size_t Transcoder::Utf8ToUtf16(const char* utf8, size_t length, wchar_t* utf16)
+{
+    return Utf8ToUtf16Impl(utf8, length, utf16);
+}
+
+std::string Transcoder::ToUtf8(std::u16string_view utf16)
+{
+    std::string utf8(MaxUtf8Length(utf16.size()), '\0');
+    utf8.resize(Utf16ToUtf8(utf16.data(), utf16.size(), utf8.data()));
+    return utf8;
+}
+
+std::u16string Transcoder::ToUtf16(std::string_view utf8)
+{
+    std::u16string utf16(MaxUtf16Length(utf8.size()), u'\0');
+    utf16.resize(Utf8ToUtf16(utf8.data(), utf8.size(), utf16.data()));
+    return utf16;
+}
@@ -0,0 +1,52 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <string>
+#include <string_view>
+
+// Single-pass UTF-8 <-> UTF-16 conversion. The output buffer is sized for
+// the worst case up front instead of asking the converter for the exact
+// length first, runs of ASCII are converted 16-32 code units at a time with
+// SSE2/AVX2/NEON, and everything else goes through a validating scalar
+// decoder. Malformed input (lone surrogates, overlong forms, truncated or
+// out-of-range sequences) is replaced with U+FFFD, one per maximal invalid
+// subpart, which is what MultiByteToWideChar/WideCharToMultiByte do too.
+class Transcoder
+{
+public:
+    // Worst case output sizes, in code units of the target encoding
+    static constexpr size_t MaxUtf8Length(size_t utf16Length) { return utf16Length * 3; }
+    static constexpr size_t MaxUtf16Length(size_t utf8Length) { return utf8Length; }
+    // wchar_t is UTF-16 on Windows but UTF-32 elsewhere, 4 bytes per unit
+    static constexpr size_t MaxUtf8LengthWide(size_t wideLength) { return wideLength * (sizeof(wchar_t) == 2 ? 3 : 4); }
+
+    // Convert into a buffer of at least MaxUtf8Length/MaxUtf16Length units
+    // and return the number of units written.
+    static size_t Utf16ToUtf8(const char16_t* utf16, size_t length, char* utf8);
+    static size_t Utf8ToUtf16(const char* utf8, size_t length, char16_t* utf16);
+    // Platform wide strings; size the UTF-8 side with MaxUtf8LengthWide
+    static size_t Utf16ToUtf8(const wchar_t* utf16, size_t length, char* utf8);
+    static size_t Utf8ToUtf16(const char* utf8, size_t length, wchar_t* utf16);
+
+    static std::string ToUtf8(std::u16string_view utf16);
+    static std::u16string ToUtf16(std::string_view utf8);
+
+    // Length of the longest prefix of at most maxLength units that does not
+    // end in the middle of a surrogate pair, for converting in chunks.
+    template <typename Unit>
+    static size_t SplitUtf16(const Unit* utf16, size_t length, size_t maxLength)
+    {
+        if (length <= maxLength)
+        {
+            return length;
+        }
+        uint32_t last = static_cast<uint32_t>(utf16[maxLength - 1]);
+        return (last >= 0xD800 && last <= 0xDBFF && maxLength > 1) ? maxLength - 1 : maxLength;
+    }
+};
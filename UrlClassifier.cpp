@@ -0,0 +1,259 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "UrlClassifier.h"
+#include "CpuFeatures.h"
+#include "UrlParser.h"
+
+#include <algorithm>
+
+namespace
+{
+    inline wchar_t Fold(wchar_t c)
+    {
+        return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c - L'A' + L'a') : c;
+    }
+}
+
+bool GlobSet::Add(std::wstring_view pattern, int id)
+{
+    if (m_literalMasks.empty())
+    {
+        m_literalMasks.assign(c_asciiCount * c_maxWords, 0);
+        for (auto* mask : { &m_starMask, &m_doubleStarMask, &m_wildcardMask, &m_acceptMask, &m_startMask })
+        {
+            mask->assign(c_maxWords, 0);
+        }
+    }
+
+    // Count the states first so a pattern that does not fit leaves no trace
+    size_t count = 1;
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        i += (pattern[i] == L'*' && i + 1 < pattern.size() && pattern[i + 1] == L'*') ? 1 : 0;
+        count++;
+    }
+    if (m_states.size() + count > c_maxStates)
+    {
+        return false;
+    }
+
+    uint16_t order = static_cast<uint16_t>(m_patternCount++);
+    SetBit(m_startMask, m_states.size());
+    size_t wildcardRun = 0;
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        size_t state = m_states.size();
+        if (pattern[i] == L'*')
+        {
+            bool doubleStar = i + 1 < pattern.size() && pattern[i + 1] == L'*';
+            i += doubleStar ? 1 : 0;
+            m_states.push_back({ doubleStar ? Token::DoubleStar : Token::Star, 0, id, order });
+            SetBit(doubleStar ? m_doubleStarMask : m_starMask, state);
+            SetBit(m_wildcardMask, state);
+            m_maxWildcardRun = (std::max)(m_maxWildcardRun, ++wildcardRun);
+        }
+        else
+        {
+            wchar_t literal = Fold(pattern[i]);
+            m_states.push_back({ Token::Literal, literal, id, order });
+            if (static_cast<uint32_t>(literal) < c_asciiCount)
+            {
+                SetBit(m_literalMasks, static_cast<size_t>(literal) * c_maxWords * 64 + state);
+            }
+            wildcardRun = 0;
+        }
+    }
+    SetBit(m_acceptMask, m_states.size());
+    m_states.push_back({ Token::Accept, 0, id, order });
+    m_words = (m_states.size() + 63) / 64;
+    return true;
+}
+
+// Wildcards can match nothing, so entering one also enters its successor
+void GlobSet::Close(uint64_t* states) const
+{
+    for (size_t round = 0; round < m_maxWildcardRun; ++round)
+    {
+        uint64_t carry = 0;
+        for (size_t word = 0; word < m_words; ++word)
+        {
+            uint64_t entered = states[word] & m_wildcardMask[word];
+            uint64_t shifted = (entered << 1) | carry;
+            carry = entered >> 63;
+            states[word] |= shifted;
+        }
+    }
+}
+
+int GlobSet::Match(std::initializer_list<std::wstring_view> pieces) const
+{
+    uint64_t current[c_maxWords];
+    for (size_t word = 0; word < m_words; ++word)
+    {
+        current[word] = m_startMask[word];
+    }
+    Close(current);
+
+    for (std::wstring_view piece : pieces)
+    {
+        for (wchar_t input : piece)
+        {
+            wchar_t c = Fold(input);
+            const uint64_t* loops = c == L'/' ? m_doubleStarMask.data() : m_wildcardMask.data();
+            const uint64_t* literals = static_cast<uint32_t>(c) < c_asciiCount ?
+                &m_literalMasks[static_cast<size_t>(c) * c_maxWords] : nullptr;
+
+            uint64_t carry = 0;
+            uint64_t any = 0;
+            for (size_t word = 0; word < m_words; ++word)
+            {
+                uint64_t matched = 0;
+                if (literals)
+                {
+                    matched = current[word] & literals[word];
+                }
+                else if (current[word])
+                {
+                    // Non-ASCII input only matches identical literals
+                    for (uint64_t bits = current[word]; bits != 0; bits &= bits - 1)
+                    {
+                        int bit = CountTrailingZeros(bits);
+                        const State& state = m_states[word * 64 + bit];
+                        if (state.token == Token::Literal && state.literal == c)
+                        {
+                            matched |= 1ull << bit;
+                        }
+                    }
+                }
+                uint64_t next = (matched << 1) | carry | (current[word] & loops[word]);
+                carry = matched >> 63;
+                current[word] = next;
+                any |= next;
+            }
+            if (any == 0)
+            {
+                return -1;
+            }
+            Close(current);
+        }
+    }
+
+    int best = -1;
+    uint16_t bestOrder = UINT16_MAX;
+    for (size_t word = 0; word < m_words; ++word)
+    {
+        for (uint64_t bits = current[word] & m_acceptMask[word]; bits != 0; bits &= bits - 1)
+        {
+            const State& state = m_states[word * 64 + CountTrailingZeros(bits)];
+            if (state.order < bestOrder)
+            {
+                best = state.id;
+                bestOrder = state.order;
+            }
+        }
+    }
+    return best;
+}
+
+void UrlClassifier::AddUrlRule(const wchar_t* name, std::wstring_view pattern, UrlRoute route)
+{
+    m_rules.push_back({ name, route });
+    m_urlRules.Add(pattern, static_cast<int>(m_rules.size() - 1));
+}
+
+void UrlClassifier::AddExtensionRule(const wchar_t* name, std::wstring_view extension, UrlRoute route)
+{
+    m_rules.push_back({ name, route });
+    int id = static_cast<int>(m_rules.size() - 1);
+    std::wstring pattern = L"**.";
+    pattern += extension;
+    m_urlRules.Add(pattern, id);
+    m_urlRules.Add(pattern + L"?**", id);
+}
+
+void UrlClassifier::AddMimeRule(const wchar_t* name, std::wstring_view pattern, UrlRoute route)
+{
+    m_rules.push_back({ name, route });
+    m_mimeRules.Add(pattern, static_cast<int>(m_rules.size() - 1));
+}
+
+UrlMatch UrlClassifier::ToMatch(int id) const
+{
+    if (id < 0)
+    {
+        return UrlMatch();
+    }
+    return { m_rules[id].name, m_rules[id].route };
+}
+
+UrlMatch UrlClassifier::ClassifyUrl(std::wstring_view url) const
+{
+    UrlParts parts = UrlParser::Parse(url);
+    if (parts.query.empty())
+    {
+        return ToMatch(m_urlRules.Match({ parts.host, parts.path }));
+    }
+    return ToMatch(m_urlRules.Match({ parts.host, parts.path, L"?", parts.query }));
+}
+
+UrlMatch UrlClassifier::ClassifyContentType(std::wstring_view contentType) const
+{
+    // "image/jpeg; charset=..." -> "image/jpeg"
+    size_t semicolon = contentType.find(L';');
+    std::wstring_view type = contentType.substr(0, semicolon);
+    size_t first = type.find_first_not_of(L" \t");
+    size_t last = type.find_last_not_of(L" \t");
+    if (first == std::wstring_view::npos)
+    {
+        return UrlMatch();
+    }
+    return ToMatch(m_mimeRules.Match({ type.substr(first, last - first + 1) }));
+}
+
+const UrlClassifier& UrlClassifier::Default()
+{
+    static const UrlClassifier classifier = []() {
+        UrlClassifier rules;
+
+        // Library specific IIIF endpoints first, so they are reported by
+        // name. These serve JPEG; other formats fall through to the generic
+        // rules below.
+        rules.AddUrlRule(L"gallica-iiif", L"gallica.bnf.fr/iiif/**/full/*/*/native.jpg", UrlRoute::IiifImage);
+        rules.AddUrlRule(L"ndl-iiif", L"dl.ndl.go.jp/api/iiif/**/full/*/*/default.jpg", UrlRoute::IiifImage);
+        rules.AddUrlRule(L"harvard-iiif", L"ids.lib.harvard.edu/ids/iiif/**/full/*/*/default.jpg", UrlRoute::IiifImage);
+        rules.AddUrlRule(L"bsb-iiif", L"api.digitale-sammlungen.de/iiif/**/full/*/*/default.jpg", UrlRoute::IiifImage);
+
+        // Generic IIIF Image API: {region}/{size}/{rotation}/{quality}.{format}.
+        // The whole image has the region "full", anything else is a tile of
+        // it. Only image formats count, so e.g. /en/us/home/default.aspx
+        // is not taken for one.
+        for (const wchar_t* quality : { L"default", L"native", L"color", L"gray", L"bitonal" })
+        {
+            for (const wchar_t* format : { L"jpg", L"png", L"gif", L"webp", L"tif", L"jp2" })
+            {
+                std::wstring image = std::wstring(quality) + L"." + format;
+                rules.AddUrlRule(L"iiif-image", L"**/full/*/*/" + image, UrlRoute::IiifImage);
+                rules.AddUrlRule(L"iiif-tile", L"**/*/*/*/" + image, UrlRoute::IiifTile);
+            }
+        }
+        rules.AddUrlRule(L"iiif-info", L"**/info.json", UrlRoute::IiifInfo);
+        rules.AddUrlRule(L"iiif-manifest", L"**/manifest", UrlRoute::IiifManifest);
+        rules.AddUrlRule(L"iiif-manifest", L"**/manifest.json", UrlRoute::IiifManifest);
+
+        for (const wchar_t* extension : { L"jpg", L"jpeg", L"png", L"gif", L"bmp", L"webp" })
+        {
+            rules.AddExtensionRule(L"image-extension", extension, UrlRoute::Image);
+        }
+
+        for (const wchar_t* mime : { L"image/jpeg", L"image/png", L"image/gif", L"image/webp", L"image/svg+xml", L"image/bmp" })
+        {
+            rules.AddMimeRule(L"image-mime", mime, UrlRoute::Image);
+        }
+        // TIFF, JPEG 2000, AVIF and whatever else a library serves
+        rules.AddMimeRule(L"image-other", L"image/*", UrlRoute::Image);
+        return rules;
+    }();
+    return classifier;
+}
@@ -0,0 +1,115 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A set of glob patterns compiled into one NFA and matched in a single
+// case-insensitive (ASCII) pass. '*' matches any run of characters except
+// '/', '**' matches any run including '/', everything else is literal.
+// When several patterns match, the one added first wins. The NFA is run
+// bit-parallel: every state is one bit and a character advances all
+// states at once with a few masks and a shift per 64 states.
+class GlobSet
+{
+public:
+    static constexpr size_t c_maxStates = 2048;
+
+    // Returns false when the state budget is exhausted.
+    bool Add(std::wstring_view pattern, int id);
+
+    // Matches the concatenation of pieces; returns the winning id or -1.
+    int Match(std::initializer_list<std::wstring_view> pieces) const;
+
+private:
+    static constexpr size_t c_maxWords = c_maxStates / 64;
+    static constexpr size_t c_asciiCount = 128;
+
+    enum class Token : uint8_t
+    {
+        Literal,
+        Star,
+        DoubleStar,
+        Accept
+    };
+
+    struct State
+    {
+        Token token;
+        wchar_t literal;
+        int id;          // Pattern id, for Accept states
+        uint16_t order;  // Pattern order, lower wins
+    };
+
+    void SetBit(std::vector<uint64_t>& mask, size_t state) { mask[state / 64] |= 1ull << (state % 64); }
+    void Close(uint64_t* states) const;
+
+    std::vector<State> m_states;
+    size_t m_patternCount = 0;
+    size_t m_words = 0;
+    size_t m_maxWildcardRun = 0;
+    std::vector<uint64_t> m_literalMasks;  // c_asciiCount masks of c_maxWords
+    std::vector<uint64_t> m_starMask;
+    std::vector<uint64_t> m_doubleStarMask;
+    std::vector<uint64_t> m_wildcardMask;
+    std::vector<uint64_t> m_acceptMask;
+    std::vector<uint64_t> m_startMask;
+};
+
+enum class UrlRoute
+{
+    None,
+    Image,         // Direct image file
+    IiifImage,     // IIIF Image API request for the whole image
+    IiifTile,      // IIIF Image API request for a region of it
+    IiifInfo,      // IIIF info.json
+    IiifManifest,  // IIIF Presentation manifest
+};
+
+struct UrlMatch
+{
+    const wchar_t* rule = nullptr;  // Name of the matching rule
+    UrlRoute route = UrlRoute::None;
+
+    explicit operator bool() const { return rule != nullptr; }
+    bool IsImage() const { return route == UrlRoute::Image || route == UrlRoute::IiifImage || route == UrlRoute::IiifTile; }
+};
+
+// Classifies URLs and Content-Type values with rules compiled once at
+// startup. URL rules are matched against host + path + ('?' + query), so a
+// rule can look at the host, the path shape or the extension; rules added
+// earlier take precedence, which lets per-library rules shadow the generic
+// ones and report a more specific name.
+class UrlClassifier
+{
+public:
+    void AddUrlRule(const wchar_t* name, std::wstring_view pattern, UrlRoute route);
+    // Shorthand for the path ending in .extension, with or without a query
+    void AddExtensionRule(const wchar_t* name, std::wstring_view extension, UrlRoute route);
+    void AddMimeRule(const wchar_t* name, std::wstring_view pattern, UrlRoute route);
+
+    UrlMatch ClassifyUrl(std::wstring_view url) const;
+    UrlMatch ClassifyContentType(std::wstring_view contentType) const;
+
+    // The built-in rule set
+    static const UrlClassifier& Default();
+
+private:
+    struct Rule
+    {
+        const wchar_t* name;
+        UrlRoute route;
+    };
+
+    UrlMatch ToMatch(int id) const;
+
+    std::vector<Rule> m_rules;
+    GlobSet m_urlRules;
+    GlobSet m_mimeRules;
+};
@@ -0,0 +1,295 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "UrlParser.h"
+#include "Transcoder.h"
+
+#include <cstdint>
+
+namespace
+{
+    bool IsSchemeChar(wchar_t c, bool first)
+    {
+        bool alpha = (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z');
+        return alpha || (!first && ((c >= L'0' && c <= L'9') || c == L'+' || c == L'-' || c == L'.'));
+    }
+
+    int HexValue(wchar_t c)
+    {
+        if (c >= L'0' && c <= L'9')
+        {
+            return c - L'0';
+        }
+        if (c >= L'a' && c <= L'f')
+        {
+            return c - L'a' + 10;
+        }
+        if (c >= L'A' && c <= L'F')
+        {
+            return c - L'A' + 10;
+        }
+        return -1;
+    }
+
+    bool IsIllegalFileNameChar(wchar_t c)
+    {
+        if (static_cast<uint32_t>(c) < 0x20)
+        {
+            return true;
+        }
+        switch (c)
+        {
+        case L'<':
+        case L'>':
+        case L':':
+        case L'"':
+        case L'/':
+        case L'\\':
+        case L'|':
+        case L'?':
+        case L'*':
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Case-insensitive comparison with an upper case ASCII word
+    bool EqualsAscii(std::wstring_view text, std::wstring_view upper)
+    {
+        if (text.size() != upper.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            wchar_t c = text[i] >= L'a' && text[i] <= L'z' ? static_cast<wchar_t>(text[i] - L'a' + L'A') : text[i];
+            if (c != upper[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // CON, PRN, AUX, NUL, COM0-9 and LPT0-9 open a device instead of a file
+    // whatever the extension, e.g. "nul.png" or "Con .jpg".
+    bool IsReservedDeviceName(std::wstring_view name)
+    {
+        std::wstring_view base = name.substr(0, name.find(L'.'));
+        while (!base.empty() && base.back() == L' ')
+        {
+            base.remove_suffix(1);
+        }
+        if (EqualsAscii(base, L"CON") || EqualsAscii(base, L"PRN") || EqualsAscii(base, L"AUX") || EqualsAscii(base, L"NUL"))
+        {
+            return true;
+        }
+        if (base.size() != 4 || !(EqualsAscii(base.substr(0, 3), L"COM") || EqualsAscii(base.substr(0, 3), L"LPT")))
+        {
+            return false;
+        }
+        // Superscript 1-3 count as digits too
+        wchar_t digit = base[3];
+        return (digit >= L'0' && digit <= L'9') || digit == 0xB9 || digit == 0xB2 || digit == 0xB3;
+    }
+
+    void AppendUtf8(const char* bytes, size_t length, std::wstring& out)
+    {
+        size_t size = out.size();
+        out.resize(size + Transcoder::MaxUtf16Length(length));
+        out.resize(size + Transcoder::Utf8ToUtf16(bytes, length, out.data() + size));
+    }
+}
+
+UrlParts UrlParser::Parse(std::wstring_view url)
+{
+    UrlParts parts;
+    std::wstring_view rest = url;
+
+    // scheme ":"
+    size_t colon = rest.find(L':');
+    if (colon != std::wstring_view::npos && colon > 0)
+    {
+        bool isScheme = true;
+        for (size_t i = 0; i < colon && isScheme; ++i)
+        {
+            isScheme = IsSchemeChar(rest[i], i == 0);
+        }
+        if (isScheme)
+        {
+            parts.scheme = rest.substr(0, colon);
+            rest.remove_prefix(colon + 1);
+        }
+    }
+
+    // "//" authority
+    if (rest.size() >= 2 && rest[0] == L'/' && rest[1] == L'/')
+    {
+        rest.remove_prefix(2);
+        size_t end = rest.find_first_of(L"/?#");
+        std::wstring_view authority = rest.substr(0, end);
+        rest.remove_prefix(authority.size());
+
+        size_t at = authority.rfind(L'@');
+        if (at != std::wstring_view::npos)
+        {
+            authority.remove_prefix(at + 1);
+        }
+        // The port colon comes after any bracketed IPv6 literal
+        size_t bracket = authority.rfind(L']');
+        size_t portColon = authority.rfind(L':');
+        if (portColon != std::wstring_view::npos && (bracket == std::wstring_view::npos || portColon > bracket))
+        {
+            parts.port = authority.substr(portColon + 1);
+            authority = authority.substr(0, portColon);
+        }
+        parts.host = authority;
+    }
+
+    size_t hash = rest.find(L'#');
+    if (hash != std::wstring_view::npos)
+    {
+        parts.fragment = rest.substr(hash + 1);
+        rest = rest.substr(0, hash);
+    }
+    size_t question = rest.find(L'?');
+    if (question != std::wstring_view::npos)
+    {
+        parts.query = rest.substr(question + 1);
+        rest = rest.substr(0, question);
+    }
+    parts.path = rest;
+    return parts;
+}
+
+void UrlParser::AppendPercentDecoded(std::wstring_view text, std::wstring& out)
+{
+    size_t i = 0;
+    while (i < text.size())
+    {
+        size_t percent = text.find(L'%', i);
+        if (percent == std::wstring_view::npos)
+        {
+            out.append(text.data() + i, text.size() - i);
+            return;
+        }
+        out.append(text.data() + i, percent - i);
+        i = percent;
+
+        // Collect a run of consecutive escapes and decode it as UTF-8 at once
+        char bytes[128];
+        size_t count = 0;
+        while (i + 2 < text.size() && text[i] == L'%')
+        {
+            int high = HexValue(text[i + 1]);
+            int low = HexValue(text[i + 2]);
+            if (high < 0 || low < 0)
+            {
+                break;
+            }
+            bytes[count++] = static_cast<char>((high << 4) | low);
+            i += 3;
+            if (count == sizeof(bytes))
+            {
+                // Keep an incomplete trailing sequence for the next round
+                size_t keep = 0;
+                while (keep < 3 && (static_cast<unsigned char>(bytes[count - 1 - keep]) & 0xC0) == 0x80)
+                {
+                    keep++;
+                }
+                if (keep < count && static_cast<unsigned char>(bytes[count - 1 - keep]) >= 0xC0)
+                {
+                    keep++;
+                }
+                else
+                {
+                    keep = 0;
+                }
+                AppendUtf8(bytes, count - keep, out);
+                std::copy(bytes + count - keep, bytes + count, bytes);
+                count = keep;
+            }
+        }
+        if (count > 0)
+        {
+            AppendUtf8(bytes, count, out);
+        }
+        else
+        {
+            // Lone '%'
+            out += text[i++];
+        }
+    }
+}
+
+std::wstring UrlParser::GetFileName(std::wstring_view url)
+{
+    UrlParts parts = Parse(url);
+    std::wstring_view path = parts.path;
+    if (parts.scheme.empty() && parts.host.empty() && path.find(L'/') == std::wstring_view::npos)
+    {
+        // Not a URL at all, use it as is
+        path = url;
+    }
+
+    size_t slash = path.find_last_of(L"/\\");
+    std::wstring_view segment = slash == std::wstring_view::npos ? path : path.substr(slash + 1);
+
+    std::wstring decoded;
+    std::wstring_view name = segment;
+    if (NeedsDecoding(segment))
+    {
+        decoded.reserve(segment.size());
+        AppendPercentDecoded(segment, decoded);
+        name = decoded;
+        // An encoded %2F still separates segments
+        slash = name.find_last_of(L"/\\");
+        if (slash != std::wstring_view::npos)
+        {
+            name.remove_prefix(slash + 1);
+        }
+    }
+
+    std::wstring filename;
+    filename.reserve(name.size() + 1);
+    for (wchar_t c : name)
+    {
+        if (!IsIllegalFileNameChar(c))
+        {
+            filename += c;
+        }
+    }
+    // Windows drops trailing dots and spaces, which also leaves nothing of
+    // "." and ".." (e.g. from "%2F..")
+    while (!filename.empty() && (filename.back() == L'.' || filename.back() == L' '))
+    {
+        filename.pop_back();
+    }
+    if (filename.empty())
+    {
+        return L"download";
+    }
+    if (IsReservedDeviceName(filename))
+    {
+        filename.insert(filename.begin(), L'_');
+    }
+
+    // Windows limits a name to 255 characters; keep a short extension
+    const size_t maxLength = 255;
+    if (filename.size() > maxLength)
+    {
+        size_t dot = filename.find_last_of(L'.');
+        if (dot != std::wstring::npos && filename.size() - dot <= 16)
+        {
+            std::wstring extension = filename.substr(dot);
+            filename.erase(maxLength - extension.size(), dot - (maxLength - extension.size()));
+        }
+        else
+        {
+            filename.resize(maxLength);
+        }
+    }
+    return filename;
+}
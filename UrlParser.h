@@ -0,0 +1,39 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Components of a URL as views into the original string.
+struct UrlParts
+{
+    std::wstring_view scheme;     // "https", empty for relative references
+    std::wstring_view host;       // Without user info and port
+    std::wstring_view port;
+    std::wstring_view path;       // Including the leading '/'
+    std::wstring_view query;      // Without the '?'
+    std::wstring_view fragment;   // Without the '#'
+};
+
+// Splits URLs into their components without allocating and percent-decodes
+// them as UTF-8, so that e.g. %E4%B8%AD becomes one CJK character instead
+// of three mojibake code units. Text without '%' is returned untouched.
+class UrlParser
+{
+public:
+    static UrlParts Parse(std::wstring_view url);
+
+    static bool NeedsDecoding(std::wstring_view text) { return text.find(L'%') != std::wstring_view::npos; }
+    // Appends text with %XX escapes decoded. Escapes that do not form valid
+    // UTF-8 become U+FFFD; a '%' not followed by two hex digits is kept.
+    static void AppendPercentDecoded(std::wstring_view text, std::wstring& out);
+
+    // Last path segment of the URL, decoded and made safe to use as a
+    // Windows file name: "download" when nothing usable remains (e.g. ".."),
+    // "_" in front of device names such as "con.jpg", at most 255
+    // characters with the extension kept.
+    static std::wstring GetFileName(std::wstring_view url);
+};
@@ -4,8 +4,12 @@
 
 #include "CheckFailure.h"
 #include "Util.h"
+#include "JsonString.h"
+#include "MappedFile.h"
+#include "Transcoder.h"
+#include "UrlParser.h"
+#include "UrlClassifier.h"
 #include <codecvt>
-#include <regex>
 #include <Windows.h>
 #include <filesystem>
 #include <cwctype>
@@ -13,6 +17,7 @@
 #include <tlhelp32.h>
 #include <shlobj.h> // For SHGetFolderPath
 #include <algorithm>
+#include <memory>
 
 std::wstring Util::UnixEpochToDateTime(double value)
 {
@@ -25,6 +30,22 @@ std::wstring Util::UnixEpochToDateTime(double value)
     return result;
 }
 
+// ֿ齫 UTF-16 תΪ UTF-8 д룬תΪַ仺
+static bool WriteUtf8(std::ofstream& outfile, const std::wstring& data)
+{
+    constexpr size_t chunkLength = 64 * 1024;
+    std::unique_ptr<char[]> buffer(new char[Transcoder::MaxUtf8LengthWide(chunkLength)]);
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t length = Transcoder::SplitUtf16(data.data() + offset, data.size() - offset, chunkLength);
+        size_t written = Transcoder::Utf16ToUtf8(data.data() + offset, length, buffer.get());
+        outfile.write(buffer.get(), static_cast<std::streamsize>(written));
+        offset += length;
+    }
+    outfile.close();
+    return !outfile.fail();
+}
+
 //zhudw
 bool Util::fileWrite(const std::wstring  filename, std::wstring data)    
 {    
@@ -32,46 +53,20 @@ bool Util::fileWrite(const std::wstring  filename, std::wstring data)
 	if (!outfile.is_open()) {
 		return 0;
 	}
-    
-    ///  UTF-16 ַתΪ UTF-8 ַ
-    int length = ::WideCharToMultiByte(CP_UTF8, 0, data.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    if (length == 0) {
-        return 0;
-    }
-
-    std::string utf8String(length, '\0');
-    if (!::WideCharToMultiByte(CP_UTF8, 0, data.c_str(), -1, &utf8String[0], length, nullptr, nullptr)) {
-        return 0;
-    }
-    outfile.write(utf8String.c_str(), utf8String.length());
-	outfile.close();
-	return true;    
+    return WriteUtf8(outfile, data);
 }    
 
 std::wstring Util::fileRead(const std::wstring  filename)    
 {    
-	std::ifstream infile(filename, std::ios::binary);
-	if (!infile.is_open()) {
-		return L"";
-	}
-
-    // ȡļݲתΪ UTF-16 ַ
-    std::string utf8String;
-    std::wstring result;
-    while (std::getline(infile, utf8String)) {
-         //  UTF-8 ַתΪ UTF-16 ַ
-        int length = ::MultiByteToWideChar(CP_UTF8, 0, utf8String.c_str(), -1, nullptr, 0);
-        if (length == 0) {
-            break;
-        }
-        std::wstring utf16String(length, L'\0');
-        if (!::MultiByteToWideChar(CP_UTF8, 0, utf8String.c_str(), -1, &utf16String[0], length)) {
-          break;
-        }
-        result += utf16String;
+    // ڴӳļһν뵽ԤĻзȥ UTF-8 BOM
+    TextFileReader reader;
+    if (!reader.Open(filename)) {
+        return L"";
     }
 
-	infile.close();
+    std::string_view utf8 = reader.GetText();
+    std::wstring result(Transcoder::MaxUtf16Length(utf8.size()), L'\0');
+    result.resize(Transcoder::Utf8ToUtf16(utf8.data(), utf8.size(), result.data()));
     return result;
 }    
 
@@ -81,19 +76,7 @@ bool Util::fileAppend(const std::wstring  filename, std::wstring data)
     if (!outfile.is_open()) {
         return 0;
     }
-
-    ///  UTF-16 ַתΪ UTF-8 ַ
-    int length = ::WideCharToMultiByte(CP_UTF8, 0, data.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    if (length == 0) {
-        return 0;
-    }
-    std::string utf8String(length, '\0');
-    if (!::WideCharToMultiByte(CP_UTF8, 0, data.c_str(), -1, &utf8String[0], length, nullptr, nullptr)) {
-        return 0;
-    }
-    outfile.write(utf8String.c_str(), utf8String.length());
-	outfile.close();
-	return true;    
+    return WriteUtf8(outfile, data);
 }    
 
 
@@ -104,7 +87,7 @@ std::wstring Util::BoolToString(BOOL value)
 
 std::wstring Util::EncodeQuote(std::wstring raw)
 {
-    return L"\"" + std::regex_replace(raw, std::wregex(L"\""), L"\\\"") + L"\"";
+    return JsonString::Quote(raw);
 }
 
 
@@ -152,135 +135,18 @@ std::wstring Util::GetUserHomeDirectory()
 
 
 std::string Util::Utf16ToUtf8(const std::wstring& utf16) {
-
-    std::string utf8; // Result
-     if (utf16.empty()) {
-        return utf8;
-     }
-
-    if (utf16.length() > static_cast<size_t>((std::numeric_limits<int>::max)()))
-    {
-      throw std::overflow_error(
-        "Input string too long: size_t-length doesn't fit into int.");
-    }
-
-    // Safely convert from size_t (STL string's length)
-    // to int (for Win32 APIs)
-    const int utf16Length = static_cast<int>(utf16.length());
-
-    // Safely fails if an invalid UTF-8 character
-    // is encountered in the input string
-    //constexpr DWORD kFlags = MB_ERR_INVALID_CHARS;
-    constexpr DWORD kFlags = 0;
-
-    const int utf8Length = ::WideCharToMultiByte(
-                              CP_UTF8,       // convert to UTF-8
-                              kFlags,        // Conversion flags
-                              utf16.data(),   // Source UTF-16 string pointer
-                              utf16Length,    // Length of the source UTF-8 string, in chars
-                              nullptr,       // Unused - no conversion done in this step
-                              0,              // Request size of destination buffer, in wchar_ts
-                              nullptr, nullptr
-                            );
-
-    if (utf8Length == 0)
-    {
-      // Conversion error: capture error code and throw
-      const DWORD error = ::GetLastError();
-      throw std::overflow_error(
-        "Cannot get result string length when converting " \
-        "from UTF-16 to UTF-8 (WideCharToMultiByte failed)." +
-        error);
-    }
-
-    utf8.resize(utf8Length);
-
-    // Convert from UTF-16 to UTF-8
-    int result = ::WideCharToMultiByte(
-      CP_UTF8,       // convert to UTF-8
-      kFlags,        // Conversion flags
-      utf16.data(),   // Source UTF-16 string pointer
-      utf16Length,    // Length of source UTF-16 string, in chars
-      &utf8[0],     // Pointer to destination buffer
-      utf8Length,    // Size of destination buffer, in wchar_ts  
-      nullptr, nullptr
-    );
-
-    if (result == 0)
-    {
-      // Conversion error: capture error code and throw
-      const DWORD error = ::GetLastError();
-      throw std::overflow_error(
-        "Cannot convert from UTF-16 to UTF-8 "\
-        "(WideCharToMultiByte failed)." + 
-        error);
-    }
-
+    // Sized for the worst case so the input is only scanned once;
+    // invalid surrogates become U+FFFD
+    std::string utf8(Transcoder::MaxUtf8Length(utf16.size()), '\0');
+    utf8.resize(Transcoder::Utf16ToUtf8(utf16.data(), utf16.size(), utf8.data()));
     return utf8;
 } // End of Utf16ToUtf8
 
 
 std::wstring Util::Utf8ToUtf16(const std::string& utf8) {
-     std::wstring utf16; // Result
-     if (utf8.empty()) {
-        return utf16;
-     }
-
-    if (utf8.length() > static_cast<size_t>((std::numeric_limits<int>::max)()))
-    {
-      throw std::overflow_error(
-        "Input string too long: size_t-length doesn't fit into int.");
-    }
-
-    // Safely convert from size_t (STL string's length)
-    // to int (for Win32 APIs)
-    const int utf8Length = static_cast<int>(utf8.length());
-
-    // Safely fails if an invalid UTF-8 character
-    // is encountered in the input string
-    //constexpr DWORD kFlags = MB_ERR_INVALID_CHARS;
-    constexpr DWORD kFlags = 0;
-
-    const int utf16Length = ::MultiByteToWideChar(
-                              CP_UTF8,       // Source string is in UTF-8
-                              kFlags,        // Conversion flags
-                              utf8.data(),   // Source UTF-8 string pointer
-                              utf8Length,    // Length of the source UTF-8 string, in chars
-                              nullptr,       // Unused - no conversion done in this step
-                              0              // Request size of destination buffer, in wchar_ts
-                            );
-    if (utf16Length == 0)
-    {
-      // Conversion error: capture error code and throw
-      const DWORD error = ::GetLastError();
-      throw std::overflow_error(
-        "Cannot get result string length when converting " \
-        "from UTF-8 to UTF-16 (MultiByteToWideChar failed)." +
-        error);
-    }
-
-    utf16.resize(utf16Length);
-
-    // Convert from UTF-8 to UTF-16
-    int result = ::MultiByteToWideChar(
-      CP_UTF8,       // Source string is in UTF-8
-      kFlags,        // Conversion flags
-      utf8.data(),   // Source UTF-8 string pointer
-      utf8Length,    // Length of source UTF-8 string, in chars
-      &utf16[0],     // Pointer to destination buffer
-      utf16Length    // Size of destination buffer, in wchar_ts          
-    );
-
-    if (result == 0)
-    {
-      // Conversion error: capture error code and throw
-      const DWORD error = ::GetLastError();
-      throw std::overflow_error(
-        "Cannot convert from UTF-8 to UTF-16 "\
-        "(MultiByteToWideChar failed)." + 
-        error);
-    }
-
+    // Invalid UTF-8 sequences become U+FFFD
+    std::wstring utf16(Transcoder::MaxUtf16Length(utf8.size()), L'\0');
+    utf16.resize(Transcoder::Utf8ToUtf16(utf8.data(), utf8.size(), utf16.data()));
     return utf16;
 } // End of Utf8ToUtf16
 
@@ -351,103 +217,23 @@ bool Util::CheckIfUrlsFileExists()
 
 bool Util::IsImageUrl(const std::wstring& url)
 {
-    std::wstring lowerUrl = url;
-    std::transform(lowerUrl.begin(), lowerUrl.end(), lowerUrl.begin(), ::tolower);
-
-    return (
-        lowerUrl.ends_with(L".jpg") || 
-        lowerUrl.ends_with(L".jpeg") ||
-        lowerUrl.ends_with(L".png") ||
-        lowerUrl.ends_with(L".gif") ||
-        lowerUrl.ends_with(L".bmp") ||
-        lowerUrl.ends_with(L".webp")
-    );
+    return UrlClassifier::Default().ClassifyUrl(url).IsImage();
 }
 
 
 
 std::wstring Util::GetFileNameFromUrl(const std::wstring& url)
 {
-    // 1. ȡ·֣ȥЭ顢Ͳѯ
-    size_t path_start = url.find(L"://");
-    if (path_start != std::wstring::npos) {
-        path_start = url.find(L'/', path_start + 3);
-    } else {
-        path_start = url.find(L'/');
-    }
-    
-    std::wstring path;
-    if (path_start != std::wstring::npos) {
-        size_t query_start = url.find(L'?', path_start);
-        path = url.substr(path_start + 1, 
-                         (query_start != std::wstring::npos) ? 
-                         (query_start - path_start - 1) : std::wstring::npos);
-    } else {
-        path = url;
-    }
-
-    // 2. ٷֺű루 %20 -> ո
-    std::wstring decoded_path;
-    for (size_t i = 0; i < path.size(); ++i) {
-        if (path[i] == L'%' && i + 2 < path.size()) {
-            int hex_val;
-            std::wistringstream hex_stream(path.substr(i + 1, 2));
-            if (hex_stream >> std::hex >> hex_val) {
-                decoded_path += static_cast<wchar_t>(hex_val);
-                i += 2;
-                continue;
-            }
-        }
-        decoded_path += path[i];
-    }
-
-    // 3. ȡһбܺΪļ
-    size_t last_slash = decoded_path.find_last_of(L"/\\");
-    std::wstring filename = (last_slash != std::wstring::npos) ? 
-                           decoded_path.substr(last_slash + 1) : decoded_path;
-
-    // 4. ļΪգбܽβURLʹĬ
-    if (filename.empty()) {
-        filename = L"download";
-    }
-
-    // 5. ƳǷļַWindowsϵͳ
-    static const std::wstring illegal_chars = L"<>:\"/\\|?*";
-    filename.erase(std::remove_if(filename.begin(), filename.end(),
-        [](wchar_t c) { return illegal_chars.find(c) != std::wstring::npos; }),
-        filename.end());
-
-    // 6. ΪգٴʹĬ
-    if (filename.empty()) {
-        filename = L"download";
-    }
-
-    // 7. ضϹļWindows255ַ
-    const size_t max_length = 255;
-    if (filename.length() > max_length) {
-        size_t last_dot = filename.find_last_of(L'.');
-        if (last_dot != std::wstring::npos && last_dot > max_length - 10) {
-            // չ
-            std::wstring ext = filename.substr(last_dot);
-            filename = filename.substr(0, max_length - ext.length()) + ext;
-        } else {
-            filename = filename.substr(0, max_length);
-        }
-    }
-
-    return filename;
+    //  UTF-8 ٷֺű룬ֻһ·
+    return UrlParser::GetFileName(url);
 }
 
 bool Util::IsImageContentType(const wchar_t* contentType) {
-    static const std::vector<std::wstring> imageTypes = {
-        L"image/jpeg", L"image/png", L"image/gif",
-        L"image/webp", L"image/svg+xml", L"image/bmp"
-    };
-    std::wstring type(contentType);
-    return std::any_of(imageTypes.begin(), imageTypes.end(),
-        [&type](const std::wstring& imgType) {
-            return type.find(imgType) != std::wstring::npos;
-        });
+    if (!contentType)
+    {
+        return false;
+    }
+    return UrlClassifier::Default().ClassifyContentType(contentType).IsImage();
 }
 
 // JSONֵ
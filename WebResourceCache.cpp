@@ -0,0 +1,248 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "WebResourceCache.h"
+#include "Metrics.h"
+
+#include <shlwapi.h>
+
+#pragma comment(lib, "shlwapi.lib")
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    HRESULT ReadHeaders(ICoreWebView2HttpResponseHeaders* headers, HttpCache::Headers& out)
+    {
+        wil::com_ptr<ICoreWebView2HttpHeadersCollectionIterator> iterator;
+        RETURN_IF_FAILED(headers->GetIterator(&iterator));
+        BOOL hasCurrent = FALSE;
+        while (SUCCEEDED(iterator->get_HasCurrentHeader(&hasCurrent)) && hasCurrent)
+        {
+            wil::unique_cotaskmem_string name;
+            wil::unique_cotaskmem_string value;
+            RETURN_IF_FAILED(iterator->GetCurrentHeader(&name, &value));
+            out.emplace_back(name.get() ? name.get() : L"", value.get() ? value.get() : L"");
+            BOOL hasNext = FALSE;
+            RETURN_IF_FAILED(iterator->MoveNext(&hasNext));
+        }
+        return S_OK;
+    }
+
+    // False when the body is larger than limit or cannot be read
+    bool ReadStream(IStream* stream, uint64_t limit, std::string& out)
+    {
+        STATSTG stat = {};
+        if (SUCCEEDED(stream->Stat(&stat, STATFLAG_NONAME)))
+        {
+            if (stat.cbSize.QuadPart > limit)
+            {
+                return false;
+            }
+            out.reserve(static_cast<size_t>(stat.cbSize.QuadPart));
+        }
+        char buffer[64 * 1024];
+        ULONG read = 0;
+        HRESULT hr = S_OK;
+        while (SUCCEEDED(hr = stream->Read(buffer, sizeof(buffer), &read)) && read > 0)
+        {
+            out.append(buffer, read);
+            if (out.size() > limit)
+            {
+                return false;
+            }
+        }
+        return SUCCEEDED(hr);
+    }
+}
+
+WebResourceCache::WebResourceCache(ThreadPool::Dispatcher background, ThreadPool::Dispatcher dispatch)
+    : m_background(std::move(background)), m_dispatch(std::move(dispatch))
+{
+}
+
+bool WebResourceCache::Open(const HttpCache::Config& config)
+{
+    return m_cache.Open(config);
+}
+
+bool WebResourceCache::IsCacheable(COREWEBVIEW2_WEB_RESOURCE_CONTEXT context)
+{
+    // Documents are what a crawl is after and media is fetched in ranges
+    switch (context)
+    {
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_STYLESHEET:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_IMAGE:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FONT:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_SCRIPT:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_XML_HTTP_REQUEST:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FETCH:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_MANIFEST:
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_OTHER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+HRESULT WebResourceCache::HandleRequest(ICoreWebView2Environment* env, ICoreWebView2WebResourceRequestedEventArgs* args,
+    ICoreWebView2WebResourceRequest* request, const std::wstring& uri)
+{
+    wil::unique_cotaskmem_string method;
+    RETURN_IF_FAILED(request->get_Method(&method));
+    if (!method.get() || _wcsicmp(method.get(), L"GET") != 0)
+    {
+        return S_OK;
+    }
+    wil::com_ptr<ICoreWebView2HttpRequestHeaders> headers;
+    RETURN_IF_FAILED(request->get_Headers(&headers));
+    BOOL hasRange = FALSE;
+    RETURN_IF_FAILED(headers->Contains(L"Range", &hasRange));
+    if (hasRange)
+    {
+        return S_OK;
+    }
+
+    // Only the index is looked at here; an entry's file, up to the largest
+    // entry size, is read off the UI thread while a deferral holds the request
+    wil::com_ptr<ICoreWebView2Deferral> deferral;
+    if (m_cache.Probe(uri, HttpCache::NowSeconds()) == HttpCache::Lookup::Fresh && SUCCEEDED(args->GetDeferral(&deferral)))
+    {
+        uint64_t id = ++m_nextLookupId;
+        PendingLookup& pending = m_lookups[id];
+        pending.env = env;
+        pending.args = args;
+        pending.deferral = deferral;
+        pending.uri = uri;
+
+        HttpCache* cache = &m_cache;
+        ThreadPool::Dispatcher dispatch = m_dispatch;
+        m_background([this, cache, dispatch, id, uri]() {
+            LoadedEntry loaded;
+            HttpCache::Entry entry;
+            if (cache->Find(uri, HttpCache::NowSeconds(), entry) == HttpCache::Lookup::Fresh)
+            {
+                loaded.status = entry.status;
+                loaded.headers = std::move(entry.headers);
+                loaded.size = entry.body.size();
+                loaded.body.attach(SHCreateMemStream(reinterpret_cast<const BYTE*>(entry.body.data()), static_cast<UINT>(entry.body.size())));
+            }
+            dispatch([this, id, loaded = std::move(loaded)]() mutable {
+                FinishLookup(id, std::move(loaded));
+            });
+        });
+        return S_OK;
+    }
+    AddPendingStore(uri);
+    return S_OK;
+}
+
+void WebResourceCache::FinishLookup(uint64_t id, LoadedEntry loaded)
+{
+    auto it = m_lookups.find(id);
+    if (it == m_lookups.end())
+    {
+        return;
+    }
+    PendingLookup pending = std::move(it->second);
+    m_lookups.erase(it);
+
+    // Evicted or gone stale in the meantime: a miss after all
+    if (!loaded.body || FAILED(Respond(pending.env.get(), pending.args.get(), loaded)))
+    {
+        AddPendingStore(pending.uri);
+    }
+    pending.deferral->Complete();
+}
+
+void WebResourceCache::AddPendingStore(const std::wstring& uri)
+{
+    // Stale entries are fetched again by the WebView itself, with the
+    // session's cookies, proxy and credentials; a 304 or a new 200 for them
+    // comes back through HandleResponse like any miss
+    Metrics::Instance().Add(Metrics::Counter::CacheMisses);
+    std::wstring normalized = HttpCache::NormalizeUrl(uri);
+    if (!normalized.empty())
+    {
+        if (m_pendingStores.size() >= c_maxPendingStores)
+        {
+            m_pendingStores.clear();
+        }
+        m_pendingStores.insert(std::move(normalized));
+    }
+}
+
+HRESULT WebResourceCache::Respond(ICoreWebView2Environment* env, ICoreWebView2WebResourceRequestedEventArgs* args,
+    const LoadedEntry& loaded)
+{
+    wil::com_ptr<ICoreWebView2WebResourceResponse> response;
+    RETURN_IF_FAILED(env->CreateWebResourceResponse(loaded.body.get(), loaded.status, L"OK", loaded.headers.c_str(), &response));
+    RETURN_IF_FAILED(args->put_Response(response.get()));
+
+    Metrics& metrics = Metrics::Instance();
+    metrics.Add(Metrics::Counter::CacheHits);
+    metrics.Add(Metrics::Counter::CacheBytes, loaded.size);
+    return S_OK;
+}
+
+HRESULT WebResourceCache::HandleResponse(ICoreWebView2WebResourceResponseReceivedEventArgs* args)
+{
+    wil::com_ptr<ICoreWebView2WebResourceRequest> request;
+    RETURN_IF_FAILED(args->get_Request(&request));
+    wil::unique_cotaskmem_string uri;
+    RETURN_IF_FAILED(request->get_Uri(&uri));
+    if (!uri.get() || m_pendingStores.erase(HttpCache::NormalizeUrl(uri.get())) == 0)
+    {
+        return S_OK;
+    }
+
+    wil::com_ptr<ICoreWebView2WebResourceResponseView> response;
+    RETURN_IF_FAILED(args->get_Response(&response));
+    int status = 0;
+    RETURN_IF_FAILED(response->get_StatusCode(&status));
+    wil::com_ptr<ICoreWebView2HttpResponseHeaders> responseHeaders;
+    RETURN_IF_FAILED(response->get_Headers(&responseHeaders));
+    HttpCache::Headers headers;
+    RETURN_IF_FAILED(ReadHeaders(responseHeaders.get(), headers));
+    if (status == 304)
+    {
+        // The WebView revalidated its own copy; ours is just as current
+        HttpCache* cache = &m_cache;
+        std::wstring url = uri.get();
+        int64_t now = HttpCache::NowSeconds();
+        m_background([cache, url, headers = std::move(headers), now]() {
+            if (cache->Refresh(url, headers, now))
+            {
+                Metrics::Instance().Add(Metrics::Counter::CacheRevalidations);
+            }
+        });
+        return S_OK;
+    }
+    // Bodies are only copied out of the WebView when they will be kept
+    if (!HttpCache::GetPolicy(status, headers, HttpCache::NowSeconds()).storable)
+    {
+        return S_OK;
+    }
+
+    std::wstring url = uri.get();
+    HttpCache* cache = &m_cache;
+    ThreadPool::Dispatcher background = m_background;
+    return response->GetContent(Callback<ICoreWebView2WebResourceResponseViewGetContentCompletedHandler>(
+        [cache, background, url, status, headers](HRESULT errorCode, IStream* content) -> HRESULT
+    {
+        // GetContent completes with the body buffered, so it is drained
+        // here on the UI thread that owns the stream and only the store
+        // goes to the pool; a pool task never calls back into this STA
+        std::string body;
+        if (FAILED(errorCode) || !content || !ReadStream(content, cache->GetMaxEntrySize(), body))
+        {
+            return S_OK;
+        }
+        int64_t now = HttpCache::NowSeconds();
+        background([cache, url, status, headers, body = std::move(body), now]() {
+            cache->Store(url, status, headers, body, now);
+        });
+        return S_OK;
+    }).Get());
+}
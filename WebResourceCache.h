@@ -0,0 +1,79 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "HttpCache.h"
+#include "ThreadPool.h"
+
+#include <map>
+#include <unordered_set>
+
+// Answers the content tabs' subresource requests from the HttpCache through
+// WebResourceRequested, shared by all tabs and called on the UI thread only.
+// Fresh entries are read on a pool thread while a deferral holds the
+// request, then served. Misses and stale entries go to the network through
+// the WebView, with the session's cookies and credentials; their responses
+// are copied out on the UI thread and stored on a pool thread, and a 304 to
+// the WebView's own revalidation refreshes a stale entry. Document requests
+// always hit the network.
+class WebResourceCache
+{
+public:
+    // background runs file reads and writes off the UI thread; dispatch runs a task
+    // back on the UI thread
+    WebResourceCache(ThreadPool::Dispatcher background, ThreadPool::Dispatcher dispatch);
+
+    WebResourceCache(const WebResourceCache&) = delete;
+    WebResourceCache& operator=(const WebResourceCache&) = delete;
+
+    bool Open(const HttpCache::Config& config);
+    bool IsOpen() const { return m_cache.IsOpen(); }
+
+    static bool IsCacheable(COREWEBVIEW2_WEB_RESOURCE_CONTEXT context);
+
+    // Takes a deferral when the cache can answer, or remembers the URL so
+    // its response is stored when it arrives.
+    HRESULT HandleRequest(ICoreWebView2Environment* env, ICoreWebView2WebResourceRequestedEventArgs* args,
+        ICoreWebView2WebResourceRequest* request, const std::wstring& uri);
+    HRESULT HandleResponse(ICoreWebView2WebResourceResponseReceivedEventArgs* args);
+
+private:
+    // A fresh entry read in the background, ready to be served
+    struct LoadedEntry
+    {
+        int status = 0;
+        std::wstring headers;
+        wil::com_ptr<IStream> body;  // Null when the entry was gone
+        uint64_t size = 0;
+    };
+
+    // A request held by its deferral until its entry is loaded; only
+    // touched on the UI thread
+    struct PendingLookup
+    {
+        wil::com_ptr<ICoreWebView2Environment> env;
+        wil::com_ptr<ICoreWebView2WebResourceRequestedEventArgs> args;
+        wil::com_ptr<ICoreWebView2Deferral> deferral;
+        std::wstring uri;
+    };
+
+    void FinishLookup(uint64_t id, LoadedEntry loaded);
+    // Counts a miss and remembers the URL so its response is stored
+    void AddPendingStore(const std::wstring& uri);
+    HRESULT Respond(ICoreWebView2Environment* env, ICoreWebView2WebResourceRequestedEventArgs* args,
+        const LoadedEntry& loaded);
+
+    // Only so many misses are tracked; a response whose request was
+    // forgotten is simply not stored
+    static constexpr size_t c_maxPendingStores = 4096;
+
+    HttpCache m_cache;
+    ThreadPool::Dispatcher m_background;
+    ThreadPool::Dispatcher m_dispatch;
+    std::unordered_set<std::wstring> m_pendingStores;  // Normalized URLs of misses in flight
+    std::map<uint64_t, PendingLookup> m_lookups;
+    uint64_t m_nextLookupId = 0;
+};
@@ -0,0 +1,457 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "WebView2Engine.h"
+#include "DownloadLayout.h"
+#include "Tab.h"
+#include "UrlClassifier.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    std::wstring GetHeader(ICoreWebView2HttpResponseHeaders* headers, LPCWSTR name)
+    {
+        wil::unique_cotaskmem_string value;
+        if (FAILED(headers->GetHeader(name, &value)) || !value.get())
+        {
+            return std::wstring();
+        }
+        return value.get();
+    }
+
+    // GetContent completes with the whole body buffered, so this is a copy
+    // out of the WebView's stream, cheap enough for the UI thread
+    bool ReadBody(IStream* stream, std::string& body)
+    {
+        STATSTG stat = {};
+        if (SUCCEEDED(stream->Stat(&stat, STATFLAG_NONAME)))
+        {
+            body.reserve(static_cast<size_t>(stat.cbSize.QuadPart));
+        }
+        char buffer[64 * 1024];
+        ULONG read = 0;
+        HRESULT hr = S_OK;
+        while (SUCCEEDED(hr = stream->Read(buffer, sizeof(buffer), &read)) && read > 0)
+        {
+            body.append(buffer, read);
+        }
+        return SUCCEEDED(hr);
+    }
+
+    // Writes the body to path after reserving its size; gives up once the
+    // capture has been stopped
+    bool WriteBodyToFile(const std::string& body, const std::wstring& path, const std::weak_ptr<bool>& alive, int64_t& bytesWritten)
+    {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        DownloadLayout::Preallocate(file, body.size());
+
+        const size_t c_chunkSize = 1024 * 1024;
+        bool written = true;
+        for (size_t offset = 0; written && offset < body.size() && !alive.expired(); offset += c_chunkSize)
+        {
+            DWORD size = static_cast<DWORD>((std::min)(c_chunkSize, body.size() - offset));
+            DWORD chunk = 0;
+            written = WriteFile(file, body.data() + offset, size, &chunk, nullptr) && chunk == size;
+            bytesWritten += chunk;
+        }
+        // Drops what an earlier, longer file or the reservation left behind
+        written = SetEndOfFile(file) && written && !alive.expired();
+        CloseHandle(file);
+        return written;
+    }
+}
+
+WebView2Engine::WebView2Engine(Tab* tab, size_t tabId)
+    : BrowserEngine(tabId)
+{
+    Attach(tab);
+}
+
+WebView2Engine::~WebView2Engine()
+{
+    Detach();
+}
+
+bool WebView2Engine::Attach(Tab* tab)
+{
+    Detach();
+    m_tab = tab;
+    m_webView = tab->m_contentWebView;
+    if (!m_webView)
+    {
+        return false;
+    }
+    m_webView10 = m_webView.try_query<ICoreWebView2_10>();
+    if (!m_webView10)
+    {
+        OutputDebugString(L"WebView2 version does not support download API\n");
+        return false;
+    }
+
+    m_webView->add_NavigationStarting(Callback<ICoreWebView2NavigationStartingEventHandler>(
+        [this](ICoreWebView2* webview, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT
+    {
+        args->get_NavigationId(&m_lastNavigationId);
+        return S_OK;
+    }).Get(), &m_navStartingToken);
+
+    // A navigation that turns into a download raises DownloadStarting first
+    // and then completes as aborted
+    m_webView->add_NavigationCompleted(Callback<ICoreWebView2NavigationCompletedEventHandler>(
+        [this](ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT
+    {
+        UINT64 navigationId = 0;
+        args->get_NavigationId(&navigationId);
+        if (!m_events || (m_stoppedNavigationId != 0 && navigationId == m_stoppedNavigationId))
+        {
+            return S_OK;
+        }
+        BOOL succeeded = FALSE;
+        args->get_IsSuccess(&succeeded);
+        wil::unique_cotaskmem_string source;
+        webview->get_Source(&source);
+        m_events->OnNavigationCompleted(source.get() ? source.get() : L"", !!succeeded);
+        return S_OK;
+    }).Get(), &m_navCompletedToken);
+
+    m_webView10->add_DownloadStarting(Callback<ICoreWebView2DownloadStartingEventHandler>(
+        [this](ICoreWebView2* sender, ICoreWebView2DownloadStartingEventArgs* args) -> HRESULT
+    {
+        return HandleDownloadStarting(args);
+    }).Get(), &m_downloadStartingToken);
+
+    if (m_captureResponses)
+    {
+        SetResponseCapture(true);
+    }
+    return true;
+}
+
+void WebView2Engine::Detach()
+{
+    bool captureResponses = m_captureResponses;
+    SetResponseCapture(false);
+    m_captureResponses = captureResponses;
+    ReleaseDownload();
+    if (m_webView10)
+    {
+        m_webView10->remove_DownloadStarting(m_downloadStartingToken);
+        m_webView->remove_NavigationCompleted(m_navCompletedToken);
+        m_webView->remove_NavigationStarting(m_navStartingToken);
+    }
+    m_webView2.reset();
+    m_webView10.reset();
+    m_webView.reset();
+    m_navigationUri.clear();
+    m_capturingUri.clear();
+    m_alive = std::make_shared<bool>(true);
+    m_lastNavigationId = 0;
+    m_stoppedNavigationId = 0;
+}
+
+void WebView2Engine::ReleaseDownload()
+{
+    if (m_download)
+    {
+        m_download->remove_StateChanged(m_downloadStateToken);
+        m_download.reset();
+    }
+}
+
+HRESULT WebView2Engine::HandleDownloadStarting(ICoreWebView2DownloadStartingEventArgs* args)
+{
+    if (!m_events)
+    {
+        return S_OK;
+    }
+
+    wil::com_ptr<ICoreWebView2DownloadOperation> download;
+    RETURN_IF_FAILED(args->get_DownloadOperation(&download));
+    wil::unique_cotaskmem_string uri;
+    RETURN_IF_FAILED(download->get_Uri(&uri));
+
+    if (!m_capturingUri.empty() && m_capturingUri == uri.get())
+    {
+        // The bytes are already being written from the response
+        return args->put_Cancel(TRUE);
+    }
+    if (!m_downloadsEnabled)
+    {
+        RETURN_IF_FAILED(args->put_Cancel(TRUE));
+        DownloadResult result;
+        result.uri = uri.get();
+        m_events->OnDownloadFinished(result);
+        return S_OK;
+    }
+
+    std::wstring path = m_events->OnDownloadStarting(uri.get());
+    if (!path.empty())
+    {
+        args->put_ResultFilePath(path.c_str());
+    }
+    args->put_Handled(TRUE);
+
+    ReleaseDownload();
+    m_download = download;
+    return download->add_StateChanged(Callback<ICoreWebView2StateChangedEventHandler>(
+        [this, path](ICoreWebView2DownloadOperation* download, IUnknown* args) -> HRESULT
+    {
+        COREWEBVIEW2_DOWNLOAD_STATE state;
+        RETURN_IF_FAILED(download->get_State(&state));
+        if (state == COREWEBVIEW2_DOWNLOAD_STATE_IN_PROGRESS)
+        {
+            return S_OK;
+        }
+
+        DownloadResult result;
+        wil::unique_cotaskmem_string uri;
+        download->get_Uri(&uri);
+        result.uri = uri.get() ? uri.get() : L"";
+        result.path = path;
+        result.completed = state == COREWEBVIEW2_DOWNLOAD_STATE_COMPLETED;
+        INT64 bytes = 0;
+        download->get_BytesReceived(&bytes);
+        result.bytesReceived = bytes;
+        bytes = 0;
+        download->get_TotalBytesToReceive(&bytes);
+        result.totalBytes = (std::max<INT64>)(bytes, 0);
+
+        if (m_events)
+        {
+            m_events->OnDownloadFinished(result);
+        }
+        return S_OK;
+    }).Get(), &m_downloadStateToken);
+}
+
+bool WebView2Engine::SetResponseCapture(bool enabled)
+{
+    m_captureResponses = false;
+    if (!m_webView2)
+    {
+        m_webView2 = m_webView ? m_webView.try_query<ICoreWebView2_2>() : nullptr;
+        if (!m_webView2)
+        {
+            return false;
+        }
+    }
+    if (m_responseReceivedToken.value != 0)
+    {
+        m_webView2->remove_WebResourceResponseReceived(m_responseReceivedToken);
+        m_responseReceivedToken = {};
+    }
+    if (!enabled)
+    {
+        return true;
+    }
+    m_captureResponses = SUCCEEDED(m_webView2->add_WebResourceResponseReceived(Callback<ICoreWebView2WebResourceResponseReceivedEventHandler>(
+        [this](ICoreWebView2* sender, ICoreWebView2WebResourceResponseReceivedEventArgs* args) -> HRESULT
+    {
+        return HandleResponseReceived(args);
+    }).Get(), &m_responseReceivedToken));
+    return m_captureResponses;
+}
+
+HRESULT WebView2Engine::HandleResponseReceived(ICoreWebView2WebResourceResponseReceivedEventArgs* args)
+{
+    if (!m_events)
+    {
+        return S_OK;
+    }
+
+    wil::com_ptr<ICoreWebView2WebResourceResponseView> response;
+    RETURN_IF_FAILED(args->get_Response(&response));
+    int status = 0;
+    RETURN_IF_FAILED(response->get_StatusCode(&status));
+    wil::com_ptr<ICoreWebView2HttpResponseHeaders> responseHeaders;
+    RETURN_IF_FAILED(response->get_Headers(&responseHeaders));
+    std::wstring contentType = GetHeader(responseHeaders.get(), L"Content-Type");
+    if (status != 200 || !UrlClassifier::Default().ClassifyContentType(contentType).IsImage())
+    {
+        return S_OK;
+    }
+
+    wil::com_ptr<ICoreWebView2WebResourceRequest> request;
+    RETURN_IF_FAILED(args->get_Request(&request));
+    wil::unique_cotaskmem_string uri;
+    RETURN_IF_FAILED(request->get_Uri(&uri));
+    wil::com_ptr<ICoreWebView2HttpRequestHeaders> requestHeaders;
+    RETURN_IF_FAILED(request->get_Headers(&requestHeaders));
+    // Sec-Fetch-Dest tells documents, elements and XHR/fetch apart; plain
+    // http requests lack it and only the navigated URI is recognised
+    wil::unique_cotaskmem_string destination;
+    if (FAILED(requestHeaders->GetHeader(L"Sec-Fetch-Dest", &destination)))
+    {
+        destination.reset();
+    }
+    std::wstring fetchDest = destination.get() ? destination.get() : L"";
+
+    ImageResponse image;
+    image.uri = uri.get();
+    image.contentType = contentType;
+    std::wstring contentLength = GetHeader(responseHeaders.get(), L"Content-Length");
+    image.contentLength = contentLength.empty() ? -1 : _wtoi64(contentLength.c_str());
+    image.isDocument = fetchDest == L"document" || (fetchDest.empty() && image.uri == m_navigationUri);
+    image.fromScript = fetchDest == L"empty";
+
+    std::wstring path = m_events->OnImageResponse(image);
+    if (path.empty())
+    {
+        return S_OK;
+    }
+
+    m_capturingUri = image.uri;
+    std::weak_ptr<bool> alive = m_alive;
+    HRESULT hr = response->GetContent(Callback<ICoreWebView2WebResourceResponseViewGetContentCompletedHandler>(
+        [this, alive, image, path](HRESULT errorCode, IStream* content) -> HRESULT
+    {
+        if (alive.expired())
+        {
+            // Stopped or destroyed; nobody waits for the file
+            return S_OK;
+        }
+        DownloadResult result;
+        result.uri = image.uri;
+        result.path = path;
+        result.totalBytes = (std::max<int64_t>)(image.contentLength, 0);
+
+        // Only the file write runs on the pool. The stream is drained here,
+        // on the thread it belongs to, so no pool task ever has to call back
+        // into this STA, which may be blocked in ThreadPool::Shutdown
+        std::string body;
+        if (FAILED(errorCode) || !content || !ReadBody(content, body))
+        {
+            FinishCapture(result);
+            return S_OK;
+        }
+        if (m_background && m_dispatch)
+        {
+            ThreadPool::Dispatcher dispatch = m_dispatch;
+            m_background([this, alive, dispatch, body = std::move(body), result]() mutable {
+                result.completed = WriteBodyToFile(body, result.path, alive, result.bytesReceived);
+                dispatch([this, alive, result]() {
+                    if (!alive.expired())
+                    {
+                        FinishCapture(result);
+                    }
+                });
+            });
+            return S_OK;
+        }
+
+        result.completed = WriteBodyToFile(body, path, alive, result.bytesReceived);
+        FinishCapture(result);
+        return S_OK;
+    }).Get());
+    if (FAILED(hr))
+    {
+        m_capturingUri.clear();
+        DownloadResult result;
+        result.uri = image.uri;
+        result.path = path;
+        m_events->OnDownloadFinished(result);
+    }
+    return S_OK;
+}
+
+void WebView2Engine::FinishCapture(const DownloadResult& result)
+{
+    m_capturingUri.clear();
+    if (m_events)
+    {
+        m_events->OnDownloadFinished(result);
+    }
+}
+
+void WebView2Engine::SetDispatchers(ThreadPool::Dispatcher background, ThreadPool::Dispatcher dispatch)
+{
+    m_background = std::move(background);
+    m_dispatch = std::move(dispatch);
+}
+
+bool WebView2Engine::Navigate(const std::wstring& uri)
+{
+    m_navigationUri = uri;
+    return m_webView && SUCCEEDED(m_webView->Navigate(uri.c_str()));
+}
+
+bool WebView2Engine::Stop()
+{
+    if (!m_webView)
+    {
+        return false;
+    }
+    m_stoppedNavigationId = m_lastNavigationId;
+    if (m_download)
+    {
+        m_download->Cancel();
+        ReleaseDownload();
+    }
+    m_capturingUri.clear();
+    m_alive = std::make_shared<bool>(true);
+    return SUCCEEDED(m_webView->CallDevToolsProtocolMethod(L"Page.stopLoading", L"{}", nullptr));
+}
+
+bool WebView2Engine::ExecuteScript(const std::wstring& script, ScriptCallback callback)
+{
+    if (!m_webView)
+    {
+        return false;
+    }
+    return SUCCEEDED(m_webView->ExecuteScript(script.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
+        [callback = std::move(callback)](HRESULT errorCode, LPCWSTR resultJson) -> HRESULT
+    {
+        callback(SUCCEEDED(errorCode), resultJson ? resultJson : L"");
+        return S_OK;
+    }).Get()));
+}
+
+bool WebView2Engine::GetCookies(const std::wstring& uri, CookiesCallback callback)
+{
+    if (!m_tab->m_cookieManager)
+    {
+        return false;
+    }
+    return SUCCEEDED(m_tab->m_cookieManager->GetCookies(uri.c_str(), Callback<ICoreWebView2GetCookiesCompletedHandler>(
+        [callback = std::move(callback)](HRESULT errorCode, ICoreWebView2CookieList* list) -> HRESULT
+    {
+        UINT count = 0;
+        if (FAILED(errorCode) || FAILED(list->get_Count(&count)))
+        {
+            callback(false, {});
+            return S_OK;
+        }
+
+        std::vector<Tab::CookieStrings> strings(count);
+        std::vector<CookieView> cookies;
+        cookies.reserve(count);
+        for (UINT i = 0; i < count; ++i)
+        {
+            wil::com_ptr<ICoreWebView2Cookie> cookie;
+            CookieView view;
+            if (SUCCEEDED(list->GetValueAtIndex(i, &cookie)) && cookie &&
+                SUCCEEDED(Tab::ReadCookie(cookie.get(), strings[i], view)))
+            {
+                cookies.push_back(view);
+            }
+        }
+        callback(true, cookies);
+        return S_OK;
+    }).Get()));
+}
+
+size_t WebView2Engine::ImportCookies(const std::vector<Cookie>& cookies)
+{
+    return m_tab->ImportCookies(cookies);
+}
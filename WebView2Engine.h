@@ -0,0 +1,78 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "BrowserEngine.h"
+#include "ThreadPool.h"
+
+class Tab;
+
+// BrowserEngine on top of one tab's WebView2. It adds its own
+// NavigationCompleted and DownloadStarting handlers next to the tab's and
+// removes them again when destroyed, so it must not outlive the tab. A tab
+// recreated after its processes died is picked up again with Attach.
+class WebView2Engine : public BrowserEngine
+{
+public:
+    WebView2Engine(Tab* tab, size_t tabId);
+    ~WebView2Engine() override;
+
+    WebView2Engine(const WebView2Engine&) = delete;
+    WebView2Engine& operator=(const WebView2Engine&) = delete;
+
+    // Moves the handlers, and response capture if it is on, to the tab's
+    // current WebView. False when the runtime lacks the download API.
+    bool Attach(Tab* tab);
+    // Lets go of the WebView before its controller is closed
+    void Detach();
+    bool IsAttached() const { return m_webView10 != nullptr; }
+    // Where captured bodies are written to their files and where that is
+    // reported back; without them the write runs on the UI thread
+    void SetDispatchers(ThreadPool::Dispatcher background, ThreadPool::Dispatcher dispatch);
+
+    bool Navigate(const std::wstring& uri) override;
+    // Page.stopLoading, as MG_CANCEL sends; the stopped navigation's
+    // completion is recognised by its id and dropped
+    bool Stop() override;
+    bool ExecuteScript(const std::wstring& script, ScriptCallback callback) override;
+    bool GetCookies(const std::wstring& uri, CookiesCallback callback) override;
+    size_t ImportCookies(const std::vector<Cookie>& cookies) override;
+    // Image responses come from WebResourceResponseReceived; a taken body is
+    // read from GetContent on the UI thread and written to its file on the
+    // pool
+    bool SetResponseCapture(bool enabled) override;
+
+private:
+    HRESULT HandleDownloadStarting(ICoreWebView2DownloadStartingEventArgs* args);
+    HRESULT HandleResponseReceived(ICoreWebView2WebResourceResponseReceivedEventArgs* args);
+    void ReleaseDownload();
+    void FinishCapture(const DownloadResult& result);
+
+    Tab* m_tab = nullptr;
+    wil::com_ptr<ICoreWebView2> m_webView;
+    wil::com_ptr<ICoreWebView2_10> m_webView10;
+    EventRegistrationToken m_navStartingToken = {};
+    EventRegistrationToken m_navCompletedToken = {};
+    EventRegistrationToken m_downloadStartingToken = {};
+    UINT64 m_lastNavigationId = 0;
+    UINT64 m_stoppedNavigationId = 0;
+
+    // The download in flight, so its handler can be removed with the engine
+    wil::com_ptr<ICoreWebView2DownloadOperation> m_download;
+    EventRegistrationToken m_downloadStateToken = {};
+
+    wil::com_ptr<ICoreWebView2_2> m_webView2;
+    EventRegistrationToken m_responseReceivedToken = {};
+    bool m_captureResponses = false;  // Kept across Detach and Attach
+    std::wstring m_navigationUri;
+    // A download of the response being captured is a duplicate and cancelled
+    std::wstring m_capturingUri;
+    // GetContent completions cannot be unregistered and check this instead;
+    // Stop replaces it to drop the one in flight
+    std::shared_ptr<bool> m_alive = std::make_shared<bool>(true);
+    ThreadPool::Dispatcher m_background;
+    ThreadPool::Dispatcher m_dispatch;
+};
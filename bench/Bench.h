@@ -0,0 +1,63 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Shared helpers for the micro benchmarks of the core kernels. Each one is
+// a plain executable that prints one line per kernel and input.
+
+namespace Bench
+{
+    // Results are folded in here so the measured calls cannot be dropped
+    inline volatile size_t g_sink = 0;
+
+    // Runs fn until at least minSeconds have passed and returns the average
+    // seconds per call.
+    template <typename Fn>
+    double SecondsPerCall(Fn&& fn, double minSeconds = 0.3)
+    {
+        using Clock = std::chrono::steady_clock;
+        g_sink = g_sink + fn();  // Warm up caches and lazily sized buffers
+        size_t calls = 0;
+        auto start = Clock::now();
+        double elapsed = 0;
+        do
+        {
+            g_sink = g_sink + fn();
+            calls++;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < minSeconds);
+        return elapsed / static_cast<double>(calls);
+    }
+
+    inline void Report(const char* kernel, const std::string& input, size_t bytes, double seconds)
+    {
+        std::printf("%-28s %-32s %10.1f MB/s %12.3f us\n", kernel, input.c_str(),
+            static_cast<double>(bytes) / seconds / 1e6, seconds * 1e6);
+    }
+
+    inline void ReportItems(const char* kernel, const std::string& input, size_t items, double seconds)
+    {
+        std::printf("%-28s %-32s %10.2f M/s  %12.3f us\n", kernel, input.c_str(),
+            static_cast<double>(items) / seconds / 1e6, seconds * 1e6);
+    }
+
+    inline bool ReadFile(const char* path, std::string& contents)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            std::fprintf(stderr, "cannot read %s\n", path);
+            return false;
+        }
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+}
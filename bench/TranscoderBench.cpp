@@ -0,0 +1,190 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares Transcoder with the conversion it replaced: Util used to call
+// MultiByteToWideChar/WideCharToMultiByte twice per string, once for the
+// size and once for the data. Those do not exist off Windows, so the
+// baseline here is a scalar converter run the same way, two passes and an
+// exactly sized result. Pass captured pages to measure those, e.g.
+//   bookget_transcoder_bench page1.html page2.html
+// Without arguments a synthetic page of markup and CJK text is used.
+
+#include "Transcoder.h"
+#include "Bench.h"
+
+#include <cstdint>
+#include <string>
+
+namespace
+{
+    // Scalar UTF-8 decoder; counts only when out is null
+    size_t LegacyUtf8ToUtf16(const char* input, size_t length, char16_t* out)
+    {
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(input);
+        size_t written = 0;
+        size_t i = 0;
+        auto put = [&](uint32_t unit) {
+            if (out)
+            {
+                out[written] = static_cast<char16_t>(unit);
+            }
+            written++;
+        };
+        while (i < length)
+        {
+            uint32_t lead = src[i];
+            size_t trailing = lead < 0x80 ? 0 : lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+            if (lead >= 0x80 && trailing == 0)
+            {
+                put(0xFFFD);
+                i++;
+                continue;
+            }
+            uint32_t codePoint = trailing == 0 ? lead : lead & (0x3F >> trailing);
+            bool valid = true;
+            for (size_t j = 1; j <= trailing; ++j)
+            {
+                if (i + j >= length || (src[i + j] & 0xC0) != 0x80)
+                {
+                    valid = false;
+                    break;
+                }
+                codePoint = (codePoint << 6) | (src[i + j] & 0x3F);
+            }
+            if (!valid)
+            {
+                put(0xFFFD);
+                i++;
+                continue;
+            }
+            if (codePoint >= 0x10000)
+            {
+                put(0xD800 + ((codePoint - 0x10000) >> 10));
+                put(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+            }
+            else
+            {
+                put(codePoint);
+            }
+            i += trailing + 1;
+        }
+        return written;
+    }
+
+    size_t LegacyUtf16ToUtf8(const char16_t* src, size_t length, char* out)
+    {
+        size_t written = 0;
+        auto put = [&](uint32_t byte) {
+            if (out)
+            {
+                out[written] = static_cast<char>(byte);
+            }
+            written++;
+        };
+        for (size_t i = 0; i < length; ++i)
+        {
+            uint32_t c = src[i];
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < length && src[i + 1] >= 0xDC00 && src[i + 1] <= 0xDFFF)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (src[++i] - 0xDC00);
+            }
+            else if (c >= 0xD800 && c <= 0xDFFF)
+            {
+                c = 0xFFFD;
+            }
+            if (c < 0x80)
+            {
+                put(c);
+            }
+            else if (c < 0x800)
+            {
+                put(0xC0 | (c >> 6));
+                put(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                put(0xE0 | (c >> 12));
+                put(0x80 | ((c >> 6) & 0x3F));
+                put(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                put(0xF0 | (c >> 18));
+                put(0x80 | ((c >> 12) & 0x3F));
+                put(0x80 | ((c >> 6) & 0x3F));
+                put(0x80 | (c & 0x3F));
+            }
+        }
+        return written;
+    }
+
+    // Markup with Chinese text in it, roughly what a catalogue page holds
+    std::string SyntheticPage(size_t bytes, size_t textPercent)
+    {
+        const std::string markup = "<div class=\"item\"><a href=\"/viewer/book?id=123456&page=7\">";
+        const std::string text = "\xE5\x8F\xB2\xE8\xAE\xB0\xE5\x8D\xB7\xE7\xAC\xAC\xE4\xB8\x80";
+        std::string page;
+        size_t textBytes = 0;
+        while (page.size() < bytes)
+        {
+            if (textBytes * 100 < page.size() * textPercent)
+            {
+                page += text;
+                textBytes += text.size();
+            }
+            else
+            {
+                page += markup;
+            }
+        }
+        return page;
+    }
+
+    void Run(const std::string& name, const std::string& utf8)
+    {
+        std::u16string utf16 = Transcoder::ToUtf16(utf8);
+
+        double legacy = Bench::SecondsPerCall([&]() {
+            std::u16string out(LegacyUtf8ToUtf16(utf8.data(), utf8.size(), nullptr), u'\0');
+            LegacyUtf8ToUtf16(utf8.data(), utf8.size(), out.data());
+            return out.size();
+        });
+        double single = Bench::SecondsPerCall([&]() { return Transcoder::ToUtf16(utf8).size(); });
+        Bench::Report("utf8->utf16 two-pass", name, utf8.size(), legacy);
+        Bench::Report("utf8->utf16 Transcoder", name, utf8.size(), single);
+
+        legacy = Bench::SecondsPerCall([&]() {
+            std::string out(LegacyUtf16ToUtf8(utf16.data(), utf16.size(), nullptr), '\0');
+            LegacyUtf16ToUtf8(utf16.data(), utf16.size(), out.data());
+            return out.size();
+        });
+        single = Bench::SecondsPerCall([&]() { return Transcoder::ToUtf8(utf16).size(); });
+        Bench::Report("utf16->utf8 two-pass", name, utf8.size(), legacy);
+        Bench::Report("utf16->utf8 Transcoder", name, utf8.size(), single);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::printf("%-28s %-32s %15s %15s\n", "kernel", "input", "UTF-8 rate", "per call");
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string page;
+            if (!Bench::ReadFile(argv[i], page))
+            {
+                return 1;
+            }
+            Run(argv[i], page);
+        }
+        return 0;
+    }
+
+    Run("ascii 4MB", SyntheticPage(4 << 20, 0));
+    Run("page 4MB, 10% text", SyntheticPage(4 << 20, 10));
+    Run("page 4MB, 60% text", SyntheticPage(4 << 20, 60));
+    Run("cookie 200B", SyntheticPage(200, 0));
+    return 0;
+}
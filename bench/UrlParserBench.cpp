@@ -0,0 +1,175 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// URLs per second through UrlParser, next to the Util::GetFileNameFromUrl
+// it replaced (a std::wistringstream per %XX escape). Pass a URL list, one
+// per line as in urls.txt, to measure that instead of the generated one:
+//   bookget_urlparser_bench urls.txt
+
+#include "UrlParser.h"
+#include "Bench.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::wstring LegacyGetFileName(const std::wstring& url)
+    {
+        size_t pathStart = url.find(L"://");
+        if (pathStart != std::wstring::npos)
+        {
+            pathStart = url.find(L'/', pathStart + 3);
+        }
+        else
+        {
+            pathStart = url.find(L'/');
+        }
+
+        std::wstring path;
+        if (pathStart != std::wstring::npos)
+        {
+            size_t queryStart = url.find(L'?', pathStart);
+            path = url.substr(pathStart + 1, queryStart != std::wstring::npos ? queryStart - pathStart - 1 : std::wstring::npos);
+        }
+        else
+        {
+            path = url;
+        }
+
+        std::wstring decodedPath;
+        for (size_t i = 0; i < path.size(); ++i)
+        {
+            if (path[i] == L'%' && i + 2 < path.size())
+            {
+                int value;
+                std::wistringstream hexStream(path.substr(i + 1, 2));
+                if (hexStream >> std::hex >> value)
+                {
+                    decodedPath += static_cast<wchar_t>(value);
+                    i += 2;
+                    continue;
+                }
+            }
+            decodedPath += path[i];
+        }
+
+        size_t lastSlash = decodedPath.find_last_of(L"/\\");
+        std::wstring filename = lastSlash != std::wstring::npos ? decodedPath.substr(lastSlash + 1) : decodedPath;
+        static const std::wstring illegal = L"<>:\"/\\|?*";
+        filename.erase(std::remove_if(filename.begin(), filename.end(),
+            [](wchar_t c) { return illegal.find(c) != std::wstring::npos; }), filename.end());
+        if (filename.empty())
+        {
+            filename = L"download";
+        }
+        if (filename.size() > 255)
+        {
+            size_t lastDot = filename.find_last_of(L'.');
+            if (lastDot != std::wstring::npos && lastDot > 245)
+            {
+                std::wstring extension = filename.substr(lastDot);
+                filename = filename.substr(0, 255 - extension.size()) + extension;
+            }
+            else
+            {
+                filename = filename.substr(0, 255);
+            }
+        }
+        return filename;
+    }
+
+    // IIIF image URLs, catalogue pages with queries and percent-encoded
+    // Chinese titles in roughly the mix of a real download list
+    std::vector<std::wstring> GeneratedUrls(size_t count)
+    {
+        std::vector<std::wstring> urls;
+        urls.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::wstring n = std::to_wstring(i);
+            switch (i % 4)
+            {
+            case 0:
+            case 1:
+                urls.push_back(L"https://iiif.example-library.org/iiif/2/book" + n + L"/full/full/0/default.jpg");
+                break;
+            case 2:
+                urls.push_back(L"https://www.example-library.org/viewer/page" + n + L".jpg?uuid=3f2a9c&session=abc#top");
+                break;
+            default:
+                urls.push_back(L"https://cdn.example-library.org/files/%E5%8F%B2%E8%AE%B0-%E5%8D%B7" + n + L".pdf");
+                break;
+            }
+        }
+        return urls;
+    }
+
+    void Run(const std::string& name, const std::vector<std::wstring>& urls)
+    {
+        double parse = Bench::SecondsPerCall([&]() {
+            size_t total = 0;
+            for (const std::wstring& url : urls)
+            {
+                total += UrlParser::Parse(url).path.size();
+            }
+            return total;
+        });
+        double fileName = Bench::SecondsPerCall([&]() {
+            size_t total = 0;
+            for (const std::wstring& url : urls)
+            {
+                total += UrlParser::GetFileName(url).size();
+            }
+            return total;
+        });
+        double legacy = Bench::SecondsPerCall([&]() {
+            size_t total = 0;
+            for (const std::wstring& url : urls)
+            {
+                total += LegacyGetFileName(url).size();
+            }
+            return total;
+        });
+        Bench::ReportItems("UrlParser::Parse", name, urls.size(), parse);
+        Bench::ReportItems("UrlParser::GetFileName", name, urls.size(), fileName);
+        Bench::ReportItems("GetFileName, wistringstream", name, urls.size(), legacy);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::printf("%-28s %-32s %15s %15s\n", "kernel", "input", "URLs", "per list");
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string text;
+            if (!Bench::ReadFile(argv[i], text))
+            {
+                return 1;
+            }
+            // URL lists are ASCII; anything else is already percent-encoded
+            std::vector<std::wstring> urls;
+            std::istringstream lines(text);
+            for (std::string line; std::getline(lines, line);)
+            {
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+                if (!line.empty())
+                {
+                    urls.emplace_back(line.begin(), line.end());
+                }
+            }
+            Run(argv[i], urls);
+        }
+        return 0;
+    }
+    Run("generated x100000", GeneratedUrls(100000));
+    return 0;
+}
@@ -48,6 +48,114 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
            g_arguments.push_back(std::make_pair(cmd, g_urlsFile));
            i++;
        }
+       else if (cmd == L"-bundle" && i + 1 < cArgs) {
+           g_bundleFormat = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_bundleFormat));
+           i++;
+       }
+       else if (cmd == L"-layout" && i + 1 < cArgs) {
+           g_downloadLayout = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_downloadLayout));
+           i++;
+       }
+       else if (cmd == L"-shard" && i + 1 < cArgs) {
+           g_shardSize = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_shardSize));
+           i++;
+       }
+       else if (cmd == L"-trace" && i + 1 < cArgs) {
+           g_traceFile = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_traceFile));
+           i++;
+       }
+       else if (cmd == L"-metrics" && i + 1 < cArgs) {
+           g_metricsFile = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_metricsFile));
+           i++;
+       }
+       else if (cmd == L"-cookies" && i + 1 < cArgs) {
+           g_cookieFile = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_cookieFile));
+           i++;
+       }
+       else if (cmd == L"-tab-pool" && i + 1 < cArgs) {
+           g_tabPoolSize = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_tabPoolSize));
+           i++;
+       }
+       else if (cmd == L"-suspend-after" && i + 1 < cArgs) {
+           g_suspendAfter = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_suspendAfter));
+           i++;
+       }
+       else if (cmd == L"-memory-budget" && i + 1 < cArgs) {
+           g_memoryBudget = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_memoryBudget));
+           i++;
+       }
+       else if (cmd == L"-headless") {
+           g_headless = true;
+           g_arguments.push_back(std::make_pair(cmd, std::wstring()));
+       }
+       else if (cmd == L"-block" && i + 1 < cArgs) {
+           g_blockMode = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_blockMode));
+           i++;
+       }
+       else if (cmd == L"-block-defaults") {
+           g_blockDefaults = true;
+           g_arguments.push_back(std::make_pair(cmd, std::wstring()));
+       }
+       else if (cmd == L"-block-list" && i + 1 < cArgs) {
+           g_blockListFile = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_blockListFile));
+           i++;
+       }
+       else if (cmd == L"-cache" && i + 1 < cArgs) {
+           g_cacheDirectory = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_cacheDirectory));
+           i++;
+       }
+       else if (cmd == L"-cache-size" && i + 1 < cArgs) {
+           g_cacheSize = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_cacheSize));
+           i++;
+       }
+       else if (cmd == L"-capture-images" && i + 1 < cArgs) {
+           g_captureImages = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_captureImages));
+           i++;
+       }
+       else if (cmd == L"-prefetch" && i + 1 < cArgs) {
+           g_prefetch = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_prefetch));
+           i++;
+       }
+       else if (cmd == L"-nav-timeout" && i + 1 < cArgs) {
+           g_navTimeout = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_navTimeout));
+           i++;
+       }
+       else if (cmd == L"-download-timeout" && i + 1 < cArgs) {
+           g_downloadTimeout = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_downloadTimeout));
+           i++;
+       }
+       else if (cmd == L"-retries" && i + 1 < cArgs) {
+           g_retries = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_retries));
+           i++;
+       }
+       else if (cmd == L"-recycle-pages" && i + 1 < cArgs) {
+           g_recyclePages = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_recyclePages));
+           i++;
+       }
+       else if (cmd == L"-recycle-memory" && i + 1 < cArgs) {
+           g_recycleMemory = arguments[i+1];
+           g_arguments.push_back(std::make_pair(cmd, g_recycleMemory));
+           i++;
+       }
     }
     LocalFree(arguments);
 
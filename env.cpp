@@ -8,4 +8,47 @@ std::wstring g_sUrl(L"about:blank");
 std::wstring g_outHtmlFile;
 std::wstring g_cmd;
 //urls.txt
-std::wstring g_urlsFile;
\ No newline at end of file
+std::wstring g_urlsFile;
+//-bundle pdf|cbz
+std::wstring g_bundleFormat;
+//-layout flat|job|hash|range, -shard <files per range directory>
+std::wstring g_downloadLayout;
+std::wstring g_shardSize;
+//-trace <file>: Chrome trace-event JSON output
+std::wstring g_traceFile;
+//-metrics <file>: Prometheus text-format metrics output
+std::wstring g_metricsFile;
+//-cookies <file>: cookie.txt or Netscape cookie file imported before the first navigation
+std::wstring g_cookieFile;
+//-tab-pool <n>: number of pre-created hidden tabs kept ready, 2 by default with -o and -urls, else 0 which disables the pool
+std::wstring g_tabPoolSize;
+//-suspend-after <seconds>: suspend tabs hidden this long, 0 by default which never suspends
+std::wstring g_suspendAfter;
+//-memory-budget <MB>: discard background tabs while the content processes use more, 0 by default which never discards
+std::wstring g_memoryBudget;
+//-headless: no controls or options UI, hidden window; for -i, -urls and shared memory batch runs
+bool g_headless = false;
+//-block off|capture|download: subresources to drop, by default capture with -o and download with -urls
+std::wstring g_blockMode;
+//-block-list <file>: extra domains to block, one per line or in hosts-file format
+std::wstring g_blockListFile;
+//-block-defaults: also block the built-in list of analytics and ad domains
+bool g_blockDefaults = false;
+//-cache <dir>|off: disk cache for subresources shared by all processes, by default <exe dir>\cache with -i/-o and -urls
+std::wstring g_cacheDirectory;
+//-cache-size <MB>: capacity of the disk cache before old entries are evicted, 1024 by default
+std::wstring g_cacheSize;
+//-capture-images on|off: -urls saves each image from the response the page loaded instead of downloading it again, on by default
+std::wstring g_captureImages;
+//-prefetch <n>: -urls loads the next n entries in hidden tabs while the current one downloads, off (0) by default
+std::wstring g_prefetch;
+//-nav-timeout <seconds>: -urls stops a page that has not started its download by then and retries it later, 60 by default, 0 waits forever
+std::wstring g_navTimeout;
+//-download-timeout <seconds>: -urls stops a download still running after this long and retries the page later, 300 by default
+std::wstring g_downloadTimeout;
+//-retries <n>: times -urls retries a page that timed out before it counts as failed, 2 by default
+std::wstring g_retries;
+//-recycle-pages <n>: -urls restarts the WebView browser process every n pages, 0 by default which never does
+std::wstring g_recyclePages;
+//-recycle-memory <MB>: -urls restarts the WebView browser process between pages once its processes use this much, 0 by default which never does
+std::wstring g_recycleMemory;
\ No newline at end of file
@@ -6,5 +6,27 @@ extern std::wstring g_sUrl;
 extern std::wstring g_outHtmlFile;
 extern std::wstring g_cmd;
 extern std::wstring g_urlsFile;
+extern std::wstring g_bundleFormat;
+extern std::wstring g_downloadLayout;
+extern std::wstring g_shardSize;
+extern std::wstring g_traceFile;
+extern std::wstring g_metricsFile;
+extern std::wstring g_cookieFile;
+extern std::wstring g_tabPoolSize;
+extern std::wstring g_suspendAfter;
+extern std::wstring g_memoryBudget;
+extern bool g_headless;
+extern std::wstring g_blockMode;
+extern std::wstring g_blockListFile;
+extern bool g_blockDefaults;
+extern std::wstring g_cacheDirectory;
+extern std::wstring g_cacheSize;
+extern std::wstring g_captureImages;
+extern std::wstring g_prefetch;
+extern std::wstring g_navTimeout;
+extern std::wstring g_downloadTimeout;
+extern std::wstring g_retries;
+extern std::wstring g_recyclePages;
+extern std::wstring g_recycleMemory;
 
 
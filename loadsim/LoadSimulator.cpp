@@ -0,0 +1,296 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Drives synthetic pages through the real DownloadScheduler on top of
+// MockEngine, on a simulated clock. Used to load-test the orchestration
+// code on any platform, e.g.
+//   bookget_loadsim -pages 100000 -jitter-ms 40 -download-fail 0.01
+//   bookget_loadsim -pages 20000 -cold-ms 300 -prefetch 2
+//   bookget_loadsim -pages 20000 -hang 0.001 -nav-timeout-ms 10000
+//   bookget_loadsim -pages 20000 -crash 0.001 -restart-ms 3000
+
+#include "DownloadScheduler.h"
+#include "Metrics.h"
+#include "MockEngine.h"
+#include "Prefetcher.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        size_t pages = 100000;
+        MockEngine::Config engine;
+        DownloadScheduler::Watchdog watchdog;
+        std::wstring layout = L"range";
+        size_t shardSize = 1000;
+        std::filesystem::path outDirectory = std::filesystem::temp_directory_path() / "bookget-loadsim";
+        bool capture = false;
+        size_t prefetch = 0;
+        uint32_t restartMs = 2000;  // Until a crashed engine is back
+        bool verbose = false;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "usage: bookget_loadsim [-pages N] [-nav-ms N] [-script-ms N] [-download-ms N] [-jitter-ms N] [-cold-ms N]\n"
+            "                       [-nav-fail P] [-script-fail P] [-download-fail P] [-script-pages] [-capture]\n"
+            "                       [-crash P] [-restart-ms N] [-hang P] [-nav-timeout-ms N] [-download-timeout-ms N] [-retry-ms N] [-attempts N]\n"
+            "                       [-prefetch N]\n"
+            "                       [-layout flat|job|hash|range] [-shard N] [-out DIR] [-seed N] [-verbose]\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string cmd = argv[i];
+            const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+            bool consumed = true;
+            if (cmd == "-script-pages")
+            {
+                options.engine.navigationDownloads = false;
+                consumed = false;
+            }
+            else if (cmd == "-capture")
+            {
+                options.capture = true;
+                consumed = false;
+            }
+            else if (cmd == "-verbose")
+            {
+                options.verbose = true;
+                consumed = false;
+            }
+            else if (!value)
+            {
+                return false;
+            }
+            else if (cmd == "-pages")
+            {
+                options.pages = std::strtoull(value, nullptr, 10);
+            }
+            else if (cmd == "-nav-ms")
+            {
+                options.engine.navigationMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-script-ms")
+            {
+                options.engine.scriptMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-download-ms")
+            {
+                options.engine.downloadMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-cold-ms")
+            {
+                options.engine.coldMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-prefetch")
+            {
+                options.prefetch = std::strtoull(value, nullptr, 10);
+            }
+            else if (cmd == "-jitter-ms")
+            {
+                options.engine.jitterMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-nav-fail")
+            {
+                options.engine.navigationFailureRate = std::strtod(value, nullptr);
+            }
+            else if (cmd == "-script-fail")
+            {
+                options.engine.scriptFailureRate = std::strtod(value, nullptr);
+            }
+            else if (cmd == "-download-fail")
+            {
+                options.engine.downloadFailureRate = std::strtod(value, nullptr);
+            }
+            else if (cmd == "-crash")
+            {
+                options.engine.crashRate = std::strtod(value, nullptr);
+            }
+            else if (cmd == "-restart-ms")
+            {
+                options.restartMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-hang")
+            {
+                options.engine.hangRate = std::strtod(value, nullptr);
+            }
+            else if (cmd == "-nav-timeout-ms")
+            {
+                options.watchdog.navigationTimeoutMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-download-timeout-ms")
+            {
+                options.watchdog.downloadTimeoutMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-retry-ms")
+            {
+                options.watchdog.retryDelayMs = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (cmd == "-attempts")
+            {
+                options.watchdog.maxAttempts = std::strtoull(value, nullptr, 10);
+            }
+            else if (cmd == "-layout")
+            {
+                options.layout = std::filesystem::path(value).wstring();
+            }
+            else if (cmd == "-shard")
+            {
+                options.shardSize = std::strtoull(value, nullptr, 10);
+            }
+            else if (cmd == "-out")
+            {
+                options.outDirectory = value;
+            }
+            else if (cmd == "-seed")
+            {
+                options.engine.seed = std::strtoull(value, nullptr, 10);
+            }
+            else
+            {
+                return false;
+            }
+            i += consumed ? 1 : 0;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    SimulatedLoop loop;
+    SimulatedProfile profile;
+    MockEngine engine(loop, options.engine);
+    engine.SetProfile(&profile);
+
+    DownloadScheduler::Host host;
+    DownloadScheduler* schedulerPointer = nullptr;
+    host.postNext = [&loop, &schedulerPointer]() { loop.Post(0, [&schedulerPointer]() { schedulerPointer->Advance(); }); };
+    host.clock = [&loop]() { return static_cast<int64_t>(loop.Now()) * 1000; };
+    // Timers are not cancelled in the loop; a rearmed one just goes stale
+    uint64_t watchdogGeneration = 0;
+    host.setWatchdog = [&loop, &schedulerPointer, &watchdogGeneration](uint32_t delayMs) {
+        uint64_t generation = ++watchdogGeneration;
+        if (delayMs > 0)
+        {
+            loop.Post(delayMs, [&schedulerPointer, &watchdogGeneration, generation]() {
+                if (generation == watchdogGeneration)
+                {
+                    schedulerPointer->OnWatchdog();
+                }
+            });
+        }
+    };
+    // Stale timers outlive the batch, so its duration is taken when it ends
+    uint64_t finishedAt = 0;
+    host.onFinished = [&loop, &finishedAt]() { finishedAt = loop.Now(); };
+    if (options.verbose)
+    {
+        host.log = [](const std::wstring& message) { std::fputws(message.c_str(), stderr); };
+    }
+
+    // One background engine per entry of lookahead, each with its own failures
+    std::vector<std::unique_ptr<MockEngine>> prefetchEngines;
+    Prefetcher::Config prefetchConfig;
+    prefetchConfig.lookahead = options.prefetch;
+    Prefetcher prefetcher(prefetchConfig);
+    for (size_t i = 0; i < options.prefetch; ++i)
+    {
+        MockEngine::Config config = options.engine;
+        config.seed = options.engine.seed + i + 1;
+        prefetchEngines.push_back(std::make_unique<MockEngine>(loop, config, i + 2));
+        prefetchEngines.back()->SetProfile(&profile);
+        prefetcher.AddEngine(*prefetchEngines.back());
+    }
+    if (options.verbose)
+    {
+        prefetcher.SetLog(host.log);
+    }
+
+    DownloadScheduler scheduler(engine, host);
+    schedulerPointer = &scheduler;
+    scheduler.SetResponseCapture(options.capture);
+    scheduler.SetWatchdog(options.watchdog);
+    // The app recreates the tab or its environment; here the engine just
+    // comes back after a while
+    engine.SetCrashHandler([&loop, &scheduler, &options]() {
+        // Like the browser after its browser process died: a new environment
+        Metrics::Instance().Add(Metrics::Counter::ProcessFailures);
+        Metrics::Instance().Add(Metrics::Counter::EnvironmentRecycles);
+        scheduler.OnEngineLost();
+        loop.Post(options.restartMs, [&scheduler]() { scheduler.OnEngineRestored(); });
+    });
+    if (options.prefetch > 0)
+    {
+        scheduler.SetPrefetcher(&prefetcher);
+    }
+
+    // Pages that load as documents click their image through the real trigger script
+    engine.SetScriptHandler([&engine](const std::wstring& script) -> std::wstring {
+        if (script == DownloadScheduler::GetTriggerScript())
+        {
+            engine.StartDownload(engine.GetUri());
+            return L"true";
+        }
+        return L"null";
+    });
+
+    std::vector<std::wstring> urls;
+    urls.reserve(options.pages);
+    for (size_t i = 0; i < options.pages; ++i)
+    {
+        // Viewer pages, since the prefetcher skips URLs that are images
+        urls.push_back(L"https://example.org/viewer/book/" + std::to_wstring(i + 1));
+    }
+    scheduler.GetLayout().Configure(options.outDirectory.wstring(), DownloadLayout::ParseMode(options.layout),
+        L"loadsim", urls.size(), options.shardSize);
+
+    auto wallStart = std::chrono::steady_clock::now();
+    scheduler.Start(std::move(urls));
+    size_t tasks = loop.RunUntilIdle();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    bool finished = !scheduler.IsRunning() && scheduler.GetCompletedCount() + scheduler.GetFailedCount() == options.pages;
+    std::printf("pages:          %zu\n", options.pages);
+    std::printf("completed:      %zu\n", scheduler.GetCompletedCount());
+    std::printf("failed:         %zu\n", scheduler.GetFailedCount());
+    std::printf("navigations:    %zu\n", engine.GetNavigationCount());
+    std::printf("downloads:      %zu\n", engine.GetDownloadCount());
+    std::printf("captures:       %zu\n", engine.GetCaptureCount());
+    std::printf("stalls:         %zu (%zu hung navigations)\n", scheduler.GetStallCount(), engine.GetHangCount());
+    std::printf("crashes:        %zu\n", engine.GetCrashCount());
+    std::printf("prefetched:     %zu (%zu ready in time, %zu wasted)\n", prefetcher.GetIssuedCount(),
+        prefetcher.GetHitCount(), prefetcher.GetWastedCount());
+    std::printf("events:         %zu\n", tasks);
+    std::printf("simulated time: %.1f s\n", finishedAt / 1000.0);
+    std::printf("wall time:      %.3f s (%.0f pages/s)\n", wallSeconds,
+        wallSeconds > 0 ? options.pages / wallSeconds : 0.0);
+    std::printf("%s", Metrics::Instance().ToPrometheusText().c_str());
+
+    if (!finished)
+    {
+        std::printf("stalled at page %zu\n", scheduler.GetCurrentIndex() + 1);
+        return 1;
+    }
+    return 0;
+}
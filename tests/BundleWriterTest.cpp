@@ -0,0 +1,175 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Writes small bundles and checks the containers the way a strict reader
+// would: CBZ entries walked from the front through their local headers
+// alone, PDF objects found at the offsets in the xref table.
+
+#include "BundleWriter.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    std::string ReadAll(const fs::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void WriteFile(const fs::path& path, const std::string& data)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    uint64_t ReadLE(const std::string& data, size_t offset, int bytes)
+    {
+        uint64_t value = 0;
+        for (int i = bytes - 1; i >= 0; --i)
+        {
+            value = (value << 8) | static_cast<uint8_t>(data[offset + i]);
+        }
+        return value;
+    }
+
+    uint32_t Crc32(const std::string& data)
+    {
+        uint32_t crc = 0xFFFFFFFFu;
+        for (char c : data)
+        {
+            crc ^= static_cast<uint8_t>(c);
+            for (int k = 0; k < 8; ++k)
+            {
+                crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+            }
+        }
+        return ~crc;
+    }
+
+    // SOI, a baseline start-of-frame and some stand-in entropy coded data
+    std::string TinyJpeg(uint16_t width, uint16_t height)
+    {
+        std::string jpeg = "\xFF\xD8\xFF\xC0";
+        jpeg += std::string("\x00\x11\x08", 3);
+        jpeg += static_cast<char>(height >> 8);
+        jpeg += static_cast<char>(height & 0xFF);
+        jpeg += static_cast<char>(width >> 8);
+        jpeg += static_cast<char>(width & 0xFF);
+        jpeg += std::string("\x03\x01\x22\x00\x02\x11\x01\x03\x11\x01", 10);
+        jpeg += std::string(100, '\x5A');
+        jpeg += "\xFF\xD9";
+        return jpeg;
+    }
+
+    void TestCbz(const fs::path& directory)
+    {
+        std::vector<std::string> pages = { std::string(70000, 'a'), "second page", std::string() };
+        fs::path bundle = directory / "book.cbz";
+        BundleWriter writer;
+        CHECK(writer.Open(bundle.wstring(), BundleWriter::Format::Cbz));
+        // Out of order, and one page that never arrives
+        for (size_t i : { 2, 0, 1 })
+        {
+            fs::path page = directory / ("000" + std::to_string(i) + ".jpg");
+            WriteFile(page, pages[i]);
+            CHECK(writer.AddPage(i, page.wstring()));
+        }
+        writer.SkipPage(3);
+        CHECK(writer.Finalize());
+
+        std::string zip = ReadAll(bundle);
+        size_t offset = 0;
+        for (size_t i = 0; i < pages.size(); ++i)
+        {
+            CHECK(offset + 30 <= zip.size());
+            if (offset + 30 > zip.size())
+            {
+                return;
+            }
+            CHECK(ReadLE(zip, offset, 4) == 0x04034b50);
+            CHECK((ReadLE(zip, offset + 6, 2) & (1 << 3)) == 0);  // No data descriptor
+            CHECK(ReadLE(zip, offset + 8, 2) == 0);               // Stored
+            uint64_t crc = ReadLE(zip, offset + 14, 4);
+            uint64_t size = ReadLE(zip, offset + 18, 4);
+            size_t nameLength = static_cast<size_t>(ReadLE(zip, offset + 26, 2));
+            size_t extraLength = static_cast<size_t>(ReadLE(zip, offset + 28, 2));
+            CHECK(zip.substr(offset + 30, nameLength) == "000" + std::to_string(i) + ".jpg");
+            CHECK(size == pages[i].size());
+            CHECK(ReadLE(zip, offset + 22, 4) == size);
+            CHECK(crc == Crc32(pages[i]));
+            offset += 30 + nameLength + extraLength;
+            CHECK(zip.compare(offset, pages[i].size(), pages[i]) == 0);
+            offset += pages[i].size();
+        }
+        CHECK(ReadLE(zip, offset, 4) == 0x02014b50);  // Central directory right after the last entry
+        CHECK(ReadLE(zip, zip.size() - 22, 4) == 0x06054b50);
+        CHECK(ReadLE(zip, zip.size() - 22 + 10, 2) == pages.size());
+        CHECK(ReadLE(zip, zip.size() - 22 + 16, 4) == offset);
+    }
+
+    void TestPdf(const fs::path& directory)
+    {
+        fs::path bundle = directory / "book.pdf";
+        BundleWriter writer;
+        CHECK(writer.Open(bundle.wstring(), BundleWriter::Format::Pdf));
+
+        fs::path first = directory / "p0.jpg";
+        fs::path notJpeg = directory / "p1.png";
+        fs::path missing = directory / "p2.jpg";
+        fs::path last = directory / "p3.jpg";
+        WriteFile(first, TinyJpeg(640, 480));
+        WriteFile(notJpeg, "\x89PNG\r\n\x1A\n not a jpeg");
+        WriteFile(last, TinyJpeg(800, 600));
+        CHECK(writer.AddPage(0, first.wstring()));
+        CHECK(!writer.AddPage(1, notJpeg.wstring()));
+        CHECK(!writer.AddPage(2, missing.wstring()));
+        CHECK(writer.AddPage(3, last.wstring()));
+        CHECK(writer.Finalize());
+
+        std::string pdf = ReadAll(bundle);
+        CHECK(pdf.starts_with("%PDF-1.4\n"));
+        CHECK(pdf.ends_with("%%EOF\n"));
+        CHECK(pdf.find("/Count 2 ") != std::string::npos);
+        CHECK(pdf.find("/Width 640 /Height 480") != std::string::npos);
+        CHECK(pdf.find("/Width 800 /Height 600") != std::string::npos);
+
+        size_t startxref = pdf.rfind("startxref\n");
+        CHECK(startxref != std::string::npos);
+        if (startxref == std::string::npos)
+        {
+            return;
+        }
+        size_t xref = std::stoul(pdf.substr(startxref + 10));
+        CHECK(pdf.compare(xref, 5, "xref\n") == 0);
+        size_t count = std::stoul(pdf.substr(xref + 7));
+        CHECK(count == 9);  // Free entry, catalog, page tree, three objects per page
+        for (size_t object = 1; object < count; ++object)
+        {
+            size_t entry = pdf.find('\n', xref + 5) + 1 + object * 20;
+            size_t offset = std::stoul(pdf.substr(entry, 10));
+            std::string header = std::to_string(object) + " 0 obj\n";
+            CHECK(pdf.compare(offset, header.size(), header) == 0);
+        }
+    }
+}
+
+int main()
+{
+    fs::path directory = fs::temp_directory_path() / "bookget-bundlewriter-test";
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    TestCbz(directory);
+    TestPdf(directory);
+    fs::remove_all(directory);
+    return TestResult();
+}
@@ -0,0 +1,36 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertions for the core tests, which are plain executables run by
+// ctest. A failed check is reported and counted; main returns TestResult().
+
+inline int& TestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++TestFailures();                                                             \
+        }                                                                                 \
+    } while (0)
+
+inline int TestResult()
+{
+    if (TestFailures() != 0)
+    {
+        std::fprintf(stderr, "%d check(s) failed\n", TestFailures());
+        return 1;
+    }
+    return 0;
+}
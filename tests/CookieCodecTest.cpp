@@ -0,0 +1,277 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CookieCodec.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    Cookie MakeCookie(const wchar_t* name, const wchar_t* value, const wchar_t* domain, const wchar_t* path)
+    {
+        Cookie cookie;
+        cookie.name = name;
+        cookie.value = value;
+        cookie.domain = domain;
+        cookie.path = path;
+        return cookie;
+    }
+
+    bool Same(const Cookie& a, const Cookie& b)
+    {
+        return a.name == b.name && a.value == b.value && a.domain == b.domain && a.path == b.path &&
+            a.expires == b.expires && a.httpOnly == b.httpOnly && a.secure == b.secure && a.session == b.session &&
+            a.sameSite == b.sameSite;
+    }
+
+    std::vector<Cookie> SampleCookies()
+    {
+        std::vector<Cookie> cookies;
+        cookies.push_back(MakeCookie(L"sid", L"abc123", L".example.org", L"/"));
+        cookies.back().expires = 1700000000.5;
+        cookies.back().secure = true;
+        cookies.back().sameSite = CookieSameSite::Strict;
+
+        // A session cookie whose strings need JSON escapes
+        cookies.push_back(MakeCookie(L"pref", L"a\tb \"c\" \\ \x4E2D\x6587", L"books.example.org", L"/viewer/"));
+        cookies.back().httpOnly = true;
+        cookies.back().session = true;
+        cookies.back().sameSite = CookieSameSite::Lax;
+
+        cookies.push_back(MakeCookie(L"empty", L"", L"example.org", L""));
+        cookies.back().expires = 1;
+        return cookies;
+    }
+
+    std::vector<CookieView> Views(const std::vector<Cookie>& cookies)
+    {
+        std::vector<CookieView> views;
+        for (const Cookie& cookie : cookies)
+        {
+            views.push_back(cookie.GetView());
+        }
+        return views;
+    }
+
+    void TestToText()
+    {
+        std::vector<Cookie> cookies = SampleCookies();
+        std::wstring text = CookieCodec::ToText(Views(cookies), L"https://example.org/");
+        CHECK(text.starts_with(L"#3 cookie(s) found on https://example.org/\n#domain\t"));
+        CHECK(text.ends_with(L"\t\n"));
+        CHECK(text.find(L"\n\n\".example.org\"\ttrue\t\"/\"\tfalse\t1700000000.500000\t\"sid\"\t\"abc123\"\ttrue\t\"Strict\"\t\n")
+            != std::wstring::npos);
+        CHECK(text.find(L"\"books.example.org\"\tfalse\t\"/viewer/\"\ttrue\t#HttpOnly_\t\"pref\"\t\"a\\tb \\\"c\\\" \\\\ ")
+            != std::wstring::npos);
+        CHECK(text.find(L"\"example.org\"\tfalse\t\"\"\tfalse\t1.000000\t\"empty\"\t\"\"\tfalse\t\"None\"\t\n") != std::wstring::npos);
+
+        // AppendTextLine writes the same line on its own
+        std::wstring line;
+        CookieCodec::AppendTextLine(line, cookies[0].GetView());
+        CHECK(text.find(L"\n" + line + L"\n") != std::wstring::npos);
+
+        CHECK(CookieCodec::ToText({}, L"https://example.org/") == L"#No cookies found.");
+        CHECK(CookieCodec::ToText(Views(cookies), L"").starts_with(L"#3 cookie(s) found\n"));
+    }
+
+    void TestTextRoundTrip()
+    {
+        std::vector<Cookie> cookies = SampleCookies();
+        std::wstring text = CookieCodec::ToText(Views(cookies), L"https://example.org/");
+
+        std::vector<Cookie> parsed;
+        CHECK(CookieCodec::ParseText(text, parsed) == cookies.size());
+        CHECK(parsed.size() == cookies.size());
+        for (size_t i = 0; i < parsed.size() && i < cookies.size(); ++i)
+        {
+            CHECK(Same(parsed[i], cookies[i]));
+        }
+
+        // Appends to what is there, CRLF line ends work too
+        std::wstring crlf;
+        for (wchar_t c : text)
+        {
+            crlf += c == L'\n' ? std::wstring(L"\r\n") : std::wstring(1, c);
+        }
+        CHECK(CookieCodec::ParseText(crlf, parsed) == cookies.size());
+        CHECK(parsed.size() == 2 * cookies.size());
+        CHECK(Same(parsed.back(), cookies.back()));
+
+        parsed.clear();
+        CHECK(CookieCodec::ParseText(L"#No cookies found.", parsed) == 0);
+        CHECK(parsed.empty());
+    }
+
+    void TestMalformedAppLines()
+    {
+        std::vector<Cookie> parsed;
+        const wchar_t* lines[] = {
+            // Too few fields
+            L"\"example.org\"\ttrue\t\"/\"\tfalse\t1\t\"a\"\t\"b\"\tfalse",
+            // Unterminated and unquoted strings
+            L"\"example.org\ttrue\t\"/\"\tfalse\t1\t\"a\"\t\"b\"\tfalse\t\"Lax\"\t",
+            L"\"example.org\"\ttrue\t\"/\"\tfalse\t1\ta\t\"b\"\tfalse\t\"Lax\"\t",
+            // Bad escape
+            L"\"example.org\"\ttrue\t\"/\"\tfalse\t1\t\"a\"\t\"b\\q\"\tfalse\t\"Lax\"\t",
+            // No name, no domain
+            L"\"example.org\"\ttrue\t\"/\"\tfalse\t1\t\"\"\t\"b\"\tfalse\t\"Lax\"\t",
+            L"\"\"\ttrue\t\"/\"\tfalse\t1\t\"a\"\t\"b\"\tfalse\t\"Lax\"\t",
+        };
+        for (const wchar_t* line : lines)
+        {
+            CHECK(CookieCodec::ParseText(line, parsed) == 0);
+        }
+        CHECK(parsed.empty());
+
+        // An unknown SameSite falls back to None; the line is kept
+        CHECK(CookieCodec::ParseText(L"\"example.org\"\tfalse\t\"/\"\tfalse\t5\t\"a\"\t\"b\"\ttrue\t\"Whatever\"\t", parsed) == 1);
+        CHECK(parsed.size() == 1 && parsed[0].sameSite == CookieSameSite::None && parsed[0].expires == 5 && parsed[0].secure);
+    }
+
+    void TestNetscapeLines()
+    {
+        std::wstring text =
+            L"# Netscape HTTP Cookie File\n"
+            L"# https://curl.se/docs/http-cookies.html\n"
+            L".example.org\tTRUE\t/\tTRUE\t1700000000\tsid\tabc\n"
+            L"#HttpOnly_books.example.org\tFALSE\t/viewer\tFALSE\t0\ttoken\tx=y\r\n"
+            L"\n"
+            L"example.org\tFALSE\t/\tFALSE\t1700000000\tshort\n"
+            L"\tFALSE\t/\tFALSE\t1700000000\tnodomain\tv\n"
+            L"example.org\tFALSE\t/\tFALSE\t1700000000\t\tnoname";
+        std::vector<Cookie> parsed;
+        CHECK(CookieCodec::ParseText(text, parsed) == 2);
+        CHECK(parsed.size() == 2);
+        if (parsed.size() != 2)
+        {
+            return;
+        }
+        CHECK(parsed[0].domain == L".example.org");
+        CHECK(parsed[0].path == L"/");
+        CHECK(parsed[0].secure && !parsed[0].httpOnly && !parsed[0].session);
+        CHECK(parsed[0].expires == 1700000000);
+        CHECK(parsed[0].name == L"sid" && parsed[0].value == L"abc");
+        CHECK(parsed[0].sameSite == CookieSameSite::Lax);
+
+        // #HttpOnly_ is a prefix of the domain here, and 0 means a session
+        // cookie
+        CHECK(parsed[1].domain == L"books.example.org");
+        CHECK(parsed[1].path == L"/viewer");
+        CHECK(parsed[1].httpOnly && !parsed[1].secure && parsed[1].session);
+        CHECK(parsed[1].name == L"token" && parsed[1].value == L"x=y");
+
+        // Written back in the app format and read again, nothing changes
+        std::vector<Cookie> again;
+        CHECK(CookieCodec::ParseText(CookieCodec::ToText(Views(parsed), L""), again) == 2);
+        CHECK(again.size() == 2 && Same(again[0], parsed[0]) && Same(again[1], parsed[1]));
+    }
+
+    void TestRecordRoundTrip()
+    {
+        std::vector<Cookie> cookies = SampleCookies();
+        size_t total = 0;
+        for (const Cookie& cookie : cookies)
+        {
+            total += CookieCodec::GetRecordSize(cookie.GetView());
+            CHECK(CookieCodec::GetRecordSize(cookie.GetView()) % 8 == 0);
+        }
+
+        // uint64_t keeps the records aligned as in shared memory
+        std::vector<uint64_t> storage(total / 8 + 1);
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(storage.data());
+        size_t offset = 0;
+        for (const Cookie& cookie : cookies)
+        {
+            size_t written = CookieCodec::WriteRecord(buffer + offset, total - offset, cookie.GetView());
+            CHECK(written == CookieCodec::GetRecordSize(cookie.GetView()));
+            offset += written;
+        }
+        CHECK(offset == total);
+        CHECK(CookieCodec::WriteRecord(buffer + offset, 8, cookies[0].GetView()) == 0);
+
+        const uint8_t* cursor = buffer;
+        const uint8_t* end = buffer + total;
+        CookieView view;
+        for (const Cookie& cookie : cookies)
+        {
+            CHECK(CookieCodec::ReadRecord(cursor, end, view));
+            CHECK(Same(Cookie(view), cookie));
+        }
+        CHECK(cursor == end);
+        CHECK(!CookieCodec::ReadRecord(cursor, end, view));
+    }
+
+    void TestMalformedRecords()
+    {
+        Cookie cookie = MakeCookie(L"name", L"value", L"example.org", L"/");
+        size_t size = CookieCodec::GetRecordSize(cookie.GetView());
+        std::vector<uint64_t> storage(size / 8 + 2);
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(storage.data());
+        CHECK(CookieCodec::WriteRecord(buffer, size, cookie.GetView()) == size);
+        CookieView view;
+
+        // Truncated anywhere, down to half a header
+        for (size_t cut : { size_t(0), sizeof(CookieRecordHeader) / 2, sizeof(CookieRecordHeader), size - 1 })
+        {
+            const uint8_t* cursor = buffer;
+            CHECK(!CookieCodec::ReadRecord(cursor, buffer + cut, view));
+            CHECK(cursor == buffer);
+        }
+
+        CookieRecordHeader header;
+        std::memcpy(&header, buffer, sizeof(header));
+        auto readWith = [&](const CookieRecordHeader& changed) {
+            std::memcpy(buffer, &changed, sizeof(changed));
+            const uint8_t* cursor = buffer;
+            bool read = CookieCodec::ReadRecord(cursor, buffer + size, view);
+            std::memcpy(buffer, &header, sizeof(header));
+            return read;
+        };
+
+        // A size past the buffer or below the header
+        CookieRecordHeader changed = header;
+        changed.size = static_cast<uint32_t>(size + 8);
+        CHECK(!readWith(changed));
+        changed.size = sizeof(CookieRecordHeader) - 1;
+        CHECK(!readWith(changed));
+        changed.size = 0;
+        CHECK(!readWith(changed));
+
+        // Strings longer than the record, including lengths that overflow
+        // 32 bits when added up
+        changed = header;
+        changed.valueLength += 64;
+        CHECK(!readWith(changed));
+        changed = header;
+        changed.nameLength = UINT32_MAX;
+        changed.valueLength = UINT32_MAX;
+        CHECK(!readWith(changed));
+        changed = header;
+        changed.pathLength = 0x40000000;
+        CHECK(!readWith(changed));
+
+        // An unknown SameSite value reads as None
+        changed = header;
+        changed.sameSite = 200;
+        CHECK(readWith(changed));
+        CHECK(view.sameSite == CookieSameSite::None);
+        CHECK(readWith(header));
+        CHECK(view.name == L"name" && view.path == L"/");
+    }
+}
+
+int main()
+{
+    TestToText();
+    TestTextRoundTrip();
+    TestMalformedAppLines();
+    TestNetscapeLines();
+    TestRecordRoundTrip();
+    TestMalformedRecords();
+    return TestResult();
+}
@@ -0,0 +1,172 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CookieTracker.h"
+#include "Check.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    Cookie MakeCookie(const wchar_t* name, const wchar_t* value, const wchar_t* domain = L".example.org", const wchar_t* path = L"/")
+    {
+        Cookie cookie;
+        cookie.name = name;
+        cookie.value = value;
+        cookie.domain = domain;
+        cookie.path = path;
+        cookie.expires = 1700000000;
+        return cookie;
+    }
+
+    std::vector<CookieView> Views(const std::vector<Cookie>& cookies)
+    {
+        std::vector<CookieView> views;
+        for (const Cookie& cookie : cookies)
+        {
+            views.push_back(cookie.GetView());
+        }
+        return views;
+    }
+
+    bool Is(const CookieTracker::Delta& delta, size_t added, size_t changed, size_t removed)
+    {
+        return delta.added == added && delta.changed == changed && delta.removed == removed;
+    }
+
+    void TestDelta()
+    {
+        const wchar_t* uri = L"https://example.org/book/1";
+        CookieTracker tracker;
+        std::vector<Cookie> jar = { MakeCookie(L"a", L"1"), MakeCookie(L"b", L"2") };
+
+        CookieTracker::Delta delta = tracker.Update(uri, Views(jar));
+        CHECK(Is(delta, 2, 0, 0));
+        CHECK(delta.originChanged && delta.NeedsPublish());
+        tracker.MarkPublished(uri);
+
+        // Same jar, nothing to publish
+        delta = tracker.Update(uri, Views(jar));
+        CHECK(delta.IsEmpty() && !delta.originChanged && !delta.NeedsPublish());
+
+        // Any field of a cookie changes its content
+        jar[0].value = L"one";
+        CHECK(Is(tracker.Update(uri, Views(jar)), 0, 1, 0));
+        jar[0].secure = true;
+        CHECK(Is(tracker.Update(uri, Views(jar)), 0, 1, 0));
+        jar[0].expires += 1;
+        CHECK(Is(tracker.Update(uri, Views(jar)), 0, 1, 0));
+        jar[0].sameSite = CookieSameSite::Strict;
+        CHECK(Is(tracker.Update(uri, Views(jar)), 0, 1, 0));
+
+        // Name, domain and path identify it; another path is another cookie
+        jar.push_back(MakeCookie(L"a", L"one", L".example.org", L"/book/"));
+        CHECK(Is(tracker.Update(uri, Views(jar)), 1, 0, 0));
+
+        // Added, changed and removed at once
+        jar.erase(jar.begin() + 1);
+        jar[0].value = L"uno";
+        jar.push_back(MakeCookie(L"c", L"3"));
+        jar.push_back(MakeCookie(L"d", L"4"));
+        CHECK(Is(tracker.Update(uri, Views(jar)), 2, 1, 1));
+
+        CHECK(Is(tracker.Update(uri, {}), 0, 0, jar.size()));
+        CHECK(tracker.Update(uri, {}).IsEmpty());
+
+        // Strings that only differ in where they split are different cookies
+        std::vector<Cookie> split = { MakeCookie(L"ab", L"c") };
+        CHECK(Is(tracker.Update(uri, Views(split)), 1, 0, 0));
+        split[0] = MakeCookie(L"a", L"bc");
+        CHECK(Is(tracker.Update(uri, Views(split)), 1, 0, 1));
+
+        // A duplicate within one jar counts once
+        std::vector<Cookie> duplicates = { MakeCookie(L"x", L"1"), MakeCookie(L"x", L"1") };
+        CHECK(Is(tracker.Update(uri, Views(duplicates)), 1, 0, 1));
+        CHECK(tracker.Update(uri, Views(duplicates)).IsEmpty());
+    }
+
+    void TestOrderIndependence()
+    {
+        const wchar_t* uri = L"https://example.org/";
+        CookieTracker tracker;
+        std::vector<Cookie> jar;
+        for (int i = 0; i < 20; ++i)
+        {
+            jar.push_back(MakeCookie(std::to_wstring(i).c_str(), std::to_wstring(i * 7).c_str()));
+        }
+        tracker.Update(uri, Views(jar));
+
+        std::vector<Cookie> reversed(jar.rbegin(), jar.rend());
+        CHECK(tracker.Update(uri, Views(reversed)).IsEmpty());
+
+        // Swapped values keep the same set of strings but change two cookies
+        std::swap(reversed[0].value, reversed[1].value);
+        CHECK(Is(tracker.Update(uri, Views(reversed)), 0, 2, 0));
+        std::swap(reversed[0], reversed[5]);
+        CHECK(tracker.Update(uri, Views(reversed)).IsEmpty());
+    }
+
+    void TestOrigins()
+    {
+        CookieTracker tracker;
+        std::vector<Cookie> jar = { MakeCookie(L"a", L"1") };
+
+        // Origins are scheme, host and port; the path does not matter
+        tracker.Update(L"https://example.org/a", Views(jar));
+        tracker.MarkPublished(L"https://example.org/a");
+        CHECK(!tracker.Update(L"https://example.org/b?x=1", Views(jar)).NeedsPublish());
+
+        // Another origin has its own snapshot and needs its own publish,
+        // even with the same jar
+        CookieTracker::Delta delta = tracker.Update(L"https://books.example.org/", Views(jar));
+        CHECK(Is(delta, 1, 0, 0) && delta.originChanged);
+        delta = tracker.Update(L"http://example.org/", Views(jar));
+        CHECK(Is(delta, 1, 0, 0) && delta.originChanged);
+        delta = tracker.Update(L"https://example.org:8443/", Views(jar));
+        CHECK(Is(delta, 1, 0, 0) && delta.originChanged);
+
+        // Coming back to a known origin that was not published last
+        tracker.MarkPublished(L"https://books.example.org/");
+        delta = tracker.Update(L"https://example.org/", Views(jar));
+        CHECK(delta.IsEmpty() && delta.originChanged && delta.NeedsPublish());
+        tracker.MarkPublished(L"https://example.org/");
+        CHECK(!tracker.Update(L"https://example.org/", Views(jar)).NeedsPublish());
+
+        tracker.Reset();
+        delta = tracker.Update(L"https://example.org/", Views(jar));
+        CHECK(Is(delta, 1, 0, 0) && delta.originChanged);
+    }
+
+    void TestOriginLimit()
+    {
+        // CookieTracker::c_maxOrigins
+        const size_t maxOrigins = 256;
+        CookieTracker tracker;
+        std::vector<Cookie> jar = { MakeCookie(L"a", L"1") };
+        auto origin = [](size_t i) { return L"https://host" + std::to_wstring(i) + L".example.org/"; };
+        for (size_t i = 0; i < maxOrigins; ++i)
+        {
+            CHECK(Is(tracker.Update(origin(i), Views(jar)), 1, 0, 0));
+        }
+        CHECK(tracker.Update(origin(0), Views(jar)).IsEmpty());
+        CHECK(tracker.Update(origin(maxOrigins - 1), Views(jar)).IsEmpty());
+
+        // One more clears the others; they are new again, the last one is kept
+        CHECK(Is(tracker.Update(origin(maxOrigins), Views(jar)), 1, 0, 0));
+        CHECK(tracker.Update(origin(maxOrigins), Views(jar)).IsEmpty());
+        CHECK(Is(tracker.Update(origin(0), Views(jar)), 1, 0, 0));
+        CHECK(Is(tracker.Update(origin(maxOrigins - 1), Views(jar)), 1, 0, 0));
+    }
+}
+
+int main()
+{
+    TestDelta();
+    TestOrderIndependence();
+    TestOrigins();
+    TestOriginLimit();
+    return TestResult();
+}
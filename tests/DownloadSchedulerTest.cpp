@@ -0,0 +1,278 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Drives DownloadScheduler through MockEngine on the simulated clock, with
+// pages that hang, fail and crash their engine, and checks the watchdog's
+// attempts and backoff, the counters it keeps and that every page ends up
+// either downloaded or failed.
+
+#include "DownloadScheduler.h"
+#include "Metrics.h"
+#include "MockEngine.h"
+#include "Check.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    // Remembers when each URL was navigated to, in loop time
+    class RecordingEngine : public MockEngine
+    {
+    public:
+        RecordingEngine(SimulatedLoop& loop, const Config& config)
+            : MockEngine(loop, config), m_loop(loop)
+        {
+        }
+
+        bool Navigate(const std::wstring& uri) override
+        {
+            starts[uri].push_back(m_loop.Now());
+            return MockEngine::Navigate(uri);
+        }
+
+        std::map<std::wstring, std::vector<uint64_t>> starts;
+
+    private:
+        SimulatedLoop& m_loop;
+    };
+
+    struct Counters
+    {
+        uint64_t stalls = Metrics::Instance().Get(Metrics::Counter::Stalls);
+        uint64_t retries = Metrics::Instance().Get(Metrics::Counter::Retries);
+        uint64_t failures = Metrics::Instance().Get(Metrics::Counter::Failures);
+        uint64_t downloads = Metrics::Instance().Get(Metrics::Counter::Downloads);
+    };
+
+    struct Run
+    {
+        std::vector<int> completed;  // Per page, how often it was reported
+        std::vector<int> failed;
+        int finished = 0;
+        uint64_t finishedAt = 0;
+        Counters before;
+        Counters after;
+        size_t stallCount = 0;
+        size_t completedCount = 0;
+        size_t failedCount = 0;
+        size_t navigations = 0;
+        size_t hangs = 0;
+        size_t crashes = 0;
+        std::map<std::wstring, std::vector<uint64_t>> starts;
+    };
+
+    Run RunBatch(const fs::path& directory, const MockEngine::Config& config, const DownloadScheduler::Watchdog& watchdog,
+        const std::vector<std::wstring>& urls, uint64_t restartMs = 200)
+    {
+        Run run;
+        run.completed.assign(urls.size(), 0);
+        run.failed.assign(urls.size(), 0);
+
+        SimulatedLoop loop;
+        RecordingEngine engine(loop, config);
+        DownloadScheduler* schedulerPointer = nullptr;
+        DownloadScheduler::Host host;
+        host.postNext = [&loop, &schedulerPointer]() { loop.Post(0, [&schedulerPointer]() { schedulerPointer->Advance(); }); };
+        host.clock = [&loop]() { return static_cast<int64_t>(loop.Now()) * 1000; };
+        uint64_t watchdogGeneration = 0;
+        host.setWatchdog = [&loop, &schedulerPointer, &watchdogGeneration](uint32_t delayMs) {
+            uint64_t generation = ++watchdogGeneration;
+            if (delayMs > 0)
+            {
+                loop.Post(delayMs, [&schedulerPointer, &watchdogGeneration, generation]() {
+                    if (generation == watchdogGeneration)
+                    {
+                        schedulerPointer->OnWatchdog();
+                    }
+                });
+            }
+        };
+        host.onPageCompleted = [&run](size_t index, const DownloadResult&) { run.completed[index]++; };
+        host.onPageFailed = [&run](size_t index) { run.failed[index]++; };
+        host.onFinished = [&run, &loop]() {
+            run.finished++;
+            run.finishedAt = loop.Now();
+        };
+
+        DownloadScheduler scheduler(engine, host);
+        schedulerPointer = &scheduler;
+        scheduler.SetWatchdog(watchdog);
+        scheduler.GetLayout().Configure(directory.wstring(), DownloadLayout::Mode::Flat, L"test", urls.size());
+        engine.SetCrashHandler([&loop, &scheduler, restartMs]() {
+            scheduler.OnEngineLost();
+            loop.Post(restartMs, [&scheduler]() { scheduler.OnEngineRestored(); });
+        });
+
+        scheduler.Start(urls);
+        loop.RunUntilIdle();
+        CHECK(!scheduler.IsRunning());
+
+        run.after = Counters();
+        run.stallCount = scheduler.GetStallCount();
+        run.completedCount = scheduler.GetCompletedCount();
+        run.failedCount = scheduler.GetFailedCount();
+        run.navigations = engine.GetNavigationCount();
+        run.hangs = engine.GetHangCount();
+        run.crashes = engine.GetCrashCount();
+        run.starts = engine.starts;
+        return run;
+    }
+
+    std::vector<std::wstring> Pages(size_t count)
+    {
+        std::vector<std::wstring> urls;
+        for (size_t i = 0; i < count; ++i)
+        {
+            urls.push_back(L"https://example.org/iiif/book/" + std::to_wstring(i + 1) + L"/full/full/0/default.jpg");
+        }
+        return urls;
+    }
+
+    // Every page settles exactly once, one way or the other
+    void CheckAllSettled(const Run& run)
+    {
+        CHECK(run.finished == 1);
+        for (size_t i = 0; i < run.completed.size(); ++i)
+        {
+            CHECK(run.completed[i] + run.failed[i] == 1);
+        }
+        CHECK(run.completedCount + run.failedCount == run.completed.size());
+        CHECK(run.after.downloads - run.before.downloads == run.completedCount);
+        CHECK(run.after.failures - run.before.failures == run.failedCount);
+        CHECK(run.after.stalls - run.before.stalls == run.stallCount);
+        // Every navigation past a page's first is a retry
+        CHECK(run.after.retries - run.before.retries == run.navigations - run.completed.size());
+    }
+
+    void TestHungPageBacksOff(const fs::path& directory)
+    {
+        MockEngine::Config config;
+        config.hangRate = 1;
+        DownloadScheduler::Watchdog watchdog;
+        watchdog.navigationTimeoutMs = 1000;
+        watchdog.retryDelayMs = 500;
+        watchdog.maxAttempts = 4;
+        std::vector<std::wstring> urls = Pages(1);
+
+        Run run = RunBatch(directory, config, watchdog, urls);
+        CheckAllSettled(run);
+        CHECK(run.failed[0] == 1);
+        CHECK(run.stallCount == 4);
+        CHECK(run.hangs == 4);
+        // Stalled after 1 s each, then 0.5, 1 and 2 s of backoff
+        std::vector<uint64_t> expected = { 0, 1500, 3500, 6500 };
+        CHECK(run.starts[urls[0]] == expected);
+        CHECK(run.finishedAt == 7500);
+    }
+
+    void TestBackoffBetweenOtherPages(const fs::path& directory)
+    {
+        // Stalled pages wait out their backoff while the rest of the list
+        // goes on, so they come back no earlier than it allows
+        MockEngine::Config config;
+        config.navigationMs = 100;
+        config.downloadMs = 50;
+        config.hangRate = 0.5;
+        config.seed = 3;
+        DownloadScheduler::Watchdog watchdog;
+        watchdog.navigationTimeoutMs = 400;
+        watchdog.retryDelayMs = 250;
+        watchdog.maxAttempts = 10;
+        std::vector<std::wstring> urls = Pages(8);
+
+        Run run = RunBatch(directory, config, watchdog, urls);
+        CheckAllSettled(run);
+        CHECK(run.stallCount > 0);
+        CHECK(run.stallCount == run.hangs);
+        for (const std::wstring& url : urls)
+        {
+            const std::vector<uint64_t>& starts = run.starts[url];
+            CHECK(!starts.empty() && starts.size() <= watchdog.maxAttempts);
+            // Stalled at 400 ms, then at least 250 ms doubling per attempt
+            for (size_t attempt = 1; attempt < starts.size(); ++attempt)
+            {
+                CHECK(starts[attempt] - starts[attempt - 1] >= 400 + (250ull << (attempt - 1)));
+            }
+        }
+    }
+
+    void TestDownloadStall(const fs::path& directory)
+    {
+        MockEngine::Config config;
+        config.downloadMs = 5000;
+        DownloadScheduler::Watchdog watchdog;
+        watchdog.navigationTimeoutMs = 1000;
+        watchdog.downloadTimeoutMs = 1000;
+        watchdog.retryDelayMs = 100;
+        watchdog.maxAttempts = 2;
+        std::vector<std::wstring> urls = Pages(3);
+
+        Run run = RunBatch(directory, config, watchdog, urls);
+        CheckAllSettled(run);
+        CHECK(run.failedCount == 3);
+        CHECK(run.stallCount == 6);
+        CHECK(run.navigations == 6);
+    }
+
+    void TestFailuresAreNotRetried(const fs::path& directory)
+    {
+        MockEngine::Config config;
+        config.navigationFailureRate = 1;
+        DownloadScheduler::Watchdog watchdog;
+        std::vector<std::wstring> urls = Pages(5);
+
+        Run run = RunBatch(directory, config, watchdog, urls);
+        CheckAllSettled(run);
+        CHECK(run.failedCount == 5);
+        CHECK(run.navigations == 5);
+        CHECK(run.stallCount == 0);
+        CHECK(run.after.retries == run.before.retries);
+    }
+
+    void TestMixedFaults(const fs::path& directory)
+    {
+        MockEngine::Config config;
+        config.jitterMs = 40;
+        config.hangRate = 0.15;
+        config.crashRate = 0.05;
+        config.navigationFailureRate = 0.05;
+        config.downloadFailureRate = 0.05;
+        config.seed = 42;
+        DownloadScheduler::Watchdog watchdog;
+        watchdog.navigationTimeoutMs = 2000;
+        watchdog.downloadTimeoutMs = 2000;
+        watchdog.retryDelayMs = 300;
+        watchdog.maxAttempts = 3;
+        std::vector<std::wstring> urls = Pages(300);
+
+        Run run = RunBatch(directory, config, watchdog, urls);
+        CheckAllSettled(run);
+        CHECK(run.hangs > 0 && run.crashes > 0);
+        CHECK(run.completedCount > 0 && run.failedCount > 0);
+        CHECK(run.stallCount == run.hangs);
+        for (const std::wstring& url : urls)
+        {
+            CHECK(run.starts[url].size() <= watchdog.maxAttempts);
+        }
+    }
+}
+
+int main()
+{
+    fs::path directory = fs::temp_directory_path() / "bookget-downloadscheduler-test";
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    TestHungPageBacksOff(directory);
+    TestBackoffBetweenOtherPages(directory);
+    TestDownloadStall(directory);
+    TestFailuresAreNotRetried(directory);
+    TestMixedFaults(directory);
+    fs::remove_all(directory);
+    return TestResult();
+}
@@ -0,0 +1,181 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "FileWriter.h"
+#include "Check.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    // Long enough that only Flush and Shutdown end a batch
+    constexpr std::chrono::milliseconds c_longBatch(60 * 1000);
+
+    std::string ReadFile(const fs::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void TestCoalescing(const fs::path& directory)
+    {
+        FileWriter writer(FileWriter::SyncPolicy::None, c_longBatch);
+        fs::path path = directory / "cookie.txt";
+
+        // A Write drops the Appends queued before it, later ones follow it
+        auto started = std::chrono::steady_clock::now();
+        writer.Append(path.wstring(), L"a");
+        writer.Append(path.wstring(), L"b");
+        writer.Write(path.wstring(), L"c");
+        writer.Append(path.wstring(), L"d");
+        CHECK(writer.Flush());
+        CHECK(std::chrono::steady_clock::now() - started < c_longBatch / 2);
+        CHECK(ReadFile(path) == "cd");
+        CHECK(writer.GetSupersededCount() == 1);
+
+        // Appends go after what is on disk already
+        writer.Append(path.wstring(), L"e");
+        writer.Append(path.wstring(), L"f");
+        CHECK(writer.Flush());
+        CHECK(ReadFile(path) == "cdef");
+        CHECK(writer.GetSupersededCount() == 1);
+
+        // Only the last of several Writes reaches the file
+        writer.Write(path.wstring(), L"x");
+        writer.Write(path.wstring(), L"y");
+        writer.Write(path.wstring(), L"z");
+        CHECK(writer.Flush());
+        CHECK(ReadFile(path) == "z");
+        CHECK(writer.GetSupersededCount() == 3);
+
+        // A Write to an empty queue supersedes nothing, other paths are kept
+        // apart
+        fs::path other = directory / "other.txt";
+        writer.Write(path.wstring(), L"1");
+        writer.Append(other.wstring(), L"2");
+        CHECK(writer.Flush());
+        CHECK(ReadFile(path) == "1");
+        CHECK(ReadFile(other) == "2");
+        CHECK(writer.GetSupersededCount() == 3);
+    }
+
+    void TestEncoding(const fs::path& directory)
+    {
+        FileWriter writer(FileWriter::SyncPolicy::Always, c_longBatch);
+        fs::path path = directory / "encoded.txt";
+
+        // Several times the write buffer, so characters of every length,
+        // surrogate pairs included, land on its boundaries
+        std::wstring text;
+        std::string expected;
+        for (int i = 0; i < 100000; ++i)
+        {
+            text += L"x\x4E2D";
+            expected += "x\xE4\xB8\xAD";
+            if (i % 3 == 0)
+            {
+                text += L"\U0001F4D6";
+                expected += "\xF0\x9F\x93\x96";
+            }
+        }
+        writer.Write(path.wstring(), text);
+        writer.Append(path.wstring(), L"\n");
+        CHECK(writer.Flush());
+        CHECK(ReadFile(path) == expected + "\n");
+    }
+
+    void TestFlushGenerations(const fs::path& directory)
+    {
+        FileWriter writer(FileWriter::SyncPolicy::OnFlush, c_longBatch);
+        fs::path shared = directory / "shared.txt";
+        const int threadCount = 4;
+        const int rounds = 50;
+
+        // Whatever a thread queued before its Flush is on disk when the Flush
+        // returns, whichever batch picked it up
+        std::atomic<int> missing = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&writer, &missing, &directory, &shared, t]() {
+                fs::path own = directory / ("thread" + std::to_string(t) + ".txt");
+                for (int round = 0; round < rounds; ++round)
+                {
+                    std::string line = std::to_string(t) + ":" + std::to_string(round) + "\n";
+                    std::wstring wide(line.begin(), line.end());
+                    writer.Write(own.wstring(), wide);
+                    writer.Append(shared.wstring(), wide);
+                    if (!writer.Flush())
+                    {
+                        missing++;
+                    }
+                    if (ReadFile(own) != line || ReadFile(shared).find(line) == std::string::npos)
+                    {
+                        missing++;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        size_t sharedSize = 0;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            for (int round = 0; round < rounds; ++round)
+            {
+                sharedSize += (std::to_string(t) + ":" + std::to_string(round) + "\n").size();
+            }
+        }
+        CHECK(missing == 0);
+        CHECK(ReadFile(shared).size() == sharedSize);
+
+        // A failed write is reported by the next Flush only
+        writer.Write((directory / "missing" / "file.txt").wstring(), L"lost");
+        CHECK(!writer.Flush());
+        CHECK(writer.Flush());
+    }
+
+    void TestShutdown(const fs::path& directory)
+    {
+        fs::path path = directory / "shutdown.txt";
+        FileWriter writer(FileWriter::SyncPolicy::OnFlush, c_longBatch);
+
+        // Shutdown writes what is queued
+        writer.Append(path.wstring(), L"queued");
+        writer.Shutdown();
+        CHECK(ReadFile(path) == "queued");
+
+        // Afterwards writes go straight to the file
+        writer.Append(path.wstring(), L" late");
+        CHECK(ReadFile(path) == "queued late");
+        writer.Write(path.wstring(), L"final");
+        CHECK(ReadFile(path) == "final");
+        CHECK(writer.Flush());
+        writer.Shutdown();
+    }
+}
+
+int main()
+{
+    fs::path directory = fs::temp_directory_path() / "bookget-filewriter-test";
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    TestCoalescing(directory);
+    TestEncoding(directory);
+    TestFlushGenerations(directory);
+    TestShutdown(directory);
+    fs::remove_all(directory);
+    return TestResult();
+}
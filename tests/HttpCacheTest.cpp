@@ -0,0 +1,252 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "HttpCache.h"
+#include "Check.h"
+
+#include <filesystem>
+#include <string>
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    // Sun, 14 Nov 2023 22:13:20 GMT
+    constexpr int64_t c_now = 1700000000;
+
+    size_t CountEntryFiles(const fs::path& directory)
+    {
+        size_t count = 0;
+        for (const auto& item : fs::recursive_directory_iterator(directory / L"data"))
+        {
+            count += item.is_regular_file() ? 1 : 0;
+        }
+        return count;
+    }
+
+    void TestParseHttpDate()
+    {
+        CHECK(HttpCache::ParseHttpDate(L"Sun, 06 Nov 1994 08:49:37 GMT") == 784111777);
+        CHECK(HttpCache::ParseHttpDate(L"sun, 6 nov 1994 08:49:37 gmt") == 784111777);
+        CHECK(HttpCache::ParseHttpDate(L"Tue, 14 Nov 2023 22:13:20 GMT") == c_now);
+        CHECK(HttpCache::ParseHttpDate(L"Thu, 01 Jan 1970 00:00:00 GMT") == 0);
+        CHECK(HttpCache::ParseHttpDate(L"Thu, 29 Feb 2024 12:00:00 GMT") == 1709208000);
+
+        // The obsolete RFC 850 form, with a two-digit year
+        CHECK(HttpCache::ParseHttpDate(L"Sunday, 06-Nov-94 08:49:37 GMT") == 784111777);
+        CHECK(HttpCache::ParseHttpDate(L"Monday, 01-Jan-69 00:00:00 GMT") == HttpCache::ParseHttpDate(L"Wed, 01 Jan 2069 00:00:00 GMT"));
+        CHECK(HttpCache::ParseHttpDate(L"Thursday, 01-Jan-70 00:00:00 GMT") == 0);
+
+        CHECK(HttpCache::ParseHttpDate(L"0") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"Sun Nov  6 08:49:37 1994") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"Sun, 06 Foo 1994 08:49:37 GMT") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"Sun, 32 Nov 1994 08:49:37 GMT") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"Sun, 06 Nov 1994 24:00:00 GMT") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"Sun, 06 Nov 1994 08:49") == -1);
+        CHECK(HttpCache::ParseHttpDate(L"Sun, 06 Nov 9 08:49:37 GMT") == -1);
+    }
+
+    void TestGetPolicy()
+    {
+        HttpCache::Policy policy = HttpCache::GetPolicy(200, { { L"Cache-Control", L"public, max-age=600" } }, c_now);
+        CHECK(policy.storable && policy.explicitFreshness);
+        CHECK(policy.freshUntil == c_now + 600);
+
+        // s-maxage wins over max-age, quoted arguments are accepted
+        policy = HttpCache::GetPolicy(200, { { L"cache-control", L"max-age=60, S-MAXAGE=\"120\"" } }, c_now);
+        CHECK(policy.freshUntil == c_now + 120);
+
+        CHECK(!HttpCache::GetPolicy(200, { { L"Cache-Control", L"no-store, max-age=600" } }, c_now).storable);
+        CHECK(!HttpCache::GetPolicy(200, { { L"Cache-Control", L"max-age=600, Private" } }, c_now).storable);
+        CHECK(!HttpCache::GetPolicy(200, { { L"Cache-Control", L"max-age=600" }, { L"Set-Cookie", L"a=b" } }, c_now).storable);
+        CHECK(!HttpCache::GetPolicy(206, { { L"Cache-Control", L"max-age=600" } }, c_now).storable);
+        CHECK(!HttpCache::GetPolicy(404, { { L"Cache-Control", L"max-age=600" } }, c_now).storable);
+        CHECK(HttpCache::GetPolicy(203, { { L"Cache-Control", L"max-age=600" } }, c_now).storable);
+
+        // Bodies are stored decoded, so only Accept-Encoding may vary
+        CHECK(HttpCache::GetPolicy(200, { { L"Cache-Control", L"max-age=600" }, { L"Vary", L"Accept-Encoding" } }, c_now).storable);
+        CHECK(HttpCache::GetPolicy(200, { { L"Cache-Control", L"max-age=600" }, { L"Vary", L" accept-encoding , " } }, c_now).storable);
+        CHECK(!HttpCache::GetPolicy(200, { { L"Cache-Control", L"max-age=600" }, { L"Vary", L"Accept-Encoding, Origin" } }, c_now).storable);
+        CHECK(!HttpCache::GetPolicy(200, { { L"Cache-Control", L"max-age=600" }, { L"Vary", L"*" } }, c_now).storable);
+
+        // Expires counts from Date; an invalid date such as 0 is already expired
+        policy = HttpCache::GetPolicy(200, {
+            { L"Date", L"Tue, 14 Nov 2023 22:00:00 GMT" },
+            { L"Expires", L"Tue, 14 Nov 2023 23:00:00 GMT" } }, c_now);
+        CHECK(policy.storable && policy.explicitFreshness);
+        CHECK(policy.freshUntil == c_now + 3600);
+        policy = HttpCache::GetPolicy(200, { { L"Expires", L"0" } }, c_now);
+        CHECK(!policy.storable && policy.explicitFreshness);
+        policy = HttpCache::GetPolicy(200, { { L"Expires", L"0" }, { L"ETag", L"\"v1\"" } }, c_now);
+        CHECK(policy.storable && policy.freshUntil == c_now);
+        CHECK(policy.etag == L"\"v1\"");
+
+        // no-cache keeps the entry for revalidation only
+        policy = HttpCache::GetPolicy(200, { { L"Cache-Control", L"no-cache, max-age=600" }, { L"ETag", L"\"v1\"" } }, c_now);
+        CHECK(policy.storable && policy.freshUntil == c_now);
+        CHECK(!HttpCache::GetPolicy(200, { { L"Pragma", L"no-cache" }, { L"Expires", L"Tue, 14 Nov 2023 23:00:00 GMT" } }, c_now).storable);
+
+        // Heuristic lifetime: a tenth of the age, at most a day
+        policy = HttpCache::GetPolicy(200, { { L"Last-Modified", L"Tue, 14 Nov 2023 12:13:20 GMT" } }, c_now);
+        CHECK(policy.storable && !policy.explicitFreshness);
+        CHECK(policy.freshUntil == c_now + 3600);
+        CHECK(policy.lastModified == L"Tue, 14 Nov 2023 12:13:20 GMT");
+        policy = HttpCache::GetPolicy(200, { { L"Last-Modified", L"Sun, 06 Nov 1994 08:49:37 GMT" } }, c_now);
+        CHECK(policy.freshUntil == c_now + 24 * 60 * 60);
+
+        // Nothing to go on
+        CHECK(!HttpCache::GetPolicy(200, { { L"Content-Type", L"image/jpeg" } }, c_now).storable);
+    }
+
+    void TestNormalizeUrl()
+    {
+        CHECK(HttpCache::NormalizeUrl(L"HTTPS://Example.ORG:443/A/b.js?v=1#top") == L"https://example.org/A/b.js?v=1");
+        CHECK(HttpCache::NormalizeUrl(L"http://example.org:80") == L"http://example.org/");
+        CHECK(HttpCache::NormalizeUrl(L"http://example.org:8080/x") == L"http://example.org:8080/x");
+        CHECK(HttpCache::NormalizeUrl(L"data:image/png;base64,AAAA").empty());
+        CHECK(HttpCache::NormalizeUrl(L"/relative/path").empty());
+    }
+
+    void TestRoundTrip(const fs::path& directory)
+    {
+        HttpCache cache;
+        HttpCache::Config config;
+        config.directory = directory.wstring();
+        config.slotCount = 64;
+        CHECK(cache.Open(config));
+
+        const wchar_t* url = L"https://iiif.example.org/viewer/app.js";
+        HttpCache::Headers headers = {
+            { L"Content-Type", L"text/javascript" },
+            { L"Cache-Control", L"max-age=60" },
+            { L"ETag", L"\"v1\"" },
+            { L"Server", L"test" },
+        };
+        std::string body(100000, 'j');
+        CHECK(cache.Store(url, 200, headers, body, c_now));
+        CHECK(cache.GetEntryCount() == 1);
+
+        HttpCache::Entry entry;
+        CHECK(cache.Probe(L"HTTPS://IIIF.EXAMPLE.ORG/viewer/app.js#x", c_now) == HttpCache::Lookup::Fresh);
+        CHECK(cache.Find(url, c_now + 59, entry) == HttpCache::Lookup::Fresh);
+        CHECK(entry.status == 200);
+        CHECK(entry.body == body);
+        CHECK(entry.etag == L"\"v1\"");
+        CHECK(entry.headers == L"Content-Type: text/javascript\r\nETag: \"v1\"");
+
+        // Past max-age the validators ask for a revalidation
+        CHECK(cache.Find(url, c_now + 60, entry) == HttpCache::Lookup::Stale);
+        CHECK(cache.Refresh(url, { { L"Date", L"Tue, 14 Nov 2023 22:14:20 GMT" } }, c_now + 60));
+        CHECK(cache.Find(url, c_now + 119, entry) == HttpCache::Lookup::Fresh);
+        CHECK(cache.Find(url, c_now + 120, entry) == HttpCache::Lookup::Stale);
+        CHECK(cache.Refresh(url, { { L"Cache-Control", L"max-age=3600" } }, c_now + 120));
+        CHECK(cache.Find(url, c_now + 3000, entry) == HttpCache::Lookup::Fresh);
+        CHECK(entry.body == body);
+        CHECK(!cache.Refresh(L"https://iiif.example.org/other.js", {}, c_now));
+
+        // Without validators a stale entry is a miss
+        const wchar_t* plain = L"https://iiif.example.org/info.json";
+        CHECK(cache.Store(plain, 200, { { L"Cache-Control", L"max-age=10" } }, "{}", c_now));
+        CHECK(cache.Find(plain, c_now + 5, entry) == HttpCache::Lookup::Fresh);
+        CHECK(cache.Probe(plain, c_now + 10) == HttpCache::Lookup::Miss);
+        CHECK(cache.Find(plain, c_now + 10, entry) == HttpCache::Lookup::Miss);
+
+        // Replacing an entry keeps the totals right
+        uint64_t total = cache.GetTotalBytes();
+        CHECK(cache.Store(url, 200, headers, "short", c_now));
+        CHECK(cache.GetEntryCount() == 2);
+        CHECK(cache.GetTotalBytes() == total - (body.size() - 5));
+        CHECK(cache.Find(url, c_now, entry) == HttpCache::Lookup::Fresh);
+        CHECK(entry.body == "short");
+
+        // Refused responses and URLs
+        CHECK(!cache.Store(L"https://iiif.example.org/me", 200, { { L"Cache-Control", L"private" } }, "x", c_now));
+        CHECK(!cache.Store(L"blob:https://iiif.example.org/1", 200, headers, "x", c_now));
+        CHECK(cache.Find(L"https://iiif.example.org/me", c_now, entry) == HttpCache::Lookup::Miss);
+
+        // A missing entry file reads as a miss and frees the slot
+        fs::remove_all(directory / L"data");
+        CHECK(cache.Find(url, c_now, entry) == HttpCache::Lookup::Miss);
+        CHECK(cache.GetEntryCount() == 1);
+    }
+
+    void TestEviction(const fs::path& directory)
+    {
+        HttpCache cache;
+        HttpCache::Config config;
+        config.directory = directory.wstring();
+        config.slotCount = 256;
+        config.capacity = 50000;
+        config.maxEntrySize = 20000;
+        CHECK(cache.Open(config));
+
+        HttpCache::Headers headers = { { L"Cache-Control", L"max-age=600" } };
+        CHECK(!cache.Store(L"https://example.org/huge", 200, headers, std::string(20001, 'h'), c_now));
+        std::wstring last;
+        for (int i = 0; i < 40; ++i)
+        {
+            last = L"https://example.org/tile/" + std::to_wstring(i) + L".jpg";
+            CHECK(cache.Store(last, 200, headers, std::string(4000, 'x'), c_now + i));
+            CHECK(cache.GetTotalBytes() <= config.capacity);
+        }
+        CHECK(cache.GetEntryCount() < 40);
+        CHECK(cache.GetEntryCount() == CountEntryFiles(directory));
+        CHECK(cache.Probe(last, c_now + 40) == HttpCache::Lookup::Fresh);
+    }
+
+    void TestReopen(const fs::path& directory)
+    {
+        HttpCache::Config config;
+        config.directory = directory.wstring();
+        config.slotCount = 64;
+        const wchar_t* url = L"https://example.org/a.js";
+        {
+            HttpCache cache;
+            CHECK(cache.Open(config));
+            CHECK(cache.Store(url, 200, { { L"Cache-Control", L"max-age=600" } }, "abc", c_now));
+            CHECK(cache.Store(L"https://example.org/b.js", 200, { { L"Cache-Control", L"max-age=600" } }, "def", c_now));
+        }
+
+        // Same layout: entries and totals survive
+        HttpCache cache;
+        CHECK(cache.Open(config));
+        CHECK(cache.GetEntryCount() == 2);
+        HttpCache::Entry entry;
+        CHECK(cache.Find(url, c_now, entry) == HttpCache::Lookup::Fresh);
+        CHECK(entry.body == "abc");
+        uint64_t total = cache.GetTotalBytes();
+        CHECK(total > 6);
+        cache.Close();
+        CHECK(!cache.IsOpen());
+        CHECK(cache.Find(url, c_now, entry) == HttpCache::Lookup::Miss);
+
+        // Another slot count cannot find the old entries, so they are dropped
+        config.slotCount = 128;
+        CHECK(cache.Open(config));
+        CHECK(cache.GetEntryCount() == 0);
+        CHECK(cache.GetTotalBytes() == 0);
+        CHECK(CountEntryFiles(directory) == 0);
+        CHECK(cache.Find(url, c_now, entry) == HttpCache::Lookup::Miss);
+        CHECK(cache.Store(url, 200, { { L"Cache-Control", L"max-age=600" } }, "abc", c_now));
+        CHECK(cache.GetTotalBytes() == total / 2);
+
+        config.slotCount = 0;
+        CHECK(!cache.Open(config));
+    }
+}
+
+int main()
+{
+    fs::path directory = fs::temp_directory_path() / "bookget-httpcache-test";
+    fs::remove_all(directory);
+    TestParseHttpDate();
+    TestGetPolicy();
+    TestNormalizeUrl();
+    TestRoundTrip(directory / "roundtrip");
+    TestEviction(directory / "eviction");
+    TestReopen(directory / "reopen");
+    fs::remove_all(directory);
+    return TestResult();
+}
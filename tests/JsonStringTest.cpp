@@ -0,0 +1,166 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks JsonString against a one-unit-at-a-time reference, through the
+// char16_t overloads (the vector path on every platform) and the wchar_t
+// ones the app calls.
+
+#include "JsonString.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace
+{
+    std::u16string ReferenceQuote(std::u16string_view raw)
+    {
+        static const char hex[] = "0123456789abcdef";
+        std::u16string out = u"\"";
+        for (char16_t c : raw)
+        {
+            switch (c)
+            {
+            case u'"': out += u"\\\""; break;
+            case u'\\': out += u"\\\\"; break;
+            case u'\b': out += u"\\b"; break;
+            case u'\f': out += u"\\f"; break;
+            case u'\n': out += u"\\n"; break;
+            case u'\r': out += u"\\r"; break;
+            case u'\t': out += u"\\t"; break;
+            default:
+                if (c < 0x20)
+                {
+                    out += u"\\u00";
+                    out += static_cast<char16_t>(hex[c >> 4]);
+                    out += static_cast<char16_t>(hex[c & 0xF]);
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+        return out + u"\"";
+    }
+
+    std::u16string Quote(std::u16string_view raw)
+    {
+        std::u16string out;
+        JsonString::AppendQuoted(out, raw);
+        return out;
+    }
+
+    bool Unquote(std::u16string_view json, std::u16string& out)
+    {
+        std::wstring wide(json.begin(), json.end());
+        std::wstring wideOut;
+        bool wideResult = JsonString::Unquote(wide, wideOut);
+        bool result = JsonString::Unquote(json, out);
+        CHECK(result == wideResult);
+        CHECK(!result || std::wstring(out.begin(), out.end()) == wideOut);
+        return result;
+    }
+
+    bool Rejects(std::u16string_view json)
+    {
+        std::u16string out;
+        return !Unquote(json, out);
+    }
+
+    std::u16string Unquoted(std::u16string_view json)
+    {
+        std::u16string out;
+        CHECK(Unquote(json, out));
+        return out;
+    }
+
+    void TestQuote()
+    {
+        CHECK(Quote(u"") == u"\"\"");
+        CHECK(Quote(u"plain") == u"\"plain\"");
+        CHECK(Quote(u"a\"b\\c/d") == u"\"a\\\"b\\\\c/d\"");
+        CHECK(Quote(u"\b\f\n\r\t") == u"\"\\b\\f\\n\\r\\t\"");
+        CHECK(Quote(std::u16string(1, u'\0') + u"\x1F\x7F") == u"\"\\u0000\\u001f\x7F\"");
+        CHECK(Quote(u"\x4E2D\xD83D\xDE00") == u"\"\x4E2D\xD83D\xDE00\"");
+
+        std::wstring wide = L"prefix:";
+        JsonString::AppendQuoted(wide, L"a\"b");
+        CHECK(wide == L"prefix:\"a\\\"b\"");
+        CHECK(JsonString::Quote(L"\n") == L"\"\\n\"");
+    }
+
+    void TestUnquote()
+    {
+        CHECK(Unquoted(u"\"\"").empty());
+        CHECK(Unquoted(u"\"plain\"") == u"plain");
+        CHECK(Unquoted(u" \"padded\"\r\n") == u"padded");
+        CHECK(Unquoted(u"\"a\\\"b\\\\c\\/d\"") == u"a\"b\\c/d");
+        CHECK(Unquoted(u"\"\\b\\f\\n\\r\\t\"") == u"\b\f\n\r\t");
+        CHECK(Unquoted(u"\"\\u4e2D\\ud83d\\uDE00\"") == u"\x4E2D\xD83D\xDE00");
+
+        CHECK(Rejects(u""));
+        CHECK(Rejects(u"null"));
+        CHECK(Rejects(u"{\"a\":1}"));
+        CHECK(Rejects(u"\""));
+        CHECK(Rejects(u"\"abc"));
+        CHECK(Rejects(u"\"a\"b\""));          // Bare quote inside
+        CHECK(Rejects(u"\"\"\""));
+        CHECK(Rejects(u"\"abc\\\""));         // Escaped closing quote
+        CHECK(Rejects(u"\"\\x41\""));
+        CHECK(Rejects(u"\"\\u12\""));
+        CHECK(Rejects(u"\"\\u12g4\""));
+
+        // A bare quote is found by the vector loops as well as the tail
+        for (size_t padding : { 7, 8, 15, 16, 17, 31, 32, 40 })
+        {
+            std::u16string filler(padding, u'x');
+            CHECK(Rejects(u"\"" + filler + u"\"" + filler + u"\""));
+            CHECK(Unquoted(u"\"" + filler + u"\\\"" + filler + u"\"") == filler + u"\"" + filler);
+        }
+    }
+
+    void TestRandom()
+    {
+        std::mt19937 random(32);
+        const char16_t special[] = { u'"', u'\\', u'/', u'\n', u'\t', u'\0', u'\x1F', u'\x7F', u'\x4E2D', u'\xD800' };
+        size_t failures = 0;
+        for (int round = 0; round < 20000; ++round)
+        {
+            // Clean runs of all lengths between the characters that need work
+            std::u16string raw;
+            int pieces = 1 + random() % 6;
+            for (int piece = 0; piece < pieces; ++piece)
+            {
+                raw.append(random() % 40, static_cast<char16_t>(u'a' + random() % 26));
+                raw += special[random() % (sizeof(special) / sizeof(special[0]))];
+            }
+
+            std::u16string quoted = Quote(raw);
+            std::u16string back;
+            if ((quoted != ReferenceQuote(raw) || !Unquote(quoted, back) || back != raw) && failures++ < 10)
+            {
+                std::fprintf(stderr, "mismatch, round %d\n", round);
+            }
+
+            std::wstring wideQuoted;
+            JsonString::AppendQuoted(wideQuoted, std::wstring(raw.begin(), raw.end()));
+            if (wideQuoted != std::wstring(quoted.begin(), quoted.end()) && failures++ < 10)
+            {
+                std::fprintf(stderr, "wide mismatch, round %d\n", round);
+            }
+        }
+        CHECK(failures == 0);
+    }
+}
+
+int main()
+{
+    TestQuote();
+    TestUnquote();
+    TestRandom();
+    return TestResult();
+}
@@ -0,0 +1,162 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "RequestFilter.h"
+#include "Metrics.h"
+#include "Check.h"
+
+#include <string>
+
+namespace
+{
+    using Type = RequestFilter::ResourceType;
+    using Decision = RequestFilter::Decision;
+
+    void TestDomains()
+    {
+        RequestFilter filter;
+        filter.AddDomain(L"tracker.example");
+        filter.AddDomain(L"*.ads.example.org");
+        filter.AddDomain(L".cdn.example.net.");
+        filter.AddDomain(L"  Stats.Example.COM \r");
+        filter.AddDomain(L"");
+        filter.AddDomain(L"*.");
+        CHECK(filter.HasDomains());
+
+        // The domain and all of its subdomains, nothing above or beside it
+        CHECK(filter.IsDomainBlocked(L"tracker.example"));
+        CHECK(filter.IsDomainBlocked(L"a.b.tracker.example"));
+        CHECK(!filter.IsDomainBlocked(L"example"));
+        CHECK(!filter.IsDomainBlocked(L"nottracker.example"));
+        CHECK(!filter.IsDomainBlocked(L"tracker.example.org"));
+
+        // "*." and leading or trailing dots only mark the subdomains
+        CHECK(filter.IsDomainBlocked(L"ads.example.org"));
+        CHECK(filter.IsDomainBlocked(L"x.ads.example.org"));
+        CHECK(!filter.IsDomainBlocked(L"example.org"));
+        CHECK(filter.IsDomainBlocked(L"cdn.example.net"));
+        CHECK(filter.IsDomainBlocked(L"img.cdn.example.net"));
+
+        // Hosts are matched without case and with a trailing dot
+        CHECK(filter.IsDomainBlocked(L"stats.example.com"));
+        CHECK(filter.IsDomainBlocked(L"WWW.STATS.EXAMPLE.COM."));
+        CHECK(filter.IsDomainBlocked(L"tracker.example..."));
+        CHECK(!filter.IsDomainBlocked(L""));
+        CHECK(!filter.IsDomainBlocked(L"."));
+        CHECK(!filter.IsDomainBlocked(L"example.com"));
+
+        // A subdomain of a blocked domain is blocked already; a domain
+        // added again, in any case, is only counted once
+        RequestFilter nested;
+        nested.AddDomain(L"example.org");
+        nested.AddDomain(L"sub.example.org");
+        nested.AddDomain(L"EXAMPLE.org");
+        CHECK(nested.IsDomainBlocked(L"other.example.org"));
+        CHECK(nested.AddDomainList(L"example.org\nsub.example.org\n") == 0);
+    }
+
+    void TestDomainList()
+    {
+        RequestFilter filter;
+        size_t added = filter.AddDomainList(
+            L"# Blocked hosts\r\n"
+            L"127.0.0.1 localhost\r\n"
+            L"::1\tlocalhost\n"
+            L"0.0.0.0 ads.example.com\r\n"
+            L"0.0.0.0\t\tpixel.example.net   # inline comment\n"
+            L"   \n"
+            L"plain.example.org\n"
+            L"*.wild.example.org\n"
+            L"ads.example.com\n"
+            L"last.example");
+        CHECK(added == 5);
+        CHECK(!filter.IsDomainBlocked(L"localhost"));
+        CHECK(filter.IsDomainBlocked(L"ads.example.com"));
+        CHECK(filter.IsDomainBlocked(L"pixel.example.net"));
+        CHECK(filter.IsDomainBlocked(L"plain.example.org"));
+        CHECK(filter.IsDomainBlocked(L"a.wild.example.org"));
+        CHECK(filter.IsDomainBlocked(L"last.example"));
+        CHECK(!filter.IsDomainBlocked(L"0.0.0.0"));
+        CHECK(!filter.IsDomainBlocked(L"127.0.0.1"));
+        CHECK(!filter.IsDomainBlocked(L"example.com"));
+
+        RequestFilter defaults;
+        CHECK(!defaults.HasDomains());
+        defaults.AddDefaultDomains();
+        CHECK(defaults.IsDomainBlocked(L"www.google-analytics.com"));
+        CHECK(defaults.IsDomainBlocked(L"hm.baidu.com"));
+        CHECK(!defaults.IsDomainBlocked(L"www.baidu.com"));
+    }
+
+    void TestModes()
+    {
+        CHECK(RequestFilter::ParseMode(L"capture") == RequestFilter::Mode::Capture);
+        CHECK(RequestFilter::ParseMode(L"download") == RequestFilter::Mode::Download);
+        CHECK(RequestFilter::ParseMode(L"off") == RequestFilter::Mode::Off);
+        CHECK(RequestFilter::ParseMode(L"") == RequestFilter::Mode::Off);
+
+        RequestFilter filter;
+        CHECK(!filter.IsEnabled());
+        CHECK(filter.GetBlockedTypes() == 0);
+
+        // Capture only needs the DOM
+        filter.Configure(RequestFilter::Mode::Capture);
+        CHECK(filter.IsEnabled());
+        for (Type type : { Type::Image, Type::Media, Type::Font, Type::Stylesheet, Type::TextTrack })
+        {
+            CHECK((filter.GetBlockedTypes() & RequestFilter::GetBit(type)) != 0);
+        }
+        for (Type type : { Type::Document, Type::Script, Type::XmlHttpRequest, Type::Fetch, Type::Other })
+        {
+            CHECK((filter.GetBlockedTypes() & RequestFilter::GetBit(type)) == 0);
+        }
+
+        // Download keeps images and stylesheets for the trigger script
+        filter.Configure(RequestFilter::Mode::Download);
+        for (Type type : { Type::Media, Type::Font, Type::TextTrack })
+        {
+            CHECK((filter.GetBlockedTypes() & RequestFilter::GetBit(type)) != 0);
+        }
+        for (Type type : { Type::Document, Type::Image, Type::Stylesheet, Type::Script, Type::Fetch })
+        {
+            CHECK((filter.GetBlockedTypes() & RequestFilter::GetBit(type)) == 0);
+        }
+
+        filter.Configure(RequestFilter::Mode::Off);
+        CHECK(filter.GetBlockedTypes() == 0);
+    }
+
+    void TestCheck()
+    {
+        Metrics& metrics = Metrics::Instance();
+        uint64_t requests = metrics.Get(Metrics::Counter::BlockedRequests);
+        uint64_t bytes = metrics.Get(Metrics::Counter::BlockedBytesEstimate);
+
+        RequestFilter filter;
+        filter.AddDomain(L"tracker.example");
+        // Off ignores the domain list too
+        CHECK(filter.Check(L"https://tracker.example/a.js", Type::Script) == Decision::Allow);
+
+        filter.Configure(RequestFilter::Mode::Download);
+        CHECK(filter.Check(L"https://books.example.org/font.woff2", Type::Font) == Decision::BlockedType);
+        CHECK(filter.Check(L"https://books.example.org/page.jpg", Type::Image) == Decision::Allow);
+        CHECK(filter.Check(L"https://user@www.Tracker.Example:8443/a.js?x=1", Type::Script) == Decision::BlockedDomain);
+        CHECK(filter.Check(L"https://books.example.org/app.js", Type::Script) == Decision::Allow);
+        // The page itself is never blocked
+        CHECK(filter.Check(L"https://tracker.example/", Type::Document) == Decision::Allow);
+
+        CHECK(metrics.Get(Metrics::Counter::BlockedRequests) - requests == 2);
+        CHECK(metrics.Get(Metrics::Counter::BlockedBytesEstimate) - bytes ==
+            RequestFilter::GetEstimatedBytes(Type::Font) + RequestFilter::GetEstimatedBytes(Type::Script));
+    }
+}
+
+int main()
+{
+    TestDomains();
+    TestDomainList();
+    TestModes();
+    TestCheck();
+    return TestResult();
+}
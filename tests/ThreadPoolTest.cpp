@@ -0,0 +1,220 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ThreadPool.h"
+#include "Check.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    void TestStrandOrder()
+    {
+        ThreadPool pool(4);
+        const int strandCount = 3;
+        const int taskCount = 500;
+
+        struct Lane
+        {
+            std::shared_ptr<ThreadPool::Strand> strand;
+            std::vector<int> order;
+            std::atomic<int> active = 0;
+            std::atomic<bool> overlapped = false;
+        };
+        std::vector<std::unique_ptr<Lane>> lanes;
+        for (int i = 0; i < strandCount; ++i)
+        {
+            lanes.push_back(std::make_unique<Lane>());
+            lanes.back()->strand = pool.CreateStrand();
+        }
+
+        // Interleave the strands with plain pool work so they share workers
+        std::atomic<int> loose = 0;
+        for (int task = 0; task < taskCount; ++task)
+        {
+            for (auto& lane : lanes)
+            {
+                Lane* current = lane.get();
+                CHECK(current->strand->Submit([current, task]() {
+                    if (current->active.fetch_add(1) != 0)
+                    {
+                        current->overlapped = true;
+                    }
+                    current->order.push_back(task);
+                    current->active.fetch_sub(1);
+                }));
+            }
+            if (task % 10 == 0)
+            {
+                pool.Submit([&loose]() { loose++; });
+            }
+        }
+        pool.WaitIdle();
+
+        for (auto& lane : lanes)
+        {
+            CHECK(!lane->overlapped);
+            CHECK(lane->order.size() == taskCount);
+            bool ordered = true;
+            for (size_t i = 0; i < lane->order.size(); ++i)
+            {
+                ordered = ordered && lane->order[i] == static_cast<int>(i);
+            }
+            CHECK(ordered);
+        }
+        CHECK(loose == taskCount / 10);
+    }
+
+    void TestSaturatedStrandRunsInline()
+    {
+        // One worker and room for one queued task
+        ThreadPool pool(1, 1);
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> gate = release.get_future().share();
+        CHECK(pool.Submit([&started, gate]() {
+            started.set_value();
+            gate.wait();
+        }));
+        started.get_future().wait();
+
+        // The worker is busy, so this one stays queued and fills the pool
+        std::atomic<bool> fillerRan = false;
+        CHECK(pool.Submit([&fillerRan]() { fillerRan = true; }));
+        CHECK(!pool.Submit([]() {}));
+
+        // A strand that cannot get a worker runs on the caller, in order
+        std::shared_ptr<ThreadPool::Strand> strand = pool.CreateStrand();
+        std::vector<int> order;
+        std::thread::id caller = std::this_thread::get_id();
+        bool inline1 = false;
+        bool inline2 = false;
+        CHECK(strand->Submit([&]() {
+            inline1 = std::this_thread::get_id() == caller;
+            order.push_back(1);
+        }));
+        CHECK(strand->Submit([&]() {
+            inline2 = std::this_thread::get_id() == caller;
+            order.push_back(2);
+        }));
+        CHECK(inline1 && inline2);
+        CHECK((order == std::vector<int>{ 1, 2 }));
+        CHECK(!fillerRan);
+
+        release.set_value();
+        pool.WaitIdle();
+        CHECK(fillerRan);
+
+        // With the pool free again the strand goes back to the worker
+        std::thread::id worker;
+        CHECK(strand->Submit([&worker]() { worker = std::this_thread::get_id(); }));
+        pool.WaitIdle();
+        CHECK(worker != std::thread::id() && worker != caller);
+    }
+
+    void TestWaitIdle()
+    {
+        ThreadPool pool(3);
+        std::atomic<int> count = 0;
+
+        // Work queued from inside a task is waited for as well, and a task
+        // that throws does not stop the worker
+        for (int i = 0; i < 100; ++i)
+        {
+            CHECK(pool.Submit([&pool, &count, i]() {
+                for (int child = 0; child < 5; ++child)
+                {
+                    pool.Submit([&count]() {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                        count++;
+                    });
+                }
+                count++;
+                if (i % 7 == 0)
+                {
+                    throw std::runtime_error("stage failed");
+                }
+            }));
+        }
+        pool.WaitIdle();
+        CHECK(count == 600);
+
+        // Nothing pending returns at once
+        pool.WaitIdle();
+        CHECK(count == 600);
+    }
+
+    void TestCompletions()
+    {
+        ThreadPool pool(2);
+        std::mutex mutex;
+        std::vector<ThreadPool::Task> completions;
+        pool.SetCompletionDispatcher([&mutex, &completions](ThreadPool::Task task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            completions.push_back(std::move(task));
+        });
+
+        int result = 0;
+        bool done = false;
+        std::vector<int> strandResults;
+        std::shared_ptr<ThreadPool::Strand> strand = pool.CreateStrand();
+        CHECK(pool.Submit([]() { return 6 * 7; }, [&result](int value) { result = value; }));
+        CHECK(pool.Submit([]() {}, [&done]() { done = true; }));
+        for (int i = 0; i < 3; ++i)
+        {
+            CHECK(strand->Submit([i]() { return i; }, [&strandResults](int value) { strandResults.push_back(value); }));
+        }
+        pool.WaitIdle();
+
+        // Nothing runs until the dispatcher's owner runs it
+        CHECK(result == 0 && !done && strandResults.empty());
+        CHECK(completions.size() == 5);
+        for (ThreadPool::Task& completion : completions)
+        {
+            completion();
+        }
+        CHECK(result == 42 && done);
+        CHECK((strandResults == std::vector<int>{ 0, 1, 2 }));
+    }
+
+    void TestShutdown()
+    {
+        ThreadPool pool(2);
+        CHECK(pool.GetThreadCount() == 2);
+        std::atomic<int> count = 0;
+        for (int i = 0; i < 200; ++i)
+        {
+            CHECK(pool.Submit([&count]() {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                count++;
+            }));
+        }
+
+        // Queued work still runs before the workers exit
+        pool.Shutdown();
+        CHECK(count == 200);
+        CHECK(pool.GetThreadCount() == 0);
+        CHECK(!pool.Submit([&count]() { count++; }));
+        pool.Shutdown();
+        pool.WaitIdle();
+        CHECK(count == 200);
+    }
+}
+
+int main()
+{
+    TestStrandOrder();
+    TestSaturatedStrandRunsInline();
+    TestWaitIdle();
+    TestCompletions();
+    TestShutdown();
+    return TestResult();
+}
@@ -0,0 +1,404 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks Transcoder against a byte-at-a-time reference decoder written
+// straight from the Unicode "maximal subpart" rules (Table 3-7), with the
+// interesting input padded by ASCII runs of different lengths so that the
+// vector loops hand over to the scalar code at every offset.
+
+#include "Transcoder.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    void AppendUtf16(std::u16string& out, uint32_t codePoint)
+    {
+        if (codePoint >= 0x10000)
+        {
+            codePoint -= 0x10000;
+            out.push_back(static_cast<char16_t>(0xD800 + (codePoint >> 10)));
+            out.push_back(static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF)));
+        }
+        else
+        {
+            out.push_back(static_cast<char16_t>(codePoint));
+        }
+    }
+
+    // One U+FFFD per maximal subpart: a lead byte followed by as many bytes
+    // as still fit a well-formed sequence, or a single byte that cannot
+    // start one.
+    std::u16string ReferenceToUtf16(std::string_view utf8)
+    {
+        std::u16string out;
+        size_t i = 0;
+        while (i < utf8.size())
+        {
+            uint8_t lead = static_cast<uint8_t>(utf8[i]);
+            int trailing = 0;
+            uint32_t codePoint = 0;
+            uint8_t low = 0x80;
+            uint8_t high = 0xBF;
+            if (lead < 0x80)
+            {
+                out.push_back(lead);
+                i++;
+                continue;
+            }
+            else if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                trailing = 1;
+                codePoint = lead & 0x1F;
+            }
+            else if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                trailing = 2;
+                codePoint = lead & 0x0F;
+                low = lead == 0xE0 ? 0xA0 : 0x80;
+                high = lead == 0xED ? 0x9F : 0xBF;
+            }
+            else if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                trailing = 3;
+                codePoint = lead & 0x07;
+                low = lead == 0xF0 ? 0x90 : 0x80;
+                high = lead == 0xF4 ? 0x8F : 0xBF;
+            }
+            else
+            {
+                out.push_back(0xFFFD);
+                i++;
+                continue;
+            }
+
+            size_t next = i + 1;
+            int matched = 0;
+            while (matched < trailing && next < utf8.size())
+            {
+                uint8_t byte = static_cast<uint8_t>(utf8[next]);
+                if (byte < low || byte > high)
+                {
+                    break;
+                }
+                codePoint = (codePoint << 6) | (byte & 0x3F);
+                low = 0x80;
+                high = 0xBF;
+                next++;
+                matched++;
+            }
+            if (matched == trailing)
+            {
+                AppendUtf16(out, codePoint);
+            }
+            else
+            {
+                out.push_back(0xFFFD);
+            }
+            i = next;
+        }
+        return out;
+    }
+
+    std::string ReferenceToUtf8(std::u16string_view utf16)
+    {
+        std::string out;
+        for (size_t i = 0; i < utf16.size(); ++i)
+        {
+            uint32_t c = utf16[i];
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < utf16.size() && utf16[i + 1] >= 0xDC00 && utf16[i + 1] <= 0xDFFF)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (utf16[i + 1] - 0xDC00);
+                i++;
+            }
+            else if (c >= 0xD800 && c <= 0xDFFF)
+            {
+                c = 0xFFFD;
+            }
+
+            if (c < 0x80)
+            {
+                out.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x800)
+            {
+                out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000)
+            {
+                out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        }
+        return out;
+    }
+
+    // Converts through the raw buffer API and checks nothing is written past
+    // the worst case size.
+    std::u16string ToUtf16(std::string_view utf8)
+    {
+        const size_t capacity = Transcoder::MaxUtf16Length(utf8.size());
+        std::u16string out(capacity + 8, u'\x5A5A');
+        size_t written = Transcoder::Utf8ToUtf16(utf8.data(), utf8.size(), out.data());
+        CHECK(written <= capacity);
+        CHECK(out.compare(capacity, 8, std::u16string(8, u'\x5A5A')) == 0);
+        out.resize(written);
+        return out;
+    }
+
+    std::string ToUtf8(std::u16string_view utf16)
+    {
+        const size_t capacity = Transcoder::MaxUtf8Length(utf16.size());
+        std::string out(capacity + 8, '\x5A');
+        size_t written = Transcoder::Utf16ToUtf8(utf16.data(), utf16.size(), out.data());
+        CHECK(written <= capacity);
+        CHECK(out.compare(capacity, 8, std::string(8, '\x5A')) == 0);
+        out.resize(written);
+        return out;
+    }
+
+    std::string Bytes(std::initializer_list<int> bytes)
+    {
+        std::string out;
+        for (int byte : bytes)
+        {
+            out.push_back(static_cast<char>(byte));
+        }
+        return out;
+    }
+
+    // Paddings that land the interesting bytes inside, at the end of and
+    // just past the 16 and 32 unit vector blocks.
+    const size_t kPaddings[] = { 0, 1, 15, 16, 31, 32, 33, 47, 64 };
+
+    bool DecodesLikeReference(const std::string& input)
+    {
+        for (size_t before : kPaddings)
+        {
+            for (size_t after : { size_t(0), size_t(17) })
+            {
+                std::string padded = std::string(before, 'a') + input + std::string(after, 'z');
+                if (ToUtf16(padded) != ReferenceToUtf16(padded))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool EncodesLikeReference(const std::u16string& input)
+    {
+        for (size_t before : kPaddings)
+        {
+            std::u16string padded = std::u16string(before, u'a') + input + std::u16string(17, u'z');
+            if (ToUtf8(padded) != ReferenceToUtf8(padded))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void TestKnownSequences()
+    {
+        // The example from the Unicode Standard, section 3.9
+        CHECK(ToUtf16(Bytes({ 0x61, 0xF1, 0x80, 0x80, 0xE1, 0x80, 0xC2, 0x62, 0x80, 0x63, 0x80, 0xBF, 0x64 })) ==
+            std::u16string(u"a\xFFFD\xFFFD\xFFFD" u"b\xFFFD" u"c\xFFFD\xFFFD" u"d"));
+
+        CHECK(ToUtf16(Bytes({ 0xC0, 0xAF })) == u"\xFFFD\xFFFD");               // Overlong '/'
+        CHECK(ToUtf16(Bytes({ 0xE0, 0x80, 0xAF })) == u"\xFFFD\xFFFD\xFFFD");   // Overlong, three bytes
+        CHECK(ToUtf16(Bytes({ 0xED, 0xA0, 0x80 })) == u"\xFFFD\xFFFD\xFFFD");   // Encoded surrogate
+        CHECK(ToUtf16(Bytes({ 0xF4, 0x90, 0x80, 0x80 })) == u"\xFFFD\xFFFD\xFFFD\xFFFD");  // Above U+10FFFF
+        CHECK(ToUtf16(Bytes({ 0xF0, 0x9F, 0x98 })) == u"\xFFFD");               // Truncated at the end
+        CHECK(ToUtf16(Bytes({ 0xF0, 0x9F, 0x98, 0x41 })) == u"\xFFFD" u"A");    // Truncated by ASCII
+        CHECK(ToUtf16(Bytes({ 0xF0, 0x9F, 0x98, 0x80 })) == u"\xD83D\xDE00");
+        CHECK(ToUtf16(Bytes({ 0xE4, 0xB8, 0xAD, 0xE6, 0x96, 0x87 })) == u"\x4E2D\x6587");
+        CHECK(ToUtf16(Bytes({ 0xFE, 0xFF, 0x80 })) == u"\xFFFD\xFFFD\xFFFD");
+
+        CHECK(ToUtf8(u"\xD83D\xDE00") == Bytes({ 0xF0, 0x9F, 0x98, 0x80 }));
+        CHECK(ToUtf8(u"\xD83D") == Bytes({ 0xEF, 0xBF, 0xBD }));                // Lone high surrogate
+        CHECK(ToUtf8(u"\xDE00\xD83D") == Bytes({ 0xEF, 0xBF, 0xBD, 0xEF, 0xBF, 0xBD }));  // Swapped pair
+        CHECK(ToUtf8(u"\xD83D" u"a") == Bytes({ 0xEF, 0xBF, 0xBD, 0x61 }));
+        CHECK(ToUtf8(u"\x00E9\x4E2D\xFFFF") == Bytes({ 0xC3, 0xA9, 0xE4, 0xB8, 0xAD, 0xEF, 0xBF, 0xBF }));
+
+        CHECK(ToUtf16({}).empty());
+        CHECK(ToUtf8({}).empty());
+        CHECK(Transcoder::ToUtf16(std::string(1, '\0')) == std::u16string(1, u'\0'));
+    }
+
+    // Every sequence of up to four bytes over an alphabet holding each
+    // boundary of Table 3-7, in every padding.
+    void TestAllShortSequences()
+    {
+        const uint8_t alphabet[] = {
+            0x00, 0x41, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF,
+            0xE0, 0xE1, 0xEC, 0xED, 0xEE, 0xEF, 0xF0, 0xF1, 0xF3, 0xF4, 0xF5, 0xFF,
+        };
+        const size_t count = sizeof(alphabet);
+        size_t failures = 0;
+        for (size_t length = 1; length <= 4; ++length)
+        {
+            size_t total = 1;
+            for (size_t i = 0; i < length; ++i)
+            {
+                total *= count;
+            }
+            for (size_t n = 0; n < total && failures < 10; ++n)
+            {
+                std::string input;
+                for (size_t i = 0, rest = n; i < length; ++i, rest /= count)
+                {
+                    input.push_back(static_cast<char>(alphabet[rest % count]));
+                }
+                // The paddings only matter near the vector blocks, one
+                // length is enough for the bulk of the combinations
+                bool same = length < 4 ? DecodesLikeReference(input) : ToUtf16(input) == ReferenceToUtf16(input);
+                if (!same)
+                {
+                    std::fprintf(stderr, "decode mismatch, length %zu, case %zu\n", length, n);
+                    failures++;
+                }
+            }
+        }
+        CHECK(failures == 0);
+    }
+
+    void TestRandomText()
+    {
+        std::mt19937 random(31);
+        size_t decodeFailures = 0;
+        size_t encodeFailures = 0;
+        for (int round = 0; round < 20000; ++round)
+        {
+            // Mostly ASCII runs with some multi-byte text and some garbage,
+            // roughly what a captured page looks like
+            std::string utf8;
+            std::u16string utf16;
+            int pieces = 1 + random() % 8;
+            for (int piece = 0; piece < pieces; ++piece)
+            {
+                switch (random() % 4)
+                {
+                case 0:
+                    utf8.append(random() % 70, 'x');
+                    utf16.append(random() % 70, u'x');
+                    break;
+                case 1:
+                    for (int i = random() % 6; i > 0; --i)
+                    {
+                        uint32_t codePoint = 0x4E00 + random() % 0x5000;
+                        if (random() % 4 == 0)
+                        {
+                            codePoint = 0x10000 + random() % 0x100000;
+                        }
+                        std::u16string unit;
+                        AppendUtf16(unit, codePoint);
+                        utf8 += ReferenceToUtf8(unit);
+                        utf16 += unit;
+                    }
+                    break;
+                case 2:
+                    for (int i = random() % 5; i > 0; --i)
+                    {
+                        utf8.push_back(static_cast<char>(0x80 + random() % 0x80));
+                    }
+                    break;
+                default:
+                    for (int i = random() % 4; i > 0; --i)
+                    {
+                        utf16.push_back(static_cast<char16_t>(0xD800 + random() % 0x800));
+                    }
+                    break;
+                }
+            }
+            if (ToUtf16(utf8) != ReferenceToUtf16(utf8) && decodeFailures++ < 10)
+            {
+                std::fprintf(stderr, "decode mismatch, round %d\n", round);
+            }
+            if (!EncodesLikeReference(utf16) && encodeFailures++ < 10)
+            {
+                std::fprintf(stderr, "encode mismatch, round %d\n", round);
+            }
+        }
+        CHECK(decodeFailures == 0);
+        CHECK(encodeFailures == 0);
+    }
+
+    void TestRoundTrip()
+    {
+        std::u16string all;
+        for (uint32_t codePoint = 0; codePoint <= 0x10FFFF; codePoint += codePoint < 0x10000 ? 1 : 0x3F)
+        {
+            if (codePoint < 0xD800 || codePoint > 0xDFFF)
+            {
+                AppendUtf16(all, codePoint);
+            }
+        }
+        CHECK(Transcoder::ToUtf16(Transcoder::ToUtf8(all)) == all);
+        CHECK(Transcoder::ToUtf8(all) == ReferenceToUtf8(all));
+    }
+
+    void TestWide()
+    {
+        std::string utf8 = Bytes({ 0x61, 0xE4, 0xB8, 0xAD, 0xF0, 0x9F, 0x98, 0x80, 0xC0 });
+        std::wstring wide(Transcoder::MaxUtf16Length(utf8.size()), L'\0');
+        wide.resize(Transcoder::Utf8ToUtf16(utf8.data(), utf8.size(), wide.data()));
+        if constexpr (sizeof(wchar_t) == 2)
+        {
+            CHECK(wide == std::wstring({ L'a', static_cast<wchar_t>(0x4E2D), static_cast<wchar_t>(0xD83D), static_cast<wchar_t>(0xDE00), static_cast<wchar_t>(0xFFFD) }));
+        }
+        else
+        {
+            CHECK(wide == std::wstring({ L'a', static_cast<wchar_t>(0x4E2D), static_cast<wchar_t>(0x1F600), static_cast<wchar_t>(0xFFFD) }));
+        }
+
+        std::string back(Transcoder::MaxUtf8LengthWide(wide.size()), '\0');
+        back.resize(Transcoder::Utf16ToUtf8(wide.data(), wide.size(), back.data()));
+        CHECK(back == utf8.substr(0, 8) + Bytes({ 0xEF, 0xBF, 0xBD }));
+
+        if constexpr (sizeof(wchar_t) == 4)
+        {
+            // Out of range UTF-32 and lone surrogates both become U+FFFD
+            std::wstring invalid = { static_cast<wchar_t>(0x110000), static_cast<wchar_t>(0xD800), L'b' };
+            std::string out(Transcoder::MaxUtf8LengthWide(invalid.size()), '\0');
+            out.resize(Transcoder::Utf16ToUtf8(invalid.data(), invalid.size(), out.data()));
+            CHECK(out == Bytes({ 0xEF, 0xBF, 0xBD, 0xEF, 0xBF, 0xBD, 0x62 }));
+        }
+    }
+
+    void TestSplit()
+    {
+        const char16_t text[] = u"ab\xD83D\xDE00" u"cd";
+        CHECK(Transcoder::SplitUtf16(text, 6, 8) == 6);
+        CHECK(Transcoder::SplitUtf16(text, 6, 3) == 2);   // Would cut the pair
+        CHECK(Transcoder::SplitUtf16(text, 6, 4) == 4);
+        CHECK(Transcoder::SplitUtf16(text + 2, 4, 1) == 1);  // Cannot shrink below one unit
+    }
+}
+
+int main()
+{
+    TestKnownSequences();
+    TestAllShortSequences();
+    TestRandomText();
+    TestRoundTrip();
+    TestWide();
+    TestSplit();
+    return TestResult();
+}
@@ -0,0 +1,133 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "UrlClassifier.h"
+#include "Check.h"
+
+#include <string>
+
+namespace
+{
+    bool Is(const UrlMatch& match, const wchar_t* rule, UrlRoute route)
+    {
+        return match && std::wstring(match.rule) == rule && match.route == route;
+    }
+
+    void TestGlobSet()
+    {
+        GlobSet globs;
+        CHECK(globs.Add(L"a/*.jpg", 1));
+        CHECK(globs.Add(L"a/**.jpg", 2));
+        CHECK(globs.Add(L"**/x*y", 3));
+        CHECK(globs.Add(L"\x4E2D/*", 4));
+
+        // '*' stops at '/', '**' does not; the earlier pattern wins
+        CHECK(globs.Match({ L"a/b.jpg" }) == 1);
+        CHECK(globs.Match({ L"a/b/c.jpg" }) == 2);
+        CHECK(globs.Match({ L"a/.jpg" }) == 1);
+        CHECK(globs.Match({ L"b/c.jpg" }) == -1);
+        CHECK(globs.Match({ L"a/b.jpgx" }) == -1);
+
+        // ASCII case folding on both sides, exact match beyond ASCII
+        CHECK(globs.Match({ L"A/B.JPG" }) == 1);
+        CHECK(globs.Match({ L"q/XzzY" }) == 3);
+        CHECK(globs.Match({ L"\x4E2D/page" }) == 4);
+        CHECK(globs.Match({ L"\x6587/page" }) == -1);
+
+        // Pieces are matched as one string
+        CHECK(globs.Match({ L"a/", L"b", L".jpg" }) == 1);
+        CHECK(globs.Match({}) == -1);
+
+        GlobSet empty;
+        CHECK(empty.Match({ L"anything" }) == -1);
+        CHECK(empty.Add(L"", 7));
+        CHECK(empty.Match({ L"" }) == 7);
+        CHECK(empty.Match({ L"x" }) == -1);
+    }
+
+    void TestStateBudget()
+    {
+        GlobSet globs;
+        std::wstring pattern(GlobSet::c_maxStates / 2, L'a');
+        CHECK(globs.Add(pattern, 1));
+        CHECK(!globs.Add(pattern, 2));  // Does not fit and leaves no trace
+        CHECK(globs.Add(L"b", 3));
+        CHECK(globs.Match({ pattern }) == 1);
+        CHECK(globs.Match({ L"b" }) == 3);
+    }
+
+    void TestUrls()
+    {
+        const UrlClassifier& rules = UrlClassifier::Default();
+
+        // Library rules shadow the generic IIIF ones
+        CHECK(Is(rules.ClassifyUrl(L"https://dl.ndl.go.jp/api/iiif/1234/R0000001/full/full/0/default.jpg"),
+            L"ndl-iiif", UrlRoute::IiifImage));
+        CHECK(Is(rules.ClassifyUrl(L"https://DL.NDL.GO.JP/api/iiif/1234/R0000001/full/1000,/0/DEFAULT.JPG"),
+            L"ndl-iiif", UrlRoute::IiifImage));
+        CHECK(Is(rules.ClassifyUrl(L"https://dl.ndl.go.jp/api/iiif/1234/R0000001/full/full/0/default.png"),
+            L"iiif-image", UrlRoute::IiifImage));
+        CHECK(Is(rules.ClassifyUrl(L"https://iiif.example.org/iiif/2/book/full/max/0/gray.tif"),
+            L"iiif-image", UrlRoute::IiifImage));
+
+        // Regions other than "full" are tiles
+        CHECK(Is(rules.ClassifyUrl(L"https://dl.ndl.go.jp/api/iiif/1234/R0000001/0,0,512,512/512,/0/default.jpg"),
+            L"iiif-tile", UrlRoute::IiifTile));
+        CHECK(Is(rules.ClassifyUrl(L"https://iiif.example.org/iiif/2/book/pct:0,0,50,50/full/0/default.webp"),
+            L"iiif-tile", UrlRoute::IiifTile));
+
+        // Not every default.* is an IIIF image
+        CHECK(!rules.ClassifyUrl(L"https://www.example.com/en/us/home/default.aspx"));
+        CHECK(!rules.ClassifyUrl(L"https://www.example.com/en/us/home/default.htm?x=1"));
+
+        CHECK(Is(rules.ClassifyUrl(L"https://iiif.example.org/iiif/2/book/info.json"), L"iiif-info", UrlRoute::IiifInfo));
+        CHECK(Is(rules.ClassifyUrl(L"https://iiif.example.org/iiif/book/manifest"), L"iiif-manifest", UrlRoute::IiifManifest));
+        CHECK(Is(rules.ClassifyUrl(L"https://iiif.example.org/iiif/book/manifest.json"), L"iiif-manifest", UrlRoute::IiifManifest));
+
+        // Extensions, with and without a query, in any case
+        CHECK(Is(rules.ClassifyUrl(L"https://example.org/scans/0001.JPEG"), L"image-extension", UrlRoute::Image));
+        CHECK(Is(rules.ClassifyUrl(L"https://example.org/scans/0001.webp?token=abc/def"), L"image-extension", UrlRoute::Image));
+        CHECK(!rules.ClassifyUrl(L"https://example.org/scans/0001.jpg.html"));
+        CHECK(!rules.ClassifyUrl(L"https://example.org/viewer?file=0001.jpgx"));
+        CHECK(!rules.ClassifyUrl(L"https://example.org/"));
+
+        CHECK(rules.ClassifyUrl(L"https://example.org/a.png").IsImage());
+        CHECK(!rules.ClassifyUrl(L"https://example.org/info.json").IsImage());
+    }
+
+    void TestContentTypes()
+    {
+        const UrlClassifier& rules = UrlClassifier::Default();
+        CHECK(Is(rules.ClassifyContentType(L"image/jpeg"), L"image-mime", UrlRoute::Image));
+        CHECK(Is(rules.ClassifyContentType(L" Image/JPEG ; charset=binary"), L"image-mime", UrlRoute::Image));
+        CHECK(Is(rules.ClassifyContentType(L"image/tiff"), L"image-other", UrlRoute::Image));
+        CHECK(Is(rules.ClassifyContentType(L"image/jp2"), L"image-other", UrlRoute::Image));
+        CHECK(!rules.ClassifyContentType(L"text/html; charset=utf-8"));
+        CHECK(!rules.ClassifyContentType(L"application/json"));
+        CHECK(!rules.ClassifyContentType(L"image"));
+        CHECK(!rules.ClassifyContentType(L""));
+        CHECK(!rules.ClassifyContentType(L"  ; q=1"));
+    }
+
+    void TestCustomRules()
+    {
+        // Rules added earlier take precedence over broader later ones
+        UrlClassifier rules;
+        rules.AddUrlRule(L"special", L"cdn.example.org/**", UrlRoute::IiifImage);
+        rules.AddExtensionRule(L"jpeg", L"jpg", UrlRoute::Image);
+        CHECK(Is(rules.ClassifyUrl(L"https://cdn.example.org/a/b.jpg"), L"special", UrlRoute::IiifImage));
+        CHECK(Is(rules.ClassifyUrl(L"https://www.example.org/a/b.jpg"), L"jpeg", UrlRoute::Image));
+        CHECK(Is(rules.ClassifyUrl(L"https://user@www.example.org:8080/a/b.jpg#frag"), L"jpeg", UrlRoute::Image));
+    }
+}
+
+int main()
+{
+    TestGlobSet();
+    TestStateBudget();
+    TestUrls();
+    TestContentTypes();
+    TestCustomRules();
+    return TestResult();
+}
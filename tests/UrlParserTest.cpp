@@ -0,0 +1,119 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "UrlParser.h"
+#include "Check.h"
+
+#include <string>
+#include <string_view>
+
+namespace
+{
+    std::wstring Decoded(std::wstring_view text)
+    {
+        std::wstring out;
+        UrlParser::AppendPercentDecoded(text, out);
+        return out;
+    }
+
+    void TestParse()
+    {
+        UrlParts parts = UrlParser::Parse(L"https://user:pw@books.example.org:8443/iiif/p1/full.jpg?size=max#page=2");
+        CHECK(parts.scheme == L"https");
+        CHECK(parts.host == L"books.example.org");
+        CHECK(parts.port == L"8443");
+        CHECK(parts.path == L"/iiif/p1/full.jpg");
+        CHECK(parts.query == L"size=max");
+        CHECK(parts.fragment == L"page=2");
+
+        parts = UrlParser::Parse(L"http://[::1]:8080/a");
+        CHECK(parts.host == L"[::1]");
+        CHECK(parts.port == L"8080");
+        CHECK(parts.path == L"/a");
+
+        parts = UrlParser::Parse(L"http://[::1]/a");
+        CHECK(parts.host == L"[::1]");
+        CHECK(parts.port.empty());
+
+        parts = UrlParser::Parse(L"images/001.jpg?v=2");
+        CHECK(parts.scheme.empty());
+        CHECK(parts.host.empty());
+        CHECK(parts.path == L"images/001.jpg");
+        CHECK(parts.query == L"v=2");
+
+        parts = UrlParser::Parse(L"https://example.org");
+        CHECK(parts.host == L"example.org");
+        CHECK(parts.path.empty());
+    }
+
+    void TestPercentDecoding()
+    {
+        CHECK(Decoded(L"plain") == L"plain");
+        CHECK(Decoded(L"a%20b") == L"a b");
+        CHECK(Decoded(L"%E4%B8%AD%e6%96%87") == L"\x4E2D\x6587");
+        CHECK(Decoded(L"%FF") == L"\xFFFD");
+        CHECK(Decoded(L"%E4%B8") == L"\xFFFD");
+        CHECK(Decoded(L"100%") == L"100%");
+        CHECK(Decoded(L"%zz%4") == L"%zz%4");
+
+        // Runs longer than the decode buffer, cut in the middle of a character
+        std::wstring encoded;
+        std::wstring expected;
+        for (int i = 0; i < 100; ++i)
+        {
+            encoded += L"%E4%B8%AD";
+            expected += L'\x4E2D';
+        }
+        CHECK(Decoded(encoded) == expected);
+        CHECK(Decoded(L"%41" + encoded) == L"A" + expected);
+    }
+
+    void TestFileName()
+    {
+        CHECK(UrlParser::GetFileName(L"https://example.org/iiif/0001.jpg?x=1#y") == L"0001.jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/%E4%B8%AD%E6%96%87.pdf") == L"\x4E2D\x6587.pdf");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a%2Fb.png") == L"b.png");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a%3Cb%3E%0A.png") == L"ab.png");
+        CHECK(UrlParser::GetFileName(L"page.tif") == L"page.tif");
+        CHECK(UrlParser::GetFileName(L"https://example.org/dir/") == L"download");
+        CHECK(UrlParser::GetFileName(L"https://example.org") == L"download");
+        CHECK(UrlParser::GetFileName(L"https://example.org/%3F%2A") == L"download");
+
+        // Nothing but dots does not name a file
+        CHECK(UrlParser::GetFileName(L"https://example.org/a/%2F..") == L"download");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a/%2E%2E") == L"download");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a/.") == L"download");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a/%20. ") == L"download");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a/scan.jpg.") == L"scan.jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/a/.hidden") == L".hidden");
+
+        // Device names, with or without an extension
+        CHECK(UrlParser::GetFileName(L"https://example.org/con.jpg") == L"_con.jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/NUL.png") == L"_NUL.png");
+        CHECK(UrlParser::GetFileName(L"https://example.org/Aux") == L"_Aux");
+        CHECK(UrlParser::GetFileName(L"https://example.org/prn.tar.gz") == L"_prn.tar.gz");
+        CHECK(UrlParser::GetFileName(L"https://example.org/com1.txt") == L"_com1.txt");
+        CHECK(UrlParser::GetFileName(L"https://example.org/LPT9") == L"_LPT9");
+        CHECK(UrlParser::GetFileName(L"https://example.org/COM%C2%B9.jpg") == L"_COM\x00B9.jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/con%20.jpg") == L"_con .jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/console.jpg") == L"console.jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/com10.jpg") == L"com10.jpg");
+        CHECK(UrlParser::GetFileName(L"https://example.org/nul_1.png") == L"nul_1.png");
+
+        // Long names are cut to 255 characters, keeping a short extension
+        std::wstring longName = UrlParser::GetFileName(L"https://example.org/" + std::wstring(300, L'x') + L".jpeg");
+        CHECK(longName.size() == 255);
+        CHECK(longName.ends_with(L"x.jpeg"));
+        longName = UrlParser::GetFileName(L"https://example.org/" + std::wstring(300, L'x'));
+        CHECK(longName == std::wstring(255, L'x'));
+    }
+}
+
+int main()
+{
+    TestParse();
+    TestPercentDecoding();
+    TestFileName();
+    return TestResult();
+}